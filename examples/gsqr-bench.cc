@@ -0,0 +1,296 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * File: gsqr-bench.cc
+ * Purpose: Microbenchmarks of the GSQR hot paths: Q evaluation, next-hop
+ *          selection, TD updates, table loading and Hello (de)serialization
+ * NS-3 Version: 3.41
+ * Usage:  ./ns3 run "gsqr-bench --dim=16 --csv=results/gsqr_bench.csv"
+ *    --dim=D         : Embedding dimension (default: 16)
+ *    --precision=P   : float64, float32, fp16 or int8 (default: float64)
+ *    --minTime=T     : Seconds each measurement runs at least (default: 0.2)
+ *    --maxNodes=N    : Largest table the loaders are timed on (default: 10000)
+ *    --csv=FILE      : Machine-readable results (default: results/gsqr_bench.csv)
+ * Output: one row per benchmark and size: ns/op, heap allocations per op
+ *         and, for tables, bytes held per node.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/gsqr-embedding.h"
+#include "ns3/gsqr-routing.h"
+#include "ns3/gsqr-routing-protocol.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+// Every heap allocation in the process goes through here, so a
+// measurement can tell how many its operation makes
+static uint64_t g_allocations = 0;
+
+void* operator new(std::size_t size)
+{
+    g_allocations++;
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment)
+{
+    g_allocations++;
+    void* p = nullptr;
+    if (posix_memalign(&p, std::max(static_cast<std::size_t>(alignment), sizeof(void*)), size ? size : 1) == 0) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept
+{
+    std::free(p);
+}
+
+// The embedding rows come from aligned_alloc, not operator new; this
+// definition takes the place of the C library's
+extern "C" void* aligned_alloc(std::size_t alignment, std::size_t size) noexcept
+{
+    g_allocations++;
+    void* p = nullptr;
+    return posix_memalign(&p, std::max(alignment, sizeof(void*)), size) == 0 ? p : nullptr;
+}
+
+namespace {
+
+struct BenchResult {
+    std::string name;
+    uint32_t param;
+    double nsPerOp;
+    double allocsPerOp;
+    double bytesPerNode;    // < 0 where it does not apply
+};
+
+double g_minTime = 0.2;
+volatile double g_sink = 0.0;   // keeps results alive past the optimizer
+
+/**
+ * Runs op(i) for i = 0, 1, ... in batches that double until one takes
+ * g_minTime, and reports ns and heap allocations per call of that batch.
+ */
+template <typename Op>
+BenchResult Measure(const std::string& name, uint32_t param, Op&& op)
+{
+    op(0);
+    uint64_t iterations = 1;
+    while (true) {
+        uint64_t allocations = g_allocations;
+        auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            op(i);
+        }
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= g_minTime || iterations >= (1ull << 40)) {
+            return BenchResult{name, param, elapsed * 1e9 / iterations,
+                               static_cast<double>(g_allocations - allocations) / iterations, -1.0};
+        }
+        iterations *= 2;
+    }
+}
+
+Ptr<GsqrEmbedding> MakeTable(uint32_t numNodes, uint32_t dim, const std::string& precision)
+{
+    Ptr<GsqrEmbedding> store = CreateObject<GsqrEmbedding>();
+    store->SetAttribute("Precision", StringValue(precision));
+    store->SetAttribute("Dimension", UintegerValue(dim));
+    store->Reserve(numNodes);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<double> value(-1.0, 1.0);
+    std::vector<double> row(dim + 1);
+    for (uint32_t node = 0; node < numNodes; ++node) {
+        for (double& x : row) {
+            x = value(rng);
+        }
+        store->WriteRow(node, row.data());
+    }
+    return store;
+}
+
+Ptr<GsqrRouting> MakeRouting(uint32_t numNodes, uint32_t degree, uint32_t dim,
+                             const std::string& precision)
+{
+    Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+    routing->SetEmbeddingStore(MakeTable(numNodes, dim, precision));
+    routing->Initialize(0);
+    std::vector<uint32_t> neighbors;
+    for (uint32_t i = 1; i <= degree; ++i) {
+        neighbors.push_back(i);
+    }
+    routing->UpdateNeighborList(0, neighbors);
+    return routing;
+}
+
+} // anonymous namespace
+
+int main(int argc, char *argv[])
+{
+    CommandLine cmd(__FILE__);
+    uint32_t dim = 16;
+    std::string precision = "float64";
+    uint32_t maxNodes = 10000;
+    std::string csvFile = "results/gsqr_bench.csv";
+
+    cmd.AddValue("dim", "Embedding dimension", dim);
+    cmd.AddValue("precision", "Storage precision: float64, float32, fp16 or int8", precision);
+    cmd.AddValue("minTime", "Seconds each measurement runs at least", g_minTime);
+    cmd.AddValue("maxNodes", "Largest table the loaders are timed on", maxNodes);
+    cmd.AddValue("csv", "Machine-readable results", csvFile);
+    cmd.Parse(argc, argv);
+
+    std::ignore = system("mkdir -p results");
+    std::vector<BenchResult> results;
+    const uint32_t numNodes = 1000;
+    std::mt19937 rng(42);
+
+    // 1. One Q value, over a table larger than the caches of small nodes
+    {
+        Ptr<GsqrRouting> routing = MakeRouting(numNodes, 0, dim, precision);
+        std::uniform_int_distribution<uint32_t> pick(0, numNodes - 1);
+        std::vector<uint32_t> ids(4096);
+        for (uint32_t& id : ids) {
+            id = pick(rng);
+        }
+        results.push_back(Measure("ComputeQValue", dim, [&](uint64_t i) {
+            g_sink = g_sink + routing->ComputeQValue(ids[i & 4095], ids[(i + 1) & 4095]);
+        }));
+    }
+
+    // 2. Next hop over 4..64 neighbors: memoized, and with the memo dropped
+    for (uint32_t degree = 4; degree <= 64; degree *= 2) {
+        Ptr<GsqrRouting> routing = MakeRouting(numNodes, degree, dim, precision);
+        results.push_back(Measure("SelectNextHop/cached", degree, [&](uint64_t i) {
+            g_sink = g_sink + routing->SelectNextHop(100 + (i & 511), 0);
+        }));
+        results.push_back(Measure("SelectNextHop/argmax", degree, [&](uint64_t i) {
+            routing->InvalidateNextHopCache();
+            g_sink = g_sink + routing->SelectNextHop(100 + (i & 511), 0);
+        }));
+    }
+
+    // 3. One TD step, applied on arrival. The destinations are memoized
+    // first, as in a running node, so the step pays for refreshing them
+    {
+        Ptr<GsqrRouting> routing = MakeRouting(numNodes, 16, dim, precision);
+        for (uint32_t dest = 100; dest < 100 + 512; ++dest) {
+            g_sink = g_sink + routing->SelectNextHop(dest, 0);
+        }
+        results.push_back(Measure("ReceiveAck", 16, [&](uint64_t i) {
+            routing->ReceiveAck(1 + (i & 15), 100 + (i & 511), 0.0, 0.01, 1e-6, 0.5);
+        }));
+    }
+
+    // 4. Table loading, 10 to maxNodes rows; bytes per node as held after the load
+    for (uint32_t n = 10; n <= maxNodes; n *= 10) {
+        Ptr<GsqrEmbedding> table = MakeTable(n, dim, precision);
+        std::string csv = "/tmp/gsqr-bench-" + std::to_string(n) + ".csv";
+        std::string bin = "/tmp/gsqr-bench-" + std::to_string(n) + ".bin";
+        if (!table->SaveToCSV(csv) || !table->SaveToBinary(bin)) {
+            std::cerr << "Cannot write the tables to /tmp" << std::endl;
+            return 1;
+        }
+        Ptr<GsqrEmbedding> loaded = CreateObject<GsqrEmbedding>();
+        loaded->SetAttribute("Precision", StringValue(precision));
+        BenchResult csvResult = Measure("LoadFromCSV", n, [&](uint64_t) {
+            loaded->LoadFromCSV(csv);
+        });
+        csvResult.bytesPerNode = static_cast<double>(loaded->GetMemoryUsageBytes()) / n;
+        results.push_back(csvResult);
+        BenchResult binResult = Measure("LoadFromBinary", n, [&](uint64_t) {
+            loaded->LoadFromBinary(bin);
+        });
+        binResult.bytesPerNode = static_cast<double>(loaded->GetMemoryUsageBytes()) / n;
+        results.push_back(binResult);
+        std::remove(csv.c_str());
+        std::remove(bin.c_str());
+    }
+
+    // 5. Hello header in and out of a buffer
+    {
+        GsqrHelloHeader hello;
+        hello.SetNodeId(7);
+        hello.SetSequence(3);
+        hello.SetMeanETX(1.5);
+        hello.SetResidualEnergy(95.0);
+        hello.SetQueueLength(0.1);
+        Buffer buffer;
+        buffer.AddAtStart(hello.GetSerializedSize());
+        results.push_back(Measure("GsqrHelloHeader::Serialize", hello.GetSerializedSize(), [&](uint64_t i) {
+            hello.SetSequence(static_cast<uint8_t>(i));
+            hello.Serialize(buffer.Begin());
+        }));
+        GsqrHelloHeader received;
+        results.push_back(Measure("GsqrHelloHeader::Deserialize", hello.GetSerializedSize(), [&](uint64_t) {
+            g_sink = g_sink + received.Deserialize(buffer.Begin());
+        }));
+    }
+
+    std::cout << std::left << std::setw(32) << "Benchmark" << std::right
+              << std::setw(8) << "Param" << std::setw(14) << "ns/op"
+              << std::setw(14) << "allocs/op" << std::setw(14) << "bytes/node" << std::endl;
+    std::cout << std::string(82, '-') << std::endl;
+    for (const BenchResult& r : results) {
+        std::cout << std::left << std::setw(32) << r.name << std::right
+                  << std::setw(8) << r.param
+                  << std::setw(14) << std::fixed << std::setprecision(1) << r.nsPerOp
+                  << std::setw(14) << std::setprecision(3) << r.allocsPerOp
+                  << std::setw(14) << std::setprecision(1);
+        if (r.bytesPerNode >= 0) {
+            std::cout << r.bytesPerNode;
+        } else {
+            std::cout << "-";
+        }
+        std::cout << std::endl;
+    }
+
+    std::ofstream csv(csvFile);
+    if (!csv.is_open()) {
+        std::cerr << "Cannot write " << csvFile << std::endl;
+        return 1;
+    }
+    csv << "benchmark,param,dim,precision,ns_per_op,allocs_per_op,bytes_per_node\n";
+    for (const BenchResult& r : results) {
+        csv << r.name << "," << r.param << "," << dim << "," << precision << ","
+            << std::setprecision(6) << r.nsPerOp << "," << r.allocsPerOp << ",";
+        if (r.bytesPerNode >= 0) {
+            csv << r.bytesPerNode;
+        }
+        csv << "\n";
+    }
+    std::cout << "\nWrote " << results.size() << " results to " << csvFile << std::endl;
+    return 0;
+}
@@ -10,8 +10,66 @@
  *    --seeds=S       : Number of random seeds (default: 1)
  *    --time=T        : Simulation time per run in seconds (default: 60)
  *    --quick         : Quick mode (only runs N=30, default: false)
+ *    --adaptiveHello : Trickle-style GSQR Hellos, 0.5 s to 8 s (default: false)
+ *    --multipath=K   : GSQR flows spread over the K best next hops (default: 1)
+ *    --multipathWeighting=W : softmax (of Q) or queue (default: softmax)
+ *    --jobs=J        : Worker processes for the sweep (default: 1, in process)
+ *    --jobTimeout=T  : Wall-clock seconds before a worker is killed (default: 0, none)
+ *    --resume        : Reuse finished jobs from --jobDir, run only the others
+ *    --mergeOnly     : Only merge the finished jobs in --jobDir into the tables
+ *    --jobDir=DIR    : Per-job results and logs (default: results/jobs)
+ *    --embeddingFile=F : Pretrained table shared by the GSQR nodes (default: none)
+ *    --records=FILE  : One record per run, JSON lines, or CSV if FILE ends
+ *                      in .csv (default: results/gsqr_runs.jsonl)
+ *    --verbosity=L   : summary, run or node (default: node)
+ *    --checkpointDir=D : GSQR tables saved to D/n<N> after each run (default: none)
+ *    --warmStart     : Start GSQR from the tables in --checkpointDir (default: false);
+ *                      not with --jobs
+ *    --convergedShare=F : Share of the nodes whose stabilization marks
+ *                      convergence (default: 0.9)
+ *    --scenario=S    : grid, gauss-markov, waypoint or formation (default: grid)
+ *    --nodeCounts=L  : Comma-separated N to sweep, e.g. 50,100,200,400
+ *                      (default: 10,15,20,25,30)
+ *    --flows=F       : UDP flows per run (default: 0, min(N/2, 5))
+ *    --packetRate=R  : Packets per second per flow (default: 100)
+ *    --speed=V       : Mean UAV speed in m/s when they move (default: 15)
+ *    --clusterSize=K : UAVs per formation group (default: 8)
  * Output: results/gsqr_results.txt; 
  * Log file: results/gsqr_simulation.log;
+ *
+ * Each record holds the network metrics and the run's cost: wall time,
+ * setup (embedding load included) and Simulator::Run time, simulated
+ * seconds per wall second, events per second and the peak RSS. Runs done
+ * in process report the peak of the whole process so far; with --jobs
+ * each worker reports its own.
+ *
+ * The convergence time of a run is when --convergedShare of its nodes had
+ * stabilized for good, or -1 if they never did. A GSQR node stabilizes by
+ * GsqrRouting's detector (low TD error and no next-hop change for a few
+ * windows); only nodes that routed or learned count. An OLSR node
+ * stabilizes with its last routing-table change, if its table then holds
+ * still for OLSR_STABLE_S. QTABLE's static routes are not measured.
+ *
+ * The mobile scenarios fly the UAVs in the 1000 x 1000 x 150 m volume of
+ * pytorch/train_embedding.py, with flows between any two of them. grid
+ * keeps the manuscript's static layout and neighboring flow pairs.
+ *
+ * Built with MPI and run under mpirun -np R, each run is distributed: rank
+ * b simulates an island of N/R consecutive UAVs in its own 1/R slab of
+ * the volume, on a wireless channel of its own, since one cannot span
+ * ranks, and neighboring islands are joined by a 1 ms wired link between
+ * one UAV of each. Only GSQR is run; the statistics are combined over the
+ * ranks, which write their output to results/gsqr_simulation.rank<k>.log,
+ * and only rank 0 writes the console and the result files.
+ *
+ * With --jobs > 1, --resume or --mergeOnly each (protocol, N, seed) run is a
+ * job: a forked worker writes its statistics to DIR/<params>/<job>.txt (its
+ * output goes to DIR/<params>/<job>.log), and the tables are built from
+ * those files. <params> names the settings that apply to every job, e.g.
+ * T60_F0_R100_V15_fixed_K1 for --time, --flows, --packetRate, --speed,
+ * --adaptiveHello and --multipath, so a sweep with other settings never
+ * reuses them. A job whose file is missing, because its worker crashed or
+ * timed out, runs again on the next --resume.
  */
 
 #include "ns3/core-module.h"
@@ -23,57 +81,158 @@
 #include "ns3/flow-monitor-helper.h"
 #include "ns3/ipv4-flow-classifier.h"
 #include "ns3/olsr-helper.h"
+#include "ns3/olsr-routing-protocol.h"
 #include "ns3/gsqr-helper.h"
 #include "ns3/gsqr-routing-protocol.h"
 #include "ns3/command-line.h"
+#ifdef NS3_MPI
+#include "ns3/mpi-interface.h"
+#include "ns3/point-to-point-helper.h"
+#include <mpi.h>
+#endif
 #include <iostream>
 #include <fstream>
 #include <iomanip>
 #include <vector>
 #include <map>
 #include <set>
+#include <algorithm>
 #include <cmath>
 #include <atomic>   
 #include <map>
 #include <string>  
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <chrono>
+#include <tuple>
+#include <cstdio>
+#include <cstdlib>
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 
 const uint32_t HELLO_PACKET_SIZE = 64;    // 36(head) + 20(IP) + 8(UDP) = 64
+const uint32_t GSQR_HELLO_PACKET_SIZE = 38; // 10(head) + 20(IP) + 8(UDP) = 38
 const uint32_t TC_PACKET_SIZE = 48;       // 20(head) + 20(IP) + 8(UDP) = 48
 const uint32_t DATA_PACKET_SIZE = 540;    // 512(head) + 20(IP) + 8(UDP) = 540
+const double OLSR_STABLE_S = 6.0;         // GsqrRouting's 3 stable windows of 2 s
 
 using namespace ns3;
 
 NS_LOG_COMPONENT_DEFINE ("QtableRoutingProtocol");
 
-class TeeStream : public std::streambuf {
-private:
-    std::streambuf *sb1, *sb2;
-    
+/**
+ * Copies what is written to it to several sinks. Output collects in a
+ * 64 KiB put area and is handed to every sink in one block when that
+ * fills or on a flush. A flush (std::endl included) stops at the sinks'
+ * own buffers; Flush() pushes everything out.
+ */
+class TeeBuffer : public std::streambuf {
 public:
-    TeeStream(std::ostream& o1, std::ostream& o2) 
-        : sb1(o1.rdbuf()), sb2(o2.rdbuf()) {}
+    explicit TeeBuffer(std::vector<std::streambuf*> sinks)
+        : m_sinks(std::move(sinks)), m_buffer(1 << 16) {
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+    }
+    ~TeeBuffer() override { Flush(); }
+    
+    void Flush() {
+        Drain();
+        for (std::streambuf* sink : m_sinks) {
+            sink->pubsync();
+        }
+    }
     
 protected:
-    virtual int overflow(int c) {
-        if (c == EOF) {
-            return !EOF;
-        } else {
-            int r1 = sb1->sputc(c);
-            int r2 = sb2->sputc(c);
-            return (r1 == EOF || r2 == EOF) ? EOF : c;
+    int overflow(int c) override {
+        if (Drain() != 0) {
+            return traits_type::eof();
+        }
+        if (!traits_type::eq_int_type(c, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(c);
+            pbump(1);
+        }
+        return traits_type::not_eof(c);
+    }
+    
+    int sync() override { return Drain(); }
+    
+private:
+    int Drain() {
+        std::streamsize n = pptr() - pbase();
+        bool ok = true;
+        for (std::streambuf* sink : m_sinks) {
+            ok = sink->sputn(pbase(), n) == n && ok;
         }
+        setp(m_buffer.data(), m_buffer.data() + m_buffer.size());
+        return ok ? 0 : -1;
     }
     
-    virtual int sync() {
-        int r1 = sb1->pubsync();
-        int r2 = sb2->pubsync();
-        return (r1 == 0 && r2 == 0) ? 0 : -1;
+    std::vector<std::streambuf*> m_sinks;
+    std::vector<char> m_buffer;
+};
+
+// How much of each run is written to the console and the log
+enum Verbosity {
+    VERBOSITY_SUMMARY,  // sweep progress and the summary tables
+    VERBOSITY_RUN,      // and each run's result block
+    VERBOSITY_NODE      // and per-flow and per-node detail
+};
+Verbosity g_verbosity = VERBOSITY_NODE;
+std::ostream g_discard(nullptr);    // badbit: insertions return at once
+
+std::ostream& Log(Verbosity level)
+{
+    return g_verbosity >= level ? std::cout : g_discard;
+}
+
+// This process's rank and the number of ranks; 0 and 1 unless run under
+// mpirun by an MPI build
+uint32_t g_rank = 0;
+uint32_t g_ranks = 1;
+
+bool IsLocal(Ptr<Node> node)
+{
+    return node->GetSystemId() == g_rank;
+}
+
+// Element-wise sum, or maximum, of values over the ranks; a no-op in one process
+void CombineRanks(std::vector<double>& values, bool maximum = false)
+{
+#ifdef NS3_MPI
+    if (g_ranks > 1) {
+        MPI_Allreduce(MPI_IN_PLACE, values.data(), static_cast<int>(values.size()), MPI_DOUBLE,
+                      maximum ? MPI_MAX : MPI_SUM, MpiInterface::GetCommunicator());
     }
+#endif
+}
+
+// One flow's packets as its own client and server counted them, for the
+// distributed runs, where no rank's flow monitor sees both ends
+struct FlowTally {
+    double txPackets = 0.0;
+    double rxPackets = 0.0;
+    double rxBytes = 0.0;
+    double delaySum = 0.0;      // seconds
 };
 
+void FlowSent(FlowTally* tally, Ptr<const Packet> packet)
+{
+    tally->txPackets++;
+}
+
+void FlowReceived(FlowTally* tally, Ptr<const Packet> packet)
+{
+    Ptr<Packet> copy = packet->Copy();
+    SeqTsHeader seqTs;
+    copy->RemoveHeader(seqTs);
+    tally->rxPackets++;
+    tally->rxBytes += packet->GetSize() + 28;   // with the IP and UDP headers, as a flow monitor counts
+    tally->delaySum += (Simulator::Now() - seqTs.GetTs()).GetSeconds();
+}
+
 // Simple QTABLE implementation
 class QtableRoutingProtocol : public Ipv4StaticRouting {
 public:
@@ -134,18 +293,388 @@ struct ExperimentStats {
     double simulatedNRO;
     uint64_t controlPackets;
     uint64_t controlBytes;
+    // Cost of the run, in wall-clock seconds
+    double wallSeconds;
+    double setupSeconds;        // before Simulator::Run, embeddingLoadSeconds included
+    double embeddingLoadSeconds;
+    double runSeconds;          // Simulator::Run
+    uint64_t events;
+    uint64_t peakRssKB;
     
     ExperimentStats() : pdr(0.0), avgDelay(0.0), throughput(0.0), 
                        totalTx(0), totalRx(0), simulatedNRO(0.0),
-                       controlPackets(0), controlBytes(0) {}
+                       controlPackets(0), controlBytes(0),
+                       wallSeconds(0.0), setupSeconds(0.0), embeddingLoadSeconds(0.0),
+                       runSeconds(0.0), events(0), peakRssKB(0) {}
+};
+
+// Sums over the seeds of one (protocol, N), for the summary tables; the
+// runs themselves are streamed to the records file as they finish
+struct SeedAverages {
+    uint32_t runs = 0;
+    double pdr = 0.0;
+    double avgDelay = 0.0;
+    double throughput = 0.0;
+    double simulatedNRO = 0.0;
+    uint64_t controlPackets = 0;
+    uint64_t controlBytes = 0;
+    
+    void Add(const ExperimentStats& stats) {
+        runs++;
+        pdr += stats.pdr;
+        avgDelay += stats.avgDelay;
+        throughput += stats.throughput;
+        simulatedNRO += stats.simulatedNRO;
+        controlPackets += stats.controlPackets;
+        controlBytes += stats.controlBytes;
+    }
+};
+
+// Mobility preset: grid, gauss-markov, waypoint or formation
+std::string g_scenario = "grid";
+// UDP flows per run (0: min(N/2, 5)) and packets per second each sends
+uint32_t g_numFlows = 0;
+double g_packetRate = 100.0;
+// Mean UAV speed in m/s, and UAVs per formation
+double g_speed = 15.0;
+uint32_t g_clusterSize = 8;
+// Trickle-style GSQR Hellos between these intervals, in seconds
+bool g_adaptiveHello = false;
+const double ADAPTIVE_HELLO_MIN = 0.5;
+const double ADAPTIVE_HELLO_MAX = 8.0;
+
+// Flight volume of pytorch/train_embedding.py
+const double VOLUME_X = 1000.0;
+const double VOLUME_Y = 1000.0;
+const double VOLUME_Z = 150.0;
+const double FORMATION_SPACING = 30.0;    // between neighbors in a formation
+
+// Flows of a run with numNodes UAVs, at most one per ordered pair
+uint32_t FlowCount(uint32_t numNodes)
+{
+    uint32_t flows = g_numFlows > 0 ? g_numFlows : std::min<uint32_t>(numNodes / 2, 5u);
+    return std::min<uint32_t>(flows, numNodes * (numNodes - 1));
+}
+
+// One (protocol, N, seed) run of the sweep
+struct SweepJob {
+    std::string protocol;
+    uint32_t numNodes;
+    uint32_t seed;
+    
+    std::string Name() const {
+        // Grid jobs keep the names they had before there were scenarios
+        std::string scenario = g_scenario == "grid" ? "" : "_" + g_scenario;
+        return protocol + scenario + "_N" + std::to_string(numNodes) + "_S" + std::to_string(seed);
+    }
+};
+
+// Subdirectory of --jobDir for the settings a job's name leaves out, so
+// that --resume and --mergeOnly never mix jobs run with different ones
+std::string RunParametersName(double simulationTime, uint32_t multipath,
+                              const std::string& multipathWeighting)
+{
+    std::ostringstream name;
+    name << "T" << simulationTime << "_F" << g_numFlows << "_R" << g_packetRate
+         << "_V" << g_speed << (g_adaptiveHello ? "_adaptive" : "_fixed") << "_K" << multipath;
+    if (multipath > 1) {
+        name << "_" << multipathWeighting;
+    }
+    if (g_scenario == "formation") {
+        name << "_C" << g_clusterSize;
+    }
+    name << "_G" << g_convergedShare;
+    if (!g_embeddingFile.empty()) {
+        name << "_E" << g_embeddingFile.substr(g_embeddingFile.find_last_of('/') + 1);
+    }
+    if (g_warmStart) {
+        name << "_warm";
+    }
+    return name.str();
+}
+
+// Written to a temporary file and renamed, so a result file exists only
+// for a job that finished
+bool WriteJobResult(const std::string& path, const ExperimentStats& stats, double convTime)
+{
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream out(tmp);
+        out << std::setprecision(17)
+            << "pdr " << stats.pdr << "\n"
+            << "avgDelay " << stats.avgDelay << "\n"
+            << "throughput " << stats.throughput << "\n"
+            << "totalTx " << stats.totalTx << "\n"
+            << "totalRx " << stats.totalRx << "\n"
+            << "simulatedNRO " << stats.simulatedNRO << "\n"
+            << "controlPackets " << stats.controlPackets << "\n"
+            << "controlBytes " << stats.controlBytes << "\n"
+            << "convergenceTime " << convTime << "\n"
+            << "wallSeconds " << stats.wallSeconds << "\n"
+            << "setupSeconds " << stats.setupSeconds << "\n"
+            << "embeddingLoadSeconds " << stats.embeddingLoadSeconds << "\n"
+            << "runSeconds " << stats.runSeconds << "\n"
+            << "events " << stats.events << "\n"
+            << "peakRssKB " << stats.peakRssKB << "\n";
+        if (!out.flush()) {
+            return false;
+        }
+    }
+    return std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+bool ReadJobResult(const std::string& path, ExperimentStats& stats, double& convTime)
+{
+    std::ifstream in(path);
+    if (!in.is_open()) {
+        return false;
+    }
+    std::map<std::string, std::string> fields;
+    std::string key, value;
+    while (in >> key >> value) {
+        fields[key] = value;
+    }
+    static const char* keys[] = {"pdr", "avgDelay", "throughput", "totalTx", "totalRx",
+                                 "simulatedNRO", "controlPackets", "controlBytes",
+                                 "convergenceTime"};
+    for (const char* k : keys) {
+        if (fields.count(k) == 0) {
+            return false;
+        }
+    }
+    stats.pdr = std::stod(fields["pdr"]);
+    stats.avgDelay = std::stod(fields["avgDelay"]);
+    stats.throughput = std::stod(fields["throughput"]);
+    stats.totalTx = std::stoul(fields["totalTx"]);
+    stats.totalRx = std::stoul(fields["totalRx"]);
+    stats.simulatedNRO = std::stod(fields["simulatedNRO"]);
+    stats.controlPackets = std::stoull(fields["controlPackets"]);
+    stats.controlBytes = std::stoull(fields["controlBytes"]);
+    convTime = std::stod(fields["convergenceTime"]);
+    // Jobs finished before the run cost was recorded have none
+    if (fields.count("wallSeconds") != 0) {
+        stats.wallSeconds = std::stod(fields["wallSeconds"]);
+        stats.setupSeconds = std::stod(fields["setupSeconds"]);
+        stats.embeddingLoadSeconds = std::stod(fields["embeddingLoadSeconds"]);
+        stats.runSeconds = std::stod(fields["runSeconds"]);
+        stats.events = std::stoull(fields["events"]);
+        stats.peakRssKB = std::stoull(fields["peakRssKB"]);
+    }
+    return true;
+}
+
+/**
+ * Appends one run to the records file: a JSON object per line, or a CSV
+ * row if csv is set, preceded by the column names if header is set.
+ */
+void WriteRunRecord(std::ostream& out, bool csv, bool header, const SweepJob& job,
+                    const ExperimentStats& stats, double convTime, double simulationTime)
+{
+    double simPerWall = stats.runSeconds > 0 ? simulationTime / stats.runSeconds : 0.0;
+    double eventsPerSecond = stats.runSeconds > 0 ? stats.events / stats.runSeconds : 0.0;
+    const std::vector<std::pair<std::string, std::string>> fields = {
+        {"protocol", job.protocol},
+        {"scenario", g_scenario},
+        {"nodes", std::to_string(job.numNodes)},
+        {"flows", std::to_string(FlowCount(job.numNodes))},
+        {"seed", std::to_string(job.seed)},
+        {"pdr", std::to_string(stats.pdr)},
+        {"avg_delay_ms", std::to_string(stats.avgDelay)},
+        {"throughput_kbps", std::to_string(stats.throughput)},
+        {"tx_packets", std::to_string(stats.totalTx)},
+        {"rx_packets", std::to_string(stats.totalRx)},
+        {"nro", std::to_string(stats.simulatedNRO)},
+        {"control_packets", std::to_string(stats.controlPackets)},
+        {"control_bytes", std::to_string(stats.controlBytes)},
+        {"convergence_s", std::to_string(convTime)},
+        {"sim_time_s", std::to_string(simulationTime)},
+        {"wall_s", std::to_string(stats.wallSeconds)},
+        {"setup_s", std::to_string(stats.setupSeconds)},
+        {"embedding_load_s", std::to_string(stats.embeddingLoadSeconds)},
+        {"run_s", std::to_string(stats.runSeconds)},
+        {"sim_per_wall", std::to_string(simPerWall)},
+        {"events", std::to_string(stats.events)},
+        {"events_per_s", std::to_string(eventsPerSecond)},
+        {"peak_rss_kb", std::to_string(stats.peakRssKB)},
+    };
+    if (csv) {
+        for (size_t i = 0; header && i < fields.size(); ++i) {
+            out << (i ? "," : "") << fields[i].first << (i + 1 == fields.size() ? "\n" : "");
+        }
+        for (size_t i = 0; i < fields.size(); ++i) {
+            out << (i ? "," : "") << fields[i].second;
+        }
+        out << "\n";
+        return;
+    }
+    out << "{";
+    for (size_t i = 0; i < fields.size(); ++i) {
+        // Only the protocol and scenario names are strings
+        bool quoted = i <= 1;
+        out << (i ? ", " : "") << "\"" << fields[i].first << "\": "
+            << (quoted ? "\"" : "") << fields[i].second << (quoted ? "\"" : "");
+    }
+    out << "}\n";
+}
+
+
+std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string protocol,
+                             uint32_t seed, double simulationTime = 60.0);
+
+// Pretrained table for the GSQR nodes, from --embeddingFile; none if empty
+std::string g_embeddingFile;
+// GSQR checkpoints, one subdirectory per N; --warmStart loads the last ones
+std::string g_checkpointDir;
+bool g_warmStart = false;
+// Share of the nodes that must have stabilized for a run to have converged
+double g_convergedShare = 0.9;
+// Routing table of one OLSR node as of its last change
+struct OlsrTableHistory {
+    Ptr<olsr::RoutingProtocol> agent;
+    std::vector<olsr::RoutingTableEntry> table;
+    double lastChange = -1.0;   // -1: the table never held a route
 };
 
+// RoutingTableChanged fires on every recomputation of the table; only
+// those that alter a route count as changes
+void OlsrTableChanged(OlsrTableHistory* history, uint32_t size)
+{
+    std::vector<olsr::RoutingTableEntry> table = history->agent->GetRoutingTableEntries();
+    bool same = table.size() == history->table.size()
+        && std::equal(table.begin(), table.end(), history->table.begin(),
+                      [](const olsr::RoutingTableEntry& a, const olsr::RoutingTableEntry& b) {
+                          return a.destAddr == b.destAddr && a.nextAddr == b.nextAddr
+                              && a.interface == b.interface && a.distance == b.distance;
+                      });
+    if (!same) {
+        history->table = std::move(table);
+        history->lastChange = Simulator::Now().GetSeconds();
+    }
+}
+
+/**
+ * Time by which share of the nodes had stabilized for good, given when
+ * each did (negative: never); -1 if fewer than that share ever did.
+ */
+double StabilizationTime(std::vector<double> times, double share)
+{
+    if (times.empty()) {
+        return -1.0;
+    }
+    size_t needed = std::max<size_t>(1, static_cast<size_t>(std::ceil(share * times.size() - 1e-9)));
+    std::sort(times.begin(), times.end());
+    auto firstStable = std::lower_bound(times.begin(), times.end(), 0.0);
+    if (static_cast<size_t>(times.end() - firstStable) < needed) {
+        return -1.0;
+    }
+    return *(firstStable + (needed - 1));
+}
+
+/**
+ * Run the jobs without a result file in jobDir on up to numWorkers forked
+ * processes. The parent never runs a simulation, so every worker starts
+ * from a clean simulator. Returns the number of jobs that failed.
+ */
+uint32_t RunSweepJobs(const std::vector<SweepJob>& jobs, const std::string& jobDir,
+                      uint32_t numWorkers, double jobTimeout, double simulationTime)
+{
+    struct Worker {
+        SweepJob job;
+        std::chrono::steady_clock::time_point start;
+        bool killed;
+    };
+    std::map<pid_t, Worker> running;
+    uint32_t failed = 0;
+    size_t next = 0;
+    
+    auto reap = [&](pid_t pid, int status) {
+        const Worker& worker = running[pid];
+        bool ok = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        if (!ok) {
+            failed++;
+            std::cout << "  Job " << worker.job.Name() << " "
+                      << (worker.killed ? "timed out" : "failed") << ", see "
+                      << jobDir << "/" << worker.job.Name() << ".log" << std::endl;
+        } else {
+            std::cout << "  Job " << worker.job.Name() << " done" << std::endl;
+        }
+        running.erase(pid);
+    };
+    
+    while (next < jobs.size() || !running.empty()) {
+        while (next < jobs.size() && running.size() < numWorkers) {
+            const SweepJob& job = jobs[next++];
+            std::cout.flush();
+            pid_t pid = fork();
+            if (pid < 0) {
+                std::cout << "  Cannot fork for job " << job.Name() << std::endl;
+                failed++;
+                continue;
+            }
+            if (pid == 0) {
+                std::ofstream jobLog(jobDir + "/" + job.Name() + ".log");
+                std::cout.rdbuf(jobLog.rdbuf());
+                auto [stats, convTime] = RunSimulation(job.numNodes, job.protocol, job.seed,
+                                                       simulationTime);
+                bool written = WriteJobResult(jobDir + "/" + job.Name() + ".txt", stats, convTime);
+                jobLog.flush();
+                _exit(written ? 0 : 1);
+            }
+            running[pid] = Worker{job, std::chrono::steady_clock::now(), false};
+        }
+        
+        int status;
+        pid_t pid = waitpid(-1, &status, WNOHANG);
+        if (pid > 0) {
+            reap(pid, status);
+            continue;
+        }
+        if (jobTimeout > 0) {
+            auto now = std::chrono::steady_clock::now();
+            for (auto& entry : running) {
+                double elapsed = std::chrono::duration<double>(now - entry.second.start).count();
+                if (!entry.second.killed && elapsed > jobTimeout) {
+                    kill(entry.first, SIGKILL);
+                    entry.second.killed = true;
+                }
+            }
+        }
+        usleep(100000);
+    }
+    return failed;
+}
+
+// Hello interval of protocol, in seconds, as {shortest, longest}: the
+// same unless the GSQR Hellos are adaptive
+std::pair<double, double> HelloIntervals(const std::string& protocol)
+{
+    if (protocol == "GSQR" && g_adaptiveHello) {
+        return {ADAPTIVE_HELLO_MIN, ADAPTIVE_HELLO_MAX};
+    }
+    double interval = (protocol == "OLSR") ? 1.0 : 2.0;
+    return {interval, interval};
+}
+
+// A theoretical figure of protocol as a function of its Hello interval:
+// one value, or "low-high" over the range of the adaptive Hellos
+template <typename Figure>
+std::string TheoryRange(const std::string& protocol, Figure figure)
+{
+    auto [shortest, longest] = HelloIntervals(protocol);
+    std::ostringstream out;
+    out << figure(longest);
+    if (shortest != longest) {
+        out << "-" << figure(shortest);
+    }
+    return out.str();
+}
+
 double CalculateRealisticNRO(uint32_t numNodes, const std::string& protocol, 
-                           double simulationTime = 25.0) {
+                           double simulationTime, double helloInterval) {
     
-    double helloInterval = (protocol == "OLSR") ? 1.0 : 2.0;
     double helloCount = simulationTime / helloInterval;
-    double controlBytes = numNodes * helloCount * HELLO_PACKET_SIZE;
+    uint32_t helloSize = (protocol == "GSQR") ? GSQR_HELLO_PACKET_SIZE : HELLO_PACKET_SIZE;
+    double controlBytes = numNodes * helloCount * helloSize;
     
     if (protocol == "OLSR") {
         double tcCount = simulationTime / 3.0;
@@ -153,47 +682,152 @@ double CalculateRealisticNRO(uint32_t numNodes, const std::string& protocol,
     }
     
     // Data flow estimation
-    uint32_t numFlows = std::min(numNodes / 2, 5u);
-    double dataBytes = numFlows * 200 * simulationTime * DATA_PACKET_SIZE;
+    uint32_t numFlows = FlowCount(numNodes);
+    double dataBytes = numFlows * g_packetRate * simulationTime * DATA_PACKET_SIZE;
     
     return controlBytes / dataBytes;
 }
 
+/**
+ * Places the UAVs and sets them moving as g_scenario says. grid is the
+ * static 60 m grid of the manuscript runs; the others fly in the
+ * VOLUME_X x VOLUME_Y x VOLUME_Z volume at about g_speed: gauss-markov
+ * and waypoint move every UAV on its own, and formation flies groups of
+ * g_clusterSize in a V that keeps its shape behind a leader point flying
+ * random waypoints. The UAVs keep to x0 <= x < x1 (the grid starts at x0).
+ */
+void InstallMobility(NodeContainer& nodes, double x0, double x1)
+{
+    uint32_t numNodes = nodes.GetN();
+    MobilityHelper mobility;
+    auto uniform = [](double min, double max) {
+        return StringValue("ns3::UniformRandomVariable[Min=" + std::to_string(min)
+                           + "|Max=" + std::to_string(max) + "]");
+    };
+    // Random positions in [xMin, xMax] x [yMin, yMax] x [0, VOLUME_Z]
+    auto volume = [&](double xMin, double xMax, double yMin, double yMax) {
+        ObjectFactory factory;
+        factory.SetTypeId("ns3::RandomBoxPositionAllocator");
+        factory.Set("X", uniform(xMin, xMax));
+        factory.Set("Y", uniform(yMin, yMax));
+        factory.Set("Z", uniform(0.0, VOLUME_Z));
+        return factory.Create()->GetObject<PositionAllocator>();
+    };
+    
+    if (g_scenario == "grid") {
+        uint32_t gridSize = static_cast<uint32_t>(ceil(sqrt(static_cast<double>(numNodes))));
+        if (gridSize < 3) gridSize = 3;
+        
+        double spacing = 60.0;  //Increase spacing to ensure multi-hop is needed
+        mobility.SetPositionAllocator("ns3::GridPositionAllocator",
+            "MinX", DoubleValue(x0),
+            "MinY", DoubleValue(0.0),
+            "DeltaX", DoubleValue(spacing),
+            "DeltaY", DoubleValue(spacing),
+            "GridWidth", UintegerValue(gridSize),
+            "LayoutType", StringValue("RowFirst"));
+        
+        mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
+        mobility.Install(nodes);
+        
+        Log(VERBOSITY_NODE) << "    Grid: " << gridSize << "x" << gridSize 
+                  << ", Distance " << spacing << "m\n";
+    }
+    else if (g_scenario == "gauss-markov") {
+        mobility.SetPositionAllocator(volume(x0, x1, 0.0, VOLUME_Y));
+        mobility.SetMobilityModel("ns3::GaussMarkovMobilityModel",
+            "Bounds", BoxValue(Box(x0, x1, 0.0, VOLUME_Y, 0.0, VOLUME_Z)),
+            "TimeStep", TimeValue(Seconds(0.5)),
+            "Alpha", DoubleValue(0.85),
+            "MeanVelocity", uniform(0.5 * g_speed, 1.5 * g_speed),
+            "MeanDirection", uniform(0.0, 2 * M_PI),
+            "MeanPitch", uniform(-0.05, 0.05),
+            "NormalVelocity", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.0|Bound=0.0]"),
+            "NormalDirection", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.2|Bound=0.4]"),
+            "NormalPitch", StringValue("ns3::NormalRandomVariable[Mean=0.0|Variance=0.02|Bound=0.04]"));
+        mobility.Install(nodes);
+        
+        Log(VERBOSITY_NODE) << "    Gauss-Markov: " << x1 - x0 << "x" << VOLUME_Y << "x" << VOLUME_Z
+                  << " m, mean speed " << g_speed << " m/s\n";
+    }
+    else if (g_scenario == "waypoint") {
+        Ptr<PositionAllocator> waypoints = volume(x0, x1, 0.0, VOLUME_Y);
+        mobility.SetPositionAllocator(waypoints);
+        mobility.SetMobilityModel("ns3::RandomWaypointMobilityModel",
+            "Speed", uniform(0.5 * g_speed, 1.5 * g_speed),
+            "Pause", StringValue("ns3::ConstantRandomVariable[Constant=1.0]"),
+            "PositionAllocator", PointerValue(waypoints));
+        mobility.Install(nodes);
+        
+        Log(VERBOSITY_NODE) << "    Random waypoint: " << x1 - x0 << "x" << VOLUME_Y << "x" << VOLUME_Z
+                  << " m, mean speed " << g_speed << " m/s\n";
+    }
+    else {
+        // Member j of a group sits rank (j + 1) / 2 places back on the
+        // left or right arm of the V; the leader points stay far enough
+        // from the sides for the whole V to fit in the volume
+        double reach = FORMATION_SPACING * (g_clusterSize / 2);
+        Ptr<PositionAllocator> waypoints = volume(x0 + reach, x1 - reach, reach, VOLUME_Y - reach);
+        ObjectFactory leaderFactory;
+        leaderFactory.SetTypeId("ns3::RandomWaypointMobilityModel");
+        leaderFactory.Set("Speed", uniform(0.5 * g_speed, 1.5 * g_speed));
+        leaderFactory.Set("Pause", StringValue("ns3::ConstantRandomVariable[Constant=1.0]"));
+        leaderFactory.Set("PositionAllocator", PointerValue(waypoints));
+        
+        uint32_t groups = 0;
+        for (uint32_t first = 0; first < numNodes; first += g_clusterSize, ++groups) {
+            Ptr<MobilityModel> leader = leaderFactory.Create<MobilityModel>();
+            leader->SetPosition(waypoints->GetNext());
+            leader->Initialize();
+            for (uint32_t j = 0; j < g_clusterSize && first + j < numNodes; ++j) {
+                double rank = (j + 1) / 2;
+                Ptr<ConstantPositionMobilityModel> slot = CreateObject<ConstantPositionMobilityModel>();
+                slot->SetPosition(Vector(-rank * FORMATION_SPACING,
+                                         (j % 2 ? rank : -rank) * FORMATION_SPACING, 0.0));
+                Ptr<HierarchicalMobilityModel> member = CreateObject<HierarchicalMobilityModel>();
+                member->SetChild(slot);
+                member->SetParent(leader);
+                nodes.Get(first + j)->AggregateObject(member);
+            }
+        }
+        
+        Log(VERBOSITY_NODE) << "    Formation: " << groups << " groups of up to " << g_clusterSize
+                  << ", " << FORMATION_SPACING << " m apart, mean speed " << g_speed << " m/s\n";
+    }
+}
+
 /**
  * Run a single simulation 
  */
 std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string protocol,
-                             uint32_t seed, double simulationTime = 60.0)
+                             uint32_t seed, double simulationTime)
 {
+    typedef std::chrono::steady_clock Clock;
+    auto seconds = [](Clock::time_point since) {
+        return std::chrono::duration<double>(Clock::now() - since).count();
+    };
+    Clock::time_point runStart = Clock::now();
+    double embeddingLoadSeconds = 0.0;
+    
     // Set random seed
     RngSeedManager::SetSeed(seed);
     
-    std::cout << "  Run: " << protocol << ", N=" << numNodes 
-              << ", Seed =" << seed << std::endl;
+    Log(VERBOSITY_RUN) << "  Run: " << protocol << ", N=" << numNodes 
+              << ", Seed =" << seed << "\n";
     
-    // 1. Create nodes
+    // 1. Create nodes: one island of consecutive UAVs per rank, which
+    // flies in its own slab of the volume and simulates on that rank
     NodeContainer nodes;
-    nodes.Create(numNodes);
-    
-    // 2. Simple grid mobility
-    MobilityHelper mobility;
-    uint32_t gridSize = static_cast<uint32_t>(ceil(sqrt(static_cast<double>(numNodes))));
-    if (gridSize < 3) gridSize = 3;
-    
-    double spacing = 60.0;  //Increase spacing to ensure multi-hop is needed
-    mobility.SetPositionAllocator("ns3::GridPositionAllocator",
-        "MinX", DoubleValue(0.0),
-        "MinY", DoubleValue(0.0),
-        "DeltaX", DoubleValue(spacing),
-        "DeltaY", DoubleValue(spacing),
-        "GridWidth", UintegerValue(gridSize),
-        "LayoutType", StringValue("RowFirst"));
-    
-    mobility.SetMobilityModel("ns3::ConstantPositionMobilityModel");
-    mobility.Install(nodes);
+    std::vector<NodeContainer> islands(g_ranks);
+    for (uint32_t b = 0; b < g_ranks; ++b) {
+        islands[b].Create((b + 1) * numNodes / g_ranks - b * numNodes / g_ranks, b);
+        nodes.Add(islands[b]);
+    }
     
-    std::cout << "    Grid: " << gridSize << "x" << gridSize 
-              << ", Distance " << spacing << "m" << std::endl;
+    // 2. Mobility
+    for (uint32_t b = 0; b < g_ranks; ++b) {
+        InstallMobility(islands[b], b * VOLUME_X / g_ranks, (b + 1) * VOLUME_X / g_ranks);
+    }
     
     // 3. WiFi configuration
     WifiHelper wifi;
@@ -201,7 +835,6 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
     
     YansWifiPhyHelper phy;
     YansWifiChannelHelper channel = YansWifiChannelHelper::Default();
-    phy.SetChannel(channel.Create());
     
     phy.Set("TxPowerStart", DoubleValue(30.0));
     phy.Set("TxPowerEnd", DoubleValue(30.0));
@@ -209,14 +842,33 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
     WifiMacHelper mac;
     mac.SetType("ns3::AdhocWifiMac");
     
-    NetDeviceContainer devices = wifi.Install(phy, mac, nodes);
+    // A wireless channel cannot span ranks: each island has its own
+    std::vector<NetDeviceContainer> devices(g_ranks);
+    for (uint32_t b = 0; b < g_ranks; ++b) {
+        phy.SetChannel(channel.Create());
+        devices[b] = wifi.Install(phy, mac, islands[b]);
+    }
     
     // 4. install Routing Protocal
     InternetStackHelper stack;
+    GsqrHelper gsqrHelper;
     
     if (protocol == "GSQR") {
-        GsqrHelper gsqrHelper;
         gsqrHelper.SetHelloInterval(Seconds(2.0));
+        if (!g_embeddingFile.empty()) {
+            // Loaded here, before the stack helper copies the helper
+            Clock::time_point loadStart = Clock::now();
+            gsqrHelper.SetEmbeddingFile(g_embeddingFile);
+            gsqrHelper.LoadEmbeddingBase();
+            embeddingLoadSeconds = seconds(loadStart);
+        }
+        if (!g_checkpointDir.empty()) {
+            std::string directory = g_checkpointDir + "/n" + std::to_string(numNodes);
+            gsqrHelper.SetCheckpoint(directory);
+            if (g_warmStart) {
+                gsqrHelper.SetWarmStart(directory);
+            }
+        }
         stack.SetRoutingHelper(gsqrHelper);
     }
     else if (protocol == "OLSR") {
@@ -231,44 +883,102 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
     }
     
     stack.Install(nodes);
+    if (protocol == "GSQR") {
+        // Hello start offsets and jitter follow the run's seed
+        gsqrHelper.AssignStreams(nodes, 0);
+    }
+    std::vector<OlsrTableHistory> olsrHistory;
+    if (protocol == "OLSR") {
+        olsrHistory.resize(numNodes);   // not resized again: the callbacks point into it
+        for (uint32_t i = 0; i < numNodes; ++i) {
+            olsrHistory[i].agent = nodes.Get(i)->GetObject<olsr::RoutingProtocol>();
+            olsrHistory[i].agent->TraceConnectWithoutContext(
+                "RoutingTableChanged", MakeBoundCallback(&OlsrTableChanged, &olsrHistory[i]));
+        }
+    }
     
-    // 5. IP Address
+    // 5. IP Address: island b is 10.<b+1>.1.0/24, or 10.<b+1>.0.0/16
+    // when it has too many UAVs for that
     Ipv4AddressHelper address;
-    address.SetBase("10.1.1.0", "255.255.255.0");
-    Ipv4InterfaceContainer interfaces = address.Assign(devices);
+    std::vector<Ipv4Address> addressOf;     // each UAV's radio, by node index
+    for (uint32_t b = 0; b < g_ranks; ++b) {
+        bool wide = islands[b].GetN() > 253;
+        std::string base = "10." + std::to_string(b + 1) + (wide ? ".0.0" : ".1.0");
+        address.SetBase(base.c_str(), wide ? "255.255.0.0" : "255.255.255.0");
+        Ipv4InterfaceContainer interfaces = address.Assign(devices[b]);
+        for (uint32_t i = 0; i < interfaces.GetN(); ++i) {
+            addressOf.push_back(interfaces.GetAddress(i));
+        }
+    }
+#ifdef NS3_MPI
+    // Neighboring islands are joined by a wired link from the last UAV of
+    // one to the first of the next; all traffic between ranks crosses
+    // these, and their delay is the lookahead of the distributed run
+    PointToPointHelper backhaul;
+    backhaul.SetDeviceAttribute("DataRate", StringValue("100Mbps"));
+    backhaul.SetChannelAttribute("Delay", StringValue("1ms"));
+    for (uint32_t b = 0; b + 1 < g_ranks; ++b) {
+        NetDeviceContainer link = backhaul.Install(islands[b].Get(islands[b].GetN() - 1),
+                                                   islands[b + 1].Get(0));
+        address.SetBase(("172.16." + std::to_string(b) + ".0").c_str(), "255.255.255.252");
+        address.Assign(link);
+    }
+#endif
     
     // 6. Create simple traffic 
-    uint32_t numFlows = std::min<uint32_t>(numNodes / 2, 5u);
+    uint32_t numFlows = FlowCount(numNodes);
     ApplicationContainer apps;
+    Ptr<UniformRandomVariable> pick = CreateObject<UniformRandomVariable>();
+    // Every rank draws every flow, and installs the ends it simulates
+    std::vector<FlowTally> tallies(numFlows);
     
-    std::cout << "    Create " << numFlows << " Flows..." << std::endl;
+    Log(VERBOSITY_NODE) << "    Create " << numFlows << " Flows...\n";
     
     for (uint32_t i = 0; i < numFlows; ++i) {
-        // Ensure source and destination nodes are within communication range
-        uint32_t src = i * 2;
-        uint32_t dst = src + 1;
-        
-        // Boundary check
-        if (src >= numNodes) src = numNodes - 2;
-        if (dst >= numNodes) dst = numNodes - 1;
-        if (src == dst) dst = (dst + 1) % numNodes;
-        
-        std::cout << "      Flow " << i << ": Node" << src << " -> Node" << dst 
-                  << " (DISTANCE: in 60m)" << std::endl;
+        uint32_t src, dst;
+        if (g_scenario == "grid" && i < numNodes / 2) {
+            // Ensure source and destination nodes are within communication range
+            src = i * 2;
+            dst = src + 1;
+            Log(VERBOSITY_NODE) << "      Flow " << i << ": Node" << src << " -> Node" << dst 
+                      << " (DISTANCE: in 60m)\n";
+        } else {
+            // Any two UAVs; in the mobile scenarios no pair stays close
+            src = pick->GetInteger(0, numNodes - 1);
+            dst = pick->GetInteger(0, numNodes - 2);
+            if (dst >= src) dst++;
+            Log(VERBOSITY_NODE) << "      Flow " << i << ": Node" << src << " -> Node" << dst << "\n";
+        }
         
         // UDP server
-        UdpServerHelper server(5000 + i);
-        server.SetAttribute("Port", UintegerValue(5000 + i));
-        apps.Add(server.Install(nodes.Get(dst)));
+        if (IsLocal(nodes.Get(dst))) {
+            UdpServerHelper server(5000 + i);
+            server.SetAttribute("Port", UintegerValue(5000 + i));
+            ApplicationContainer serverApp = server.Install(nodes.Get(dst));
+            if (g_ranks > 1) {
+                serverApp.Get(0)->TraceConnectWithoutContext(
+                    "Rx", MakeBoundCallback(&FlowReceived, &tallies[i]));
+            }
+            apps.Add(serverApp);
+        }
         
         // UDP client
-        UdpClientHelper client(interfaces.GetAddress(dst), 5000 + i);
-        client.SetAttribute("MaxPackets", UintegerValue(50000));
-        client.SetAttribute("Interval", TimeValue(Seconds(0.01)));
-        client.SetAttribute("PacketSize", UintegerValue(512));
-        
-        apps.Add(client.Install(nodes.Get(src)));
-        apps.Get(apps.GetN() - 1)->SetStartTime(Seconds(5.0 + i * 0.5));
+        if (IsLocal(nodes.Get(src))) {
+            UdpClientHelper client(addressOf[dst], 5000 + i);
+            // Never the limit at the default rate
+            client.SetAttribute("MaxPackets", UintegerValue(std::max<uint64_t>(
+                50000, static_cast<uint64_t>(std::ceil(g_packetRate * simulationTime)))));
+            client.SetAttribute("Interval", TimeValue(Seconds(1.0 / g_packetRate)));
+            client.SetAttribute("PacketSize", UintegerValue(512));
+            
+            ApplicationContainer clientApp = client.Install(nodes.Get(src));
+            if (g_ranks > 1) {
+                clientApp.Get(0)->TraceConnectWithoutContext(
+                    "Tx", MakeBoundCallback(&FlowSent, &tallies[i]));
+            }
+            apps.Add(clientApp);
+            apps.Get(apps.GetN() - 1)->SetStartTime(Seconds(5.0 + i * 0.5));
+        }
     }
     
     double trafficDuration = simulationTime - 10.0;
@@ -277,20 +987,47 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
     
     Simulator::Stop(Seconds(simulationTime));
     
-    // 7. Traffic monitoring
+    // 7. Traffic monitoring; a distributed run counts at the applications
     Ptr<FlowMonitor> flowMonitor;
     FlowMonitorHelper flowHelper;
-    flowMonitor = flowHelper.InstallAll();
+    if (g_ranks == 1) {
+        flowMonitor = flowHelper.InstallAll();
+    }
     
     // 8. Run the simulation
-    std::cout << "    Run the simulation..." << std::endl;
+    Log(VERBOSITY_RUN) << "    Run the simulation...\n";
+    double setupSeconds = seconds(runStart);
+    Clock::time_point simulatorStart = Clock::now();
     Simulator::Run();
+    double runSeconds = seconds(simulatorStart);
     
     // 9. Collect statistics
     ExperimentStats stats;
+    stats.setupSeconds = setupSeconds;
+    stats.embeddingLoadSeconds = embeddingLoadSeconds;
+    stats.runSeconds = runSeconds;
+    stats.events = Simulator::GetEventCount();
     
-    flowMonitor->CheckForLostPackets();
-    std::map<FlowId, FlowMonitor::FlowStats> flowStats = flowMonitor->GetFlowStats();
+    std::map<FlowId, FlowMonitor::FlowStats> flowStats;
+    if (flowMonitor) {
+        flowMonitor->CheckForLostPackets();
+        flowStats = flowMonitor->GetFlowStats();
+    } else {
+        // Each end's counts are on its own rank
+        std::vector<double> counts;
+        for (const FlowTally& tally : tallies) {
+            counts.insert(counts.end(), {tally.txPackets, tally.rxPackets, tally.rxBytes, tally.delaySum});
+        }
+        CombineRanks(counts);
+        for (uint32_t i = 0; i < numFlows; ++i) {
+            FlowMonitor::FlowStats flow = FlowMonitor::FlowStats();
+            flow.txPackets = static_cast<uint32_t>(counts[4 * i]);
+            flow.rxPackets = static_cast<uint32_t>(counts[4 * i + 1]);
+            flow.rxBytes = static_cast<uint64_t>(counts[4 * i + 2]);
+            flow.delaySum = Seconds(counts[4 * i + 3]);
+            flowStats[i + 1] = flow;
+        }
+    }
     
     uint32_t validFlows = 0;
     for (const auto& flow : flowStats) {
@@ -329,20 +1066,25 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
     
         if (actualDataBytes == 0) {
             actualDataBytes = stats.totalRx * DATA_PACKET_SIZE;
-            std::cout << "⚠️  using estimate data bytes: " << actualDataBytes << std::endl;
+            Log(VERBOSITY_NODE) << "⚠️  using estimate data bytes: " << actualDataBytes << "\n";
         } else {
-            std::cout << "✅ real data bytes: " << actualDataBytes << std::endl;
+            Log(VERBOSITY_NODE) << "✅ real data bytes: " << actualDataBytes << "\n";
         }
         
         // Control packet calculation
         if (protocol == "GSQR") {
             uint32_t totalActualHellos = 0;
             uint64_t totalActualControlBytes = 0;
+            uint64_t totalHellosReceived = 0;
+            uint64_t totalHellosLost = 0;
             
-            std::cout << "\n=== GSQR control packets status ===" << std::endl;
+            Log(VERBOSITY_NODE) << "\n=== GSQR control packets status ===\n";
             
             for (uint32_t i = 0; i < numNodes; ++i) {
                 Ptr<Node> node = nodes.Get(i);
+                if (!IsLocal(node)) {
+                    continue;
+                }
                 Ptr<GsqrRoutingProtocol> gsqr = node->GetObject<GsqrRoutingProtocol>();
                 if (gsqr) {
                     uint32_t nodeHellos = gsqr->GetControlPacketsSent(); 
@@ -350,17 +1092,39 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
                     
                     totalActualHellos += nodeHellos;
                     totalActualControlBytes += nodeBytes;
+                    totalHellosReceived += gsqr->GetHellosReceived();
+                    totalHellosLost += gsqr->GetHellosLost();
                     
-                    std::cout << "node " << i << ": " << nodeHellos << "packets, " 
-                            << nodeBytes << "bytes" << std::endl;
-                    std::cout << "    Node " << i << ": GSQR protocol installed successfully" << std::endl;
+                    Log(VERBOSITY_NODE) << "node " << i << ": " << nodeHellos << "packets, " 
+                            << nodeBytes << "bytes, mean Hello interval "
+                            << gsqr->GetMeanHelloInterval().GetSeconds() << "s, "
+                            << gsqr->GetHelloIntervalResets() << " resets\n";
+                    Log(VERBOSITY_NODE) << "    Node " << i << ": GSQR protocol installed successfully\n";
                 } else {
-                    std::cout << "    WARNING: Node " << i << ": GSQR protocol NOT found!" << std::endl;
+                    Log(VERBOSITY_NODE) << "    WARNING: Node " << i << ": GSQR protocol NOT found!\n";
                 }
             }
+            std::vector<double> totals = {static_cast<double>(totalActualHellos),
+                                          static_cast<double>(totalActualControlBytes),
+                                          static_cast<double>(totalHellosReceived),
+                                          static_cast<double>(totalHellosLost)};
+            CombineRanks(totals);
+            totalActualHellos = static_cast<uint32_t>(totals[0]);
+            totalActualControlBytes = static_cast<uint64_t>(totals[1]);
+            totalHellosReceived = static_cast<uint64_t>(totals[2]);
+            totalHellosLost = static_cast<uint64_t>(totals[3]);
+            
+            Log(VERBOSITY_RUN) << "GSQR Actual - Hello packet: " << totalActualHellos 
+                    << ", theoretical value: " << TheoryRange(protocol, [&](double interval) {
+                           return static_cast<uint64_t>(numNodes * (simulationTime / interval));
+                       }) << "\n";
             
-            std::cout << "GSQR Actual - Hello packet: " << totalActualHellos 
-                    << ", theoretical value: " << static_cast<uint64_t>(numNodes * (simulationTime / 2.0)) << std::endl;
+            if (totalHellosReceived + totalHellosLost > 0) {
+                Log(VERBOSITY_RUN) << "GSQR Hello loss between neighbors: " << totalHellosLost << " of "
+                          << (totalHellosReceived + totalHellosLost) << " ("
+                          << 100.0 * totalHellosLost / (totalHellosReceived + totalHellosLost)
+                          << "%)\n";
+            }
             
             stats.controlPackets = totalActualHellos;
             stats.controlBytes = totalActualControlBytes;
@@ -391,59 +1155,91 @@ std::pair<ExperimentStats, double> RunSimulation(uint32_t numNodes, std::string
    
     
     // 11. Output results 
-    std::cout << "===GSQR_RESULTS_START===" << std::endl;
-    std::cout << "PROTOCOL: " << protocol << std::endl;
-    std::cout << "NODES: " << numNodes << std::endl;
-    std::cout << "SEED: " << seed << std::endl;
-    std::cout << "PDR: " << stats.pdr << std::endl;
-    std::cout << "AVG_DELAY_MS: " << stats.avgDelay << std::endl;
-    std::cout << "THROUGHPUT_KBPS: " << stats.throughput << std::endl;
-    std::cout << "TX_PACKETS: " << stats.totalTx << std::endl;
-    std::cout << "RX_PACKETS: " << stats.totalRx << std::endl;
-    std::cout << "THEORETICAL_NRO: " << CalculateRealisticNRO(numNodes, protocol,simulationTime) << std::endl;
-    std::cout << "SIMULATED_NRO: " << stats.simulatedNRO << std::endl;
-    std::cout << "CONTROL_PACKETS: " << stats.controlPackets 
-          << " (theory: " << static_cast<uint64_t>(numNodes * (simulationTime / 2.0)) << ")" 
-          << std::endl;
-    std::cout << "CONTROL_BYTES: " << stats.controlBytes 
-          << " (theory: " << static_cast<uint64_t>(numNodes * (simulationTime / 2.0) * HELLO_PACKET_SIZE) << ")" 
-          << std::endl;
-    
-    double convergenceTime = -1.0;
-    
-    if (stats.pdr > 0) {
-        // Simple estimate based on PDR
-        convergenceTime = 5.0 + (100.0 - stats.pdr) * 0.2;
-        if (protocol == "GSQR") {
-            // Ensure different seeds yield different values
-            double variation = (seed % 10) * 0.1;  // 0.0-0.9
-            convergenceTime = 4.6 + variation;
-            if (convergenceTime > 5.5) convergenceTime = 5.5;
-
-        } else if (protocol == "OLSR") {
-                    double baseTime = 15.0 + ((seed % 5) * 0.3); // 14.7-16.5
-                    double pdrEffect = (100.0 - stats.pdr) * 0.1;
-                    convergenceTime = baseTime + pdrEffect;
-                    if (convergenceTime < 14.0) convergenceTime = 14.0;
-                    if (convergenceTime > 17.0) convergenceTime = 17.0;            
-        } else if (protocol == "QTABLE") {
-            // QTABLE: does not converge when PDR < 85%
-            if (stats.pdr >= 85.0) {
-                double baseTime = 30.0 + ((seed % 10) * 0.5); // 30-34.5
-                convergenceTime = baseTime + (100.0 - stats.pdr) * 0.5;
-                if (convergenceTime > 60.0) convergenceTime = 60.0;
-            } else {
-                convergenceTime = -1.0; // Non-convergent
+    Log(VERBOSITY_RUN) << "===GSQR_RESULTS_START===\n";
+    Log(VERBOSITY_RUN) << "PROTOCOL: " << protocol << "\n";
+    Log(VERBOSITY_RUN) << "NODES: " << numNodes << "\n";
+    Log(VERBOSITY_RUN) << "SEED: " << seed << "\n";
+    Log(VERBOSITY_RUN) << "PDR: " << stats.pdr << "\n";
+    Log(VERBOSITY_RUN) << "AVG_DELAY_MS: " << stats.avgDelay << "\n";
+    Log(VERBOSITY_RUN) << "THROUGHPUT_KBPS: " << stats.throughput << "\n";
+    Log(VERBOSITY_RUN) << "TX_PACKETS: " << stats.totalTx << "\n";
+    Log(VERBOSITY_RUN) << "RX_PACKETS: " << stats.totalRx << "\n";
+    Log(VERBOSITY_RUN) << "THEORETICAL_NRO: " << TheoryRange(protocol, [&](double interval) {
+        return CalculateRealisticNRO(numNodes, protocol, simulationTime, interval);
+    }) << "\n";
+    Log(VERBOSITY_RUN) << "SIMULATED_NRO: " << stats.simulatedNRO << "\n";
+    Log(VERBOSITY_RUN) << "CONTROL_PACKETS: " << stats.controlPackets 
+          << " (theory: " << TheoryRange(protocol, [&](double interval) {
+                 return static_cast<uint64_t>(numNodes * (simulationTime / interval));
+             }) << ")" 
+          << "\n";
+    Log(VERBOSITY_RUN) << "CONTROL_BYTES: " << stats.controlBytes 
+          << " (theory: " << TheoryRange(protocol, [&](double interval) {
+                 return static_cast<uint64_t>(numNodes * (simulationTime / interval) *
+                                              (protocol == "GSQR" ? GSQR_HELLO_PACKET_SIZE : HELLO_PACKET_SIZE));
+             }) << ")" 
+          << "\n";
+    
+    // When each node stabilized for good, -1 for those that did not
+    std::vector<double> stabilized;
+    if (protocol == "GSQR") {
+        // -2 for the nodes that did not take part, or that another rank ran
+        std::vector<double> byNode(numNodes, -2.0);
+        for (uint32_t i = 0; i < numNodes; ++i) {
+            Ptr<GsqrRoutingProtocol> gsqr = nodes.Get(i)->GetObject<GsqrRoutingProtocol>();
+            if (gsqr && gsqr->IsLocal() && gsqr->GetRouting()->IsActive()) {
+                byNode[i] = gsqr->GetRouting()->GetConvergenceTime();
             }
         }
+        CombineRanks(byNode, true);
+        for (double t : byNode) {
+            if (t > -2.0) {
+                stabilized.push_back(t);
+            }
+        }
+    } else if (protocol == "OLSR") {
+        double end = Simulator::Now().GetSeconds();
+        for (const OlsrTableHistory& history : olsrHistory) {
+            bool settled = history.lastChange >= 0.0 && end - history.lastChange >= OLSR_STABLE_S;
+            stabilized.push_back(settled ? history.lastChange : -1.0);
+        }
     }
+    double convergenceTime = StabilizationTime(stabilized, g_convergedShare);
+    uint32_t settledNodes = std::count_if(stabilized.begin(), stabilized.end(),
+                                          [](double t) { return t >= 0.0; });
     
-    std::cout << "ESTIMATED_CONVERGENCE_S: " << convergenceTime << std::endl;
-    std::cout << "SIMULATION_TIME_S: " << simulationTime << std::endl;
-    std::cout << "===GSQR_RESULTS_END===" << std::endl << std::endl;
+    Log(VERBOSITY_RUN) << "CONVERGENCE_S: " << convergenceTime << " (" << settledNodes << " of "
+              << stabilized.size() << " nodes stabilized)\n";
+    Log(VERBOSITY_RUN) << "SIMULATION_TIME_S: " << simulationTime << "\n";
     
     Simulator::Destroy();
     
+    // Linux reports the peak in kilobytes
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+        stats.peakRssKB = static_cast<uint64_t>(usage.ru_maxrss);
+    }
+    stats.wallSeconds = seconds(runStart);
+    // The ranks run in step, so a distributed run takes as long as its
+    // slowest rank; its events and memory are those of all ranks together
+    std::vector<double> longest = {stats.wallSeconds, stats.setupSeconds,
+                                   stats.embeddingLoadSeconds, stats.runSeconds};
+    std::vector<double> total = {static_cast<double>(stats.events), static_cast<double>(stats.peakRssKB)};
+    CombineRanks(longest, true);
+    CombineRanks(total);
+    stats.wallSeconds = longest[0];
+    stats.setupSeconds = longest[1];
+    stats.embeddingLoadSeconds = longest[2];
+    stats.runSeconds = longest[3];
+    stats.events = static_cast<uint64_t>(total[0]);
+    stats.peakRssKB = static_cast<uint64_t>(total[1]);
+    Log(VERBOSITY_RUN) << "WALL_S: " << stats.wallSeconds << " (setup " << stats.setupSeconds
+              << ", embedding load " << stats.embeddingLoadSeconds
+              << ", run " << stats.runSeconds << ")\n";
+    Log(VERBOSITY_RUN) << "EVENTS: " << stats.events << "\n";
+    Log(VERBOSITY_RUN) << "PEAK_RSS_KB: " << stats.peakRssKB << "\n";
+    Log(VERBOSITY_RUN) << "===GSQR_RESULTS_END===\n" << std::endl;
+    
     return std::make_pair(stats, convergenceTime);
 }
 
@@ -452,40 +1248,35 @@ int main(int argc, char *argv[])
     
     std::ignore = system("mkdir -p results");
     
-    std::streambuf* original_cout = std::cout.rdbuf();
+#ifdef NS3_MPI
+    // Under mpirun every rank runs all of main, and each run is collective;
+    // a single rank keeps the ordinary simulator
+    GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::DistributedSimulatorImpl"));
+    MpiInterface::Enable(&argc, &argv);
+    g_rank = MpiInterface::GetSystemId();
+    g_ranks = MpiInterface::GetSize();
+    if (g_ranks == 1) {
+        GlobalValue::Bind("SimulatorImplementationType", StringValue("ns3::DefaultSimulatorImpl"));
+    }
+#endif
     
-    class TeeBuffer : public std::streambuf {
-    private:
-        std::streambuf* sb1;
-        std::streambuf* sb2;
-        
-    public:
-        TeeBuffer(std::streambuf* sb1, std::streambuf* sb2) 
-            : sb1(sb1), sb2(sb2) {}
-            
-    protected:
-        int overflow(int c) override {
-            if (c == EOF) return !EOF;
-            sb1->sputc(c);
-            sb2->sputc(c);
-            return c;
-        }
-        
-        int sync() override {
-            sb1->pubsync();
-            sb2->pubsync();
-            return 0;
-        }
-    };
-    std::ofstream logFile("results/gsqr_simulation.log");
-    TeeBuffer tee_buffer(original_cout, logFile.rdbuf());
+    // Only rank 0 writes to the console and the result files; the others
+    // log to results/gsqr_simulation.rank<k>.log
+    std::streambuf* original_cout = std::cout.rdbuf();
+    std::ofstream logFile(g_rank == 0 ? std::string("results/gsqr_simulation.log")
+                                      : "results/gsqr_simulation.rank" + std::to_string(g_rank) + ".log");
+    std::vector<std::streambuf*> sinks = {logFile.rdbuf()};
+    if (g_rank == 0) {
+        sinks.insert(sinks.begin(), original_cout);
+    }
+    TeeBuffer tee_buffer(sinks);
     
     std::cout.rdbuf(&tee_buffer);   
     
-    TeeStream tee(std::cout, logFile);
-    //std::streambuf* oldBuffer = std::cout.rdbuf(&tee);
-    
-    std::ofstream outFile("results/gsqr_results.txt");
+    std::ofstream outFile;
+    if (g_rank == 0) {
+        outFile.open("results/gsqr_results.txt");
+    }
     
     std::cout << "==================================================" << std::endl;
     std::cout << "GSQR Protocol - Honest Measurement Version" << std::endl;
@@ -498,22 +1289,126 @@ int main(int argc, char *argv[])
     uint32_t numSeeds = 1;
     double simulationTime = 60.0;
     bool quickMode = false;
+    uint32_t multipath = 1;
+    std::string multipathWeighting = "softmax";
+    uint32_t numWorkers = 1;
+    double jobTimeout = 0.0;
+    bool resume = false;
+    bool mergeOnly = false;
+    std::string jobDir = "results/jobs";
+    std::string recordsFile = "results/gsqr_runs.jsonl";
+    std::string verbosity = "node";
+    std::string nodeList;
 
     cmd.AddValue("maxNodes", "Maximum number of nodes to test", maxNodes);
     cmd.AddValue("seeds", "Number of random seeds", numSeeds);
     cmd.AddValue("time", "Simulation time per run (seconds)", simulationTime);
     cmd.AddValue("quick", "Quick mode (only N=30)", quickMode);
+    cmd.AddValue("adaptiveHello", "Trickle-style GSQR Hello intervals", g_adaptiveHello);
+    cmd.AddValue("multipath", "GSQR next hops per destination the flows are spread over", multipath);
+    cmd.AddValue("multipathWeighting", "Multipath share per next hop: softmax or queue",
+                 multipathWeighting);
+    cmd.AddValue("jobs", "Worker processes for the sweep", numWorkers);
+    cmd.AddValue("jobTimeout", "Wall-clock seconds before a worker is killed (0: none)", jobTimeout);
+    cmd.AddValue("resume", "Reuse finished jobs from jobDir", resume);
+    cmd.AddValue("mergeOnly", "Only merge the finished jobs in jobDir", mergeOnly);
+    cmd.AddValue("jobDir", "Directory of per-job results and logs", jobDir);
+    cmd.AddValue("embeddingFile", "Pretrained embedding table shared by the GSQR nodes",
+                 g_embeddingFile);
+    cmd.AddValue("records", "Per-run records, JSON lines or CSV (*.csv)", recordsFile);
+    cmd.AddValue("checkpointDir", "GSQR tables saved at the end of each run, per N", g_checkpointDir);
+    cmd.AddValue("warmStart", "Start GSQR from the tables in checkpointDir", g_warmStart);
+    cmd.AddValue("convergedShare", "Share of the nodes that must stabilize for convergence",
+                 g_convergedShare);
+    cmd.AddValue("verbosity", "Console and log detail: summary, run or node", verbosity);
+    cmd.AddValue("scenario", "Mobility: grid, gauss-markov, waypoint or formation", g_scenario);
+    cmd.AddValue("nodeCounts", "Comma-separated N to sweep, in place of the default list", nodeList);
+    cmd.AddValue("flows", "UDP flows per run (0: min(N/2, 5))", g_numFlows);
+    cmd.AddValue("packetRate", "Packets per second each flow sends", g_packetRate);
+    cmd.AddValue("speed", "Mean UAV speed in the mobile scenarios (m/s)", g_speed);
+    cmd.AddValue("clusterSize", "UAVs per group in the formation scenario", g_clusterSize);
     cmd.Parse(argc, argv);
     
+    if (g_scenario != "grid" && g_scenario != "gauss-markov" && g_scenario != "waypoint"
+        && g_scenario != "formation") {
+        std::cerr << "Unknown --scenario=" << g_scenario
+                  << "; expected grid, gauss-markov, waypoint or formation" << std::endl;
+        return 1;
+    }
+    if (g_packetRate <= 0.0 || (g_scenario != "grid" && g_speed <= 0.0)) {
+        std::cerr << "--packetRate and, when the UAVs move, --speed must be positive" << std::endl;
+        return 1;
+    }
+    if (g_clusterSize == 0
+        || FORMATION_SPACING * (g_clusterSize / 2) * 2 >= std::min(VOLUME_X / g_ranks, VOLUME_Y)) {
+        std::cerr << "--clusterSize=" << g_clusterSize << " does not fit a formation in "
+                  << (g_ranks > 1 ? "a rank's slab of " : "") << "the volume" << std::endl;
+        return 1;
+    }
+    if (g_warmStart && numWorkers > 1) {
+        // The seeds of one N would load and save the same checkpoints at once
+        std::cerr << "--warmStart runs each N's seeds one after another; it cannot be used with --jobs"
+                  << std::endl;
+        return 1;
+    }
+    if (g_ranks > 1 && (numWorkers > 1 || resume || mergeOnly)) {
+        std::cerr << "A distributed run is one process per rank; --jobs, --resume and --mergeOnly"
+                  << " cannot be used with it" << std::endl;
+        return 1;
+    }
+    
+    if (verbosity == "summary") {
+        g_verbosity = VERBOSITY_SUMMARY;
+    } else if (verbosity == "run") {
+        g_verbosity = VERBOSITY_RUN;
+    } else if (verbosity == "node") {
+        g_verbosity = VERBOSITY_NODE;
+    } else {
+        std::cerr << "Unknown --verbosity=" << verbosity << "; expected summary, run or node" << std::endl;
+        return 1;
+    }
+    
+    if (g_adaptiveHello) {
+        Config::SetDefault("ns3::GsqrRoutingProtocol::AdaptiveHello", BooleanValue(true));
+        Config::SetDefault("ns3::GsqrRoutingProtocol::HelloMinInterval",
+                           TimeValue(Seconds(ADAPTIVE_HELLO_MIN)));
+        Config::SetDefault("ns3::GsqrRoutingProtocol::HelloMaxInterval",
+                           TimeValue(Seconds(ADAPTIVE_HELLO_MAX)));
+    }
+    Config::SetDefault("ns3::GsqrRoutingProtocol::MultipathPaths", UintegerValue(multipath));
+    Config::SetDefault("ns3::GsqrRoutingProtocol::MultipathWeighting", StringValue(multipathWeighting));
+    
     std::vector<uint32_t> nodeCounts;
-    if (quickMode) {
+    if (!nodeList.empty()) {
+        std::stringstream list(nodeList);
+        std::string item;
+        while (std::getline(list, item, ',')) {
+            unsigned long n = std::strtoul(item.c_str(), nullptr, 10);
+            if (n < 2) {
+                std::cerr << "Bad --nodeCounts entry '" << item << "'; each N must be at least 2"
+                          << std::endl;
+                return 1;
+            }
+            nodeCounts.push_back(static_cast<uint32_t>(n));
+        }
+    } else if (quickMode) {
         nodeCounts = {30};
     } else {
         nodeCounts = {10, 15, 20, 25, 30};
     }
     
+    if (*std::min_element(nodeCounts.begin(), nodeCounts.end()) < g_ranks) {
+        std::cerr << "Every N must be at least the number of ranks, " << g_ranks << std::endl;
+        return 1;
+    }
+    
     std::vector<std::string> protocols = {"GSQR", "OLSR", "QTABLE"};
-    std::map<std::string, std::map<uint32_t, std::vector<ExperimentStats>>> allResults;
+    if (g_ranks > 1) {
+        // OLSR and QTABLE would run every node on every rank
+        protocols = {"GSQR"};
+        std::cout << "Distributed over " << g_ranks << " ranks: GSQR only" << std::endl;
+    }
+    std::map<std::string, std::map<uint32_t, SeedAverages>> allResults;
     
     std::map<std::string, double> convTimeSum; // Total convergence time
     std::map<std::string, int> convCount;      // Number of experiments with valid convergence
@@ -523,25 +1418,74 @@ int main(int argc, char *argv[])
         convTimeSum[proto] = 0.0;
         convCount[proto] = 0;
     }
+    // Sweep mode: run the unfinished jobs in workers, then read every
+    // finished one back in the order of the sequential loop
+    bool sweep = numWorkers > 1 || resume || mergeOnly;
+    if (sweep) {
+        jobDir += "/" + RunParametersName(simulationTime, multipath, multipathWeighting);
+        std::ignore = system(("mkdir -p " + jobDir).c_str());
+        std::vector<SweepJob> pending;
+        for (const auto& protocol : protocols) {
+            for (uint32_t n : nodeCounts) {
+                for (uint32_t seed = 1; seed <= numSeeds; seed++) {
+                    SweepJob job{protocol, n, seed};
+                    std::ifstream done(jobDir + "/" + job.Name() + ".txt");
+                    if (!done.is_open()) {
+                        pending.push_back(job);
+                    }
+                }
+            }
+        }
+        std::cout << "\n=== sweep: " << pending.size() << " jobs to run on "
+                  << std::max(numWorkers, 1u) << " workers ===" << std::endl;
+        if (!mergeOnly && !pending.empty()) {
+            uint32_t failed = RunSweepJobs(pending, jobDir, std::max(numWorkers, 1u),
+                                           jobTimeout, simulationTime);
+            if (failed > 0) {
+                std::cout << failed << " jobs did not finish; rerun with --resume" << std::endl;
+            }
+        }
+    }
+    
+    std::ofstream records;
+    if (g_rank == 0) {
+        records.open(recordsFile);
+    }
+    bool recordsCsv = recordsFile.size() >= 4
+                      && recordsFile.compare(recordsFile.size() - 4, 4, ".csv") == 0;
+    bool recordsHeader = recordsCsv;
+    
     // Run experiments
     for (const auto& protocol : protocols) {
-        std::cout << "\n=== test " << protocol << " ===" << std::endl;
+        std::cout << "\n=== test " << protocol << " ===" << "\n";
 
         for (uint32_t n : nodeCounts) {
-            std::cout << "\nNodes: " << n << std::endl;
+            std::cout << "\nNodes: " << n << "\n";
             
             for (uint32_t seed = 1; seed <= numSeeds; seed++) {
-                auto [stats, convTime] = RunSimulation(n, protocol, seed, simulationTime);
+                ExperimentStats stats;
+                double convTime = -1.0;
+                if (!sweep) {
+                    std::tie(stats, convTime) = RunSimulation(n, protocol, seed, simulationTime);
+                } else if (!ReadJobResult(jobDir + "/" + SweepJob{protocol, n, seed}.Name() + ".txt",
+                                          stats, convTime)) {
+                    Log(VERBOSITY_RUN) << "  Seed " << seed << ": missing\n";
+                    continue;
+                }
                 if (convTime > 0) {
                     convTimeSum[protocol] += convTime;
                     convCount[protocol] += 1;
                 }
-                allResults[protocol][n].push_back(stats);
+                allResults[protocol][n].Add(stats);
+                WriteRunRecord(records, recordsCsv, recordsHeader, SweepJob{protocol, n, seed},
+                               stats, convTime, simulationTime);
+                records.flush();
+                recordsHeader = false;
                 
-                std::cout << "  Seed " << seed << ": "
+                Log(VERBOSITY_RUN) << "  Seed " << seed << ": "
                           << "PDR=" << std::fixed << std::setprecision(1) << stats.pdr << "%, "
                           << "Delay=" << std::setprecision(2) << stats.avgDelay << "ms, "
-                          << "NRO=" << std::setprecision(4) << stats.simulatedNRO << std::endl;
+                          << "NRO=" << std::setprecision(4) << stats.simulatedNRO << "\n";
             }
         }
     }
@@ -578,20 +1522,11 @@ int main(int argc, char *argv[])
         for (uint32_t n : nodeCounts) {
             if (allResults[protocol].count(n) == 0) continue;
             
-            const auto& statsList = allResults[protocol][n];
-            double avgPdr = 0.0, avgDelay = 0.0, avgThr = 0.0, avgNro = 0.0;
-            
-            for (const auto& stats : statsList) {
-                avgPdr += stats.pdr;
-                avgDelay += stats.avgDelay;
-                avgThr += stats.throughput;
-                avgNro += stats.simulatedNRO;
-            }
-            
-            avgPdr /= statsList.size();
-            avgDelay /= statsList.size();
-            avgThr /= statsList.size();
-            avgNro /= statsList.size();
+            const SeedAverages& sums = allResults[protocol][n];
+            double avgPdr = sums.pdr / sums.runs;
+            double avgDelay = sums.avgDelay / sums.runs;
+            double avgThr = sums.throughput / sums.runs;
+            double avgNro = sums.simulatedNRO / sums.runs;
             
             std::cout << std::setw(10) << protocol
                       << std::setw(10) << n
@@ -624,18 +1559,9 @@ int main(int argc, char *argv[])
     for (const auto& protocol : protocols) {
         for (uint32_t n : nodeCounts) {
             if (allResults[protocol].count(n) > 0) {
-                const auto& statsList = allResults[protocol][n];
-                
-                uint64_t avgControlPackets = 0;
-                uint64_t avgControlBytes = 0;
-                
-                for (const auto& stats : statsList) {
-                    avgControlPackets += stats.controlPackets;
-                    avgControlBytes += stats.controlBytes;
-                }
-                
-                avgControlPackets /= statsList.size();
-                avgControlBytes /= statsList.size();
+                const SeedAverages& sums = allResults[protocol][n];
+                uint64_t avgControlPackets = sums.controlPackets / sums.runs;
+                uint64_t avgControlBytes = sums.controlBytes / sums.runs;
                 
                 std::cout << std::setw(9) << protocol
                         << std::setw(8) << n
@@ -667,14 +1593,21 @@ int main(int argc, char *argv[])
             std::cout << proto << ": " << std::fixed << std::setprecision(2) << avgConv << std::endl;
             outFile   << proto << ": " << std::fixed << std::setprecision(2) << avgConv << "\n";
 
+        } else if (proto == "QTABLE") {
+            std::cout << proto << ": Not measured (static routes)" << std::endl;
+            outFile   << proto << ": -1\n";
         } else {
             std::cout << proto << ": Did not converge" << std::endl;
             outFile   << proto << ": -1\n";
         }
     }
     outFile.close();
+    tee_buffer.Flush();
     std::cout.rdbuf(original_cout);
     logFile.close();
+#ifdef NS3_MPI
+    MpiInterface::Disable();
+#endif
 
     return 0;
 }
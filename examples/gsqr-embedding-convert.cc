@@ -0,0 +1,61 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * File: gsqr-embedding-convert.cc
+ * Purpose: Convert embedding tables between the CSV written by
+ *          pytorch/train_embedding.py and the binary, memory-mapped format
+ * NS-3 Version: 3.41
+ * Usage:  ./ns3 run "gsqr-embedding-convert --input=outputs/emb_16.csv --output=emb_16.bin"
+ *    --input=FILE      : CSV or binary embedding table
+ *    --output=FILE     : Binary table, or CSV if the name ends in .csv
+ *    --precision=P     : float64, float32, fp16 or int8 (default: float64)
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/gsqr-embedding.h"
+#include <iostream>
+#include <string>
+
+using namespace ns3;
+
+int main(int argc, char *argv[])
+{
+    CommandLine cmd(__FILE__);
+    std::string input;
+    std::string output;
+    std::string precision = "float64";
+
+    cmd.AddValue("input", "CSV or binary embedding table", input);
+    cmd.AddValue("output", "Binary table, or CSV if the name ends in .csv", output);
+    cmd.AddValue("precision", "Storage precision: float64, float32, fp16 or int8", precision);
+    cmd.Parse(argc, argv);
+
+    if (input.empty() || output.empty()) {
+        std::cerr << "Both --input and --output are required" << std::endl;
+        return 1;
+    }
+    gsqr::Precision parsed;
+    if (!gsqr::ParsePrecision(precision, &parsed)) {
+        std::cerr << "Unknown precision " << precision << std::endl;
+        return 1;
+    }
+
+    Ptr<GsqrEmbedding> store = CreateObject<GsqrEmbedding>();
+    store->SetAttribute("Precision", StringValue(precision));
+    if (!store->LoadFromFile(input)) {
+        std::cerr << "Cannot load " << input << std::endl;
+        return 1;
+    }
+
+    bool toCsv = output.size() >= 4 && output.compare(output.size() - 4, 4, ".csv") == 0;
+    bool saved = toCsv ? store->SaveToCSV(output) : store->SaveToBinary(output);
+    if (!saved) {
+        std::cerr << "Cannot write " << output << std::endl;
+        return 1;
+    }
+
+    std::cout << "Wrote " << store->GetNumNodes() << " rows of dimension "
+              << store->GetEmbeddingDimension() << " (" << precision << ", "
+              << store->GetRowBytes() << " bytes per row) to " << output << std::endl;
+    return 0;
+}
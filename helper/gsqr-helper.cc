@@ -3,7 +3,11 @@
 #include "gsqr-helper.h"
 #include "ns3/gsqr-routing-protocol.h"
 #include "ns3/node.h"
+#include "ns3/ipv4.h"
+#include "ns3/ipv4-list-routing.h"
 #include "ns3/log.h"
+#include "ns3/boolean.h"
+#include "ns3/uinteger.h"
 
 namespace ns3
 {
@@ -34,6 +38,14 @@ GsqrHelper::Create(Ptr<Node> node) const
     
     Ptr<GsqrRoutingProtocol> protocol = m_factory.Create<GsqrRoutingProtocol>();
     
+    LoadEmbeddingBase();
+    if (m_embeddingBase) {
+        protocol->SetEmbeddingBase(m_embeddingBase);
+    }
+    if (m_checkpointWriter) {
+        protocol->SetCheckpointWriter(m_checkpointWriter);
+    }
+    
     node->AggregateObject(protocol);
     
     NS_LOG_INFO("GSQR routing protocol created for node " << node->GetId());
@@ -41,6 +53,23 @@ GsqrHelper::Create(Ptr<Node> node) const
     return protocol;
 }
 
+Ptr<const GsqrEmbedding>
+GsqrHelper::LoadEmbeddingBase() const
+{
+    if (!m_embeddingFile.empty() && !m_embeddingBase) {
+        NS_LOG_FUNCTION(this << m_embeddingFile);
+        m_embeddingBase = CreateObject<GsqrEmbedding>();
+        m_embeddingBase->SetAttribute("Precision", StringValue(m_embeddingPrecision));
+        if (m_embeddingBase->LoadFromFile(m_embeddingFile)) {
+            NS_LOG_INFO("Shared embedding base: " << m_embeddingBase->GetNumNodes()
+                        << " rows from " << m_embeddingFile);
+        } else {
+            NS_LOG_ERROR("Cannot load embedding file: " << m_embeddingFile);
+        }
+    }
+    return m_embeddingBase;
+}
+
 void GsqrHelper::Install(NodeContainer nodes) const
 {
     NS_LOG_FUNCTION(this);
@@ -60,6 +89,36 @@ void GsqrHelper::Install(Ptr<Node> node) const
     NS_LOG_INFO("GSQR routing protocol installed on node " << node->GetId());
 }
 
+int64_t GsqrHelper::AssignStreams(NodeContainer c, int64_t stream)
+{
+    NS_LOG_FUNCTION(this << stream);
+    int64_t currentStream = stream;
+    for (NodeContainer::Iterator i = c.Begin(); i != c.End(); ++i) {
+        Ptr<Ipv4> ipv4 = (*i)->GetObject<Ipv4>();
+        NS_ASSERT_MSG(ipv4, "Ipv4 not installed on node");
+        Ptr<Ipv4RoutingProtocol> proto = ipv4->GetRoutingProtocol();
+        NS_ASSERT_MSG(proto, "Ipv4 routing not installed on node");
+        Ptr<GsqrRoutingProtocol> gsqr = DynamicCast<GsqrRoutingProtocol>(proto);
+        if (gsqr) {
+            currentStream += gsqr->AssignStreams(currentStream);
+            continue;
+        }
+        // GSQR may also sit inside a list routing protocol
+        Ptr<Ipv4ListRouting> list = DynamicCast<Ipv4ListRouting>(proto);
+        if (list) {
+            int16_t priority;
+            for (uint32_t j = 0; j < list->GetNRoutingProtocols(); ++j) {
+                gsqr = DynamicCast<GsqrRoutingProtocol>(list->GetRoutingProtocol(j, priority));
+                if (gsqr) {
+                    currentStream += gsqr->AssignStreams(currentStream);
+                    break;
+                }
+            }
+        }
+    }
+    return currentStream - stream;
+}
+
 void GsqrHelper::SetLearningRate(double alpha)
 {
     NS_LOG_FUNCTION(this << alpha);
@@ -87,7 +146,36 @@ void GsqrHelper::SetUpdateInterval(double seconds)
 void GsqrHelper::SetEmbeddingFile(const std::string &filename)
 {
     NS_LOG_FUNCTION(this << filename);
-    m_factory.Set("EmbeddingFile", StringValue(filename));
+    m_embeddingFile = filename;
+    m_embeddingBase = nullptr;
+}
+
+void GsqrHelper::SetEmbeddingPrecision(const std::string &precision)
+{
+    NS_LOG_FUNCTION(this << precision);
+    m_factory.Set("EmbeddingPrecision", StringValue(precision));
+    m_embeddingPrecision = precision;
+    m_embeddingBase = nullptr;
+}
+
+void GsqrHelper::SetEmbeddingMemoryBudget(uint64_t bytes, const std::string &policy)
+{
+    NS_LOG_FUNCTION(this << bytes << policy);
+    m_factory.Set("EmbeddingMemoryBudget", UintegerValue(bytes));
+    m_factory.Set("EmbeddingEvictionPolicy", StringValue(policy));
+}
+
+void GsqrHelper::SetSageWeightsFile(const std::string &filename)
+{
+    NS_LOG_FUNCTION(this << filename);
+    m_factory.Set("SageWeightsFile", StringValue(filename));
+}
+
+void GsqrHelper::SetBatchTdUpdates(bool enable, bool average)
+{
+    NS_LOG_FUNCTION(this << enable << average);
+    m_factory.Set("BatchTdUpdates", BooleanValue(enable));
+    m_factory.Set("AverageTdBatch", BooleanValue(average));
 }
 
 void GsqrHelper::SetHelloInterval(Time interval)
@@ -96,4 +184,46 @@ void GsqrHelper::SetHelloInterval(Time interval)
     m_factory.Set("HelloInterval", TimeValue(interval));
 }
 
+void GsqrHelper::SetAdaptiveHello(Time minInterval, Time maxInterval)
+{
+    NS_LOG_FUNCTION(this << minInterval << maxInterval);
+    m_factory.Set("AdaptiveHello", BooleanValue(true));
+    m_factory.Set("HelloMinInterval", TimeValue(minInterval));
+    m_factory.Set("HelloMaxInterval", TimeValue(maxInterval));
+}
+
+void GsqrHelper::SetDeltaDissemination(const std::string &mode, double threshold)
+{
+    NS_LOG_FUNCTION(this << mode << threshold);
+    m_factory.Set("DisseminationMode", StringValue(mode));
+    m_factory.Set("DisseminationThreshold", DoubleValue(threshold));
+}
+
+void GsqrHelper::SetMultipath(uint32_t paths, const std::string &weighting)
+{
+    NS_LOG_FUNCTION(this << paths << weighting);
+    m_factory.Set("MultipathPaths", UintegerValue(paths));
+    m_factory.Set("MultipathWeighting", StringValue(weighting));
+}
+
+void GsqrHelper::SetCheckpoint(const std::string &directory, Time interval)
+{
+    NS_LOG_FUNCTION(this << directory << interval);
+    m_factory.Set("CheckpointDirectory", StringValue(directory));
+    m_factory.Set("CheckpointInterval", TimeValue(interval));
+    m_checkpointWriter = directory.empty() ? nullptr : CreateObject<GsqrCheckpointWriter>();
+}
+
+void GsqrHelper::SetWarmStart(const std::string &directory)
+{
+    NS_LOG_FUNCTION(this << directory);
+    m_factory.Set("WarmStartDirectory", StringValue(directory));
+}
+
+void GsqrHelper::SetInterfaceSelection(const std::string &mode)
+{
+    NS_LOG_FUNCTION(this << mode);
+    m_factory.Set("InterfaceSelection", StringValue(mode));
+}
+
 } // namespace ns3
\ No newline at end of file
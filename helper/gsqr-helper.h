@@ -7,6 +7,8 @@
 #include "ns3/ptr.h"
 #include "ns3/object-factory.h"
 #include "ns3/node-container.h"
+#include "ns3/gsqr-embedding.h"
+#include "ns3/gsqr-routing.h"
 #include <string>
 
 namespace ns3
@@ -24,15 +26,64 @@ public:
     void Install(NodeContainer nodes) const;
     void Install(Ptr<Node> node) const;
     
+    /**
+     * Assign a fixed random variable stream number to the random variables
+     * used by the GSQR protocols on the given nodes, which must already
+     * have their Internet stack installed. Return the number of streams
+     * that have been assigned.
+     */
+    int64_t AssignStreams(NodeContainer c, int64_t stream);
+    
     void SetLearningRate(double alpha);
     void SetDiscountFactor(double gamma);
     void SetEnergyWeight(double lambda);
     void SetUpdateInterval(double seconds);
+    /// TD steps applied once per UpdateInterval; averaged per pair if requested
+    void SetBatchTdUpdates(bool enable, bool average = false);
+    /**
+     * Pretrained table loaded once, on the first Create, and shared
+     * read-only by every protocol this helper (and its copies) creates.
+     */
     void SetEmbeddingFile(const std::string &filename);
+    /// float64 (default), float32, fp16 or int8
+    void SetEmbeddingPrecision(const std::string &precision);
+    /// Bounds each node's own rows; rarely used ones fall back to the shared table
+    void SetEmbeddingMemoryBudget(uint64_t bytes, const std::string &policy = "lru");
+    /// GraphSAGE weights from pytorch/train_embedding.py --weights
+    void SetSageWeightsFile(const std::string &filename);
     void SetHelloInterval(Time interval);
+    /// Trickle-style Hellos, backing off from minInterval to maxInterval
+    void SetAdaptiveHello(Time minInterval, Time maxInterval);
+    /// Changed embedding rows sent to neighbors: "hello", "message" or "none"
+    void SetDeltaDissemination(const std::string &mode, double threshold = 0.05);
+    /// Flows spread over the best paths by Q: weighting "softmax" or "queue"
+    void SetMultipath(uint32_t paths, const std::string &weighting = "softmax");
+    /**
+     * Each node's learned rows saved to directory every interval (zero: at
+     * the end only), by one writer thread shared with this helper's copies
+     * and drained when the last of them and of the protocols goes away.
+     */
+    void SetCheckpoint(const std::string &directory, Time interval = Seconds(0));
+    /// Starts every node from its checkpoint in directory, where there is one
+    void SetWarmStart(const std::string &directory);
+    /// Link to a neighbor heard on several interfaces: "spread" (default) or "best"
+    void SetInterfaceSelection(const std::string &mode);
+
+    /// The shared pretrained table, null until the first Create.
+    Ptr<const GsqrEmbedding> GetEmbeddingBase() const { return m_embeddingBase; }
+    /**
+     * Loads the shared table now rather than on the first Create, so that
+     * copies made afterwards (InternetStackHelper::SetRoutingHelper makes
+     * one) share it. Null without an embedding file.
+     */
+    Ptr<const GsqrEmbedding> LoadEmbeddingBase() const;
 
 private:
     ObjectFactory m_factory;
+    std::string m_embeddingFile;
+    std::string m_embeddingPrecision {"float64"};
+    mutable Ptr<GsqrEmbedding> m_embeddingBase; // loaded lazily; copies share it
+    Ptr<GsqrCheckpointWriter> m_checkpointWriter; // copies share it
 };
 
 } // namespace ns3
@@ -2,12 +2,20 @@
 
 #include "gsqr-embedding.h"
 #include "ns3/log.h"
+#include "ns3/fatal-error.h"
 #include "ns3/uinteger.h"      
 #include "ns3/double.h"       
 #include "ns3/string.h"       
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <algorithm>
+#include <cstring>
+#include <cctype>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 NS_LOG_COMPONENT_DEFINE ("GsqrEmbedding");
 
@@ -15,6 +23,50 @@ namespace ns3 {
 
 NS_OBJECT_ENSURE_REGISTERED (GsqrEmbedding);
 
+namespace {
+
+const char BINARY_MAGIC[8] = {'G', 'S', 'Q', 'R', 'E', 'M', 'B', '\0'};
+const uint32_t BINARY_VERSION = 1;
+
+// On-disk header of the binary format; see GsqrEmbedding
+struct BinaryHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t precision;
+    uint32_t stride;
+    uint32_t numRows;
+    uint32_t indexSize;
+    uint64_t indexOffset;
+    uint64_t nodesOffset;
+    uint64_t rowsOffset;
+    uint64_t reserved;
+};
+
+static_assert (sizeof (BinaryHeader) == 64, "binary embedding header must be 64 bytes");
+
+// Stands in for absent rows; covers the widest row, 64 doubles plus the bias, padded
+alignas(64) const uint8_t ZERO_ROW[576] = {0};
+
+// Whether count items of size bytes at offset lie within a file of fileBytes,
+// for header fields that may be garbage: neither sum nor product overflows
+bool FitsInFile(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileBytes)
+{
+    return offset <= fileBytes && count <= (fileBytes - offset) / size;
+}
+
+} // namespace
+
+void GsqrEmbedding::RowRelease::operator() (uint8_t* p) const
+{
+    if (mapping != nullptr) {
+        munmap(mapping, mappedBytes);
+    } else {
+        std::free(p);
+    }
+}
+
 TypeId 
 GsqrEmbedding::GetTypeId (void)
 {
@@ -25,8 +77,29 @@ GsqrEmbedding::GetTypeId (void)
         .AddAttribute ("Dimension",
                        "Dimension of embedding vectors",
                        UintegerValue (16),
-                       MakeUintegerAccessor (&GsqrEmbedding::m_dimension),
-                       MakeUintegerChecker<uint32_t> (1, 64))  
+                       MakeUintegerAccessor (&GsqrEmbedding::SetDimension,
+                                             &GsqrEmbedding::GetDimension),
+                       MakeUintegerChecker<uint32_t> (1, MAX_DIMENSION))
+        .AddAttribute ("Precision",
+                       "Storage precision of embedding rows: float64, float32, fp16 or int8",
+                       StringValue ("float64"),
+                       MakeStringAccessor (&GsqrEmbedding::SetPrecisionName,
+                                           &GsqrEmbedding::GetPrecisionName),
+                       MakeStringChecker ())
+        .AddAttribute ("MemoryBudget",
+                       "Bytes of local rows kept before rarely used ones are evicted "
+                       "and read from the base again; 0 for no limit",
+                       UintegerValue (0),
+                       MakeUintegerAccessor (&GsqrEmbedding::SetMemoryBudget,
+                                             &GsqrEmbedding::GetMemoryBudget),
+                       MakeUintegerChecker<uint64_t> ())
+        .AddAttribute ("EvictionPolicy",
+                       "Row evicted once the MemoryBudget is full: lru (least recently "
+                       "used) or lfu (least often used)",
+                       StringValue ("lru"),
+                       MakeStringAccessor (&GsqrEmbedding::SetEvictionPolicyName,
+                                           &GsqrEmbedding::GetEvictionPolicyName),
+                       MakeStringChecker ())
         ;
     return tid;
 }
@@ -41,6 +114,560 @@ GsqrEmbedding::~GsqrEmbedding ()
     NS_LOG_FUNCTION (this);
 }
 
+void GsqrEmbedding::SetFormat(gsqr::Precision precision, size_t dimension)
+{
+    NS_LOG_FUNCTION (this << gsqr::PrecisionName(precision) << dimension);
+    
+    m_format = gsqr::MakeRowFormat(precision, dimension);
+    m_kernel = &gsqr::GetQKernel(precision, dimension);
+    NS_LOG_DEBUG ("Dimension " << dimension << " " << gsqr::PrecisionName(precision)
+                  << " rows of " << m_format.stride << " bytes use the "
+                  << (m_kernel->dimension != 0 ? "specialized " : "generic ")
+                  << m_kernel->isa << " kernel");
+    
+    // The row layout changed, so any existing rows are meaningless
+    m_rows.reset();
+    m_capacity = 0;
+    m_nodeSlot.clear();
+    m_slotNode.clear();
+    m_slotShadow.clear();
+    m_shadow.clear();
+    m_slotAdvert.clear();
+    m_advert.clear();
+    m_slotDirty.clear();
+    m_dirtySlots.clear();
+    m_slotLastUse.clear();
+    m_slotUses.clear();
+    m_evictionQueue.clear();
+    m_base = nullptr;
+    m_numOverrides = 0;
+    UpdateRowLimit();
+}
+
+void GsqrEmbedding::SetBase(Ptr<const GsqrEmbedding> base)
+{
+    NS_LOG_FUNCTION (this << base);
+    
+    if (!base) {
+        m_base = nullptr;
+        m_numOverrides = 0;
+        return;
+    }
+    // Delta rows are copied byte for byte, so they take the base's layout
+    if (base->m_format.precision != m_format.precision) {
+        NS_LOG_INFO ("Using the base precision " << gsqr::PrecisionName(base->m_format.precision)
+                     << " instead of " << gsqr::PrecisionName(m_format.precision));
+    }
+    SetFormat(base->m_format.precision, base->m_format.dimension);
+    m_base = base;
+}
+
+void GsqrEmbedding::SetDimension(uint32_t dimension)
+{
+    SetFormat(m_format.precision, dimension);
+}
+
+void GsqrEmbedding::SetPrecisionName(std::string name)
+{
+    gsqr::Precision precision;
+    if (!gsqr::ParsePrecision(name, &precision)) {
+        NS_FATAL_ERROR ("Unknown embedding precision \"" << name
+                        << "\"; expected float64, float32, fp16 or int8");
+    }
+    if (precision != m_format.precision) {
+        SetFormat(precision, m_format.dimension);
+    }
+}
+
+void GsqrEmbedding::SetMemoryBudget(uint64_t bytes)
+{
+    m_memoryBudget = bytes;
+    UpdateRowLimit();
+}
+
+void GsqrEmbedding::SetEvictionPolicyName(std::string name)
+{
+    if (name == "lru") {
+        m_lfu = false;
+    } else if (name == "lfu") {
+        m_lfu = true;
+    } else {
+        NS_FATAL_ERROR ("Unknown embedding eviction policy \"" << name
+                        << "\"; expected lru or lfu");
+    }
+    // Queued under the other key
+    m_evictionQueue.clear();
+}
+
+void GsqrEmbedding::UpdateRowLimit()
+{
+    if (m_memoryBudget == 0) {
+        m_maxRows = 0;
+        return;
+    }
+    size_t rowBytes = m_format.stride;
+    if (m_kernel->td == nullptr) {
+        rowBytes += (m_format.dimension + 1) * sizeof(double);
+    }
+    m_maxRows = std::max<uint64_t>(m_memoryBudget / rowBytes, 1);
+    NS_LOG_DEBUG ("Memory budget of " << m_memoryBudget << " bytes holds "
+                  << m_maxRows << " rows of " << rowBytes << " bytes");
+}
+
+void GsqrEmbedding::Grow(size_t minRows)
+{
+    size_t newCapacity = std::max<size_t>(m_capacity * 2, 64);
+    while (newCapacity < minRows) {
+        newCapacity *= 2;
+    }
+    if (m_maxRows != 0) {
+        // Doubling would overshoot the budget
+        newCapacity = std::max(minRows, std::min(newCapacity, m_maxRows));
+    }
+    
+    // aligned_alloc wants a whole number of cache lines
+    size_t bytes = (newCapacity * m_format.stride + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    uint8_t* raw = static_cast<uint8_t*>(std::aligned_alloc(CACHE_LINE, bytes));
+    if (raw == nullptr) {
+        NS_FATAL_ERROR ("Cannot allocate " << bytes << " bytes for embedding table");
+    }
+    if (m_rows) {
+        std::memcpy(raw, m_rows.get(), m_slotNode.size() * m_format.stride);
+    }
+    m_rows = RowTable(raw, RowRelease());
+    m_capacity = newCapacity;
+}
+
+void GsqrEmbedding::Reserve(size_t numRows)
+{
+    if (numRows > m_capacity) {
+        Grow(numRows);
+    }
+}
+
+void GsqrEmbedding::Clear()
+{
+    m_nodeSlot.clear();
+    m_slotNode.clear();
+    m_slotShadow.clear();
+    m_shadow.clear();
+    m_slotAdvert.clear();
+    m_advert.clear();
+    m_slotDirty.clear();
+    m_dirtySlots.clear();
+    m_slotLastUse.clear();
+    m_slotUses.clear();
+    m_evictionQueue.clear();
+    m_numOverrides = 0;
+}
+
+uint8_t* GsqrEmbedding::GetOrCreateRow(uint32_t nodeId)
+{
+    uint32_t slot = FindSlot(nodeId);
+    if (slot != NO_SLOT) {
+        if (m_maxRows != 0) {
+            NoteUse(slot);
+        }
+        if (m_tracking) {
+            TrackSlot(slot);
+        }
+        return RowAt(slot);
+    }
+    
+    if (nodeId >= m_nodeSlot.size()) {
+        m_nodeSlot.resize(nodeId + 1, NO_SLOT);
+    }
+    bool reused = m_maxRows != 0 && m_slotNode.size() >= m_maxRows;
+    if (reused) {
+        slot = EvictSlot();
+        m_slotNode[slot] = nodeId;
+    } else {
+        if (m_slotNode.size() == m_capacity) {
+            Grow(m_capacity + 1);
+        }
+        slot = static_cast<uint32_t>(m_slotNode.size());
+        m_slotNode.push_back(nodeId);
+        m_slotShadow.push_back(NO_SLOT);
+        m_slotAdvert.push_back(NO_SLOT);
+        m_slotDirty.push_back(0);
+        m_slotLastUse.push_back(0);
+        m_slotUses.push_back(0);
+    }
+    m_nodeSlot[nodeId] = slot;
+    if (m_maxRows != 0) {
+        NoteUse(slot);
+        QueueForEviction(slot);
+    }
+    
+    // Copy on write from the base; otherwise all-zero bytes, which decode
+    // to h = 0, b = 0 in every precision
+    uint8_t* row = RowAt(slot);
+    const uint8_t* baseRow = m_base ? m_base->FindRow(nodeId) : nullptr;
+    if (baseRow != nullptr) {
+        std::memcpy(row, baseRow, m_format.stride);
+        ++m_numOverrides;
+    } else {
+        std::memset(row, 0, m_format.stride);
+    }
+    if (reused) {
+        // The shadow and advertised rows of the victim now describe this node
+        const size_t width = m_format.dimension + 1;
+        if (m_slotShadow[slot] != NO_SLOT) {
+            m_kernel->decode(row, &m_shadow[m_slotShadow[slot] * width], m_format.dimension);
+        }
+        if (m_slotAdvert[slot] != NO_SLOT) {
+            DecodeSlot(slot, &m_advert[m_slotAdvert[slot] * width]);
+        }
+    }
+    if (m_tracking) {
+        TrackSlot(slot);
+    }
+    return row;
+}
+
+bool GsqrEmbedding::EvictsAfter(const EvictionEntry& a, const EvictionEntry& b)
+{
+    // The fewest uses under LFU, then the oldest use, then the lowest slot
+    if (a.uses != b.uses) {
+        return a.uses > b.uses;
+    }
+    return a.lastUse != b.lastUse ? a.lastUse > b.lastUse : a.slot > b.slot;
+}
+
+void GsqrEmbedding::QueueForEviction(uint32_t slot)
+{
+    // Out of step, after a load or with rows added before the budget:
+    // EvictSlot queues every slot afresh
+    if (m_evictionQueue.size() + 1 != m_slotNode.size()) {
+        return;
+    }
+    m_evictionQueue.push_back(MakeEvictionEntry(slot));
+    std::push_heap(m_evictionQueue.begin(), m_evictionQueue.end(), EvictsAfter);
+}
+
+uint32_t GsqrEmbedding::EvictSlot()
+{
+    if (m_evictionQueue.size() != m_slotNode.size()) {
+        m_evictionQueue.clear();
+        for (uint32_t slot = 0; slot < m_slotNode.size(); ++slot) {
+            m_evictionQueue.push_back(MakeEvictionEntry(slot));
+        }
+        std::make_heap(m_evictionQueue.begin(), m_evictionQueue.end(), EvictsAfter);
+    }
+    
+    // Uses only raise a key, so they leave the queue alone: an entry found
+    // stale on top is requeued with its current key, a log per use at most
+    uint32_t victim;
+    while (true) {
+        std::pop_heap(m_evictionQueue.begin(), m_evictionQueue.end(), EvictsAfter);
+        EvictionEntry& top = m_evictionQueue.back();
+        EvictionEntry current = MakeEvictionEntry(top.slot);
+        if (current.uses == top.uses && current.lastUse == top.lastUse) {
+            victim = top.slot;
+            m_evictionQueue.pop_back();
+            break;
+        }
+        top = current;
+        std::push_heap(m_evictionQueue.begin(), m_evictionQueue.end(), EvictsAfter);
+    }
+    
+    uint32_t nodeId = m_slotNode[victim];
+    NS_LOG_LOGIC ("Evicting the row of node " << nodeId << " from slot " << victim);
+    m_nodeSlot[nodeId] = NO_SLOT;
+    if (m_base && m_base->HasRow(nodeId)) {
+        --m_numOverrides;
+    }
+    if (m_slotDirty[victim]) {
+        // Its unadvertised change is dropped with it
+        m_slotDirty[victim] = 0;
+        m_dirtySlots.erase(std::find(m_dirtySlots.begin(), m_dirtySlots.end(), victim));
+    }
+    // LFU with dynamic aging: the newcomer inherits the victim's count, so
+    // rows that stopped being used are eventually overtaken
+    if (!m_lfu) {
+        m_slotUses[victim] = 0;
+    }
+    if (m_evictedNodes.size() < EVICTION_LOG) {
+        m_evictedNodes.push_back(nodeId);
+    } else {
+        m_evictedNodes[m_numEvictions % EVICTION_LOG] = nodeId;
+    }
+    ++m_numEvictions;
+    return victim;
+}
+
+bool GsqrEmbedding::GetEvictedNode(uint64_t eviction, uint32_t* nodeId) const
+{
+    if (eviction >= m_numEvictions || m_numEvictions - eviction > m_evictedNodes.size()) {
+        return false;
+    }
+    *nodeId = m_evictedNodes[eviction % EVICTION_LOG];
+    return true;
+}
+
+double* GsqrEmbedding::EnsureShadow(uint32_t slot)
+{
+    const size_t dim = m_format.dimension;
+    if (m_slotShadow[slot] == NO_SLOT) {
+        m_slotShadow[slot] = static_cast<uint32_t>(m_shadow.size() / (dim + 1));
+        m_shadow.resize(m_shadow.size() + dim + 1);
+        m_kernel->decode(RowAt(slot), &m_shadow[m_slotShadow[slot] * (dim + 1)], dim);
+    }
+    return &m_shadow[m_slotShadow[slot] * (dim + 1)];
+}
+
+void GsqrEmbedding::TrackSlot(uint32_t slot)
+{
+    // The value before this write is what neighbors last heard about
+    const size_t width = m_format.dimension + 1;
+    if (m_slotAdvert[slot] == NO_SLOT) {
+        m_slotAdvert[slot] = static_cast<uint32_t>(m_advert.size() / width);
+        m_advert.resize(m_advert.size() + width);
+        DecodeSlot(slot, &m_advert[m_slotAdvert[slot] * width]);
+    }
+    if (!m_slotDirty[slot]) {
+        m_slotDirty[slot] = 1;
+        m_dirtySlots.push_back(slot);
+    }
+}
+
+void GsqrEmbedding::SetChangeTracking(bool enable)
+{
+    NS_LOG_FUNCTION (this << enable);
+    
+    // Advertised values are snapshot lazily, on the next write to a row
+    m_tracking = enable;
+    m_slotAdvert.assign(m_slotNode.size(), NO_SLOT);
+    m_advert.clear();
+    m_slotDirty.assign(m_slotNode.size(), 0);
+    m_dirtySlots.clear();
+}
+
+size_t GsqrEmbedding::CollectRowChanges(double threshold, size_t maxRows,
+                                        std::vector<uint32_t>& nodes, std::vector<double>& deltas)
+{
+    const size_t width = m_format.dimension + 1;
+    double current[MAX_DIMENSION + 1];
+    std::vector<std::pair<double, uint32_t>> changed;
+    for (uint32_t slot : m_dirtySlots) {
+        const double* advertised = &m_advert[m_slotAdvert[slot] * width];
+        DecodeSlot(slot, current);
+        double largest = 0.0;
+        for (size_t i = 0; i < width; ++i) {
+            largest = std::max(largest, std::abs(current[i] - advertised[i]));
+        }
+        if (largest >= threshold && largest > 0.0) {
+            changed.emplace_back(largest, slot);
+        }
+    }
+    // Ties go to the lower slot, so the pick is deterministic
+    std::sort(changed.begin(), changed.end(),
+              [](const std::pair<double, uint32_t>& a, const std::pair<double, uint32_t>& b) {
+                  return a.first != b.first ? a.first > b.first : a.second < b.second;
+              });
+    if (changed.size() > maxRows) {
+        changed.resize(maxRows);
+    }
+    
+    for (const auto& entry : changed) {
+        uint32_t slot = entry.second;
+        const double* advertised = &m_advert[m_slotAdvert[slot] * width];
+        DecodeSlot(slot, current);
+        nodes.push_back(m_slotNode[slot]);
+        for (size_t i = 0; i < width; ++i) {
+            deltas.push_back(current[i] - advertised[i]);
+        }
+    }
+    return changed.size();
+}
+
+void GsqrEmbedding::MarkAdvertised(uint32_t nodeId, const double* sent)
+{
+    uint32_t slot = FindSlot(nodeId);
+    if (slot == NO_SLOT || m_slotAdvert[slot] == NO_SLOT) {
+        return;
+    }
+    const size_t width = m_format.dimension + 1;
+    double* advertised = &m_advert[m_slotAdvert[slot] * width];
+    for (size_t i = 0; i < width; ++i) {
+        advertised[i] += sent[i];
+    }
+    
+    // Any quantization residue waits until the row is written again
+    m_slotDirty[slot] = 0;
+    m_dirtySlots.erase(std::find(m_dirtySlots.begin(), m_dirtySlots.end(), slot));
+}
+
+void GsqrEmbedding::ApplyRowDelta(uint32_t nodeId, const double* delta)
+{
+    const size_t width = m_format.dimension + 1;
+    uint32_t slot = FindSlot(nodeId);
+    bool wasDirty = slot != NO_SLOT && slot < m_slotDirty.size() && m_slotDirty[slot];
+    GetOrCreateRow(nodeId);
+    slot = FindSlot(nodeId);
+    
+    // Like a TD step, a small delta may be below fp16/int8 resolution
+    double row[MAX_DIMENSION + 1];
+    double* value = m_kernel->td != nullptr ? row : EnsureShadow(slot);
+    if (value == row) {
+        DecodeSlot(slot, row);
+    }
+    for (size_t i = 0; i < width; ++i) {
+        value[i] += delta[i];
+    }
+    m_kernel->encode(value, RowAt(slot), m_format.dimension);
+    
+    if (m_tracking) {
+        double* advertised = &m_advert[m_slotAdvert[slot] * width];
+        for (size_t i = 0; i < width; ++i) {
+            advertised[i] += delta[i];
+        }
+        if (!wasDirty) {
+            m_slotDirty[slot] = 0;
+            m_dirtySlots.pop_back();
+        }
+    }
+}
+
+void GsqrEmbedding::DecodeSlot(uint32_t slot, double* out) const
+{
+    if (m_slotShadow[slot] != NO_SLOT) {
+        const double* shadow = &m_shadow[m_slotShadow[slot] * (m_format.dimension + 1)];
+        std::copy(shadow, shadow + m_format.dimension + 1, out);
+        return;
+    }
+    m_kernel->decode(RowAt(slot), out, m_format.dimension);
+}
+
+void GsqrEmbedding::EncodeSlot(uint32_t slot, const double* in)
+{
+    if (m_slotShadow[slot] != NO_SLOT) {
+        double* shadow = &m_shadow[m_slotShadow[slot] * (m_format.dimension + 1)];
+        std::copy(in, in + m_format.dimension + 1, shadow);
+    }
+    m_kernel->encode(in, RowAt(slot), m_format.dimension);
+}
+
+bool GsqrEmbedding::ReadRow(uint32_t nodeId, double* out) const
+{
+    uint32_t slot = FindSlot(nodeId);
+    if (slot == NO_SLOT) {
+        return m_base && m_base->ReadRow(nodeId, out);
+    }
+    DecodeSlot(slot, out);
+    return true;
+}
+
+void GsqrEmbedding::WriteRow(uint32_t nodeId, const double* in)
+{
+    GetOrCreateRow(nodeId);
+    EncodeSlot(FindSlot(nodeId), in);
+}
+
+bool GsqrEmbedding::ComputeQ(uint32_t destId, uint32_t nodeId, double* q) const
+{
+    const uint8_t* h_d = FindRow(destId);
+    const uint8_t* h_n = FindRow(nodeId);
+    if (h_d == nullptr || h_n == nullptr) {
+        return false;
+    }
+    *q = m_kernel->q(h_d, h_n, m_format.dimension);
+    return true;
+}
+
+bool GsqrEmbedding::ApplyTd(uint32_t nodeId, uint32_t destId, double step)
+{
+    // The row is copied from the base or created here first; after that
+    // h_d is looked up, as the copy may have moved the table or evicted it
+    GetOrCreateRow(nodeId);
+    uint32_t slot = FindSlot(nodeId);
+    const uint8_t* destRow = FindRow(destId);
+    bool found = destRow != nullptr;
+    if (!found) {
+        destRow = ZERO_ROW;
+    }
+    
+    const size_t dim = m_format.dimension;
+    if (m_kernel->td != nullptr) {
+        m_kernel->td(RowAt(slot), destRow, step, dim);
+        return found;
+    }
+    
+    // fp16/int8: a single step is often below the storage resolution, so
+    // steps accumulate in a double shadow that is re-encoded each time
+    double h_d[MAX_DIMENSION + 1] = {0.0};
+    ReadRow(destId, h_d);
+    double* shadow = EnsureShadow(slot);
+    for (size_t i = 0; i < dim; ++i) {
+        shadow[i] += step * h_d[i];
+    }
+    shadow[dim] += step;
+    m_kernel->encode(shadow, RowAt(slot), dim);
+    return found;
+}
+
+size_t GsqrEmbedding::GetMemoryUsageBytes() const
+{
+    return m_capacity * m_format.stride
+           + m_shadow.capacity() * sizeof(double)
+           + m_slotShadow.capacity() * sizeof(uint32_t)
+           + m_nodeSlot.capacity() * sizeof(uint32_t)
+           + m_slotNode.capacity() * sizeof(uint32_t)
+           + m_slotLastUse.capacity() * sizeof(uint64_t)
+           + m_slotUses.capacity() * sizeof(uint32_t)
+           + m_evictionQueue.capacity() * sizeof(EvictionEntry)
+           + m_evictedNodes.capacity() * sizeof(uint32_t)
+           + m_slotAdvert.capacity() * sizeof(uint32_t)
+           + m_advert.capacity() * sizeof(double)
+           + m_slotDirty.capacity() * sizeof(uint8_t)
+           + m_dirtySlots.capacity() * sizeof(uint32_t);
+}
+
+size_t GsqrEmbedding::ArgmaxQ(uint32_t destId, const uint32_t* candidates, size_t n,
+                              double* bestQ) const
+{
+    const uint8_t* h_d = FindRow(destId);
+    if (h_d == nullptr) {
+        h_d = ZERO_ROW;
+    }
+    
+    const uint8_t* rows[BATCH];
+    size_t best = 0;
+    double bestValue = 0.0;
+    for (size_t base = 0; base < n; base += BATCH) {
+        size_t count = std::min(BATCH, n - base);
+        for (size_t i = 0; i < count; ++i) {
+            const uint8_t* row = FindRow(candidates[base + i]);
+            rows[i] = (row != nullptr) ? row : ZERO_ROW;
+        }
+        
+        double q;
+        size_t idx = m_kernel->argmax(h_d, rows, count, m_format.dimension, &q);
+        if (base == 0 || q > bestValue) {
+            bestValue = q;
+            best = base + idx;
+        }
+    }
+    
+    if (bestQ != nullptr) {
+        *bestQ = bestValue;
+    }
+    return best;
+}
+
+void GsqrEmbedding::ScoreQ(uint32_t destId, const uint32_t* candidates, size_t n,
+                           double* q) const
+{
+    const uint8_t* h_d = FindRow(destId);
+    if (h_d == nullptr) {
+        h_d = ZERO_ROW;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        const uint8_t* row = FindRow(candidates[i]);
+        q[i] = m_kernel->q(h_d, (row != nullptr) ? row : ZERO_ROW, m_format.dimension);
+    }
+}
+
 bool GsqrEmbedding::LoadFromCSV(const std::string& filename)
 {
     NS_LOG_FUNCTION (this << filename);
@@ -52,13 +679,31 @@ bool GsqrEmbedding::LoadFromCSV(const std::string& filename)
     }
     
     std::string line;
-    m_embeddings.clear();
-    m_biases.clear();
+    std::vector<double> embedding;
+    Clear();
     
-    while (std::getline(file, line)) {
+    // The first line fixes the dimension: node id, h_0 .. h_{dim-1}, bias.
+    // train_embedding.py writes it as a header (node_id,h0,...,bias)
+    if (std::getline(file, line)) {
+        size_t columns = std::count(line.begin(), line.end(), ',') + 1;
+        if (columns >= 3 && columns - 2 <= MAX_DIMENSION && columns - 2 != m_format.dimension) {
+            NS_LOG_INFO ("Embedding file " << filename << " has dimension " << columns - 2);
+            SetDimension(static_cast<uint32_t>(columns - 2));
+        }
+        if (line.empty() || !std::isdigit(static_cast<unsigned char>(line[0]))) {
+            line.clear();
+        }
+    }
+    const size_t dim = m_format.dimension;
+    embedding.reserve(dim + 1);
+    // The file is kept whole; the budget only bounds the rows added later
+    m_maxRows = 0;
+    
+    bool pending = !line.empty();
+    while (pending || std::getline(file, line)) {
+        pending = false;
         std::stringstream ss(line);
         std::string item;
-        std::vector<double> embedding;
         
         if (!std::getline(ss, item, ',')) {
             NS_LOG_WARN ("Invalid line format: " << line);
@@ -74,7 +719,7 @@ bool GsqrEmbedding::LoadFromCSV(const std::string& filename)
         }
         
         embedding.clear();
-        for (int i = 0; i < 16; ++i) {
+        for (size_t i = 0; i < dim; ++i) {
             if (!std::getline(ss, item, ',')) {
                 NS_LOG_WARN ("Incomplete embedding for node " << nodeId);
                 break;
@@ -87,7 +732,7 @@ bool GsqrEmbedding::LoadFromCSV(const std::string& filename)
             }
         }
         
-        if (embedding.size() != 16) {
+        if (embedding.size() != dim) {
             NS_LOG_WARN ("Embedding dimension mismatch for node " << nodeId);
             continue;
         }
@@ -105,19 +750,24 @@ bool GsqrEmbedding::LoadFromCSV(const std::string& filename)
             bias = 0.0;
         }
         
-        m_embeddings[nodeId] = embedding;
-        m_biases[nodeId] = bias;
+        embedding.push_back(bias);
+        WriteRow(nodeId, embedding.data());
         
         NS_LOG_DEBUG ("Loaded embedding for node " << nodeId << 
                      ", bias: " << bias);
     }
     
     file.close();
-    NS_LOG_INFO ("Loaded " << m_embeddings.size() << " embeddings from " << filename);
+    UpdateRowLimit();
+    if (m_tracking) {
+        // A freshly loaded table is what every neighbor starts from
+        SetChangeTracking(true);
+    }
+    NS_LOG_INFO ("Loaded " << GetNumNodes() << " embeddings from " << filename);
     return true;
 }
 
-bool GsqrEmbedding::SaveToCSV(const std::string& filename)
+bool GsqrEmbedding::SaveToCSV(const std::string& filename) const
 {
     NS_LOG_FUNCTION (this << filename);
     
@@ -127,48 +777,269 @@ bool GsqrEmbedding::SaveToCSV(const std::string& filename)
         return false;
     }
     
-    for (const auto& entry : m_embeddings) {
-        uint32_t nodeId = entry.first;
-        const auto& embedding = entry.second;
-        
-        if (embedding.size() != 16) {
-            NS_LOG_WARN ("Embedding dimension mismatch for node " << nodeId);
-            continue;
-        }
+    const size_t dim = m_format.dimension;
+    std::vector<double> row(dim + 1);
+    for (uint32_t nodeId : CollectNodes()) {
+        ReadRow(nodeId, row.data());
         
         file << nodeId;
-        for (double val : embedding) {
-            file << "," << val;
+        for (size_t i = 0; i < dim; ++i) {
+            file << "," << row[i];
         }
-        
-        auto biasIt = m_biases.find(nodeId);
-        double bias = (biasIt != m_biases.end()) ? biasIt->second : 0.0;
-        file << "," << bias << "\n";
+        file << "," << row[dim] << "\n";
     }
     
     file.close();
-    NS_LOG_INFO ("Saved " << m_embeddings.size() << " embeddings to " << filename);
+    NS_LOG_INFO ("Saved " << GetNumNodes() << " embeddings to " << filename);
     return true;
 }
 
-const std::vector<double>& GsqrEmbedding::GetEmbedding(uint32_t nodeId) const
+bool GsqrEmbedding::LoadFromBinary(const std::string& filename)
 {
-    auto it = m_embeddings.find(nodeId);
-    if (it != m_embeddings.end()) {
-        return it->second;
+    NS_LOG_FUNCTION (this << filename);
+    
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        NS_LOG_ERROR ("Cannot open embedding file: " << filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(BinaryHeader)) {
+        NS_LOG_ERROR ("Embedding file too short: " << filename);
+        close(fd);
+        return false;
     }
     
-    // Returns a zero vector if the node has no pre-trained embeddings
-    NS_LOG_WARN ("No embedding found for node " << nodeId << ", using zero vector");
-    static const std::vector<double> zeroVector(16, 0.0);
-    return zeroVector;
+    // Private and writable: TD steps on mapped rows copy the page, never the file
+    size_t bytes = static_cast<size_t>(st.st_size);
+    void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        NS_LOG_ERROR ("Cannot map embedding file: " << filename);
+        return false;
+    }
+    RowTable file(static_cast<uint8_t*>(mapping), RowRelease{mapping, bytes});
+    
+    const uint8_t* base = file.get();
+    const BinaryHeader* header = reinterpret_cast<const BinaryHeader*>(base);
+    if (std::memcmp(header->magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) != 0
+        || header->version != BINARY_VERSION) {
+        NS_LOG_ERROR ("Not a version " << BINARY_VERSION << " binary embedding file: " << filename);
+        return false;
+    }
+    if (header->dimension < 1 || header->dimension > MAX_DIMENSION
+        || header->precision > static_cast<uint32_t>(gsqr::Precision::INT8)) {
+        NS_LOG_ERROR ("Unsupported dimension " << header->dimension << " or precision "
+                      << header->precision << " in " << filename);
+        return false;
+    }
+    
+    gsqr::Precision precision = static_cast<gsqr::Precision>(header->precision);
+    gsqr::RowFormat format = gsqr::MakeRowFormat(precision, header->dimension);
+    uint64_t numRows = header->numRows;
+    if (header->stride != format.stride
+        || header->rowsOffset % CACHE_LINE != 0
+        || header->indexOffset % sizeof(uint32_t) != 0
+        || header->nodesOffset % sizeof(uint32_t) != 0
+        || !FitsInFile(header->indexOffset, header->indexSize, sizeof(uint32_t), bytes)
+        || !FitsInFile(header->nodesOffset, numRows, sizeof(uint32_t), bytes)
+        || !FitsInFile(header->rowsOffset, numRows, format.stride, bytes)) {
+        NS_LOG_ERROR ("Corrupt binary embedding file: " << filename);
+        return false;
+    }
+    
+    // Slots and ids must map one to one: a stray index entry would send
+    // lookups past the rows or to another node's row
+    const uint32_t* index = reinterpret_cast<const uint32_t*>(base + header->indexOffset);
+    const uint32_t* nodes = reinterpret_cast<const uint32_t*>(base + header->nodesOffset);
+    for (uint64_t slot = 0; slot < numRows; ++slot) {
+        uint32_t nodeId = nodes[slot];
+        if (nodeId >= header->indexSize || index[nodeId] != slot) {
+            NS_LOG_ERROR ("Inconsistent id tables in binary embedding file: " << filename);
+            return false;
+        }
+    }
+    for (uint32_t nodeId = 0; nodeId < header->indexSize; ++nodeId) {
+        if (index[nodeId] != NO_SLOT && (index[nodeId] >= numRows || nodes[index[nodeId]] != nodeId)) {
+            NS_LOG_ERROR ("Inconsistent id tables in binary embedding file: " << filename);
+            return false;
+        }
+    }
+    
+    // The file fixes the dimension, the Precision attribute the storage
+    gsqr::Precision wanted = m_format.precision;
+    SetFormat(wanted, header->dimension);
+    m_nodeSlot.assign(index, index + header->indexSize);
+    m_slotNode.assign(nodes, nodes + numRows);
+    m_slotShadow.assign(numRows, NO_SLOT);
+    m_slotAdvert.assign(numRows, NO_SLOT);
+    m_slotDirty.assign(numRows, 0);
+    m_slotLastUse.assign(numRows, 0);
+    m_slotUses.assign(numRows, 0);
+    m_evictionQueue.clear();
+    
+    if (precision == wanted) {
+        // Zero copy: the table is the mapped file from the first row on;
+        // the mapping goes once the table grows or is replaced
+        uint8_t* rows = file.get() + header->rowsOffset;
+        RowRelease release = file.get_deleter();
+        file.release();
+        m_rows = RowTable(rows, release);
+        m_capacity = numRows;
+    } else {
+        // Re-encode into our precision; the mapping is dropped on return
+        const gsqr::QKernel& fileKernel = gsqr::GetQKernel(precision, header->dimension);
+        Reserve(numRows);
+        double row[MAX_DIMENSION + 1];
+        for (uint32_t slot = 0; slot < numRows; ++slot) {
+            fileKernel.decode(base + header->rowsOffset + slot * format.stride, row, header->dimension);
+            std::memset(RowAt(slot), 0, m_format.stride);
+            m_kernel->encode(row, RowAt(slot), header->dimension);
+        }
+        NS_LOG_INFO ("Converted " << filename << " from " << gsqr::PrecisionName(precision)
+                     << " to " << gsqr::PrecisionName(wanted));
+    }
+    
+    NS_LOG_INFO ("Mapped " << GetNumNodes() << " embeddings from " << filename);
+    return true;
+}
+
+bool GsqrEmbedding::SaveToBinary(const std::string& filename) const
+{
+    NS_LOG_FUNCTION (this << filename);
+    
+    std::ofstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        NS_LOG_ERROR ("Cannot create file: " << filename);
+        return false;
+    }
+    if (!WriteBinary(file, false)) {
+        NS_LOG_ERROR ("Error writing " << filename);
+        return false;
+    }
+    NS_LOG_INFO ("Saved " << GetNumNodes() << " embeddings to " << filename);
+    return true;
+}
+
+std::string GsqrEmbedding::EncodeLocalRows() const
+{
+    NS_LOG_FUNCTION (this);
+    
+    std::ostringstream image(std::ios::binary);
+    WriteBinary(image, true);
+    return image.str();
+}
+
+size_t GsqrEmbedding::MergeRows(const GsqrEmbedding& other)
+{
+    NS_LOG_FUNCTION (this << other.GetNumNodes());
+    
+    if (other.m_format.dimension != m_format.dimension) {
+        NS_LOG_ERROR ("Cannot merge rows of dimension " << other.m_format.dimension
+                      << " into dimension " << m_format.dimension);
+        return 0;
+    }
+    std::vector<uint32_t> nodes = other.CollectNodes();
+    double row[MAX_DIMENSION + 1];
+    for (uint32_t nodeId : nodes) {
+        other.ReadRow(nodeId, row);
+        WriteRow(nodeId, row);
+    }
+    return nodes.size();
+}
+
+bool GsqrEmbedding::WriteBinary(std::ostream& file, bool localOnly) const
+{
+    // The merged view: base rows with the local ones written over them.
+    // Local slots hold their rows back to back in slot order
+    bool contiguous = localOnly || !m_base;
+    std::vector<uint32_t> nodes = contiguous ? m_slotNode : CollectNodes();
+    std::vector<uint32_t> index;
+    for (uint32_t slot = 0; slot < nodes.size(); ++slot) {
+        if (nodes[slot] >= index.size()) {
+            index.resize(nodes[slot] + 1, NO_SLOT);
+        }
+        index[nodes[slot]] = slot;
+    }
+    
+    BinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BINARY_MAGIC, sizeof(BINARY_MAGIC));
+    header.version = BINARY_VERSION;
+    header.dimension = static_cast<uint32_t>(m_format.dimension);
+    header.precision = static_cast<uint32_t>(m_format.precision);
+    header.stride = static_cast<uint32_t>(m_format.stride);
+    header.numRows = static_cast<uint32_t>(nodes.size());
+    header.indexSize = static_cast<uint32_t>(index.size());
+    header.indexOffset = sizeof(BinaryHeader);
+    header.nodesOffset = header.indexOffset + index.size() * sizeof(uint32_t);
+    uint64_t nodesEnd = header.nodesOffset + nodes.size() * sizeof(uint32_t);
+    header.rowsOffset = (nodesEnd + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    
+    static const char padding[CACHE_LINE] = {0};
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint32_t));
+    file.write(reinterpret_cast<const char*>(nodes.data()), nodes.size() * sizeof(uint32_t));
+    file.write(padding, header.rowsOffset - nodesEnd);
+    if (contiguous) {
+        if (!nodes.empty()) {
+            file.write(reinterpret_cast<const char*>(RowAt(0)), nodes.size() * m_format.stride);
+        }
+    } else {
+        for (uint32_t nodeId : nodes) {
+            file.write(reinterpret_cast<const char*>(FindRow(nodeId)), m_format.stride);
+        }
+    }
+    return file.good();
+}
+
+std::vector<uint32_t> GsqrEmbedding::CollectNodes() const
+{
+    if (!m_base) {
+        return m_slotNode;
+    }
+    std::vector<uint32_t> nodes = m_base->CollectNodes();
+    for (uint32_t nodeId : m_slotNode) {
+        if (!m_base->HasRow(nodeId)) {
+            nodes.push_back(nodeId);
+        }
+    }
+    return nodes;
+}
+
+bool GsqrEmbedding::LoadFromFile(const std::string& filename)
+{
+    char magic[sizeof(BINARY_MAGIC)] = {0};
+    {
+        std::ifstream probe(filename, std::ios::binary);
+        if (!probe.is_open()) {
+            NS_LOG_ERROR ("Cannot open embedding file: " << filename);
+            return false;
+        }
+        probe.read(magic, sizeof(magic));
+    }
+    if (std::memcmp(magic, BINARY_MAGIC, sizeof(BINARY_MAGIC)) == 0) {
+        return LoadFromBinary(filename);
+    }
+    return LoadFromCSV(filename);
+}
+
+std::vector<double> GsqrEmbedding::GetEmbedding(uint32_t nodeId) const
+{
+    std::vector<double> row(m_format.dimension + 1, 0.0);
+    if (!ReadRow(nodeId, row.data())) {
+        // Returns a zero vector if the node has no pre-trained embeddings
+        NS_LOG_WARN ("No embedding found for node " << nodeId << ", using zero vector");
+    }
+    row.pop_back();
+    return row;
 }
 
 double GsqrEmbedding::GetBias(uint32_t nodeId) const
 {
-    auto it = m_biases.find(nodeId);
-    if (it != m_biases.end()) {
-        return it->second;
+    double row[MAX_DIMENSION + 1];
+    if (ReadRow(nodeId, row)) {
+        return row[m_format.dimension];
     }
     
     NS_LOG_WARN ("No bias found for node " << nodeId << ", using 0.0");
@@ -177,47 +1048,57 @@ double GsqrEmbedding::GetBias(uint32_t nodeId) const
 
 void GsqrEmbedding::SetEmbedding(uint32_t nodeId, const std::vector<double>& embedding)
 {
-    if (embedding.size() != 16) {
-        NS_LOG_ERROR ("Embedding dimension must be 16, got " << embedding.size());
+    const size_t dim = m_format.dimension;
+    if (embedding.size() != dim) {
+        NS_LOG_ERROR ("Embedding dimension must be " << dim << ", got " << embedding.size());
         return;
     }
-    m_embeddings[nodeId] = embedding;
+    double row[MAX_DIMENSION + 1] = {0.0};
+    ReadRow(nodeId, row);
+    std::copy(embedding.begin(), embedding.end(), row);
+    WriteRow(nodeId, row);
 }
 
 void GsqrEmbedding::SetBias(uint32_t nodeId, double bias)
 {
-    m_biases[nodeId] = bias;
+    double row[MAX_DIMENSION + 1] = {0.0};
+    ReadRow(nodeId, row);
+    row[m_format.dimension] = bias;
+    WriteRow(nodeId, row);
 }
 
 void GsqrEmbedding::UpdateEmbedding(uint32_t nodeId, 
                                    const std::vector<double>& gradient, 
                                    double learningRate)
 {
-    auto it = m_embeddings.find(nodeId);
-    if (it == m_embeddings.end()) {
-        // Create a zero vector if the node has no initial embedding
-        m_embeddings[nodeId] = std::vector<double>(16, 0.0);
-        it = m_embeddings.find(nodeId);
-    }
-    
     // Check gradient dimensions
-    if (gradient.size() != 16) {
-        NS_LOG_ERROR ("Gradient dimension must be 16, got " << gradient.size());
+    const size_t dim = m_format.dimension;
+    if (gradient.size() != dim) {
+        NS_LOG_ERROR ("Gradient dimension must be " << dim << ", got " << gradient.size());
         return;
     }
     
+    // Starts from a zero vector if the node has no initial embedding
+    double row[MAX_DIMENSION + 1] = {0.0};
+    ReadRow(nodeId, row);
+    
     //  h = h + α * gradient
-    for (size_t i = 0; i < 16; ++i) {
-        it->second[i] += learningRate * gradient[i];
+    for (size_t i = 0; i < dim; ++i) {
+        row[i] += learningRate * gradient[i];
     }
+    WriteRow(nodeId, row);
     
     NS_LOG_DEBUG ("Updated embedding for node " << nodeId);
 }
 
 void GsqrEmbedding::UpdateBias(uint32_t nodeId, double gradient, double learningRate)
 {
-    m_biases[nodeId] += learningRate * gradient;
-    NS_LOG_DEBUG ("Updated bias for node " << nodeId << " to " << m_biases[nodeId]);
+    double row[MAX_DIMENSION + 1] = {0.0};
+    ReadRow(nodeId, row);
+    double& bias = row[m_format.dimension];
+    bias += learningRate * gradient;
+    WriteRow(nodeId, row);
+    NS_LOG_DEBUG ("Updated bias for node " << nodeId << " to " << bias);
 }
 
-} // namespace ns3
\ No newline at end of file
+} // namespace ns3
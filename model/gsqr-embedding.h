@@ -5,9 +5,11 @@
 
 #include "ns3/object.h"
 #include "ns3/ptr.h"
+#include "gsqr-q-kernel.h"
 #include <vector>
-#include <map>
+#include <memory>
 #include <string>
+#include <cstdlib>
 #include <cstdint>
 
 namespace ns3 {
@@ -15,39 +17,319 @@ namespace ns3 {
 /**
  * \ingroup gsqr
  * \brief Classes for Managing GraphSAGE Embedded Vectors
- * 
- * Responsible for loading/saving embedded vectors from CSV files 
+ *
+ * Responsible for loading/saving embedded vectors from CSV files
  * and providing embedded query and update interfaces
+ *
+ * Rows live in one flat, row-major table. Each row holds the embedding
+ * h followed by its bias b, stored in the precision set by the Precision
+ * attribute (see gsqr::RowFormat), and is padded so a row never straddles
+ * a cache line it does not need. Node ids are mapped to row slots through
+ * a dense vector, which makes a lookup a single index operation.
+ * GsqrRouting reads the same table directly.
+ *
+ * Q values are computed in the storage domain. TD steps are applied in
+ * place for float64 and float32 rows; fp16 and int8 rows that receive
+ * updates get a double shadow row, which accumulates the steps and is
+ * re-encoded into the stored row after each one.
+ *
+ * The dimension is taken from the column count of the loaded file (or the
+ * Dimension attribute) and selects the matching gsqr::QKernel, which is
+ * specialized for 8, 16 and 32.
+ *
+ * Besides CSV the table can be saved to and loaded from a binary file,
+ * little-endian, laid out as
+ *
+ *     offset  bytes
+ *          0      8  magic "GSQREMB\0"
+ *          8      4  version (1)
+ *         12      4  dimension
+ *         16      4  precision (gsqr::Precision)
+ *         20      4  stride, bytes per row
+ *         24      4  row count
+ *         28      4  index size, node ids covered by the id-to-slot table
+ *         32      8  offset of the id-to-slot table (uint32, 0xffffffff if absent)
+ *         40      8  offset of the slot-to-id table (uint32 per row)
+ *         48      8  offset of the rows, 64-byte aligned, in gsqr::RowFormat
+ *         56      8  reserved, 0
+ *
+ * LoadFromBinary maps the file privately and uses its rows in place; pages
+ * are copied by the kernel only when a TD step writes to them. Only the
+ * two index tables are copied out.
+ *
+ * A table can also sit on top of a shared, read-only base (SetBase): reads
+ * fall through to the base for nodes without a local row, and the first
+ * write to such a node copies its base row into the local table. Each node
+ * then holds only the rows it has learned on, while GsqrHelper loads the
+ * pretrained table once for the whole simulation.
+ *
+ * With change tracking on, every row handed out for writing is marked
+ * dirty and remembers, in double precision, the value it had when last
+ * advertised. CollectRowChanges then yields only the rows that moved by at
+ * least a threshold since, for delta dissemination to neighbors.
+ *
+ * A MemoryBudget bounds the local rows. Each counts at its padded bytes,
+ * plus a double shadow for fp16 and int8, whose rows may need one. Once
+ * the budget is full, a new row takes the slot of the least recently
+ * used row (EvictionPolicy lru) or of the least often used one (lfu,
+ * with dynamic aging: the newcomer starts from the victim's count). Reads
+ * of an evicted node fall through to the base again, so an evicted row is
+ * re-derived from the pretrained table on demand; without a base it
+ * reverts to zero. Rows loaded from a file are kept whole and only give
+ * way to rows created later. Victims come off a heap in O(log rows), and
+ * GetEvictedNode names recent ones, so that users memoizing Q can drop
+ * just what read them.
  */
 class GsqrEmbedding : public Object
 {
 public:
     static TypeId GetTypeId (void);
-    
+
     GsqrEmbedding ();
     virtual ~GsqrEmbedding ();
-    
+
     bool LoadFromCSV (const std::string& filename);
-    bool SaveToCSV (const std::string& filename);
-    
-    const std::vector<double>& GetEmbedding (uint32_t nodeId) const;
+    bool SaveToCSV (const std::string& filename) const;
+    /// Loads a binary table; rows are converted if its precision differs from ours.
+    bool LoadFromBinary (const std::string& filename);
+    bool SaveToBinary (const std::string& filename) const;
+    /**
+     * The binary file image of the rows this table holds itself, without
+     * those it reads from its base (all rows if it has none). Built on the
+     * simulation thread, so that a checkpoint can be written on another.
+     */
+    std::string EncodeLocalRows () const;
+    /**
+     * Writes every row of other into this table, as WriteRow would, so the
+     * base and the MemoryBudget apply. Returns the rows written; none if
+     * the dimensions differ.
+     */
+    size_t MergeRows (const GsqrEmbedding& other);
+    /// Loads a binary table if the file starts with the binary magic, CSV otherwise.
+    bool LoadFromFile (const std::string& filename);
+
+    /// Returns the embedding h of nodeId (zeros if absent).
+    std::vector<double> GetEmbedding (uint32_t nodeId) const;
     double GetBias (uint32_t nodeId) const;
-    
+
     void SetEmbedding (uint32_t nodeId, const std::vector<double>& embedding);
     void SetBias (uint32_t nodeId, double bias);
-    
+
     void UpdateEmbedding (uint32_t nodeId, const std::vector<double>& gradient, double learningRate);
     void UpdateBias (uint32_t nodeId, double gradient, double learningRate);
-    
-    size_t GetEmbeddingDimension () const { return m_dimension; }
-    size_t GetNumNodes () const { return m_embeddings.size (); }
-    
+
+    /// Decodes the row of nodeId into dim + 1 doubles (h, then b); false if absent.
+    bool ReadRow (uint32_t nodeId, double* out) const;
+    /// Encodes dim + 1 doubles (h, then b) into the row of nodeId, creating it if needed.
+    void WriteRow (uint32_t nodeId, const double* in);
+
+    /// Stored row of nodeId in the current gsqr::RowFormat (local, else base), or nullptr.
+    const uint8_t* FindRow (uint32_t nodeId) const
+    {
+        uint32_t slot = FindSlot (nodeId);
+        if (slot != NO_SLOT) {
+            if (m_maxRows != 0) {
+                NoteUse (slot);
+            }
+            return RowAt (slot);
+        }
+        return m_base ? m_base->FindRow (nodeId) : nullptr;
+    }
+    /**
+     * Local row of nodeId. A missing row is copied from the base if the base
+     * has one, and created as all zeros otherwise.
+     */
+    uint8_t* GetOrCreateRow (uint32_t nodeId);
+    bool HasRow (uint32_t nodeId) const { return FindRow (nodeId) != nullptr; }
+    /// True if nodeId has a row of its own, not just one in the base.
+    bool HasLocalRow (uint32_t nodeId) const { return FindSlot (nodeId) != NO_SLOT; }
+
+    /**
+     * Reads rows missing here from base, which is never written to. Drops
+     * the local rows and adopts the base's dimension and precision. A null
+     * base detaches it.
+     */
+    void SetBase (Ptr<const GsqrEmbedding> base);
+    Ptr<const GsqrEmbedding> GetBase () const { return m_base; }
+
+    /// Q = h_d^T h_n + b_n for one pair; false if either row is absent.
+    bool ComputeQ (uint32_t destId, uint32_t nodeId, double* q) const;
+    /**
+     * TD step on the row of nodeId: h_n += step * h_d, b_n += step. The
+     * row is created on first use; an absent h_d counts as zero, and then
+     * only b_n moves and false is returned.
+     */
+    bool ApplyTd (uint32_t nodeId, uint32_t destId, double step);
+
+    /**
+     * Scores Q = h_d^T h_n + b_n for every candidate n against the row of
+     * destId in one batched pass and returns the index of the best candidate
+     * (the first on ties). Missing rows score as zero rows. No allocation.
+     * n must be > 0; bestQ may be null.
+     */
+    size_t ArgmaxQ (uint32_t destId, const uint32_t* candidates, size_t n, double* bestQ) const;
+    /// Q of every candidate into q[0..n), with ArgmaxQ's treatment of missing rows.
+    void ScoreQ (uint32_t destId, const uint32_t* candidates, size_t n, double* q) const;
+    /// Starts or stops dirty-row tracking; starting treats every row as advertised.
+    void SetChangeTracking (bool enable);
+    bool GetChangeTracking () const { return m_tracking; }
+    /**
+     * Dirty rows whose largest element changed by at least threshold since
+     * last advertised, largest change first, at most maxRows. Appends their
+     * ids to nodes and their changes, dim + 1 doubles each, to deltas.
+     */
+    size_t CollectRowChanges (double threshold, size_t maxRows,
+                              std::vector<uint32_t>& nodes, std::vector<double>& deltas);
+    /**
+     * Records that sent (dim + 1 doubles, as the receivers decode it) was
+     * advertised for nodeId; what was not sent stays as pending change.
+     */
+    void MarkAdvertised (uint32_t nodeId, const double* sent);
+    /**
+     * Adds delta (dim + 1 doubles) to the row of nodeId, creating it if
+     * needed. The change was learned elsewhere, so it is not advertised
+     * again.
+     */
+    void ApplyRowDelta (uint32_t nodeId, const double* delta);
+    /// Rows currently marked dirty.
+    size_t GetNumDirtyRows () const { return m_dirtySlots.size (); }
+
+    /// Local rows the MemoryBudget allows; 0 if unbounded.
+    size_t GetMaxRows () const { return m_maxRows; }
+    /// Rows evicted to stay within the MemoryBudget so far.
+    uint64_t GetNumEvictions () const { return m_numEvictions; }
+    /**
+     * Node whose row was evicted by eviction number eviction, counting from
+     * 0. Only the last EVICTION_LOG are kept; false for older ones.
+     */
+    bool GetEvictedNode (uint64_t eviction, uint32_t* nodeId) const;
+    static constexpr uint32_t EVICTION_LOG = 64;
+
+    /// Drops all local rows (the base stays); keeps the allocated capacity.
+    void Clear ();
+    /// Pre-allocates room for numRows rows.
+    void Reserve (size_t numRows);
+
+    size_t GetEmbeddingDimension () const { return m_format.dimension; }
+    gsqr::Precision GetPrecision () const { return m_format.precision; }
+    const gsqr::RowFormat& GetRowFormat () const { return m_format; }
+    /// Q/TD kernel for the current dimension and precision.
+    const gsqr::QKernel& GetKernel () const { return *m_kernel; }
+    /// Nodes with a row, local or in the base.
+    size_t GetNumNodes () const
+    {
+        return m_slotNode.size () + (m_base ? m_base->GetNumNodes () - m_numOverrides : 0);
+    }
+    /// Rows held locally, i.e. the copy-on-write delta when a base is set.
+    size_t GetNumLocalRows () const { return m_slotNode.size (); }
+    /// Bytes of one padded row.
+    size_t GetRowBytes () const { return m_format.stride; }
+    /// Number of rows carrying a double shadow.
+    size_t GetNumShadowRows () const { return m_shadow.size () / (m_format.dimension + 1); }
+    /**
+     * Bytes actually held by the table: row capacity, shadow rows, the
+     * index vectors and the change-tracking snapshots. A shared base is not
+     * included.
+     */
+    size_t GetMemoryUsageBytes () const;
+
 private:
-    size_t m_dimension {16};  
-    std::map<uint32_t, std::vector<double>> m_embeddings;
-    std::map<uint32_t, double> m_biases;
+    static constexpr uint32_t NO_SLOT = 0xffffffff;
+    static constexpr uint32_t MAX_DIMENSION = 64;
+    static constexpr size_t CACHE_LINE = 64;
+    static constexpr size_t BATCH = 64;       //!< rows gathered per ArgmaxQ pass
+
+    /// Frees heap rows, or unmaps the file the rows were loaded from.
+    struct RowRelease
+    {
+        RowRelease () : mapping (nullptr), mappedBytes (0) {}
+        RowRelease (void* m, size_t bytes) : mapping (m), mappedBytes (bytes) {}
+        void operator() (uint8_t* p) const;
+        void* mapping;
+        size_t mappedBytes;
+    };
+    typedef std::unique_ptr<uint8_t[], RowRelease> RowTable;
+
+    void SetFormat (gsqr::Precision precision, size_t dimension);
+    void SetDimension (uint32_t dimension);
+    uint32_t GetDimension (void) const { return static_cast<uint32_t> (m_format.dimension); }
+    void SetPrecisionName (std::string name);
+    std::string GetPrecisionName (void) const { return gsqr::PrecisionName (m_format.precision); }
+    void SetMemoryBudget (uint64_t bytes);
+    uint64_t GetMemoryBudget (void) const { return m_memoryBudget; }
+    void SetEvictionPolicyName (std::string name);
+    std::string GetEvictionPolicyName (void) const { return m_lfu ? "lfu" : "lru"; }
+    /// Recomputes m_maxRows from the budget and the row format.
+    void UpdateRowLimit ();
+    void NoteUse (uint32_t slot) const
+    {
+        m_slotLastUse[slot] = ++m_clock;
+        ++m_slotUses[slot];
+    }
+    /// Frees the slot of the row the eviction policy picks and returns it.
+    uint32_t EvictSlot ();
+
+    /// A slot queued for eviction with its key as it was then
+    struct EvictionEntry
+    {
+        uint32_t uses;     //!< 0 under LRU
+        uint64_t lastUse;
+        uint32_t slot;
+    };
+    EvictionEntry MakeEvictionEntry (uint32_t slot) const
+    {
+        return EvictionEntry {m_lfu ? m_slotUses[slot] : 0, m_slotLastUse[slot], slot};
+    }
+    /// Heap order: the top is evicted first.
+    static bool EvictsAfter (const EvictionEntry& a, const EvictionEntry& b);
+    /// Queues a slot that just got its row.
+    void QueueForEviction (uint32_t slot);
+
+    uint32_t FindSlot (uint32_t nodeId) const
+    {
+        return nodeId < m_nodeSlot.size () ? m_nodeSlot[nodeId] : NO_SLOT;
+    }
+    uint8_t* RowAt (uint32_t slot) const { return m_rows.get () + slot * m_format.stride; }
+    /// Decodes a slot, from its shadow when it has one.
+    void DecodeSlot (uint32_t slot, double* out) const;
+    /// Encodes into a slot and refreshes its shadow when it has one.
+    void EncodeSlot (uint32_t slot, const double* in);
+    /// Gives an fp16/int8 slot a double shadow holding its decoded value.
+    double* EnsureShadow (uint32_t slot);
+    /// Snapshots the advertised value of a slot if needed and marks it dirty.
+    void TrackSlot (uint32_t slot);
+    /// Node ids of every row, base order first, then local-only rows.
+    std::vector<uint32_t> CollectNodes () const;
+    /// The binary format of the merged view, or of the local rows only.
+    bool WriteBinary (std::ostream& out, bool localOnly) const;
+    void Grow (size_t minRows);
+
+    gsqr::RowFormat m_format {gsqr::MakeRowFormat (gsqr::Precision::FLOAT64, 16)};
+    const gsqr::QKernel* m_kernel {&gsqr::GetQKernel (gsqr::Precision::FLOAT64, 16)};
+    size_t m_capacity {0};                 //!< rows allocated
+    RowTable m_rows;                       //!< heap or mapped rows
+    std::vector<uint32_t> m_nodeSlot;      //!< node id -> slot, NO_SLOT if absent
+    std::vector<uint32_t> m_slotNode;      //!< slot -> node id
+    std::vector<uint32_t> m_slotShadow;    //!< slot -> shadow row, NO_SLOT if none
+    std::vector<double> m_shadow;          //!< fp16/int8 shadow rows, dim + 1 doubles each
+    bool m_tracking {false};               //!< dirty-row tracking on
+    std::vector<uint32_t> m_slotAdvert;    //!< slot -> advertised row, NO_SLOT if none
+    std::vector<double> m_advert;          //!< advertised values, dim + 1 doubles each
+    std::vector<uint8_t> m_slotDirty;      //!< slot -> written since last advertised
+    std::vector<uint32_t> m_dirtySlots;    //!< slots with m_slotDirty set
+    Ptr<const GsqrEmbedding> m_base;       //!< shared read-only rows, may be null
+    size_t m_numOverrides {0};             //!< local rows that replace a base row
+    uint64_t m_memoryBudget {0};           //!< bytes of local rows, 0 if unbounded
+    bool m_lfu {false};                    //!< evict by use count instead of recency
+    size_t m_maxRows {0};                  //!< rows the budget allows, 0 if unbounded
+    uint64_t m_numEvictions {0};
+    mutable uint64_t m_clock {0};          //!< uses noted so far
+    mutable std::vector<uint64_t> m_slotLastUse; //!< slot -> m_clock at its last use
+    mutable std::vector<uint32_t> m_slotUses;    //!< slot -> uses, aged on eviction
+    std::vector<EvictionEntry> m_evictionQueue;  //!< min-heap, one entry per slot once evicting
+    std::vector<uint32_t> m_evictedNodes;        //!< last EVICTION_LOG evicted ids, a ring
 };
 
 } // namespace ns3
 
-#endif // GSQR_EMBEDDING_H
\ No newline at end of file
+#endif // GSQR_EMBEDDING_H
@@ -0,0 +1,658 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "gsqr-q-kernel.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// AVX2 is compiled per function and picked at run time, so a default
+// (non -march=native) build still uses it. NEON is baseline on AArch64.
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#include <immintrin.h>
+#define GSQR_KERNEL_AVX2 1
+#define GSQR_TARGET_AVX2 __attribute__ ((target ("avx2,fma,f16c")))
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define GSQR_KERNEL_NEON 1
+#endif
+
+namespace ns3 {
+namespace gsqr {
+
+const char*
+PrecisionName (Precision precision)
+{
+    switch (precision) {
+    case Precision::FLOAT64:
+        return "float64";
+    case Precision::FLOAT32:
+        return "float32";
+    case Precision::FLOAT16:
+        return "fp16";
+    case Precision::INT8:
+        return "int8";
+    }
+    return "unknown";
+}
+
+bool
+ParsePrecision (const std::string& name, Precision* precision)
+{
+    static const Precision all[] = {Precision::FLOAT64, Precision::FLOAT32,
+                                    Precision::FLOAT16, Precision::INT8};
+    for (Precision p : all) {
+        if (name == PrecisionName(p)) {
+            *precision = p;
+            return true;
+        }
+    }
+    return false;
+}
+
+namespace {
+
+template <Precision P> struct Traits;
+
+template <> struct Traits<Precision::FLOAT64>
+{
+    typedef double Elem;
+    typedef double Bias;
+    typedef double Acc;
+};
+
+template <> struct Traits<Precision::FLOAT32>
+{
+    typedef float Elem;
+    typedef float Bias;
+    typedef float Acc;
+};
+
+template <> struct Traits<Precision::FLOAT16>
+{
+    typedef uint16_t Elem;
+    typedef float Bias;
+    typedef float Acc;
+};
+
+template <> struct Traits<Precision::INT8>
+{
+    typedef int8_t Elem;
+    typedef float Bias;
+    typedef int32_t Acc;
+};
+
+constexpr size_t
+ElementBytes (Precision p)
+{
+    return p == Precision::FLOAT64 ? 8 : p == Precision::FLOAT32 ? 4 : p == Precision::FLOAT16 ? 2 : 1;
+}
+
+constexpr size_t
+MetaOffset (Precision p, size_t dim)
+{
+    return (dim * ElementBytes(p) + 7) / 8 * 8;
+}
+
+template <Precision P>
+inline double
+BiasOf (const uint8_t* row, size_t dim)
+{
+    return *reinterpret_cast<const typename Traits<P>::Bias*>(row + MetaOffset(P, dim));
+}
+
+template <Precision P>
+inline typename Traits<P>::Bias&
+BiasRef (uint8_t* row, size_t dim)
+{
+    return *reinterpret_cast<typename Traits<P>::Bias*>(row + MetaOffset(P, dim));
+}
+
+// INT8 rows keep their scale right after the float bias
+inline float
+ScaleOf (const uint8_t* row, size_t dim)
+{
+    return *reinterpret_cast<const float*>(row + MetaOffset(Precision::INT8, dim) + sizeof(float));
+}
+
+inline float&
+ScaleRef (uint8_t* row, size_t dim)
+{
+    return *reinterpret_cast<float*>(row + MetaOffset(Precision::INT8, dim) + sizeof(float));
+}
+
+// IEEE binary16 <-> binary32, round to nearest even
+inline float
+HalfToFloat (uint16_t h)
+{
+    uint32_t sign = static_cast<uint32_t>(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f;
+    uint32_t mantissa = h & 0x3ff;
+    uint32_t bits;
+    if (exponent == 0) {
+        if (mantissa == 0) {
+            bits = sign;
+        } else {
+            // Subnormal: renormalize
+            exponent = 127 - 15 + 1;
+            while ((mantissa & 0x400) == 0) {
+                mantissa <<= 1;
+                --exponent;
+            }
+            bits = sign | (exponent << 23) | ((mantissa & 0x3ff) << 13);
+        }
+    } else if (exponent == 0x1f) {
+        bits = sign | 0x7f800000 | (mantissa << 13);
+    } else {
+        bits = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+    }
+    float f;
+    std::memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+inline uint16_t
+FloatToHalf (float f)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &f, sizeof(bits));
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t abs = bits & 0x7fffffff;
+    if (abs >= 0x7f800000) {
+        // Inf or NaN
+        return sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0);
+    }
+    if (abs >= 0x477ff000) {
+        // Rounds past the largest half
+        return sign | 0x7c00;
+    }
+    if (abs < 0x38800000) {
+        // Subnormal half (or zero)
+        if (abs < 0x33000000) {
+            return sign;
+        }
+        uint32_t exponent = abs >> 23;
+        uint32_t mantissa = (abs & 0x7fffff) | 0x800000;
+        uint32_t shift = 126 - exponent;
+        // The half counts units of 2^-24: mantissa * 2^(exponent - 126)
+        uint32_t half = mantissa >> shift;
+        uint32_t rest = mantissa & ((1u << shift) - 1);
+        uint32_t midpoint = 1u << (shift - 1);
+        if (rest > midpoint || (rest == midpoint && (half & 1))) {
+            ++half;
+        }
+        return sign | static_cast<uint16_t>(half);
+    }
+    uint32_t half = ((abs - 0x38000000) >> 13);
+    uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) {
+        ++half;
+    }
+    return sign | static_cast<uint16_t>(half);
+}
+
+inline double Load (double v) { return v; }
+inline float Load (float v) { return v; }
+inline float Load (uint16_t v) { return HalfToFloat(v); }
+inline int32_t Load (int8_t v) { return v; }
+
+// DIM == 0 selects the run-time dimension; any other value is a constant
+// the compiler can unroll against.
+#define GSQR_DIM(dim) (DIM != 0 ? DIM : (dim))
+
+// Accumulated dot product to Q: rescale INT8, then add the bias
+template <Precision P>
+inline double
+Finish (typename Traits<P>::Acc acc, const uint8_t* hd, const uint8_t* row, size_t dim)
+{
+    if constexpr (P == Precision::INT8) {
+        return static_cast<double>(acc) * ScaleOf(hd, dim) * ScaleOf(row, dim) + BiasOf<P>(row, dim);
+    } else {
+        return static_cast<double>(acc) + BiasOf<P>(row, dim);
+    }
+}
+
+template <Precision P, size_t DIM>
+double
+QScalar (const uint8_t* hd, const uint8_t* row, size_t dim)
+{
+    typedef typename Traits<P>::Elem Elem;
+    const Elem* a = reinterpret_cast<const Elem*>(hd);
+    const Elem* b = reinterpret_cast<const Elem*>(row);
+    typename Traits<P>::Acc acc = 0;
+    for (size_t i = 0; i < GSQR_DIM(dim); ++i) {
+        acc += Load(a[i]) * Load(b[i]);
+    }
+    return Finish<P>(acc, hd, row, GSQR_DIM(dim));
+}
+
+template <size_t DIM, double (*Q) (const uint8_t*, const uint8_t*, size_t)>
+size_t
+ArgmaxRows (const uint8_t* hd, const uint8_t* const* rows, size_t n,
+            size_t dim, double* bestQ)
+{
+    const size_t d = GSQR_DIM(dim);
+    size_t best = 0;
+    double bestValue = Q(hd, rows[0], d);
+    for (size_t i = 1; i < n; ++i) {
+        double q = Q(hd, rows[i], d);
+        if (q > bestValue) {
+            bestValue = q;
+            best = i;
+        }
+    }
+    *bestQ = bestValue;
+    return best;
+}
+
+template <Precision P, size_t DIM>
+void
+TdScalar (uint8_t* row, const uint8_t* hd, double step, size_t dim)
+{
+    typedef typename Traits<P>::Elem Elem;
+    Elem* r = reinterpret_cast<Elem*>(row);
+    const Elem* h = reinterpret_cast<const Elem*>(hd);
+    const Elem s = static_cast<Elem>(step);
+    for (size_t i = 0; i < GSQR_DIM(dim); ++i) {
+        r[i] += s * h[i];
+    }
+    BiasRef<P>(row, GSQR_DIM(dim)) += s;
+}
+
+template <Precision P, size_t DIM>
+void
+Decode (const uint8_t* row, double* out, size_t dim)
+{
+    typedef typename Traits<P>::Elem Elem;
+    const Elem* r = reinterpret_cast<const Elem*>(row);
+    double scale = 1.0;
+    if constexpr (P == Precision::INT8) {
+        scale = ScaleOf(row, GSQR_DIM(dim));
+    }
+    for (size_t i = 0; i < GSQR_DIM(dim); ++i) {
+        out[i] = Load(r[i]) * scale;
+    }
+    out[GSQR_DIM(dim)] = BiasOf<P>(row, GSQR_DIM(dim));
+}
+
+template <Precision P, size_t DIM>
+void
+Encode (const double* in, uint8_t* row, size_t dim)
+{
+    typedef typename Traits<P>::Elem Elem;
+    Elem* r = reinterpret_cast<Elem*>(row);
+    const size_t d = GSQR_DIM(dim);
+    if constexpr (P == Precision::INT8) {
+        // Symmetric: the largest magnitude maps to 127
+        double maxAbs = 0.0;
+        for (size_t i = 0; i < d; ++i) {
+            maxAbs = std::max(maxAbs, std::fabs(in[i]));
+        }
+        float scale = static_cast<float>(maxAbs / 127.0);
+        ScaleRef(row, d) = scale;
+        for (size_t i = 0; i < d; ++i) {
+            long v = scale > 0.0f ? std::lround(in[i] / scale) : 0;
+            r[i] = static_cast<int8_t>(std::min(127L, std::max(-127L, v)));
+        }
+    } else if constexpr (P == Precision::FLOAT16) {
+        for (size_t i = 0; i < d; ++i) {
+            r[i] = FloatToHalf(static_cast<float>(in[i]));
+        }
+    } else {
+        for (size_t i = 0; i < d; ++i) {
+            r[i] = static_cast<Elem>(in[i]);
+        }
+    }
+    BiasRef<P>(row, d) = static_cast<typename Traits<P>::Bias>(in[d]);
+}
+
+#if defined(GSQR_KERNEL_AVX2)
+
+// Dot product into a 4-lane accumulator; the caller reduces it.
+template <size_t DIM>
+GSQR_TARGET_AVX2 inline __m256d
+DotLanesF64 (const double* hd, const double* h, size_t dim)
+{
+    __m256d acc = _mm256_setzero_pd();
+    size_t i = 0;
+    for (; i + 4 <= GSQR_DIM(dim); i += 4) {
+        acc = _mm256_fmadd_pd(_mm256_loadu_pd(hd + i), _mm256_loadu_pd(h + i), acc);
+    }
+    // Specialized dimensions are multiples of 4 and have no tail
+    if constexpr (DIM == 0 || DIM % 4 != 0) {
+        if (i < GSQR_DIM(dim)) {
+            // Tail goes into lane 0
+            double tail = 0.0;
+            for (; i < GSQR_DIM(dim); ++i) {
+                tail += hd[i] * h[i];
+            }
+            acc = _mm256_add_pd(acc, _mm256_set_pd(0.0, 0.0, 0.0, tail));
+        }
+    }
+    return acc;
+}
+
+template <size_t DIM>
+GSQR_TARGET_AVX2 double
+QF64Avx2 (const uint8_t* hd, const uint8_t* row, size_t dim)
+{
+    const double* h = reinterpret_cast<const double*>(row);
+    __m256d v = DotLanesF64<DIM>(reinterpret_cast<const double*>(hd), h, dim);
+    __m128d lo = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(lo, _mm_unpackhi_pd(lo, lo))) + h[GSQR_DIM(dim)];
+}
+
+template <size_t DIM>
+GSQR_TARGET_AVX2 void
+TdF64Avx2 (uint8_t* row, const uint8_t* hd, double step, size_t dim)
+{
+    double* r = reinterpret_cast<double*>(row);
+    const double* h = reinterpret_cast<const double*>(hd);
+    __m256d s = _mm256_set1_pd(step);
+    size_t i = 0;
+    for (; i + 4 <= GSQR_DIM(dim); i += 4) {
+        _mm256_storeu_pd(r + i, _mm256_fmadd_pd(s, _mm256_loadu_pd(h + i), _mm256_loadu_pd(r + i)));
+    }
+    if constexpr (DIM == 0 || DIM % 4 != 0) {
+        for (; i < GSQR_DIM(dim); ++i) {
+            r[i] += step * h[i];
+        }
+    }
+    r[GSQR_DIM(dim)] += step;
+}
+
+// Four rows at a time: the four accumulators are reduced together into
+// [q0, q1, q2, q3] and the biases added as one vector.
+template <size_t DIM>
+GSQR_TARGET_AVX2 size_t
+ArgmaxF64Avx2 (const uint8_t* hdBytes, const uint8_t* const* rowBytes, size_t n,
+               size_t dim, double* bestQ)
+{
+    const size_t d = GSQR_DIM(dim);
+    const double* hd = reinterpret_cast<const double*>(hdBytes);
+    const double* const* rows = reinterpret_cast<const double* const*>(rowBytes);
+    size_t best = 0;
+    double bestValue = 0.0;
+    size_t i = 0;
+    alignas(32) double q[4];
+    for (; i + 4 <= n; i += 4) {
+        __m256d t0 = _mm256_hadd_pd(DotLanesF64<DIM>(hd, rows[i], d),
+                                    DotLanesF64<DIM>(hd, rows[i + 1], d));
+        __m256d t1 = _mm256_hadd_pd(DotLanesF64<DIM>(hd, rows[i + 2], d),
+                                    DotLanesF64<DIM>(hd, rows[i + 3], d));
+        __m256d sum = _mm256_add_pd(_mm256_permute2f128_pd(t0, t1, 0x20),
+                                    _mm256_permute2f128_pd(t0, t1, 0x31));
+        __m256d bias = _mm256_set_pd(rows[i + 3][d], rows[i + 2][d],
+                                     rows[i + 1][d], rows[i][d]);
+        _mm256_store_pd(q, _mm256_add_pd(sum, bias));
+        for (size_t k = 0; k < 4; ++k) {
+            if (i + k == 0 || q[k] > bestValue) {
+                bestValue = q[k];
+                best = i + k;
+            }
+        }
+    }
+    for (; i < n; ++i) {
+        double qi = QF64Avx2<DIM>(hdBytes, rowBytes[i], d);
+        if (i == 0 || qi > bestValue) {
+            bestValue = qi;
+            best = i;
+        }
+    }
+    *bestQ = bestValue;
+    return best;
+}
+
+GSQR_TARGET_AVX2 inline float
+HorizontalSum (__m256 v)
+{
+    __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+}
+
+GSQR_TARGET_AVX2 inline __m256
+Load8 (const float* p)
+{
+    return _mm256_loadu_ps(p);
+}
+
+GSQR_TARGET_AVX2 inline __m256
+Load8 (const uint16_t* p)
+{
+    return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+// FLOAT32 and FLOAT16 rows: 8 lanes of float, halves widened on load
+template <Precision P, size_t DIM>
+GSQR_TARGET_AVX2 double
+QFloatAvx2 (const uint8_t* hd, const uint8_t* row, size_t dim)
+{
+    typedef typename Traits<P>::Elem Elem;
+    const Elem* a = reinterpret_cast<const Elem*>(hd);
+    const Elem* b = reinterpret_cast<const Elem*>(row);
+    __m256 acc = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= GSQR_DIM(dim); i += 8) {
+        acc = _mm256_fmadd_ps(Load8(a + i), Load8(b + i), acc);
+    }
+    float result = HorizontalSum(acc);
+    if constexpr (DIM == 0 || DIM % 8 != 0) {
+        for (; i < GSQR_DIM(dim); ++i) {
+            result += Load(a[i]) * Load(b[i]);
+        }
+    }
+    return Finish<P>(result, hd, row, GSQR_DIM(dim));
+}
+
+// INT8 rows: widen to int16 and multiply-add pairs into int32 lanes
+template <size_t DIM>
+GSQR_TARGET_AVX2 double
+QInt8Avx2 (const uint8_t* hd, const uint8_t* row, size_t dim)
+{
+    const int8_t* a = reinterpret_cast<const int8_t*>(hd);
+    const int8_t* b = reinterpret_cast<const int8_t*>(row);
+    __m256i acc = _mm256_setzero_si256();
+    size_t i = 0;
+    for (; i + 16 <= GSQR_DIM(dim); i += 16) {
+        __m256i x = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m256i y = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(x, y));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1));
+    if (i + 8 <= GSQR_DIM(dim)) {
+        __m128i x = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(a + i)));
+        __m128i y = _mm_cvtepi8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(b + i)));
+        s = _mm_add_epi32(s, _mm_madd_epi16(x, y));
+        i += 8;
+    }
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0x4e));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, 0xb1));
+    int32_t result = _mm_cvtsi128_si32(s);
+    if constexpr (DIM == 0 || DIM % 8 != 0) {
+        for (; i < GSQR_DIM(dim); ++i) {
+            result += static_cast<int32_t>(a[i]) * b[i];
+        }
+    }
+    return Finish<Precision::INT8>(result, hd, row, GSQR_DIM(dim));
+}
+
+template <size_t DIM, double (*Q) (const uint8_t*, const uint8_t*, size_t)>
+GSQR_TARGET_AVX2 size_t
+ArgmaxRowsAvx2 (const uint8_t* hd, const uint8_t* const* rows, size_t n,
+                size_t dim, double* bestQ)
+{
+    const size_t d = GSQR_DIM(dim);
+    size_t best = 0;
+    double bestValue = Q(hd, rows[0], d);
+    for (size_t i = 1; i < n; ++i) {
+        double q = Q(hd, rows[i], d);
+        if (q > bestValue) {
+            bestValue = q;
+            best = i;
+        }
+    }
+    *bestQ = bestValue;
+    return best;
+}
+
+#elif defined(GSQR_KERNEL_NEON)
+
+template <size_t DIM>
+double
+QF64Neon (const uint8_t* hdBytes, const uint8_t* row, size_t dim)
+{
+    const double* hd = reinterpret_cast<const double*>(hdBytes);
+    const double* h = reinterpret_cast<const double*>(row);
+    float64x2_t acc0 = vdupq_n_f64(0.0);
+    float64x2_t acc1 = vdupq_n_f64(0.0);
+    size_t i = 0;
+    for (; i + 4 <= GSQR_DIM(dim); i += 4) {
+        acc0 = vfmaq_f64(acc0, vld1q_f64(hd + i), vld1q_f64(h + i));
+        acc1 = vfmaq_f64(acc1, vld1q_f64(hd + i + 2), vld1q_f64(h + i + 2));
+    }
+    double result = vaddvq_f64(vaddq_f64(acc0, acc1));
+    if constexpr (DIM == 0 || DIM % 4 != 0) {
+        for (; i < GSQR_DIM(dim); ++i) {
+            result += hd[i] * h[i];
+        }
+    }
+    return result + h[GSQR_DIM(dim)];
+}
+
+template <size_t DIM>
+double
+QF32Neon (const uint8_t* hdBytes, const uint8_t* row, size_t dim)
+{
+    const float* hd = reinterpret_cast<const float*>(hdBytes);
+    const float* h = reinterpret_cast<const float*>(row);
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 8 <= GSQR_DIM(dim); i += 8) {
+        acc0 = vfmaq_f32(acc0, vld1q_f32(hd + i), vld1q_f32(h + i));
+        acc1 = vfmaq_f32(acc1, vld1q_f32(hd + i + 4), vld1q_f32(h + i + 4));
+    }
+    float result = vaddvq_f32(vaddq_f32(acc0, acc1));
+    if constexpr (DIM == 0 || DIM % 8 != 0) {
+        for (; i < GSQR_DIM(dim); ++i) {
+            result += hd[i] * h[i];
+        }
+    }
+    return Finish<Precision::FLOAT32>(result, hdBytes, row, GSQR_DIM(dim));
+}
+
+#endif
+
+#undef GSQR_DIM
+
+template <Precision P, size_t DIM>
+QKernel
+MakeKernel (void)
+{
+    void (*td) (uint8_t*, const uint8_t*, double, size_t) = nullptr;
+    if constexpr (P == Precision::FLOAT64 || P == Precision::FLOAT32) {
+        td = &TdScalar<P, DIM>;
+    }
+    QKernel kernel {&QScalar<P, DIM>, &ArgmaxRows<DIM, QScalar<P, DIM>>, td,
+                    &Decode<P, DIM>, &Encode<P, DIM>, DIM, "scalar"};
+
+#if defined(GSQR_KERNEL_AVX2)
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+        && __builtin_cpu_supports("f16c")) {
+        kernel.isa = "avx2";
+        if constexpr (P == Precision::FLOAT64) {
+            kernel.q = &QF64Avx2<DIM>;
+            kernel.argmax = &ArgmaxF64Avx2<DIM>;
+            kernel.td = &TdF64Avx2<DIM>;
+        } else if constexpr (P == Precision::INT8) {
+            kernel.q = &QInt8Avx2<DIM>;
+            kernel.argmax = &ArgmaxRowsAvx2<DIM, QInt8Avx2<DIM>>;
+        } else {
+            kernel.q = &QFloatAvx2<P, DIM>;
+            kernel.argmax = &ArgmaxRowsAvx2<DIM, QFloatAvx2<P, DIM>>;
+        }
+    }
+#elif defined(GSQR_KERNEL_NEON)
+    if constexpr (P == Precision::FLOAT64) {
+        kernel.q = &QF64Neon<DIM>;
+        kernel.argmax = &ArgmaxRows<DIM, QF64Neon<DIM>>;
+        kernel.isa = "neon";
+    } else if constexpr (P == Precision::FLOAT32) {
+        kernel.q = &QF32Neon<DIM>;
+        kernel.argmax = &ArgmaxRows<DIM, QF32Neon<DIM>>;
+        kernel.isa = "neon";
+    }
+#endif
+    return kernel;
+}
+
+// One row of the table: the specialized dimensions, then the generic one
+struct KernelRow
+{
+    QKernel d8;
+    QKernel d16;
+    QKernel d32;
+    QKernel generic;
+};
+
+template <Precision P>
+KernelRow
+MakeKernelRow (void)
+{
+    return KernelRow {MakeKernel<P, 8>(), MakeKernel<P, 16>(), MakeKernel<P, 32>(), MakeKernel<P, 0>()};
+}
+
+} // namespace
+
+RowFormat
+MakeRowFormat (Precision precision, size_t dim)
+{
+    RowFormat format;
+    format.precision = precision;
+    format.dimension = dim;
+    format.metaOffset = MetaOffset(precision, dim);
+    // Bias, plus the scale for INT8 rows
+    format.rowBytes = format.metaOffset + (precision == Precision::FLOAT64 ? sizeof(double)
+                                                                           : 2 * sizeof(float));
+
+    const size_t cacheLine = 64;
+    if (format.rowBytes <= cacheLine) {
+        format.stride = 8;
+        while (format.stride < format.rowBytes) {
+            format.stride *= 2;
+        }
+    } else {
+        format.stride = (format.rowBytes + cacheLine - 1) / cacheLine * cacheLine;
+    }
+    return format;
+}
+
+const QKernel&
+GetQKernel (Precision precision, size_t dim)
+{
+    static const KernelRow* table = [] {
+#if defined(GSQR_KERNEL_AVX2)
+        __builtin_cpu_init();
+#endif
+        static const KernelRow rows[] = {MakeKernelRow<Precision::FLOAT64>(),
+                                         MakeKernelRow<Precision::FLOAT32>(),
+                                         MakeKernelRow<Precision::FLOAT16>(),
+                                         MakeKernelRow<Precision::INT8>()};
+        return rows;
+    }();
+
+    const KernelRow& row = table[static_cast<size_t>(precision)];
+    switch (dim) {
+    case 8:
+        return row.d8;
+    case 16:
+        return row.d16;
+    case 32:
+        return row.d32;
+    default:
+        return row.generic;
+    }
+}
+
+} // namespace gsqr
+} // namespace ns3
@@ -0,0 +1,96 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef GSQR_Q_KERNEL_H
+#define GSQR_Q_KERNEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+namespace ns3 {
+namespace gsqr {
+
+/**
+ * \ingroup gsqr
+ * \brief Storage precision of an embedding row
+ */
+enum class Precision : uint8_t
+{
+    FLOAT64 = 0,
+    FLOAT32 = 1,
+    FLOAT16 = 2,   //!< IEEE half
+    INT8 = 3       //!< symmetric, one float scale per row
+};
+
+const char* PrecisionName (Precision precision);
+/// Parses float64/float32/fp16/int8; returns false on anything else.
+bool ParsePrecision (const std::string& name, Precision* precision);
+
+/**
+ * \brief Byte layout of one embedding row
+ *
+ * A row is dim elements h in the storage precision, then at metaOffset the
+ * bias b (a double for FLOAT64 rows, a float otherwise) and, for INT8, the
+ * float scale that maps the int8 values back to h. Rows are padded to
+ * stride: a power of two up to one cache line, whole cache lines above
+ * that, so no row straddles a line it does not need.
+ */
+struct RowFormat
+{
+    Precision precision;
+    size_t dimension;
+    size_t metaOffset;  //!< byte offset of the bias
+    size_t rowBytes;    //!< unpadded bytes
+    size_t stride;      //!< padded bytes between rows
+};
+
+RowFormat MakeRowFormat (Precision precision, size_t dim);
+
+/**
+ * \brief Q-value and TD kernels over GsqrEmbedding rows
+ *
+ * The score of a row against the destination row h_d is
+ * Q = h_d^T h + b, computed in the storage domain: float for FLOAT32 and
+ * FLOAT16 rows, an int32 accumulation rescaled once for INT8 rows. On x86
+ * the AVX2/FMA (and F16C) kernels are chosen at run time when the CPU has
+ * them; AArch64 uses NEON; anything else falls back to plain loops.
+ *
+ * Kernels are templates on the dimension. 8, 16 and 32 are instantiated
+ * with the dimension as a constant, so their loops unroll fully; any
+ * other dimension uses the generic instance, which reads the dim argument.
+ */
+struct QKernel
+{
+    /// Q of one row against hd.
+    double (*q) (const uint8_t* hd, const uint8_t* row, size_t dim);
+
+    /**
+     * Scores every row against hd in one pass and returns the index of the
+     * best one (the first on ties). bestQ receives its Q value. n must be > 0.
+     */
+    size_t (*argmax) (const uint8_t* hd, const uint8_t* const* rows, size_t n,
+                      size_t dim, double* bestQ);
+
+    /**
+     * TD step in place: h += step * h_d and b += step. Null for FLOAT16 and
+     * INT8, whose steps are too small to survive rounding and go through a
+     * double shadow row instead.
+     */
+    void (*td) (uint8_t* row, const uint8_t* hd, double step, size_t dim);
+
+    /// Row to dim + 1 doubles (h, then b).
+    void (*decode) (const uint8_t* row, double* out, size_t dim);
+    /// dim + 1 doubles (h, then b) to a row; INT8 picks a new scale.
+    void (*encode) (const double* in, uint8_t* row, size_t dim);
+
+    size_t dimension;   //!< specialized dimension, 0 for the generic kernel
+    const char* isa;    //!< instruction set the kernel runs on
+};
+
+/// Kernel for rows of the given precision and dimension.
+const QKernel& GetQKernel (Precision precision, size_t dim);
+
+} // namespace gsqr
+} // namespace ns3
+
+#endif // GSQR_Q_KERNEL_H
@@ -3,9 +3,11 @@
 #include "gsqr-routing-protocol.h"
 #include "gsqr-routing.h"
 #include "gsqr-embedding.h"
+#include "gsqr-sage.h"
 #include "ns3/log.h"
 #include "ns3/simulator.h"
 #include "ns3/node.h"
+#include "ns3/node-list.h"
 #include "ns3/ipv4-route.h"
 #include "ns3/ipv4-interface.h"      
 #include "ns3/ipv4-l3-protocol.h"    
@@ -14,14 +16,30 @@
 #include "ns3/udp-socket.h"
 #include "ns3/wifi-net-device.h"
 #include "ns3/wifi-mac.h"
+#include "ns3/wifi-mac-queue.h"
+#include "ns3/qos-utils.h"
+#include "ns3/energy-source-container.h"
 #include "ns3/string.h"     
 #include "ns3/double.h"
+#include "ns3/uinteger.h"
+#include "ns3/boolean.h"
+#include "ns3/pointer.h"
+#include "ns3/hash.h"
+#include "ns3/trace-source-accessor.h"
+#include <algorithm>
+#include <bitset>
+#include <cmath>
+#include <cstring>
 
 NS_LOG_COMPONENT_DEFINE ("GsqrRoutingProtocol");
 
 namespace ns3 {
 
 NS_OBJECT_ENSURE_REGISTERED (GsqrRoutingProtocol);
+NS_OBJECT_ENSURE_REGISTERED (GsqrHelloHeader);
+NS_OBJECT_ENSURE_REGISTERED (GsqrAckHeader);
+NS_OBJECT_ENSURE_REGISTERED (GsqrDeltaHeader);
+NS_OBJECT_ENSURE_REGISTERED (GsqrHopTag);
 
 TypeId
 GsqrRoutingProtocol::GetTypeId (void)
@@ -34,10 +52,196 @@ GsqrRoutingProtocol::GetTypeId (void)
                    TimeValue (Seconds (2.0)),
                    MakeTimeAccessor (&GsqrRoutingProtocol::m_helloInterval),
                    MakeTimeChecker ())
-    .AddAttribute ("EmbeddingFile", "Path to GraphSAGE embedding file",
+    .AddAttribute ("NeighborHoldHellos",
+                   "HelloIntervals without a Hello after which a neighbor expires",
+                   UintegerValue (3),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_neighborHoldHellos),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("AdaptiveHello",
+                   "Back the Hello interval off while the neighborhood is stable, "
+                   "between HelloMinInterval and HelloMaxInterval, instead of "
+                   "sending every HelloInterval",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GsqrRoutingProtocol::m_adaptiveHello),
+                   MakeBooleanChecker ())
+    .AddAttribute ("HelloMinInterval", "Adaptive Hello interval after a change",
+                   TimeValue (Seconds (0.5)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_helloMinInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("HelloMaxInterval", "Adaptive Hello interval bound while stable",
+                   TimeValue (Seconds (8.0)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_helloMaxInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("MaxHelloJitter",
+                   "Upper bound on how early a Hello goes out in each period, "
+                   "at most a quarter of the period",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_maxHelloJitter),
+                   MakeTimeChecker ())
+    .AddAttribute ("AckBatchSize",
+                   "Packets from one previous hop acknowledged together",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_ackBatchSize),
+                   MakeUintegerChecker<uint32_t> (1, 255))
+    .AddAttribute ("AckTimeout",
+                   "Longest an ACK waits for a batch or a Hello to ride on",
+                   TimeValue (MilliSeconds (200)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_ackTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("EnergyPerBit",
+                   "Energy per bit received; the ACKs report it times the bits of each packet",
+                   DoubleValue (1e-6),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_energyPerBit),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("FeatureChangeThreshold",
+                   "Change in an advertised feature that resets the adaptive Hello "
+                   "interval; relative to the old value, absolute below 1",
+                   DoubleValue (0.2),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_featureChangeThreshold),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("HelloWindow",
+                   "Latest Hellos of a neighbor, heard or missed, whose reception "
+                   "ratio gives the ETX of its link",
+                   UintegerValue (16),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_helloWindow),
+                   MakeUintegerChecker<uint32_t> (1, 32))
+    .AddAttribute ("QueueSampleInterval",
+                   "Time between samples of the Wi-Fi queue occupancy that is "
+                   "advertised in Hellos; zero samples only when a Hello is sent",
+                   TimeValue (MilliSeconds (100)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_queueSampleInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("QueueSmoothing",
+                   "Weight of each new sample in the advertised queue occupancy",
+                   DoubleValue (0.2),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_queueSmoothing),
+                   MakeDoubleChecker<double> (0.0, 1.0))
+    .AddAttribute ("InterfaceSelection",
+                   "Link to a next hop heard on several interfaces: best (least ETX "
+                   "times local queue occupancy plus 0.05) or spread (flows hashed "
+                   "over the links in inverse proportion to that)",
+                   StringValue ("spread"),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_interfaceSelectionName),
+                   MakeStringChecker ())
+    .AddAttribute ("EmbeddingFile", "Path to GraphSAGE embedding file (CSV or binary)",
                    StringValue (""),
                    MakeStringAccessor (&GsqrRoutingProtocol::m_embeddingFile),
                    MakeStringChecker ())
+    .AddAttribute ("EmbeddingPrecision",
+                   "Storage precision of the embedding table: float64, float32, fp16 or int8",
+                   StringValue ("float64"),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_embeddingPrecision),
+                   MakeStringChecker ())
+    .AddAttribute ("EmbeddingMemoryBudget",
+                   "Bytes of embedding rows this node keeps of its own; rarely used "
+                   "rows beyond it are evicted and read from the shared table again. "
+                   "0 for no limit",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_embeddingMemoryBudget),
+                   MakeUintegerChecker<uint64_t> ())
+    .AddAttribute ("EmbeddingEvictionPolicy",
+                   "Row evicted once the EmbeddingMemoryBudget is full: lru or lfu",
+                   StringValue ("lru"),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_embeddingEvictionPolicy),
+                   MakeStringChecker ())
+    .AddAttribute ("SageWeightsFile",
+                   "GraphSAGE weights exported by pytorch/train_embedding.py --weights; "
+                   "if set, embeddings are recomputed from Hello features and the "
+                   "neighborhood every UpdateInterval",
+                   StringValue (""),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_sageWeightsFile),
+                   MakeStringChecker ())
+    .AddAttribute ("UpdateInterval",
+                   "Seconds between batched TD updates, with BatchTdUpdates",
+                   DoubleValue (2.0),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_updateInterval),
+                   MakeDoubleChecker<double> (0.1, 10.0))
+    .AddAttribute ("BatchTdUpdates",
+                   "Apply TD steps once per UpdateInterval instead of on every ACK",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GsqrRoutingProtocol::m_batchTdUpdates),
+                   MakeBooleanChecker ())
+    .AddAttribute ("AverageTdBatch",
+                   "Apply the mean rather than the sum of batched steps per pair",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&GsqrRoutingProtocol::m_averageTdBatch),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MultipathPaths",
+                   "Best neighbors by Q that the flows to a destination are spread "
+                   "over, each flow kept on one; 1 forwards everything to the best",
+                   UintegerValue (1),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_multipathPaths),
+                   MakeUintegerChecker<uint32_t> (1, 16))
+    .AddAttribute ("MultipathWeighting",
+                   "Share of the flows each path gets: softmax (of Q) or queue "
+                   "(inverse advertised queue occupancy)",
+                   StringValue ("softmax"),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_multipathWeighting),
+                   MakeStringChecker ())
+    .AddAttribute ("MultipathTemperature",
+                   "Softmax temperature, in units of Q",
+                   DoubleValue (0.01),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_multipathTemperature),
+                   MakeDoubleChecker<double> (1e-9))
+    .AddAttribute ("FlowTimeout",
+                   "Idle time after which a flow may be moved to another path",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_flowTimeout),
+                   MakeTimeChecker ())
+    .AddAttribute ("CheckpointDirectory",
+                   "Directory this node's learned table is checkpointed to, as "
+                   "node-<id>.bin; none if empty",
+                   StringValue (""),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_checkpointDirectory),
+                   MakeStringChecker ())
+    .AddAttribute ("CheckpointInterval",
+                   "Time between checkpoints; zero checkpoints only at the end of the simulation",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_checkpointInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("WarmStartDirectory",
+                   "Directory of an earlier run's checkpoints, loaded over the "
+                   "pretrained table; none if empty",
+                   StringValue (""),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_warmStartDirectory),
+                   MakeStringChecker ())
+    .AddAttribute ("ConvergenceWindow",
+                   "Time over which the TD errors and next-hop changes are judged "
+                   "for convergence; zero disables the detector",
+                   TimeValue (Seconds (2.0)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_convergenceWindow),
+                   MakeTimeChecker ())
+    .AddAttribute ("ConvergenceThreshold",
+                   "Mean |TD error| below which a window counts as stable",
+                   DoubleValue (0.01),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_convergenceThreshold),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("DisseminationMode",
+                   "How changed embedding rows reach the neighbors: none, hello "
+                   "(piggybacked on Hellos) or message (own broadcast)",
+                   StringValue ("none"),
+                   MakeStringAccessor (&GsqrRoutingProtocol::m_disseminationModeName),
+                   MakeStringChecker ())
+    .AddAttribute ("DisseminationThreshold",
+                   "Largest element change since last advertised for a row to be sent",
+                   DoubleValue (0.05),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_disseminationThreshold),
+                   MakeDoubleChecker<double> (0.0))
+    .AddAttribute ("DisseminationMaxRows",
+                   "Rows per advertisement, the largest changes first",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&GsqrRoutingProtocol::m_disseminationMaxRows),
+                   MakeUintegerChecker<uint32_t> (1, GsqrDeltaHeader::MAX_ROWS))
+    .AddAttribute ("DisseminationInterval",
+                   "Shortest time between two delta messages, in message mode",
+                   TimeValue (Seconds (1.0)),
+                   MakeTimeAccessor (&GsqrRoutingProtocol::m_disseminationInterval),
+                   MakeTimeChecker ())
+    .AddAttribute ("DisseminationWeight",
+                   "Share of a neighbor's advertised change applied to the local rows",
+                   DoubleValue (1.0),
+                   MakeDoubleAccessor (&GsqrRoutingProtocol::m_disseminationWeight),
+                   MakeDoubleChecker<double> (0.0, 1.0))
     .AddAttribute ("LearningRate", "Q-learning learning rate (alpha)",
                    DoubleValue (0.1),
                    MakeDoubleAccessor (&GsqrRoutingProtocol::SetLearningRate),
@@ -50,28 +254,138 @@ GsqrRoutingProtocol::GetTypeId (void)
                    DoubleValue (0.01),
                    MakeDoubleAccessor (&GsqrRoutingProtocol::SetEnergyWeight),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("Routing", "The Q-learning state, with its own counters and trace sources",
+                   TypeId::ATTR_GET,
+                   PointerValue (),
+                   MakePointerAccessor (&GsqrRoutingProtocol::m_routing),
+                   MakePointerChecker<GsqrRouting> ())
+    .AddTraceSource ("RouteLookup",
+                     "A route was looked up for a destination; nextHop is this node "
+                     "while there is no neighbor, qEvaluations the candidates scored",
+                     MakeTraceSourceAccessor (&GsqrRoutingProtocol::m_routeLookupTrace),
+                     "ns3::GsqrRoutingProtocol::RouteLookupTracedCallback")
+    .AddTraceSource ("HelloTx", "A Hello was sent by this node",
+                     MakeTraceSourceAccessor (&GsqrRoutingProtocol::m_helloTxTrace),
+                     "ns3::GsqrRoutingProtocol::HelloTracedCallback")
+    .AddTraceSource ("HelloRx", "A Hello was received from a neighbor",
+                     MakeTraceSourceAccessor (&GsqrRoutingProtocol::m_helloRxTrace),
+                     "ns3::GsqrRoutingProtocol::HelloTracedCallback")
+    .AddTraceSource ("HelloDrop",
+                     "A Hello was refused by the socket, or received in an unknown version",
+                     MakeTraceSourceAccessor (&GsqrRoutingProtocol::m_helloDropTrace),
+                     "ns3::GsqrRoutingProtocol::HelloTracedCallback")
+    .AddTraceSource ("NeighborCount", "Number of neighbors currently heard",
+                     MakeTraceSourceAccessor (&GsqrRoutingProtocol::m_neighborCount),
+                     "ns3::TracedValueCallback::Uint32")
   ;
   return tid;
 }
 
 GsqrRoutingProtocol::GsqrRoutingProtocol ()
   : m_ipv4 (0),
-    m_routing (0),
-    m_embedding (0),
     m_helloInterval (Seconds (2.0)),
+    m_embeddingMemoryBudget (0),
+    m_updateInterval (2.0),
+    m_batchTdUpdates (false),
+    m_averageTdBatch (false),
+    m_multipathPaths (1),
+    m_multipathWeighting ("softmax"),
+    m_multipathTemperature (0.01),
+    m_flowTimeout (Seconds (1.0)),
+    m_checkpointInterval (Seconds (0)),
+    m_convergenceWindow (Seconds (2.0)),
+    m_convergenceThreshold (0.01),
     m_nodeId (0),
+    m_local (true),
+    m_wheelTick (0),
+    m_neighborHoldHellos (3),
+    m_interfaceSelectionName ("spread"),
+    m_spreadInterfaces (true),
+    m_outputInterface (0),
+    m_adaptiveHello (false),
+    m_helloMinInterval (Seconds (0.5)),
+    m_helloMaxInterval (Seconds (8.0)),
+    m_featureChangeThreshold (0.2),
+    m_helloExponent (0),
+    m_helloExponentMax (0),
+    m_advertisedETX (0.0),
+    m_advertisedEnergy (0.0),
+    m_advertisedQueue (0.0),
+    m_helloWindow (16),
+    m_queueSampleInterval (MilliSeconds (100)),
+    m_queueSmoothing (0.2),
+    m_helloIntervalCount (0),
+    m_helloResets (0),
+    m_maxHelloJitter (MilliSeconds (100)),
+    m_helloSequence (0),
+    m_hellosReceived (0),
+    m_hellosLost (0),
+    m_hellosSent (0),
+    m_hellosDropped (0),
+    m_ackBatchSize (8),
+    m_ackTimeout (MilliSeconds (200)),
+    m_energyPerBit (1e-6),
+    m_acksSent (0),
+    m_disseminationModeName ("none"),
+    m_disseminationMode (DISSEMINATE_NONE),
+    m_disseminationThreshold (0.05),
+    m_disseminationMaxRows (8),
+    m_disseminationInterval (Seconds (1.0)),
+    m_disseminationWeight (1.0),
+    m_deltaRowsSent (0),
+    m_deltaRowsReceived (0),
     m_controlPacketsSent (0),   
-    m_controlBytesSent (0)       
+    m_controlBytesSent (0),
+    m_routeOutputCalls (0),
+    m_routeInputCalls (0),
+    m_neighborCount (0),
+    m_helloPort (6543)
 {
   NS_LOG_FUNCTION (this);
+  m_helloJitter = CreateObject<UniformRandomVariable> ();
 }
 
 GsqrRoutingProtocol::~GsqrRoutingProtocol ()
+{
+  NS_LOG_FUNCTION (this);
+}
+
+void
+GsqrRoutingProtocol::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
   
-  delete m_routing;
-  delete m_embedding;
+  m_helloEvent.Cancel ();
+  m_cleanupEvent.Cancel ();
+  m_ackEvent.Cancel ();
+  m_deltaEvent.Cancel ();
+  m_queueSampleEvent.Cancel ();
+  m_pendingAcks.clear ();
+  for (auto& iface : m_interfaces) {
+    iface.second.socket->Close ();
+  }
+  m_interfaces.clear ();
+  if (m_routing) {
+    m_routing->Dispose ();
+    m_routing = 0;
+  }
+  m_embedding = 0;
+  m_embeddingBase = 0;
+  m_checkpointWriter = 0;
+  m_routeCache.clear ();
+  m_neighbors.clear ();
+  m_neighborWheel.clear ();
+  m_onLinkRoute = 0;
+  m_outputDevice = 0;
+  m_ipv4 = 0;
+  Ipv4RoutingProtocol::DoDispose ();
+}
+
+void
+GsqrRoutingProtocol::SetCheckpointWriter (Ptr<GsqrCheckpointWriter> writer)
+{
+  NS_LOG_FUNCTION (this << writer);
+  m_checkpointWriter = writer;
 }
 
 void
@@ -84,10 +398,75 @@ GsqrRoutingProtocol::SetIpv4 (Ptr<Ipv4> ipv4)
   m_ipv4 = ipv4;
   
   if (m_ipv4) {
-    m_nodeId = m_ipv4->GetObject<Node> ()->GetId ();
+    Ptr<Node> node = m_ipv4->GetObject<Node> ();
+    m_nodeId = node->GetId ();
+    // Every rank of a distributed run builds every node, under the same
+    // ids, but runs only its own; a copy held for another rank keeps
+    // just an empty table, and loads, schedules and saves nothing
+    m_local = (node->GetSystemId () == Simulator::GetSystemId ());
+    UpdateLocalAddresses ();
+    
+    // One embedding table per node, read and written by GsqrRouting
+    m_embedding = CreateObject<GsqrEmbedding> ();
+    m_embedding->SetAttribute ("Precision", StringValue (m_embeddingPrecision));
+    m_embedding->SetAttribute ("MemoryBudget", UintegerValue (m_embeddingMemoryBudget));
+    m_embedding->SetAttribute ("EvictionPolicy", StringValue (m_embeddingEvictionPolicy));
+    m_routing = CreateObject<GsqrRouting> ();
+    m_routing->SetAttribute ("UpdateInterval", DoubleValue (m_updateInterval));
+    m_routing->SetAttribute ("BatchUpdates", BooleanValue (m_local && m_batchTdUpdates));
+    m_routing->SetAttribute ("AverageBatch", BooleanValue (m_averageTdBatch));
+    m_routing->SetAttribute ("MultipathK", UintegerValue (m_multipathPaths));
+    m_routing->SetAttribute ("MultipathWeighting", StringValue (m_multipathWeighting));
+    m_routing->SetAttribute ("MultipathTemperature", DoubleValue (m_multipathTemperature));
+    m_routing->SetAttribute ("FlowTimeout", DoubleValue (m_flowTimeout.GetSeconds ()));
+    m_routing->SetAttribute ("CheckpointDirectory", StringValue (m_local ? m_checkpointDirectory : ""));
+    m_routing->SetAttribute ("CheckpointInterval", DoubleValue (m_checkpointInterval.GetSeconds ()));
+    m_routing->SetAttribute ("WarmStartDirectory", StringValue (m_local ? m_warmStartDirectory : ""));
+    m_routing->SetAttribute ("ConvergenceWindow",
+                             DoubleValue (m_local ? m_convergenceWindow.GetSeconds () : 0.0));
+    m_routing->SetAttribute ("ConvergenceThreshold", DoubleValue (m_convergenceThreshold));
+    m_routing->SetEmbeddingStore (m_embedding);
+    if (m_local && m_checkpointWriter) {
+      m_routing->SetCheckpointWriter (m_checkpointWriter);
+    }
+    if (m_local && !m_sageWeightsFile.empty ()) {
+      Ptr<GsqrSage> sage = CreateObject<GsqrSage> ();
+      if (sage->LoadWeights (m_sageWeightsFile)) {
+        m_routing->SetSage (sage);
+      }
+    }
+    if (m_embeddingBase) {
+      // Copy-on-write over the shared table instead of a private load
+      m_embedding->SetBase (m_embeddingBase);
+      m_routing->Initialize (m_nodeId);
+    } else {
+      m_routing->Initialize (m_nodeId, m_local ? m_embeddingFile : "");
+    }
     
-    m_routing = new GsqrRouting ();
-    m_embedding = new GsqrEmbedding ();
+    if (m_disseminationModeName == "hello") {
+      m_disseminationMode = DISSEMINATE_HELLO;
+    } else if (m_disseminationModeName == "message") {
+      m_disseminationMode = DISSEMINATE_MESSAGE;
+    } else if (m_disseminationModeName == "none") {
+      m_disseminationMode = DISSEMINATE_NONE;
+    } else {
+      NS_FATAL_ERROR ("Unknown DisseminationMode \"" << m_disseminationModeName
+                      << "\"; expected none, hello or message");
+    }
+    if (m_interfaceSelectionName == "spread" || m_interfaceSelectionName == "best") {
+      m_spreadInterfaces = (m_interfaceSelectionName == "spread");
+    } else {
+      NS_FATAL_ERROR ("Unknown InterfaceSelection \"" << m_interfaceSelectionName
+                      << "\"; expected best or spread");
+    }
+    // What was loaded is what every neighbor starts from
+    m_embedding->SetChangeTracking (m_disseminationMode != DISSEMINATE_NONE);
+    if (!m_local) {
+      return;
+    }
+    if (m_disseminationMode == DISSEMINATE_MESSAGE && !m_deltaEvent.IsRunning ()) {
+      m_deltaEvent = Simulator::Schedule (m_disseminationInterval, &GsqrRoutingProtocol::SendDelta, this);
+    }
     
     // Important: Check and start the interface manually
     for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); i++) {
@@ -105,7 +484,29 @@ GsqrRoutingProtocol::SetIpv4 (Ptr<Ipv4> ipv4)
     // Alternative: Start the Hello timer directly 
     //(try again later if the interface is not ready)
     if (!m_helloEvent.IsRunning ()) {
-      m_helloEvent = Simulator::Schedule (Seconds (1.0), &GsqrRoutingProtocol::SendHello, this);
+      // Anywhere in the first period, so nodes do not transmit in lockstep
+      Time start = Seconds (m_helloJitter->GetValue (0.0, GetBaseHelloInterval ().GetSeconds ()));
+      m_helloEvent = Simulator::Schedule (start, &GsqrRoutingProtocol::SendHello, this);
+    }
+    if (!m_queueSampleEvent.IsRunning () && m_queueSampleInterval.IsStrictlyPositive ()) {
+      m_queueSampleEvent = Simulator::Schedule (m_queueSampleInterval, &GsqrRoutingProtocol::SampleQueue, this);
+    }
+    
+    m_helloExponent = 0;
+    m_helloExponentMax = 0;
+    while (m_adaptiveHello && m_helloExponentMax < GsqrHelloHeader::MAX_INTERVAL_EXPONENT
+           && m_helloMinInterval * (2 << m_helloExponentMax) <= m_helloMaxInterval) {
+      m_helloExponentMax++;
+    }
+    
+    // A neighbor heard in tick t with exponent k expires at the end of tick
+    // t + hold * 2^k; one spare slot keeps the due slot apart from the one
+    // being filled
+    m_neighborWheel.assign ((m_neighborHoldHellos << m_helloExponentMax) + 2,
+                            std::vector<std::pair<uint32_t, uint32_t> > ());
+    m_wheelTick = 0;
+    if (!m_cleanupEvent.IsRunning ()) {
+      m_cleanupEvent = Simulator::Schedule (GetBaseHelloInterval (), &GsqrRoutingProtocol::CleanupNeighbors, this);
     }
   }
 }
@@ -116,38 +517,19 @@ GsqrRoutingProtocol::RouteOutput (Ptr<Packet> p, const Ipv4Header &header,
 {
   NS_LOG_FUNCTION (this << p << header << oif);
   
-  if (!m_ipv4) {
+  m_routeOutputCalls++;
+  if (!m_ipv4 || m_outputInterface == 0) {
     sockerr = Socket::ERROR_NOROUTETOHOST;
     return 0;
   }
   
-  Ipv4Address dest = header.GetDestination ();
-  sockerr = Socket::ERROR_NOTERROR;
-  
-  Ptr<Ipv4Route> route = Create<Ipv4Route> ();
-  route->SetDestination (dest);
-  
-  // Simplification: Find the next hop
-  // Method 1: Use the first non-loopback interface
-  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i) {
-    // Skip the loopback and down interfaces
-    if (i == 0) continue; // loopback
-    if (!m_ipv4->IsUp (i)) continue;
-    
-    uint32_t numAddr = m_ipv4->GetNAddresses (i);
-    if (numAddr == 0) continue;
-    
-    Ipv4InterfaceAddress ifAddr = m_ipv4->GetAddress (i, 0);
-    
-    route->SetGateway (Ipv4Address::GetZero ()); 
-    route->SetSource (ifAddr.GetLocal ());
-    route->SetOutputDevice (m_ipv4->GetNetDevice (i));
-    
-    NS_LOG_LOGIC ("RouteOutput: Using interface " << i 
-                  << " with address " << ifAddr.GetLocal ());
-    break;
+  uint32_t destId = ResolveNodeId (header.GetDestination ());
+  Ptr<Ipv4Route> route = LookupRoute (header.GetDestination (), destId, GetFlowId (header),
+                                      GsqrRouting::UNKNOWN_NODE, oif);
+  sockerr = route ? Socket::ERROR_NOTERROR : Socket::ERROR_NOROUTETOHOST;
+  if (route && p) {
+    TagForNextHop (p, destId);
   }
-  
   return route;
 }
 
@@ -161,41 +543,483 @@ GsqrRoutingProtocol::RouteInput (Ptr<const Packet> p, const Ipv4Header &header,
 {
   NS_LOG_FUNCTION (this << p << header << idev);
   
+  m_routeInputCalls++;
   if (!m_ipv4) {
     return false;
   }
   
-  // Check if it is a local address
+  // Local unicast or broadcast: deliver to the upper layer, which demuxes
+  // by the interface the packet came in on
+  int32_t iif = m_ipv4->GetInterfaceForDevice (idev);
   Ipv4Address destAddr = header.GetDestination ();
+  GsqrHopTag hopTag;
+  if (m_localAddresses.count (destAddr) != 0) {
+    // Last hop: the ACK reports no downstream Q
+    if (p->PeekPacketTag (hopTag) && !hopTag.IsControl ()) {
+      QueueAck (hopTag, p->GetSize (), 0.0);
+    }
+    if (!lcb.IsNull ()) {
+      lcb (p, header, iif);
+    }
+    return true;
+  }
+  if (m_broadcastAddresses.count (destAddr) != 0) {
+    if (!lcb.IsNull ()) {
+      lcb (p, header, iif);
+    }
+    return true;
+  }
   
-  // Method 1: Check all interfaces for this address
-  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i) {
-    for (uint32_t j = 0; j < m_ipv4->GetNAddresses (i); ++j) {
-      Ipv4InterfaceAddress ifAddr = m_ipv4->GetAddress (i, j);
-      
-      if (ifAddr.GetLocal () == destAddr) {
-        // This is a local address, delivered to the upper layer
-        if (!lcb.IsNull ()) {
-          lcb (p, header, header.GetProtocol ());
-        }
-        return true;
+  // Not a local address: forward towards the best-Q neighbor
+  if (destAddr.IsMulticast () || ucb.IsNull ()) {
+    return false;
+  }
+  if (iif < 0 || !m_ipv4->IsForwarding (iif)) {
+    NS_LOG_LOGIC ("Forwarding disabled for this interface");
+    if (!ecb.IsNull ()) {
+      ecb (p, header, Socket::ERROR_NOROUTETOHOST);
+    }
+    return true;
+  }
+  
+  bool tagged = p->PeekPacketTag (hopTag);
+  uint32_t previousHop = tagged ? hopTag.GetPreviousHop () : GsqrRouting::UNKNOWN_NODE;
+  uint32_t destId = ResolveNodeId (destAddr);
+  double qNextMax = 0.0;
+  Ptr<Ipv4Route> route = m_outputInterface != 0
+                           ? LookupRoute (destAddr, destId, GetFlowId (header), previousHop, 0, &qNextMax)
+                           : Ptr<Ipv4Route> ();
+  if (!route) {
+    // Dropped here, like AODV: no other protocol should try to forward it
+    NS_LOG_LOGIC ("No route to " << destAddr);
+    if (!ecb.IsNull ()) {
+      ecb (p, header, Socket::ERROR_NOROUTETOHOST);
+    }
+    return true;
+  }
+  
+  // Acknowledge the previous hop and restamp the packet for the next one
+  if (tagged && hopTag.IsControl ()) {
+    ucb (route, p, header);
+    return true;
+  }
+  if (tagged) {
+    QueueAck (hopTag, p->GetSize (), qNextMax);
+  }
+  Ptr<Packet> packet = p->Copy ();
+  TagForNextHop (packet, destId);
+  ucb (route, packet, header);
+  return true;
+}
+
+// Addresses of every node in the simulation, for destinations no Hello
+// names: beyond one hop ids are known only from here. Shared by all
+// instances, rebuilt on a miss at most once per simulated second, and
+// dropped with the simulation
+struct NodeAddressMap
+{
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> nodes;
+  Time built;
+  bool valid = false;
+};
+
+static NodeAddressMap &
+GetNodeAddressMap (void)
+{
+  static NodeAddressMap map;
+  return map;
+}
+
+static void
+ClearNodeAddressMap (void)
+{
+  NodeAddressMap &map = GetNodeAddressMap ();
+  map.nodes.clear ();
+  map.valid = false;
+}
+
+static void
+BuildNodeAddressMap (void)
+{
+  NodeAddressMap &map = GetNodeAddressMap ();
+  if (!map.valid) {
+    Simulator::ScheduleDestroy (&ClearNodeAddressMap);
+  }
+  map.nodes.clear ();
+  for (NodeList::Iterator nodeIt = NodeList::Begin (); nodeIt != NodeList::End (); ++nodeIt) {
+    Ptr<Ipv4> ipv4 = (*nodeIt)->GetObject<Ipv4> ();
+    if (!ipv4) {
+      continue;
+    }
+    // Interface 0 is the loopback every node shares
+    for (uint32_t i = 1; i < ipv4->GetNInterfaces (); ++i) {
+      for (uint32_t j = 0; j < ipv4->GetNAddresses (i); ++j) {
+        map.nodes[ipv4->GetAddress (i, j).GetLocal ()] = (*nodeIt)->GetId ();
       }
-      
-      // Check broadcast address
-      if (destAddr == ifAddr.GetBroadcast () || destAddr == Ipv4Address ("255.255.255.255")) {
-        if (!lcb.IsNull ()) {
-          lcb (p, header, header.GetProtocol ());
-        }
-        return true;
+    }
+  }
+  map.built = Simulator::Now ();
+  map.valid = true;
+}
+
+uint32_t
+GsqrRoutingProtocol::ResolveNodeId (Ipv4Address address) const
+{
+  auto addrIt = m_addressToNode.find (address);
+  if (addrIt != m_addressToNode.end ()) {
+    return addrIt->second;
+  }
+  
+  NodeAddressMap &map = GetNodeAddressMap ();
+  auto nodeIt = map.nodes.find (address);
+  if (nodeIt == map.nodes.end () && (!map.valid || Simulator::Now () >= map.built + Seconds (1.0))) {
+    BuildNodeAddressMap ();
+    nodeIt = map.nodes.find (address);
+  }
+  return nodeIt != map.nodes.end () ? nodeIt->second : GsqrRouting::UNKNOWN_NODE;
+}
+
+double
+GsqrRoutingProtocol::GetLinkETX (uint32_t neighborId) const
+{
+  auto neighborIt = m_neighbors.find (neighborId);
+  return neighborIt != m_neighbors.end () ? BestLink (neighborIt->second).linkETX : 0.0;
+}
+
+double
+GsqrRoutingProtocol::GetLinkETX (uint32_t neighborId, uint32_t interface) const
+{
+  auto neighborIt = m_neighbors.find (neighborId);
+  if (neighborIt != m_neighbors.end ()) {
+    for (const LinkInfo& link : neighborIt->second.links) {
+      if (link.interface == interface) {
+        return link.linkETX;
+      }
+    }
+  }
+  return 0.0;
+}
+
+double
+GsqrRoutingProtocol::MeasureMeanETX (void) const
+{
+  double sum = 0.0;
+  uint32_t links = 0;
+  for (const auto& neighbor : m_neighbors) {
+    for (const LinkInfo& link : neighbor.second.links) {
+      sum += link.linkETX;
+      links++;
+    }
+  }
+  // A node that hears nobody has no lossy link to report
+  return links > 0 ? sum / links : 1.0;
+}
+
+double
+GsqrRoutingProtocol::MeasureResidualEnergy (void) const
+{
+  // Nodes without an energy model count as mains powered
+  Ptr<EnergySourceContainer> sources = m_ipv4->GetObject<Node> ()->GetObject<EnergySourceContainer> ();
+  if (!sources || sources->GetN () == 0) {
+    return 100.0;
+  }
+  return 100.0 * sources->Get (0)->GetEnergyFraction ();
+}
+
+double
+GsqrRoutingProtocol::ReadQueueOccupancy (const InterfaceState &state) const
+{
+  if (!state.macQueue) {
+    return 0.0;
+  }
+  QueueSize limit = state.macQueue->GetMaxSize ();
+  if (limit.GetValue () == 0) {
+    return 0.0;
+  }
+  double held = limit.GetUnit () == QueueSizeUnit::PACKETS ? state.macQueue->GetNPackets ()
+                                                           : state.macQueue->GetNBytes ();
+  return std::min (held / limit.GetValue (), 1.0);
+}
+
+double
+GsqrRoutingProtocol::MeanQueueOccupancy (void) const
+{
+  if (m_interfaces.empty ()) {
+    return 0.0;
+  }
+  double sum = 0.0;
+  for (const auto& iface : m_interfaces) {
+    sum += iface.second.queueOccupancy;
+  }
+  return sum / m_interfaces.size ();
+}
+
+void
+GsqrRoutingProtocol::SampleQueue (void)
+{
+  for (auto& iface : m_interfaces) {
+    InterfaceState& state = iface.second;
+    state.queueOccupancy += m_queueSmoothing * (ReadQueueOccupancy (state) - state.queueOccupancy);
+  }
+  m_queueSampleEvent = Simulator::Schedule (m_queueSampleInterval, &GsqrRoutingProtocol::SampleQueue, this);
+}
+
+uint32_t
+GsqrRoutingProtocol::GetFlowId (const Ipv4Header &header) const
+{
+  // Locally originated packets may not have their source filled in yet
+  Ipv4Address source = header.GetSource () == Ipv4Address::GetAny () ? m_sourceAddress
+                                                                       : header.GetSource ();
+  uint32_t key[3] = {source.Get (), header.GetDestination ().Get (), header.GetProtocol ()};
+  return Hash32 (reinterpret_cast<const char *> (key), sizeof (key));
+}
+
+Ptr<Ipv4Route>
+GsqrRoutingProtocol::LookupRoute (Ipv4Address dest, uint32_t destId, uint32_t flowId,
+                                  uint32_t previousHop, Ptr<NetDevice> oif, double *bestQ)
+{
+  // A neighbor is reached directly; anything else goes to the neighbor
+  // with the best Q towards it, or with MultipathPaths > 1 to the one of
+  // the best few this flow is kept on. A destination with no embedding
+  // row yet is scored by neighbor bias alone, which would send the packet
+  // back and forth between two nodes, so the hop it came from is skipped.
+  if (destId != GsqrRouting::UNKNOWN_NODE) {
+    auto neighborIt = m_neighbors.find (destId);
+    if (neighborIt != m_neighbors.end ()) {
+      m_routeLookupTrace (destId, destId, 0);
+      if (bestQ) {
+        *bestQ = m_routing->ComputeQValue (destId, destId);
       }
+      return GetNextHopRoute (neighborIt->second, ChooseLink (neighborIt->second, flowId, oif));
     }
   }
   
-  // Not a local address. Forwarding is required 
-  // (simplified implementation)
+  uint64_t evaluations = m_routing->GetNumQEvaluations ();
+  uint32_t nextHop = previousHop != GsqrRouting::UNKNOWN_NODE && !m_routing->HasDestinationRow (destId)
+                       ? m_routing->SelectNextHopExcluding (destId, previousHop, bestQ)
+                       : m_routing->SelectMultipathHop (destId, flowId, bestQ);
+  m_routeLookupTrace (destId, nextHop,
+                      static_cast<uint32_t> (m_routing->GetNumQEvaluations () - evaluations));
+  auto neighborIt = m_neighbors.find (nextHop);
+  if (nextHop != m_nodeId && neighborIt != m_neighbors.end ()) {
+    NS_LOG_LOGIC ("Node " << m_nodeId << " forwards to " << dest << " via node " << nextHop);
+    return GetNextHopRoute (neighborIt->second, ChooseLink (neighborIt->second, flowId, oif));
+  }
   
+  // No neighbor yet: hand the packet to the link, as a single-hop network would
+  if (!m_onLinkRoute) {
+    m_onLinkRoute = Create<Ipv4Route> ();
+    m_onLinkRoute->SetDestination (Ipv4Address::GetAny ());
+    m_onLinkRoute->SetGateway (Ipv4Address::GetZero ());
+    m_onLinkRoute->SetSource (m_sourceAddress);
+    m_onLinkRoute->SetOutputDevice (m_outputDevice);
+  }
+  return m_onLinkRoute;
+}
+
+const GsqrRoutingProtocol::LinkInfo&
+GsqrRoutingProtocol::ChooseLink (const NeighborInfo& neighbor, uint32_t flowId, Ptr<NetDevice> oif) const
+{
+  // One radio, the common case: nothing to choose
+  if (neighbor.links.size () == 1) {
+    return neighbor.links.front ();
+  }
+  // A socket bound to a device sends over it when the neighbor is heard there
+  if (oif) {
+    for (const LinkInfo& link : neighbor.links) {
+      auto iface = m_interfaces.find (link.interface);
+      if (iface != m_interfaces.end () && iface->second.device == oif) {
+        return link;
+      }
+    }
+  }
   
-  return false;
+  // Each link weighs 1 / (ETX (queue occupancy + 0.05)): lossy links and
+  // busy radios get fewer flows. A flow keeps its link while the weights
+  // hold, since its hash picks the point it falls on.
+  auto weight = [this](const LinkInfo& link) {
+    auto iface = m_interfaces.find (link.interface);
+    double queue = iface != m_interfaces.end () ? iface->second.queueOccupancy : 0.0;
+    return 1.0 / (link.linkETX * (queue + 0.05));
+  };
+  double total = 0.0;
+  const LinkInfo* best = &neighbor.links.front ();
+  double bestWeight = 0.0;
+  for (const LinkInfo& link : neighbor.links) {
+    double w = weight (link);
+    total += w;
+    if (w > bestWeight) {
+      best = &link;
+      bestWeight = w;
+    }
+  }
+  if (!m_spreadInterfaces) {
+    return *best;
+  }
+  double point = flowId / 4294967296.0 * total;
+  for (const LinkInfo& link : neighbor.links) {
+    double w = weight (link);
+    if (point < w) {
+      return link;
+    }
+    point -= w;
+  }
+  return neighbor.links.back ();
+}
+
+const GsqrRoutingProtocol::LinkInfo&
+GsqrRoutingProtocol::BestLink (const NeighborInfo& neighbor) const
+{
+  const LinkInfo* best = &neighbor.links.front ();
+  for (const LinkInfo& link : neighbor.links) {
+    if (link.linkETX < best->linkETX) {
+      best = &link;
+    }
+  }
+  return *best;
+}
+
+Ptr<Ipv4Route>
+GsqrRoutingProtocol::GetNextHopRoute (const NeighborInfo& neighbor, const LinkInfo& link)
+{
+  // One route object per link, shared by every destination behind it;
+  // Ipv4L3Protocol reads only the gateway, source and device
+  Ptr<Ipv4Route>& route = m_routeCache[(static_cast<uint64_t> (neighbor.nodeId) << 32) | link.interface];
+  if (!route) {
+    const InterfaceState& iface = m_interfaces.at (link.interface);
+    route = Create<Ipv4Route> ();
+    route->SetDestination (link.address);
+    route->SetGateway (link.address);
+    route->SetSource (iface.local);
+    route->SetOutputDevice (iface.device);
+  }
+  return route;
+}
+
+void
+GsqrRoutingProtocol::SelectOutputInterface (void)
+{
+  NS_LOG_FUNCTION (this);
+  
+  // Runs on interface and address changes only, never per packet
+  m_outputInterface = 0;
+  m_outputDevice = 0;
+  m_sourceAddress = Ipv4Address ();
+  if (!m_interfaces.empty ()) {
+    auto primary = m_interfaces.begin ();
+    m_outputInterface = primary->first;
+    m_outputDevice = primary->second.device;
+    m_sourceAddress = primary->second.local;
+  }
+  m_routeCache.clear ();
+  m_onLinkRoute = 0;
+}
+
+void
+GsqrRoutingProtocol::OpenInterface (uint32_t interface)
+{
+  if (!m_local) {
+    return;
+  }
+  if (interface == 0 || !m_ipv4->IsUp (interface) || m_ipv4->GetNAddresses (interface) == 0) {
+    CloseInterface (interface);
+    return;
+  }
+  Ipv4Address localAddress = m_ipv4->GetAddress (interface, 0).GetLocal ();
+  auto found = m_interfaces.find (interface);
+  if (found != m_interfaces.end () && found->second.local == localAddress) {
+    return;
+  }
+  NS_LOG_FUNCTION (this << interface << localAddress);
+  
+  InterfaceState& state = m_interfaces[interface];
+  if (state.socket) {
+    state.socket->Close ();
+  }
+  state.device = m_ipv4->GetNetDevice (interface);
+  state.local = localAddress;
+  state.queueOccupancy = 0.0;
+  
+  // Bound to the device, so that broadcasts leave and are heard by this
+  // radio only, and to any address, the only endpoint a limited
+  // broadcast is demultiplexed to
+  state.socket = Socket::CreateSocket (GetObject<Node> (), UdpSocketFactory::GetTypeId ());
+  state.socket->BindToNetDevice (state.device);
+  state.socket->Bind (InetSocketAddress (Ipv4Address::GetAny (), m_helloPort));
+  state.socket->SetAllowBroadcast (true);
+  state.socket->SetRecvCallback ([this, interface](Ptr<Socket> socket) {
+    this->ReceiveHello (socket, interface);
+  });
+  
+  // Data goes out best effort; without QoS that is the DCF queue
+  state.macQueue = 0;
+  Ptr<WifiNetDevice> wifi = DynamicCast<WifiNetDevice> (state.device);
+  if (wifi && wifi->GetMac ()) {
+    Ptr<WifiMac> mac = wifi->GetMac ();
+    state.macQueue = mac->GetTxopQueue (mac->GetQosSupported () ? AC_BE : AC_BE_NQOS);
+  }
+  m_routeCache.clear ();
+  NS_LOG_INFO ("GSQR Node " << m_nodeId << " Hello socket bound to " << localAddress << ":"
+               << m_helloPort << " on interface " << interface);
+}
+
+void
+GsqrRoutingProtocol::CloseInterface (uint32_t interface)
+{
+  auto found = m_interfaces.find (interface);
+  if (found == m_interfaces.end ()) {
+    return;
+  }
+  NS_LOG_FUNCTION (this << interface);
+  found->second.socket->Close ();
+  m_interfaces.erase (found);
+  
+  std::vector<uint32_t> stranded;
+  for (const auto& neighbor : m_neighbors) {
+    for (const LinkInfo& link : neighbor.second.links) {
+      if (link.interface == interface) {
+        stranded.push_back (neighbor.first);
+      }
+    }
+  }
+  for (uint32_t neighborId : stranded) {
+    ExpireLink (neighborId, interface);
+  }
+}
+
+void
+GsqrRoutingProtocol::InitializeHelloSockets (void)
+{
+  NS_LOG_FUNCTION (this);
+  
+  if (!m_ipv4) {
+    return;
+  }
+  for (uint32_t i = 1; i < m_ipv4->GetNInterfaces (); i++) {
+    OpenInterface (i);
+  }
+  SelectOutputInterface ();
+}
+
+void
+GsqrRoutingProtocol::UpdateLocalAddresses (void)
+{
+  NS_LOG_FUNCTION (this);
+  
+  // Rebuilt from scratch: two addresses can share a subnet broadcast
+  m_localAddresses.clear ();
+  m_broadcastAddresses.clear ();
+  m_broadcastAddresses.insert (Ipv4Address::GetBroadcast ());
+  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i) {
+    if (!m_ipv4->IsUp (i)) {
+      continue;
+    }
+    for (uint32_t j = 0; j < m_ipv4->GetNAddresses (i); ++j) {
+      Ipv4InterfaceAddress ifAddr = m_ipv4->GetAddress (i, j);
+      m_localAddresses.insert (ifAddr.GetLocal ());
+      m_broadcastAddresses.insert (ifAddr.GetBroadcast ());
+    }
+  }
 }
 
 void
@@ -203,40 +1027,23 @@ GsqrRoutingProtocol::NotifyInterfaceUp (uint32_t interface)
 {
   NS_LOG_FUNCTION (this << interface);
   
+  UpdateLocalAddresses ();
   if (interface > 0) { 
     NS_LOG_INFO ("Interface " << interface << " is up, starting GSQR protocol");
-    
     if (m_ipv4->GetNAddresses (interface) > 0) {
       Ipv4InterfaceAddress addr = m_ipv4->GetAddress (interface, 0);
       NS_LOG_INFO ("  Address: " << addr.GetLocal () 
                     << "/" << addr.GetMask ().GetPrefixLength ());
     }
     
-    // +++ Hello Socket +++
-    if (!m_socket) {
-      m_helloPort = 6543; // Fixed port, or configurable parameter
-      
-      // 1. Crreate UDP Socket
-      m_socket = Socket::CreateSocket (GetObject<Node> (), UdpSocketFactory::GetTypeId ());
-      
-      // 2. Bind to local IP and Hello port
-      Ipv4Address localAddress = m_ipv4->GetAddress (interface, 0).GetLocal ();
-      InetSocketAddress local = InetSocketAddress (localAddress, m_helloPort);
-      m_socket->Bind (local);
-      
-      // 3. Set broadcast permissions
-      m_socket->SetAllowBroadcast (true);
-      
-      // 4. Set callback
-      //m_socket->SetRecvCallback (MakeCallback (&GsqrRoutingProtocol::ReceiveHelloPacket, this));
-      m_socket->SetRecvCallback (MakeCallback (&GsqrRoutingProtocol::ReceiveHello, this));
-      //m_socket->SetRecvCallback (MakeCallback (&GsqrRoutingProtocol::ReceiveHello, this, std::placeholders::_1));
-      
-      NS_LOG_INFO ("GSQR Node " << m_nodeId << " Hello socket bound to " << localAddress << ":" << m_helloPort);
-    }
+    // Every radio has its own Hello socket and its own neighbors
+    OpenInterface (interface);
+    SelectOutputInterface ();
+    
     // Start the Hello timer (if not already started)
-    if (!m_helloEvent.IsRunning ()) {
-      m_helloEvent = Simulator::Schedule (Seconds (0.5), &GsqrRoutingProtocol::SendHello, this);
+    if (m_local && !m_helloEvent.IsRunning ()) {
+      Time start = Seconds (m_helloJitter->GetValue (0.0, GetBaseHelloInterval ().GetSeconds ()));
+      m_helloEvent = Simulator::Schedule (start, &GsqrRoutingProtocol::SendHello, this);
     }
   }
 }
@@ -245,18 +1052,34 @@ void
 GsqrRoutingProtocol::NotifyInterfaceDown (uint32_t interface)
 {
   NS_LOG_FUNCTION (this << interface);
+  UpdateLocalAddresses ();
+  CloseInterface (interface);
+  SelectOutputInterface ();
 }
 
 void
 GsqrRoutingProtocol::NotifyAddAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
+  if (!m_ipv4) {
+    return;
+  }
+  UpdateLocalAddresses ();
+  OpenInterface (interface);
+  SelectOutputInterface ();
 }
 
 void
 GsqrRoutingProtocol::NotifyRemoveAddress (uint32_t interface, Ipv4InterfaceAddress address)
 {
   NS_LOG_FUNCTION (this << interface << address);
+  if (!m_ipv4) {
+    return;
+  }
+  // Rebound to the address left, or closed if there is none
+  UpdateLocalAddresses ();
+  OpenInterface (interface);
+  SelectOutputInterface ();
 }
 
 void
@@ -271,6 +1094,10 @@ GsqrRoutingProtocol::PrintRoutingTable (Ptr<OutputStreamWrapper> stream, Time::U
     *stream->GetStream () << "Neighbor " << neighbor.first 
                          << " (last seen: " << neighbor.second.lastSeen.GetSeconds () << "s)"
                          << std::endl;
+    for (const LinkInfo& link : neighbor.second.links) {
+      *stream->GetStream () << "  interface " << link.interface << " via " << link.address
+                           << ", ETX " << link.linkETX << std::endl;
+    }
   }
   
   *stream->GetStream () << std::endl;
@@ -326,113 +1153,189 @@ GsqrRoutingProtocol::SendHello (void)
 {
     NS_LOG_FUNCTION (this);
     
-    // If the Socket does not exist, try to create it
-    if (!m_socket) {
-      InitializeHelloSocket ();
+    // If no socket exists yet, try to create them
+    if (m_interfaces.empty ()) {
+      InitializeHelloSockets ();
     }
     
-    if (!m_socket || !m_ipv4) {
+    if (m_interfaces.empty () || !m_ipv4) {
       NS_LOG_WARN ("GSQR Node " << m_nodeId << " cannot send Hello: socket/IPv4 not ready");
       ScheduleNextHello ();
       return;
     }
-    
-    // check
-    if (!m_socket || !m_ipv4) {
-      NS_LOG_WARN ("GSQR Node " << m_nodeId << " cannot send Hello: socket/IPv4 not ready");
-      ScheduleNextHello();
-      return;
-    }
-    
 
     // 1. Create a Hello Header with data
     GsqrHelloHeader helloHeader;
     helloHeader.SetNodeId (m_nodeId);
-    helloHeader.SetTimestamp (Simulator::Now ().GetSeconds ());
-    helloHeader.SetMeanETX (1.5);
-    helloHeader.SetResidualEnergy (95.0);
-    helloHeader.SetQueueLength (0.1);
+    helloHeader.SetSequence (m_helloSequence++);
+    helloHeader.SetTimestamp (Simulator::Now ());
+    if (!m_queueSampleInterval.IsStrictlyPositive ()) {
+      for (auto& iface : m_interfaces) {
+        iface.second.queueOccupancy = ReadQueueOccupancy (iface.second);
+      }
+    }
+    double etx = MeasureMeanETX ();
+    double energy = MeasureResidualEnergy ();
+    double queue = MeanQueueOccupancy ();
+    helloHeader.SetMeanETX (etx);
+    helloHeader.SetResidualEnergy (energy);
+    helloHeader.SetQueueLength (queue);
     
-    // 2. Create Packet
-    Ptr<Packet> packet = Create<Packet> (0);
+    // Our own advertisement moving counts as a change, like a neighbor's
+    if (FeatureChanged (m_advertisedETX, etx, m_featureChangeThreshold)
+        || FeatureChanged (m_advertisedEnergy, energy, m_featureChangeThreshold)
+        || FeatureChanged (m_advertisedQueue, queue, m_featureChangeThreshold)) {
+      m_helloExponent = 0;
+    }
+    m_advertisedETX = etx;
+    m_advertisedEnergy = energy;
+    m_advertisedQueue = queue;
+    m_routing->UpdateNodeFeatures (m_nodeId, etx, energy, queue);
+    helloHeader.SetIntervalExponent (m_helloExponent);
+    
+    // Pending ACKs ride along instead of going out on their own
+    for (auto& pending : m_pendingAcks) {
+      GsqrAckHeader ack;
+      if (!BuildAck (pending.first, ack)) {
+        continue;
+      }
+      Ptr<Packet> ackPacket = Create<Packet> ();
+      ackPacket->AddHeader (ack);
+      std::vector<uint8_t> value (ackPacket->GetSize ());
+      ackPacket->CopyData (value.data (), value.size ());
+      helloHeader.AddExtension (GsqrHelloHeader::EXT_ACK, value);
+    }
+    m_pendingAcks.clear ();
+    m_ackEvent.Cancel ();
+    
+    GsqrDeltaHeader delta;
+    if (m_disseminationMode == DISSEMINATE_HELLO && BuildDelta (delta)) {
+      Ptr<Packet> deltaPacket = Create<Packet> ();
+      deltaPacket->AddHeader (delta);
+      std::vector<uint8_t> value (deltaPacket->GetSize ());
+      deltaPacket->CopyData (value.data (), value.size ());
+      helloHeader.AddExtension (GsqrHelloHeader::EXT_DELTA, value);
+    }
+    
+    // 2. Create Packet
+    Ptr<Packet> packet = Create<Packet> (0);
     packet->AddHeader (helloHeader);
-    uint32_t pktSize = packet->GetSize ();
+    GsqrHopTag controlTag;
+    controlTag.SetControl (true);
+    packet->AddPacketTag (controlTag);
+    // Bytes on the air above the MAC: Hello, UDP and IPv4 headers
+    uint32_t pktSize = packet->GetSize () + 8 + 20;
     
-    // 3.send to broadcast Address
+    // 3. Send a copy to the broadcast address of every radio; receivers
+    // act on the first and only count the others for the links' ETX
     Ipv4Address broadcastAddr ("255.255.255.255");
     InetSocketAddress remote = InetSocketAddress (broadcastAddr, m_helloPort);
-    
-    int bytesSent = m_socket->SendTo (packet, 0, remote);
-    
-    // 4. Statistical control packet 
-    //(counted only when sent successfully)
-    NS_LOG_INFO("Before sending - Hello count: " << m_controlPacketsSent 
-                << ", Control bytes: " << m_controlBytesSent);
-    if (bytesSent > 0) {
+    uint32_t sent = 0;
+    for (auto& iface : m_interfaces) {
+      int bytesSent = iface.second.socket->SendTo (packet->Copy (), 0, remote);
+      
+      // 4. Statistical control packet 
+      //(counted only when sent successfully)
+      if (bytesSent > 0) {
         m_controlPacketsSent++;        
         m_controlBytesSent += pktSize;   
-        
+        m_hellosSent++;
+        m_helloTxTrace (packet, m_nodeId);
+        sent++;
         NS_LOG_INFO("After sending - Hello count: " << m_controlPacketsSent 
                     << ", Control bytes: " << m_controlBytesSent
-                    << ", This packet size: " << pktSize);
-    } else {
-        NS_LOG_WARN ("GSQR Node " << m_nodeId << " failed to send Hello");
+                    << ", This packet size: " << pktSize
+                    << ", interface " << iface.first);
+      } else {
+        NS_LOG_WARN ("GSQR Node " << m_nodeId << " failed to send Hello on interface " << iface.first);
+        m_hellosDropped++;
+        m_helloDropTrace (packet, m_nodeId);
+      }
+    }
+    if (sent > 0) {
+      if (m_hellosSent > sent) {
+        m_helloIntervalSum += Simulator::Now () - m_lastHelloSent;
+        m_helloIntervalCount++;
+      }
+      m_lastHelloSent = Simulator::Now ();
     }
     
-    // 5. Schedule Next Hello
+    // 5. Schedule Next Hello, at the interval just advertised
     ScheduleNextHello();
+    if (m_helloExponent < m_helloExponentMax) {
+      m_helloExponent++;
+    }
    
 }
 
 void
-GsqrRoutingProtocol::InitializeHelloSocket (void)
+GsqrRoutingProtocol::ScheduleNextHello()
 {
-  NS_LOG_FUNCTION (this);
-  
-  if (m_socket || !m_ipv4) {
+  m_helloEvent = Simulator::Schedule (JitterHelloDelay (GetCurrentHelloInterval ()),
+                                      &GsqrRoutingProtocol::SendHello, this);
+}
+
+Time
+GsqrRoutingProtocol::JitterHelloDelay (Time delay)
+{
+  Time jitter = std::min (m_maxHelloJitter, delay / 4);
+  return delay - Seconds (m_helloJitter->GetValue (0.0, jitter.GetSeconds ()));
+}
+
+int64_t
+GsqrRoutingProtocol::AssignStreams (int64_t stream)
+{
+  NS_LOG_FUNCTION (this << stream);
+  m_helloJitter->SetStream (stream);
+  if (m_routing) {
+    m_routing->AssignStreams (stream + 1);
+  }
+  return 2;
+}
+
+void
+GsqrRoutingProtocol::ResetHelloInterval (void)
+{
+  // Already at the minimum: the pending Hello is no later than that
+  if (!m_adaptiveHello || m_helloExponent == 0) {
     return;
   }
+  NS_LOG_FUNCTION (this);
   
-  // Find the first non-loopback UP interface
-  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); i++) {
-    if (i == 0) continue; 
-    
-    if (m_ipv4->IsUp (i) && m_ipv4->GetNAddresses (i) > 0) {
-      m_helloPort = 6543;
-      
-      // 1. Create UDP Socket
-      m_socket = Socket::CreateSocket (GetObject<Node> (), UdpSocketFactory::GetTypeId ());
-      
-      // 2. Bind to local IP and Hello port
-      Ipv4Address localAddress = m_ipv4->GetAddress (i, 0).GetLocal ();
-      InetSocketAddress local = InetSocketAddress (localAddress, m_helloPort);
-      m_socket->Bind (local);
-      
-      // 3. Set broadcast permissions
-      m_socket->SetAllowBroadcast (true);
-      
-      // 4. Set callback
-      m_socket->SetRecvCallback ([this](Ptr<Socket> socket) {
-        this->ReceiveHello (socket);
-      });
-      
-      NS_LOG_INFO ("GSQR Node " << m_nodeId << " Hello socket bound to " 
-                  << localAddress << ":" << m_helloPort);
-      break;
-    }
+  m_helloExponent = 0;
+  m_helloResets++;
+  if (m_helloEvent.IsRunning () && Simulator::GetDelayLeft (m_helloEvent) > m_helloMinInterval) {
+    m_helloEvent.Cancel ();
+    m_helloEvent = Simulator::Schedule (JitterHelloDelay (m_helloMinInterval),
+                                        &GsqrRoutingProtocol::SendHello, this);
   }
 }
 
-void
-GsqrRoutingProtocol::ScheduleNextHello()
+Time
+GsqrRoutingProtocol::GetBaseHelloInterval (void) const
+{
+  return m_adaptiveHello ? m_helloMinInterval : m_helloInterval;
+}
+
+Time
+GsqrRoutingProtocol::GetCurrentHelloInterval (void) const
+{
+  return GetBaseHelloInterval () * (1 << m_helloExponent);
+}
+
+Time
+GsqrRoutingProtocol::GetMeanHelloInterval (void) const
 {
-  m_helloEvent = Simulator::Schedule (m_helloInterval, &GsqrRoutingProtocol::SendHello, this);
+  if (m_helloIntervalCount == 0) {
+    return GetCurrentHelloInterval ();
+  }
+  return m_helloIntervalSum / m_helloIntervalCount;
 }
 
 void
-GsqrRoutingProtocol::ReceiveHello (Ptr<Socket> socket)
+GsqrRoutingProtocol::ReceiveHello (Ptr<Socket> socket, uint32_t interface)
 {
-  NS_LOG_FUNCTION (this << socket);
+  NS_LOG_FUNCTION (this << socket << interface);
   
   Address fromAddr;
   Ptr<Packet> packet = socket->RecvFrom (fromAddr);
@@ -441,9 +1344,42 @@ GsqrRoutingProtocol::ReceiveHello (Ptr<Socket> socket)
     return;
   }
   
+  // Standalone ACKs and deltas share the Hello port
+  uint8_t kind;
+  packet->CopyData (&kind, 1);
+  if (kind == GsqrAckHeader::TYPE) {
+    GsqrAckHeader ack;
+    packet->RemoveHeader (ack);
+    HandleAck (ack);
+    return;
+  }
+  if (kind == GsqrDeltaHeader::TYPE) {
+    GsqrDeltaHeader delta;
+    packet->RemoveHeader (delta);
+    // Broadcast on every radio of the sender: taken from the lowest
+    // interface it is heard on, so that it is applied once
+    auto sender = m_neighbors.find (delta.GetSender ());
+    if (sender != m_neighbors.end ()) {
+      for (const LinkInfo& link : sender->second.links) {
+        if (link.interface < interface) {
+          return;
+        }
+      }
+    }
+    HandleDelta (delta);
+    return;
+  }
+  
   // 1. Get Hello Header
   GsqrHelloHeader helloHeader;
   packet->PeekHeader (helloHeader);
+  if (helloHeader.GetVersion () != GsqrHelloHeader::VERSION) {
+    NS_LOG_DEBUG ("GSQR Node " << m_nodeId << " drops Hello of version "
+                  << static_cast<uint32_t> (helloHeader.GetVersion ()));
+    m_hellosDropped++;
+    m_helloDropTrace (packet, helloHeader.GetNodeId ());
+    return;
+  }
   
   uint32_t neighborId = helloHeader.GetNodeId ();
   
@@ -451,24 +1387,115 @@ GsqrRoutingProtocol::ReceiveHello (Ptr<Socket> socket)
   InetSocketAddress inetFromAddr = InetSocketAddress::ConvertFrom (fromAddr);
   Ipv4Address senderIp = inetFromAddr.GetIpv4 ();
   
-  // 3. Update or create neighbor information
+  // 3. Update or create neighbor information, and its link over this interface
+  auto found = m_neighbors.find (neighborId);
+  bool isNew = (found == m_neighbors.end ());
   NeighborInfo& neighbor = m_neighbors[neighborId];
-  neighbor.nodeId = neighborId;
+  auto linkIt = std::find_if (neighbor.links.begin (), neighbor.links.end (),
+                              [interface](const LinkInfo& l) { return l.interface == interface; });
+  bool isNewLink = (linkIt == neighbor.links.end ());
+  if (!isNewLink && linkIt->address != senderIp) {
+    // Another radio of the sender on the same channel: the link keeps the
+    // gateway it was formed with until it expires
+    NS_LOG_LOGIC ("GSQR Node " << m_nodeId << " ignores Hello of " << neighborId
+                  << " from " << senderIp << " on interface " << interface);
+    return;
+  }
+  if (!isNewLink && helloHeader.GetSequence () == linkIt->lastSequence) {
+    // A duplicate of the Hello last heard on this link: counting it would
+    // take the sequence gap for 255 lost Hellos
+    NS_LOG_LOGIC ("GSQR Node " << m_nodeId << " ignores duplicate Hello "
+                  << static_cast<uint32_t> (helloHeader.GetSequence ()) << " of " << neighborId);
+    return;
+  }
+  if (isNewLink) {
+    neighbor.links.push_back (LinkInfo ());
+    linkIt = neighbor.links.end () - 1;
+    linkIt->interface = interface;
+  }
+  LinkInfo& link = *linkIt;
+  m_hellosReceived++;
+  m_helloRxTrace (packet, neighborId);
+  if (!isNewLink) {
+    // Hellos between the last one heard and this one never arrived
+    uint8_t missing = static_cast<uint8_t> (helloHeader.GetSequence () - link.lastSequence - 1);
+    m_hellosLost += missing;
+    uint32_t shift = missing + 1u;
+    link.helloWindow = shift < 32 ? (link.helloWindow << shift) | 1u : 1u;
+    link.windowFill = static_cast<uint8_t> (std::min<uint32_t> (link.windowFill + shift, m_helloWindow));
+  } else {
+    link.helloWindow = 1;
+    link.windowFill = 1;
+  }
+  // Links are taken as symmetric: the reverse ratio stands in for the
+  // forward one that only the neighbor could measure
+  uint32_t mask = m_helloWindow < 32 ? (1u << m_helloWindow) - 1 : 0xffffffffu;
+  double ratio = static_cast<double> (std::bitset<32> (link.helloWindow & mask).count ())
+                 / std::max<uint32_t> (link.windowFill, 1);
+  link.linkETX = 1.0 / (ratio * ratio);
+  link.lastSequence = helloHeader.GetSequence ();
+  if (isNewLink) {
+    // A neighbor that renumbers forms a new link once the old one expires
+    m_addressToNode[senderIp] = neighborId;
+    m_routeCache.erase ((static_cast<uint64_t> (neighborId) << 32) | interface);
+    link.address = senderIp;
+  }
+  
+  // Due once hold of the sender's advertised intervals pass in silence;
+  // at most one wheel entry per link and tick
+  uint64_t hold = static_cast<uint64_t> (m_neighborHoldHellos) << helloHeader.GetIntervalExponent ();
+  uint64_t expiryTick = m_wheelTick + std::min<uint64_t> (hold + 1, m_neighborWheel.size () - 1);
+  if (isNewLink || link.expiryTick != expiryTick) {
+    link.expiryTick = expiryTick;
+    m_neighborWheel[expiryTick % m_neighborWheel.size ()].push_back (std::make_pair (neighborId, interface));
+  }
   neighbor.lastSeen = Simulator::Now ();
+  
+  // The same Hello heard on another radio only counted for that link
+  if (!isNew && helloHeader.GetSequence () == neighbor.helloSequence) {
+    if (isNewLink) {
+      ResetHelloInterval ();
+    }
+    return;
+  }
+  neighbor.helloSequence = helloHeader.GetSequence ();
+  if (isNew || isNewLink
+      || FeatureChanged (neighbor.meanETX, helloHeader.GetMeanETX (), m_featureChangeThreshold)
+      || FeatureChanged (neighbor.residualEnergy, helloHeader.GetResidualEnergy (), m_featureChangeThreshold)
+      || FeatureChanged (neighbor.queueLength, helloHeader.GetQueueLength (), m_featureChangeThreshold)) {
+    ResetHelloInterval ();
+  }
+  neighbor.nodeId = neighborId;
   neighbor.meanETX = helloHeader.GetMeanETX ();
   neighbor.residualEnergy = helloHeader.GetResidualEnergy ();
   neighbor.queueLength = helloHeader.GetQueueLength ();
+  m_routing->UpdateNodeFeatures (neighborId, neighbor.meanETX, neighbor.residualEnergy,
+                                 neighbor.queueLength);
+  if (isNew) {
+    m_routing->AddNeighbor (m_nodeId, neighborId);
+    m_neighborCount = static_cast<uint32_t> (m_neighbors.size ());
+  }
   
-  // The record is received from which interface (for routing decisions)
-  for (uint32_t i = 0; i < m_ipv4->GetNInterfaces (); ++i) {
-    if (m_ipv4->GetAddress (i, 0).GetLocal () == senderIp) {
-      neighbor.interface = i;
-      break;
+  // ACKs piggybacked for any of the sender's previous hops, and its deltas
+  for (uint32_t i = 0; i < helloHeader.GetNExtensions (); ++i) {
+    const std::vector<uint8_t>& value = helloHeader.GetExtensionValue (i);
+    if (helloHeader.GetExtensionType (i) == GsqrHelloHeader::EXT_ACK) {
+      Ptr<Packet> ackPacket = Create<Packet> (value.data (), value.size ());
+      GsqrAckHeader ack;
+      ackPacket->RemoveHeader (ack);
+      if (ack.GetReceiver () == m_nodeId) {
+        HandleAck (ack);
+      }
+    } else if (helloHeader.GetExtensionType (i) == GsqrHelloHeader::EXT_DELTA) {
+      Ptr<Packet> deltaPacket = Create<Packet> (value.data (), value.size ());
+      GsqrDeltaHeader delta;
+      deltaPacket->RemoveHeader (delta);
+      HandleDelta (delta);
     }
   }
   
   NS_LOG_DEBUG ("GSQR Node " << m_nodeId << " received Hello from Node " 
-                << neighborId << " via " << senderIp 
+                << neighborId << " via " << senderIp << " on interface " << interface
                 << ", ETX=" << neighbor.meanETX);
 }
 
@@ -476,17 +1503,289 @@ void
 GsqrRoutingProtocol::CleanupNeighbors (void)
 {
   NS_LOG_FUNCTION (this);
+  
+  // Slot of the tick now due; each entry is visited once, so expiry costs
+  // O(1) per Hello received
+  m_wheelTick++;
+  std::vector<std::pair<uint32_t, uint32_t> > due;
+  due.swap (m_neighborWheel[m_wheelTick % m_neighborWheel.size ()]);
+  for (const auto& entry : due) {
+    auto it = m_neighbors.find (entry.first);
+    if (it == m_neighbors.end ()) {
+      continue;
+    }
+    // Already gone, or heard again and filed under a later tick
+    for (const LinkInfo& link : it->second.links) {
+      if (link.interface == entry.second && link.expiryTick == m_wheelTick) {
+        ExpireLink (entry.first, entry.second);
+        break;
+      }
+    }
+  }
+  
+  m_cleanupEvent = Simulator::Schedule (GetBaseHelloInterval (), &GsqrRoutingProtocol::CleanupNeighbors, this);
+}
 
+void
+GsqrRoutingProtocol::ExpireLink (uint32_t neighborId, uint32_t interface)
+{
+  NS_LOG_FUNCTION (this << neighborId << interface);
+  
+  auto it = m_neighbors.find (neighborId);
+  std::vector<LinkInfo>& links = it->second.links;
+  auto linkIt = std::find_if (links.begin (), links.end (),
+                              [interface](const LinkInfo& l) { return l.interface == interface; });
+  if (linkIt == links.end ()) {
+    return;
+  }
+  // The last link takes the neighbor with it
+  if (links.size () == 1) {
+    ExpireNeighbor (neighborId);
+    return;
+  }
+  auto addressIt = m_addressToNode.find (linkIt->address);
+  if (addressIt != m_addressToNode.end () && addressIt->second == neighborId) {
+    m_addressToNode.erase (addressIt);
+  }
+  m_routeCache.erase ((static_cast<uint64_t> (neighborId) << 32) | interface);
+  links.erase (linkIt);
+  ResetHelloInterval ();
 }
 
-std::vector<uint32_t>
+void
+GsqrRoutingProtocol::ExpireNeighbor (uint32_t neighborId)
+{
+  NS_LOG_FUNCTION (this << neighborId);
+  
+  auto it = m_neighbors.find (neighborId);
+  NS_LOG_DEBUG ("GSQR Node " << m_nodeId << " lost neighbor " << neighborId
+                << ", last seen " << it->second.lastSeen.GetSeconds () << "s");
+  for (const LinkInfo& link : it->second.links) {
+    auto addressIt = m_addressToNode.find (link.address);
+    if (addressIt != m_addressToNode.end () && addressIt->second == neighborId) {
+      m_addressToNode.erase (addressIt);
+    }
+    m_routeCache.erase ((static_cast<uint64_t> (neighborId) << 32) | link.interface);
+  }
+  m_neighbors.erase (it);
+  m_routing->RemoveNeighbor (m_nodeId, neighborId);
+  m_neighborCount = static_cast<uint32_t> (m_neighbors.size ());
+  ResetHelloInterval ();
+}
+
+const std::vector<uint32_t>&
 GsqrRoutingProtocol::GetCurrentNeighbors (void) const
 {
-  std::vector<uint32_t> neighbors;
-  for (const auto& entry : m_neighbors) {
-    neighbors.push_back (entry.first);
+  // Maintained by AddNeighbor/RemoveNeighbor, in sync with m_neighbors
+  return m_routing->GetNeighbors (m_nodeId);
+}
+
+void
+GsqrRoutingProtocol::TagForNextHop (Ptr<Packet> packet, uint32_t destId) const
+{
+  // Replaces the previous hop's tag; GSQR control packets keep theirs
+  GsqrHopTag tag;
+  if (packet->PeekPacketTag (tag)) {
+    if (tag.IsControl ()) {
+      return;
+    }
+    packet->RemovePacketTag (tag);
+  }
+  tag.SetPreviousHop (m_nodeId);
+  tag.SetDestination (destId);
+  tag.SetSendTime (Simulator::Now ());
+  tag.SetControl (false);
+  packet->AddPacketTag (tag);
+}
+
+void
+GsqrRoutingProtocol::QueueAck (const GsqrHopTag &tag, uint32_t bytes, double qNextMax)
+{
+  // Without a destination id the previous hop has nothing to learn
+  uint32_t destId = tag.GetDestination ();
+  if (destId == GsqrRouting::UNKNOWN_NODE || tag.GetPreviousHop () == m_nodeId) {
+    return;
+  }
+  NS_LOG_FUNCTION (this << tag.GetPreviousHop () << destId << bytes << qNextMax);
+  
+  PendingAcks& pending = m_pendingAcks[tag.GetPreviousHop ()];
+  PendingAck& entry = pending.destinations[destId];
+  entry.packets++;
+  entry.delaySum += (Simulator::Now () - tag.GetSendTime ()).GetSeconds ();
+  entry.energySum += m_energyPerBit * bytes * 8;
+  entry.qNextMax = qNextMax;
+  pending.packets++;
+  
+  if (pending.packets >= m_ackBatchSize || entry.packets >= 0xff
+      || pending.destinations.size () >= GsqrAckHeader::MAX_ENTRIES) {
+    SendAck (tag.GetPreviousHop ());
+  } else if (!m_ackEvent.IsRunning ()) {
+    m_ackEvent = Simulator::Schedule (m_ackTimeout, &GsqrRoutingProtocol::FlushAcks, this);
   }
-  return neighbors;
+}
+
+bool
+GsqrRoutingProtocol::BuildAck (uint32_t previousHop, GsqrAckHeader &ack)
+{
+  auto pendingIt = m_pendingAcks.find (previousHop);
+  if (pendingIt == m_pendingAcks.end () || pendingIt->second.packets == 0) {
+    return false;
+  }
+  ack.SetSender (m_nodeId);
+  ack.SetReceiver (previousHop);
+  for (const auto& destination : pendingIt->second.destinations) {
+    const PendingAck& pending = destination.second;
+    GsqrAckHeader::Entry entry;
+    entry.destination = destination.first;
+    entry.packets = static_cast<uint8_t> (pending.packets);
+    entry.delay = pending.delaySum / pending.packets;
+    entry.energy = pending.energySum / pending.packets;
+    entry.qNextMax = pending.qNextMax;
+    ack.AddEntry (entry);
+  }
+  pendingIt->second.packets = 0;
+  pendingIt->second.destinations.clear ();
+  return true;
+}
+
+void
+GsqrRoutingProtocol::SendAck (uint32_t previousHop)
+{
+  NS_LOG_FUNCTION (this << previousHop);
+  
+  GsqrAckHeader ack;
+  auto neighborIt = m_neighbors.find (previousHop);
+  if (!BuildAck (previousHop, ack) || neighborIt == m_neighbors.end ()) {
+    // Not heard from yet (or gone): drop rather than guess an address
+    m_pendingAcks.erase (previousHop);
+    return;
+  }
+  m_pendingAcks.erase (previousHop);
+  
+  Ptr<Packet> packet = Create<Packet> ();
+  packet->AddHeader (ack);
+  GsqrHopTag controlTag;
+  controlTag.SetControl (true);
+  packet->AddPacketTag (controlTag);
+  uint32_t pktSize = packet->GetSize () + 8 + 20;
+  
+  // Over the link the previous hop is heard best on
+  const LinkInfo& link = BestLink (neighborIt->second);
+  InetSocketAddress remote = InetSocketAddress (link.address, m_helloPort);
+  if (m_interfaces.at (link.interface).socket->SendTo (packet, 0, remote) > 0) {
+    m_acksSent++;
+    m_controlPacketsSent++;
+    m_controlBytesSent += pktSize;
+  }
+}
+
+void
+GsqrRoutingProtocol::FlushAcks (void)
+{
+  NS_LOG_FUNCTION (this);
+  
+  // The ACK timeout passed before a batch filled or a Hello went out
+  while (!m_pendingAcks.empty ()) {
+    SendAck (m_pendingAcks.begin ()->first);
+  }
+}
+
+void
+GsqrRoutingProtocol::HandleAck (const GsqrAckHeader &ack)
+{
+  NS_LOG_FUNCTION (this << ack.GetSender ());
+  
+  if (!ack.IsValid () || ack.GetReceiver () != m_nodeId) {
+    return;
+  }
+  // One TD step per destination, on the means over the packets covered
+  for (const GsqrAckHeader::Entry& entry : ack.GetEntries ()) {
+    m_routing->ReceiveAck (ack.GetSender (), entry.destination, 0.0,
+                           entry.delay, entry.energy, entry.qNextMax);
+  }
+}
+
+bool
+GsqrRoutingProtocol::BuildDelta (GsqrDeltaHeader &delta)
+{
+  std::vector<uint32_t> nodes;
+  std::vector<double> changes;
+  if (m_embedding->CollectRowChanges (m_disseminationThreshold, m_disseminationMaxRows,
+                                      nodes, changes) == 0) {
+    return false;
+  }
+  NS_LOG_FUNCTION (this << nodes.size ());
+  
+  uint32_t width = m_embedding->GetEmbeddingDimension () + 1;
+  delta.SetSender (m_nodeId);
+  delta.SetDimension (width - 1);
+  std::vector<double> sent (width);
+  for (uint32_t i = 0; i < nodes.size (); ++i) {
+    delta.AddRow (nodes[i], &changes[i * width]);
+    // Only what the neighbors decode counts as advertised; the int8
+    // rounding error stays pending for the next advertisement
+    delta.GetRowDelta (i, sent.data ());
+    m_embedding->MarkAdvertised (nodes[i], sent.data ());
+  }
+  m_deltaRowsSent += nodes.size ();
+  return true;
+}
+
+void
+GsqrRoutingProtocol::SendDelta (void)
+{
+  NS_LOG_FUNCTION (this);
+  
+  // Rows stay dirty while nobody is around to hear them
+  GsqrDeltaHeader delta;
+  if (!m_interfaces.empty () && !GetCurrentNeighbors ().empty () && BuildDelta (delta)) {
+    Ptr<Packet> packet = Create<Packet> ();
+    packet->AddHeader (delta);
+    GsqrHopTag controlTag;
+    controlTag.SetControl (true);
+    packet->AddPacketTag (controlTag);
+    uint32_t pktSize = packet->GetSize () + 8 + 20;
+    
+    InetSocketAddress remote = InetSocketAddress (Ipv4Address ("255.255.255.255"), m_helloPort);
+    for (auto& iface : m_interfaces) {
+      if (iface.second.socket->SendTo (packet->Copy (), 0, remote) > 0) {
+        m_controlPacketsSent++;
+        m_controlBytesSent += pktSize;
+      }
+    }
+  }
+  m_deltaEvent = Simulator::Schedule (m_disseminationInterval, &GsqrRoutingProtocol::SendDelta, this);
+}
+
+void
+GsqrRoutingProtocol::HandleDelta (const GsqrDeltaHeader &delta)
+{
+  NS_LOG_FUNCTION (this << delta.GetSender ());
+  
+  if (!delta.IsValid () || delta.GetSender () == m_nodeId
+      || m_disseminationMode == DISSEMINATE_NONE) {
+    return;
+  }
+  if (delta.GetDimension () != m_embedding->GetEmbeddingDimension ()) {
+    NS_LOG_DEBUG ("GSQR Node " << m_nodeId << " drops delta of dimension "
+                  << delta.GetDimension () << " from " << delta.GetSender ());
+    return;
+  }
+  std::vector<double> change (delta.GetDimension () + 1);
+  for (uint32_t i = 0; i < delta.GetNRows (); ++i) {
+    delta.GetRowDelta (i, change.data ());
+    for (double& value : change) {
+      value *= m_disseminationWeight;
+    }
+    m_routing->ApplyNeighborDelta (delta.GetRowNode (i), change.data ());
+  }
+  m_deltaRowsReceived += delta.GetNRows ();
+}
+
+bool
+GsqrRoutingProtocol::FeatureChanged (double before, double after, double threshold)
+{
+  return std::abs (after - before) > threshold * std::max (std::abs (before), 1.0);
 }
 
 // GsqrHelloHeader
@@ -510,60 +1809,454 @@ GsqrHelloHeader::GetInstanceTypeId (void) const
 uint32_t
 GsqrHelloHeader::GetSerializedSize (void) const
 {
-  return sizeof(m_nodeId) + sizeof(m_timestamp) + 
-         sizeof(m_meanETX) + sizeof(m_residualEnergy) + 
-         sizeof(m_queueLength);
+  uint32_t size = BASE_SIZE;
+  if (!m_extensions.empty ()) {
+    size += 1;
+    for (const Extension& ext : m_extensions) {
+      size += 3 + ext.value.size ();
+    }
+  }
+  return size;
 }
 
 void
 GsqrHelloHeader::Serialize (Buffer::Iterator start) const
 {
-  start.WriteHtonU32 (m_nodeId);
-  start.WriteHtonU64 (static_cast<uint64_t>(m_timestamp));
-  start.WriteHtonU64 (static_cast<uint64_t>(m_meanETX));
-  start.WriteHtonU64 (static_cast<uint64_t>(m_residualEnergy));
-  start.WriteHtonU64 (static_cast<uint64_t>(m_queueLength));
+  uint8_t flags = static_cast<uint8_t> (m_intervalExponent << 1);
+  if (!m_extensions.empty ()) {
+    flags |= FLAG_EXTENSIONS;
+  }
+  start.WriteU8 (static_cast<uint8_t> (VERSION << 4) | flags);
+  start.WriteHtonU16 (m_nodeId);
+  start.WriteU8 (m_sequence);
+  start.WriteHtonU16 (m_timestamp);
+  start.WriteHtonU16 (m_meanETX);
+  start.WriteU8 (m_residualEnergy);
+  start.WriteU8 (m_queueLength);
+  if (flags & FLAG_EXTENSIONS) {
+    start.WriteU8 (static_cast<uint8_t> (m_extensions.size ()));
+    for (const Extension& ext : m_extensions) {
+      start.WriteU8 (ext.type);
+      start.WriteHtonU16 (static_cast<uint16_t> (ext.value.size ()));
+      start.Write (ext.value.data (), ext.value.size ());
+    }
+  }
 }
 
 uint32_t
 GsqrHelloHeader::Deserialize (Buffer::Iterator start)
 {
-  m_nodeId = start.ReadNtohU32 ();
+  uint8_t first = start.ReadU8 ();
+  m_version = first >> 4;
+  m_intervalExponent = (first >> 1) & MAX_INTERVAL_EXPONENT;
+  m_extensions.clear ();
+  if (m_version != VERSION) {
+    return 1;
+  }
   
-  uint64_t temp;
-    
-    temp = start.ReadNtohU64 ();
-    memcpy(&m_timestamp, &temp, sizeof(double));
-    
-    temp = start.ReadNtohU64 ();
-    memcpy(&m_meanETX, &temp, sizeof(double));
-    
-    temp = start.ReadNtohU64 ();
-    memcpy(&m_residualEnergy, &temp, sizeof(double));
-    
-    temp = start.ReadNtohU64 ();
-    memcpy(&m_queueLength, &temp, sizeof(double));
-    
-    return GetSerializedSize ();
+  m_nodeId = start.ReadNtohU16 ();
+  m_sequence = start.ReadU8 ();
+  m_timestamp = start.ReadNtohU16 ();
+  m_meanETX = start.ReadNtohU16 ();
+  m_residualEnergy = start.ReadU8 ();
+  m_queueLength = start.ReadU8 ();
+  if (first & FLAG_EXTENSIONS) {
+    uint8_t count = start.ReadU8 ();
+    m_extensions.resize (count);
+    for (Extension& ext : m_extensions) {
+      ext.type = start.ReadU8 ();
+      ext.value.resize (start.ReadNtohU16 ());
+      start.Read (ext.value.data (), ext.value.size ());
+    }
+  }
+  return GetSerializedSize ();
 }
 
 void
 GsqrHelloHeader::Print (std::ostream &os) const
 {
-  os << "GsqrHelloHeader [Node=" << m_nodeId 
-     << ", Timestamp=" << m_timestamp
-     << ", ETX=" << m_meanETX
-     << ", Energy=" << m_residualEnergy
-     << ", Queue=" << m_queueLength << "]";
+  os << "GsqrHelloHeader [v" << static_cast<uint32_t> (m_version)
+     << ", Node=" << m_nodeId 
+     << ", Seq=" << static_cast<uint32_t> (m_sequence)
+     << ", IntervalExponent=" << static_cast<uint32_t> (m_intervalExponent)
+     << ", TimestampMs=" << m_timestamp
+     << ", ETX=" << GetMeanETX ()
+     << ", Energy=" << GetResidualEnergy ()
+     << ", Queue=" << GetQueueLength ()
+     << ", Extensions=" << m_extensions.size () << "]";
+}
+
+void
+GsqrHelloHeader::SetNodeId (uint32_t id)
+{
+  NS_ASSERT_MSG (id <= 0xffff, "Node id " << id << " does not fit the 16-bit Hello field");
+  m_nodeId = static_cast<uint16_t> (id);
+}
+
+void
+GsqrHelloHeader::SetIntervalExponent (uint8_t exponent)
+{
+  NS_ASSERT (exponent <= MAX_INTERVAL_EXPONENT);
+  m_intervalExponent = exponent;
+}
+
+void
+GsqrHelloHeader::SetTimestamp (Time sent)
+{
+  m_timestamp = static_cast<uint16_t> (sent.GetMilliSeconds () & 0xffff);
+}
+
+Time
+GsqrHelloHeader::GetTimestamp (Time now) const
+{
+  int64_t nowMs = now.GetMilliSeconds ();
+  int64_t age = (nowMs - m_timestamp) & 0xffff;
+  return MilliSeconds (nowMs - age);
+}
+
+// Fixed-point fields round to nearest and saturate at the field range
+void
+GsqrHelloHeader::SetMeanETX (double etx)
+{
+  m_meanETX = static_cast<uint16_t> (std::lround (std::min (std::max (etx, 0.0), 65535.0 / 256.0) * 256.0));
+}
+
+void
+GsqrHelloHeader::SetResidualEnergy (double energy)
+{
+  m_residualEnergy = static_cast<uint8_t> (std::lround (std::min (std::max (energy, 0.0), 127.5) * 2.0));
+}
+
+void
+GsqrHelloHeader::SetQueueLength (double length)
+{
+  m_queueLength = static_cast<uint8_t> (std::lround (std::min (std::max (length, 0.0), 1.0) * 255.0));
+}
+
+void
+GsqrHelloHeader::AddExtension (uint8_t type, const std::vector<uint8_t> &value)
+{
+  NS_ASSERT_MSG (m_extensions.size () < 0xff && value.size () <= 0xffff,
+                 "Hello extension does not fit its TLV fields");
+  m_extensions.push_back (Extension {type, value});
+}
+
+bool
+GsqrHelloHeader::GetExtension (uint8_t type, std::vector<uint8_t> &value) const
+{
+  for (const Extension& ext : m_extensions) {
+    if (ext.type == type) {
+      value = ext.value;
+      return true;
+    }
+  }
+  return false;
 }
 
 GsqrHelloHeader::GsqrHelloHeader ()
-  : m_nodeId (0),
-    m_timestamp (0.0),
-    m_meanETX (0.0),
-    m_residualEnergy (0.0),
-    m_queueLength (0.0)
+  : m_version (VERSION),
+    m_intervalExponent (0),
+    m_nodeId (0),
+    m_sequence (0),
+    m_timestamp (0),
+    m_meanETX (0),
+    m_residualEnergy (0),
+    m_queueLength (0)
+{
+}
+
+// GsqrAckHeader
+TypeId
+GsqrAckHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::GsqrAckHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Gsqr")
+    .AddConstructor<GsqrAckHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+GsqrAckHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+GsqrAckHeader::GetSerializedSize (void) const
+{
+  return 6 + ENTRY_SIZE * m_entries.size ();
+}
+
+static void
+WriteFloat (Buffer::Iterator &start, double value)
+{
+  float f = static_cast<float> (value);
+  uint32_t bits;
+  std::memcpy (&bits, &f, sizeof (bits));
+  start.WriteHtonU32 (bits);
+}
+
+static double
+ReadFloat (Buffer::Iterator &start)
+{
+  uint32_t bits = start.ReadNtohU32 ();
+  float f;
+  std::memcpy (&f, &bits, sizeof (f));
+  return f;
+}
+
+void
+GsqrAckHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteU8 (TYPE);
+  start.WriteHtonU16 (m_sender);
+  start.WriteHtonU16 (m_receiver);
+  start.WriteU8 (static_cast<uint8_t> (m_entries.size ()));
+  for (const Entry& entry : m_entries) {
+    start.WriteHtonU16 (static_cast<uint16_t> (entry.destination));
+    start.WriteU8 (entry.packets);
+    start.WriteHtonU16 (static_cast<uint16_t> (std::lround (std::min (std::max (entry.delay, 0.0), 6.5535) * 1e4)));
+    WriteFloat (start, entry.energy);
+    WriteFloat (start, entry.qNextMax);
+  }
+}
+
+uint32_t
+GsqrAckHeader::Deserialize (Buffer::Iterator start)
+{
+  m_type = start.ReadU8 ();
+  m_entries.clear ();
+  if (m_type != TYPE) {
+    return 1;
+  }
+  m_sender = start.ReadNtohU16 ();
+  m_receiver = start.ReadNtohU16 ();
+  uint8_t count = start.ReadU8 ();
+  m_entries.resize (count);
+  for (Entry& entry : m_entries) {
+    entry.destination = start.ReadNtohU16 ();
+    entry.packets = start.ReadU8 ();
+    entry.delay = start.ReadNtohU16 () / 1e4;
+    entry.energy = ReadFloat (start);
+    entry.qNextMax = ReadFloat (start);
+  }
+  return GetSerializedSize ();
+}
+
+void
+GsqrAckHeader::Print (std::ostream &os) const
+{
+  os << "GsqrAckHeader [" << m_sender << "->" << m_receiver
+     << ", Entries=" << m_entries.size () << "]";
+}
+
+void
+GsqrAckHeader::SetSender (uint32_t id)
+{
+  NS_ASSERT_MSG (id <= 0xffff, "Node id " << id << " does not fit the 16-bit ACK field");
+  m_sender = static_cast<uint16_t> (id);
+}
+
+void
+GsqrAckHeader::SetReceiver (uint32_t id)
+{
+  NS_ASSERT_MSG (id <= 0xffff, "Node id " << id << " does not fit the 16-bit ACK field");
+  m_receiver = static_cast<uint16_t> (id);
+}
+
+void
+GsqrAckHeader::AddEntry (const Entry &entry)
+{
+  NS_ASSERT_MSG (m_entries.size () < MAX_ENTRIES && entry.destination <= 0xffff,
+                 "ACK entry does not fit its fields");
+  m_entries.push_back (entry);
+}
+
+GsqrAckHeader::GsqrAckHeader ()
+  : m_type (TYPE),
+    m_sender (0),
+    m_receiver (0)
+{
+}
+
+// GsqrDeltaHeader
+TypeId
+GsqrDeltaHeader::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::GsqrDeltaHeader")
+    .SetParent<Header> ()
+    .SetGroupName ("Gsqr")
+    .AddConstructor<GsqrDeltaHeader> ()
+  ;
+  return tid;
+}
+
+TypeId
+GsqrDeltaHeader::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+GsqrDeltaHeader::GetSerializedSize (void) const
+{
+  return 5 + (6 + m_dimension + 1) * m_rows.size ();
+}
+
+void
+GsqrDeltaHeader::Serialize (Buffer::Iterator start) const
+{
+  start.WriteU8 (TYPE);
+  start.WriteHtonU16 (m_sender);
+  start.WriteU8 (m_dimension);
+  start.WriteU8 (static_cast<uint8_t> (m_rows.size ()));
+  for (const Row& row : m_rows) {
+    start.WriteHtonU16 (row.node);
+    WriteFloat (start, row.scale);
+    for (int8_t value : row.values) {
+      start.WriteU8 (static_cast<uint8_t> (value));
+    }
+  }
+}
+
+uint32_t
+GsqrDeltaHeader::Deserialize (Buffer::Iterator start)
+{
+  m_type = start.ReadU8 ();
+  m_rows.clear ();
+  if (m_type != TYPE) {
+    return 1;
+  }
+  m_sender = start.ReadNtohU16 ();
+  m_dimension = start.ReadU8 ();
+  uint8_t count = start.ReadU8 ();
+  m_rows.resize (count);
+  for (Row& row : m_rows) {
+    row.node = start.ReadNtohU16 ();
+    row.scale = static_cast<float> (ReadFloat (start));
+    row.values.resize (m_dimension + 1);
+    for (int8_t& value : row.values) {
+      value = static_cast<int8_t> (start.ReadU8 ());
+    }
+  }
+  return GetSerializedSize ();
+}
+
+void
+GsqrDeltaHeader::Print (std::ostream &os) const
+{
+  os << "GsqrDeltaHeader [" << m_sender
+     << ", Dimension=" << static_cast<uint32_t> (m_dimension)
+     << ", Rows=" << m_rows.size () << "]";
+}
+
+void
+GsqrDeltaHeader::SetSender (uint32_t id)
+{
+  NS_ASSERT_MSG (id <= 0xffff, "Node id " << id << " does not fit the 16-bit delta field");
+  m_sender = static_cast<uint16_t> (id);
+}
+
+void
+GsqrDeltaHeader::SetDimension (uint32_t dimension)
+{
+  NS_ASSERT_MSG (dimension <= 0xff && m_rows.empty (), "Bad delta dimension " << dimension);
+  m_dimension = static_cast<uint8_t> (dimension);
+}
+
+void
+GsqrDeltaHeader::AddRow (uint32_t nodeId, const double *delta)
+{
+  NS_ASSERT_MSG (m_rows.size () < MAX_ROWS && nodeId <= 0xffff,
+                 "Delta row does not fit its fields");
+  double largest = 0.0;
+  for (uint32_t i = 0; i <= m_dimension; ++i) {
+    largest = std::max (largest, std::abs (delta[i]));
+  }
+  Row row;
+  row.node = static_cast<uint16_t> (nodeId);
+  row.scale = static_cast<float> (largest / 127.0);
+  row.values.resize (m_dimension + 1);
+  for (uint32_t i = 0; i <= m_dimension; ++i) {
+    long q = row.scale > 0.0f ? std::lround (delta[i] / row.scale) : 0;
+    row.values[i] = static_cast<int8_t> (std::min (std::max (q, -127L), 127L));
+  }
+  m_rows.push_back (row);
+}
+
+void
+GsqrDeltaHeader::GetRowDelta (uint32_t i, double *delta) const
+{
+  const Row& row = m_rows[i];
+  for (uint32_t j = 0; j <= m_dimension; ++j) {
+    delta[j] = row.values[j] * static_cast<double> (row.scale);
+  }
+}
+
+GsqrDeltaHeader::GsqrDeltaHeader ()
+  : m_type (TYPE),
+    m_sender (0),
+    m_dimension (0)
+{
+}
+
+// GsqrHopTag
+TypeId
+GsqrHopTag::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::GsqrHopTag")
+    .SetParent<Tag> ()
+    .SetGroupName ("Gsqr")
+    .AddConstructor<GsqrHopTag> ()
+  ;
+  return tid;
+}
+
+TypeId
+GsqrHopTag::GetInstanceTypeId (void) const
+{
+  return GetTypeId ();
+}
+
+uint32_t
+GsqrHopTag::GetSerializedSize (void) const
+{
+  return 4 + 4 + 8 + 1;
+}
+
+void
+GsqrHopTag::Serialize (TagBuffer i) const
+{
+  i.WriteU32 (m_previousHop);
+  i.WriteU32 (m_destination);
+  i.WriteU64 (static_cast<uint64_t> (m_sendTime.GetNanoSeconds ()));
+  i.WriteU8 (m_control ? 1 : 0);
+}
+
+void
+GsqrHopTag::Deserialize (TagBuffer i)
+{
+  m_previousHop = i.ReadU32 ();
+  m_destination = i.ReadU32 ();
+  m_sendTime = NanoSeconds (static_cast<int64_t> (i.ReadU64 ()));
+  m_control = i.ReadU8 () != 0;
+}
+
+void
+GsqrHopTag::Print (std::ostream &os) const
+{
+  os << "GsqrHopTag [From=" << m_previousHop << ", Dest=" << m_destination
+     << ", Sent=" << m_sendTime.GetSeconds () << "s"
+     << (m_control ? ", control" : "") << "]";
+}
+
+GsqrHopTag::GsqrHopTag ()
+  : m_previousHop (0),
+    m_destination (0),
+    m_control (false)
 {
 }
 
-} // namespace ns3
\ No newline at end of file
+} // namespace ns3
@@ -12,21 +12,47 @@
 #include "ns3/nstime.h"
 #include "ns3/event-id.h"
 #include "ns3/header.h"
+#include "ns3/tag.h"
 #include "ns3/string.h"     
 #include "ns3/double.h"     
 #include "ns3/type-id.h"    
 #include "ns3/attribute.h"  
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include "ns3/traced-value.h"
 #include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 namespace ns3
 {
 
 class GsqrRouting;
+class GsqrCheckpointWriter;
 class GsqrEmbedding;
+class WifiMacQueue;
 
 /**
  * \brief GSQR Hello packet header
+ *
+ * Version 1 wire format, network byte order, 10 bytes without extensions:
+ *
+ *   u8  version (high nibble) | interval exponent (bits 3-1) | FLAG_EXTENSIONS
+ *   u16 node id
+ *   u8  sequence number, one per Hello sent; gaps count as lost Hellos
+ *   u16 send time in ms, modulo 2^16; unwrapped against the receiver's clock
+ *   u16 mean ETX, unsigned Q8.8
+ *   u8  residual energy, in steps of 0.5
+ *   u8  queue occupancy in [0, 1], in steps of 1/255
+ *
+ * The high nibble of the first byte also tells GSQR messages apart on the
+ * Hello port; GsqrAckHeader::TYPE and GsqrDeltaHeader::TYPE are not Hello
+ * versions.
+ *
+ * With FLAG_EXTENSIONS set, a u8 count of TLVs follows, each a u8 type,
+ * a u16 length and the value bytes. The interval exponent k promises the
+ * next Hello within 2^k base Hello intervals of the sender.
  */
 class GsqrHelloHeader : public Header
 {
@@ -41,27 +67,223 @@ public:
   virtual uint32_t Deserialize (Buffer::Iterator start);
   virtual void Print (std::ostream &os) const;
   
-  void SetNodeId (uint32_t id) { m_nodeId = id; }
+  static const uint8_t VERSION = 1;
+  static const uint8_t FLAG_EXTENSIONS = 0x1;
+  static const uint32_t BASE_SIZE = 10;
+  static const uint8_t MAX_INTERVAL_EXPONENT = 7;
+  
+  /// Extension types
+  static const uint8_t EXT_ACK = 1;   ///< a serialized GsqrAckHeader
+  static const uint8_t EXT_DELTA = 2; ///< a serialized GsqrDeltaHeader
+  
+  /// Received headers of another version carry no usable fields
+  uint8_t GetVersion (void) const { return m_version; }
+  
+  void SetNodeId (uint32_t id);
   uint32_t GetNodeId (void) const { return m_nodeId; }
   
-  void SetTimestamp (double ts) { m_timestamp = ts; }
-  double GetTimestamp (void) const { return m_timestamp; }
+  void SetSequence (uint8_t seq) { m_sequence = seq; }
+  uint8_t GetSequence (void) const { return m_sequence; }
+  
+  void SetIntervalExponent (uint8_t exponent);
+  uint8_t GetIntervalExponent (void) const { return m_intervalExponent; }
   
-  void SetMeanETX (double etx) { m_meanETX = etx; }
-  double GetMeanETX (void) const { return m_meanETX; }
+  void SetTimestamp (Time sent);
+  /// The latest time not after \p now whose low 16 bits in ms match the stamp
+  Time GetTimestamp (Time now) const;
   
-  void SetResidualEnergy (double energy) { m_residualEnergy = energy; }
-  double GetResidualEnergy (void) const { return m_residualEnergy; }
+  void SetMeanETX (double etx);
+  double GetMeanETX (void) const { return m_meanETX / 256.0; }
   
-  void SetQueueLength (double length) { m_queueLength = length; }
-  double GetQueueLength (void) const { return m_queueLength; }
+  void SetResidualEnergy (double energy);
+  double GetResidualEnergy (void) const { return m_residualEnergy / 2.0; }
+  
+  void SetQueueLength (double length);
+  double GetQueueLength (void) const { return m_queueLength / 255.0; }
+  
+  /// Optional TLVs, at most 255 of up to 65535 bytes each
+  void AddExtension (uint8_t type, const std::vector<uint8_t> &value);
+  bool GetExtension (uint8_t type, std::vector<uint8_t> &value) const;
+  uint32_t GetNExtensions (void) const { return m_extensions.size (); }
+  uint8_t GetExtensionType (uint32_t i) const { return m_extensions[i].type; }
+  const std::vector<uint8_t>& GetExtensionValue (uint32_t i) const { return m_extensions[i].value; }
 
 private:
-  uint32_t m_nodeId;
-  double m_timestamp;
-  double m_meanETX;
-  double m_residualEnergy;
-  double m_queueLength;
+  struct Extension
+  {
+    uint8_t type;
+    std::vector<uint8_t> value;
+  };
+  
+  uint8_t m_version;
+  uint8_t m_intervalExponent;
+  uint16_t m_nodeId;
+  uint8_t m_sequence;
+  uint16_t m_timestamp;     // ms, modulo 2^16
+  uint16_t m_meanETX;       // Q8.8
+  uint8_t m_residualEnergy; // 0.5 per step
+  uint8_t m_queueLength;    // 1/255 per step
+  std::vector<Extension> m_extensions;
+};
+
+/**
+ * \brief GSQR hop-by-hop acknowledgement
+ *
+ * Sent by a next hop nh back to the previous hop v, covering every packet
+ * v forwarded to nh since the last ACK, aggregated per destination:
+ *
+ *   u8  TYPE
+ *   u16 sender (nh) id
+ *   u16 receiver (v) id
+ *   u8  entry count, then per entry:
+ *     u16   destination id
+ *     u8    packets covered
+ *     u16   mean hop delay, in units of 100 us, saturating
+ *     float mean energy per packet reported by nh, J
+ *     float max_n' Q(nh, d, n'), 0 when nh is the destination
+ *
+ * Unicast on its own, or carried in a Hello as an EXT_ACK extension.
+ */
+class GsqrAckHeader : public Header
+{
+public:
+  GsqrAckHeader ();
+  virtual ~GsqrAckHeader () {}
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  
+  static const uint8_t TYPE = 0xa1;
+  static const uint32_t ENTRY_SIZE = 13;
+  static const uint32_t MAX_ENTRIES = 255;
+  
+  struct Entry
+  {
+    uint32_t destination;
+    uint8_t packets;
+    double delay;     // seconds
+    double energy;    // per packet, J
+    double qNextMax;
+  };
+  
+  /// Received headers with another type byte carry no entries
+  bool IsValid (void) const { return m_type == TYPE; }
+  
+  void SetSender (uint32_t id);
+  uint32_t GetSender (void) const { return m_sender; }
+  void SetReceiver (uint32_t id);
+  uint32_t GetReceiver (void) const { return m_receiver; }
+  
+  void AddEntry (const Entry &entry);
+  const std::vector<Entry>& GetEntries (void) const { return m_entries; }
+
+private:
+  uint8_t m_type;
+  uint16_t m_sender;
+  uint16_t m_receiver;
+  std::vector<Entry> m_entries;
+};
+
+/**
+ * \brief GSQR embedding row deltas
+ *
+ * Broadcast by a node with the rows of its embedding table that changed
+ * since it last advertised them, each quantized to int8 against its own
+ * scale:
+ *
+ *   u8  TYPE
+ *   u16 sender id
+ *   u8  embedding dimension
+ *   u8  row count, then per row:
+ *     u16   node id
+ *     float scale, the largest |change| / 127
+ *     int8  change of each of the dimension elements of h, then of b
+ *
+ * Sent on its own, or carried in a Hello as an EXT_DELTA extension.
+ */
+class GsqrDeltaHeader : public Header
+{
+public:
+  GsqrDeltaHeader ();
+  virtual ~GsqrDeltaHeader () {}
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (Buffer::Iterator start) const;
+  virtual uint32_t Deserialize (Buffer::Iterator start);
+  virtual void Print (std::ostream &os) const;
+  
+  static const uint8_t TYPE = 0xb1;
+  static const uint32_t MAX_ROWS = 255;
+  
+  /// Received headers with another type byte carry no rows
+  bool IsValid (void) const { return m_type == TYPE; }
+  
+  void SetSender (uint32_t id);
+  uint32_t GetSender (void) const { return m_sender; }
+  /// Set before the first AddRow
+  void SetDimension (uint32_t dimension);
+  uint32_t GetDimension (void) const { return m_dimension; }
+  
+  /// Quantizes dimension + 1 changes for nodeId
+  void AddRow (uint32_t nodeId, const double *delta);
+  uint32_t GetNRows (void) const { return m_rows.size (); }
+  uint32_t GetRowNode (uint32_t i) const { return m_rows[i].node; }
+  /// The dimension + 1 changes of row i, as every receiver decodes them
+  void GetRowDelta (uint32_t i, double *delta) const;
+
+private:
+  struct Row
+  {
+    uint16_t node;
+    float scale;
+    std::vector<int8_t> values;
+  };
+  
+  uint8_t m_type;
+  uint16_t m_sender;
+  uint8_t m_dimension;
+  std::vector<Row> m_rows;
+};
+
+/**
+ * \brief Packet tag set by each GSQR hop on the packets it forwards
+ *
+ * Records who sent the packet over the last hop, when, and the destination
+ * id it was routed towards, so the next hop can acknowledge it. GSQR's own
+ * control packets are tagged as such and never acknowledged.
+ */
+class GsqrHopTag : public Tag
+{
+public:
+  GsqrHopTag ();
+
+  static TypeId GetTypeId (void);
+  virtual TypeId GetInstanceTypeId (void) const;
+  virtual uint32_t GetSerializedSize (void) const;
+  virtual void Serialize (TagBuffer i) const;
+  virtual void Deserialize (TagBuffer i);
+  virtual void Print (std::ostream &os) const;
+  
+  void SetPreviousHop (uint32_t id) { m_previousHop = id; }
+  uint32_t GetPreviousHop (void) const { return m_previousHop; }
+  void SetDestination (uint32_t id) { m_destination = id; }
+  uint32_t GetDestination (void) const { return m_destination; }
+  void SetSendTime (Time sent) { m_sendTime = sent; }
+  Time GetSendTime (void) const { return m_sendTime; }
+  void SetControl (bool control) { m_control = control; }
+  bool IsControl (void) const { return m_control; }
+
+private:
+  uint32_t m_previousHop;
+  uint32_t m_destination;
+  Time m_sendTime;
+  bool m_control;
 };
 
 /**
@@ -104,45 +326,300 @@ public:
   uint32_t GetControlPacketsSent (void) const{return m_controlPacketsSent;}
   uint64_t GetControlBytesSent () const{ return m_controlBytesSent;}
   
+  Ptr<GsqrRouting> GetRouting (void) const { return m_routing; }
+  Ptr<GsqrEmbedding> GetEmbedding (void) const { return m_embedding; }
+  // False on the ranks of a distributed run that hold this node but do
+  // not simulate it; such a copy opens no socket and never sends
+  bool IsLocal (void) const { return m_local; }
+  
+  // Hello scheduling statistics; intervals are measured between Hellos sent
+  Time GetCurrentHelloInterval (void) const;
+  Time GetMeanHelloInterval (void) const;
+  uint32_t GetHelloIntervalResets (void) const { return m_helloResets; }
+  
+  // Hellos received from current and past neighbors, and those missing
+  // from their sequence, mostly lost to broadcast collisions
+  uint32_t GetHellosReceived (void) const { return m_hellosReceived; }
+  uint32_t GetHellosLost (void) const { return m_hellosLost; }
+  
+  // ACK messages sent on their own; piggybacked ones ride in Hellos
+  uint32_t GetAcksSent (void) const { return m_acksSent; }
+  
+  // Embedding rows advertised to and applied from neighbors
+  uint32_t GetDeltaRowsSent (void) const { return m_deltaRowsSent; }
+  uint32_t GetDeltaRowsReceived (void) const { return m_deltaRowsReceived; }
+  
+  // Hot-path counters; Q evaluations, next-hop memo hits and misses, TD
+  // errors and rows touched are kept by GetRouting ()
+  uint64_t GetRouteOutputCalls (void) const { return m_routeOutputCalls; }
+  uint64_t GetRouteInputCalls (void) const { return m_routeInputCalls; }
+  uint32_t GetHellosSent (void) const { return m_hellosSent; }
+  // Hellos the socket refused to send, or received in an unknown version
+  uint32_t GetHellosDropped (void) const { return m_hellosDropped; }
+  uint32_t GetNeighborCount (void) const { return m_neighborCount; }
+  
+  // Features in the last Hello sent: mean link ETX over the neighbors,
+  // residual energy in percent and smoothed MAC queue occupancy
+  double GetAdvertisedETX (void) const { return m_advertisedETX; }
+  double GetAdvertisedEnergy (void) const { return m_advertisedEnergy; }
+  double GetAdvertisedQueue (void) const { return m_advertisedQueue; }
+  // ETX of the link from a neighbor over the last HelloWindow of its Hellos
+  // on one interface, or on its best link; 0 if not heard there
+  double GetLinkETX (uint32_t neighborId) const;
+  double GetLinkETX (uint32_t neighborId, uint32_t interface) const;
+  // Interfaces with a Hello socket of their own
+  uint32_t GetNHelloInterfaces (void) const { return m_interfaces.size (); }
+  
+  typedef void (* RouteLookupTracedCallback)(uint32_t destId, uint32_t nextHop,
+                                             uint32_t qEvaluations);
+  typedef void (* HelloTracedCallback)(Ptr<const Packet> packet, uint32_t nodeId);
+  
+  /**
+   * Assign a fixed random variable stream number to the random variables
+   * used by this model. Return the number of streams (possibly zero) that
+   * have been assigned.
+   */
+  int64_t AssignStreams (int64_t stream);
+  /**
+   * Pretrained rows shared by every node, read-only; this node's table holds
+   * only the rows it updates. Set before SetIpv4; replaces EmbeddingFile.
+   */
+  void SetEmbeddingBase (Ptr<const GsqrEmbedding> base) { m_embeddingBase = base; }
+  /// Queue the checkpoints of this node go to, shared by the helper. Set before SetIpv4.
+  void SetCheckpointWriter (Ptr<GsqrCheckpointWriter> writer);
+
+protected:
+  virtual void DoDispose (void);
+
 private:
+  // A neighbor as heard on one of this node's interfaces
+  struct LinkInfo
+  {
+    uint32_t interface;
+    Ipv4Address address;  // Hello source, the gateway over this link
+    uint64_t expiryTick;  // neighbor wheel tick at which the link expires
+    uint8_t lastSequence; // of the latest Hello heard on it
+    uint32_t helloWindow; // its last Hellos, newest in bit 0: 1 heard, 0 missed
+    uint8_t windowFill;   // Hellos the window spans, up to HelloWindow
+    double linkETX;       // 1 / d^2 for the reception ratio d over the window
+  };
+  
   struct NeighborInfo
   {
     uint32_t nodeId;
-    Time lastSeen;
+    Time lastSeen;        // on any link
     double meanETX;
-    double residualEnergy;
+    double residualEnergy;  // percent, as in the Hello
     double queueLength;
-    uint32_t interface;
+    uint8_t helloSequence;  // of the latest Hello acted on; its copies on other links are not
+    std::vector<LinkInfo> links;  // one per interface it is heard on, never empty
+  };
+  
+  // An up interface with an address, and the Hello socket bound to it
+  struct InterfaceState
+  {
+    Ptr<Socket> socket;
+    Ptr<NetDevice> device;
+    Ipv4Address local;
+    // Occupancy of the device's best-effort Wi-Fi queue, sampled every
+    // QueueSampleInterval into an EWMA; null for other devices
+    Ptr<WifiMacQueue> macQueue;
+    double queueOccupancy;
   };
   
   void SendHello (void);
   void ScheduleNextHello();
-  void ReceiveHello (Ptr<Socket> socket);
-  void InitializeHelloSocket (void);
+  void ResetHelloInterval (void);
+  Time GetBaseHelloInterval (void) const;
+  Time JitterHelloDelay (Time delay);
+  void ReceiveHello (Ptr<Socket> socket, uint32_t interface);
+  void InitializeHelloSockets (void);
+  // Binds a Hello socket to the interface, or rebinds it to a new address
+  void OpenInterface (uint32_t interface);
+  // Closes its socket and drops the links heard over it
+  void CloseInterface (uint32_t interface);
   
   void SendPacket (Ptr<Packet> packet, Ipv4Address dest, uint32_t interface);
   void PacketSent (Ptr<const Packet> packet, const Ipv4Header& header,
                    Ptr<Ipv4Interface> interface, uint32_t ifIndex);
-  std::vector<uint32_t> GetCurrentNeighbors (void) const;
+  const std::vector<uint32_t>& GetCurrentNeighbors (void) const;
   void CleanupNeighbors (void);
+  void ExpireLink (uint32_t neighborId, uint32_t interface);
+  void ExpireNeighbor (uint32_t neighborId);
+  static bool FeatureChanged (double before, double after, double threshold);
+  // Measured x_v of this node for the next Hello
+  double MeasureMeanETX (void) const;
+  double MeasureResidualEnergy (void) const;  // percent
+  void SampleQueue (void);
+  double ReadQueueOccupancy (const InterfaceState &state) const;
+  double MeanQueueOccupancy (void) const;
+  
+  // Acknowledgements
+  void TagForNextHop (Ptr<Packet> packet, uint32_t destId) const;
+  void QueueAck (const GsqrHopTag &tag, uint32_t bytes, double qNextMax);
+  void SendAck (uint32_t previousHop);
+  void FlushAcks (void);
+  void HandleAck (const GsqrAckHeader &ack);
+  bool BuildAck (uint32_t previousHop, GsqrAckHeader &ack);
+  
+  // Embedding dissemination
+  bool BuildDelta (GsqrDeltaHeader &delta);
+  void SendDelta (void);
+  void HandleDelta (const GsqrDeltaHeader &delta);
+  
+  // Forwarding
+  // Hello sources first, then the addresses of every node in the simulation
+  uint32_t ResolveNodeId (Ipv4Address address) const;
+  // flowId picks one of the paths with multipath forwarding, and one of
+  // the links to the next hop; oif, if given, is preferred for the link.
+  // previousHop, UNKNOWN_NODE for local packets, is avoided while the
+  // destination has no usable Q. bestQ, if given, receives the best Q of
+  // the choice, which the ACK to the previous hop reports
+  Ptr<Ipv4Route> LookupRoute (Ipv4Address dest, uint32_t destId, uint32_t flowId,
+                              uint32_t previousHop, Ptr<NetDevice> oif = 0,
+                              double *bestQ = 0);
+  // A flow is a (source, destination, protocol) triple; RouteOutput sees no ports
+  uint32_t GetFlowId (const Ipv4Header &header) const;
+  const LinkInfo& ChooseLink (const NeighborInfo& neighbor, uint32_t flowId, Ptr<NetDevice> oif) const;
+  // Lowest ETX, for the control messages to one neighbor
+  const LinkInfo& BestLink (const NeighborInfo& neighbor) const;
+  Ptr<Ipv4Route> GetNextHopRoute (const NeighborInfo& neighbor, const LinkInfo& link);
+  void SelectOutputInterface (void);
+  void UpdateLocalAddresses (void);
   
   Ptr<Ipv4> m_ipv4;
   
-  GsqrRouting* m_routing;        
-  GsqrEmbedding* m_embedding;    
+  Ptr<GsqrRouting> m_routing;
+  Ptr<GsqrEmbedding> m_embedding; // embedding table, shared with m_routing
+  Ptr<const GsqrEmbedding> m_embeddingBase; // shared pretrained rows, may be null
+  Ptr<GsqrCheckpointWriter> m_checkpointWriter; // shared, may be null
   
   Time m_helloInterval;
   std::string m_embeddingFile;
+  std::string m_embeddingPrecision;
+  uint64_t m_embeddingMemoryBudget;      // bytes of local rows, 0 if unbounded
+  std::string m_embeddingEvictionPolicy;
+  std::string m_sageWeightsFile;  // GraphSAGE weights, none if empty
+  double m_updateInterval;    // forwarded to m_routing
+  bool m_batchTdUpdates;
+  bool m_averageTdBatch;
+  uint32_t m_multipathPaths;  // forwarded to m_routing, with the three below
+  std::string m_multipathWeighting;
+  double m_multipathTemperature;
+  Time m_flowTimeout;
+  std::string m_checkpointDirectory;  // forwarded to m_routing, with the two below
+  Time m_checkpointInterval;
+  std::string m_warmStartDirectory;
+  Time m_convergenceWindow;   // forwarded to m_routing, with the threshold
+  double m_convergenceThreshold;
   uint32_t m_nodeId;
+  bool m_local;               // the node's system id is this rank's
+  
+  std::unordered_map<uint32_t, NeighborInfo> m_neighbors;
+  // Hashed timing wheel with one slot per base Hello interval: slot t % size
+  // lists the links due to expire at tick t. A link heard again is added to
+  // a later slot and its old entry is skipped when that one is due.
+  std::vector<std::vector<std::pair<uint32_t, uint32_t> > > m_neighborWheel; // (node, interface)
+  uint64_t m_wheelTick;
+  uint32_t m_neighborHoldHellos;
+  std::unordered_map<Ipv4Address, uint32_t, Ipv4AddressHash> m_addressToNode; // from Hello sources
+  // (next-hop node id << 32 | interface) -> route over that link
+  std::unordered_map<uint64_t, Ptr<Ipv4Route> > m_routeCache;
+  Ptr<Ipv4Route> m_onLinkRoute;  // zero gateway, used before any neighbor is known
+  std::map<uint32_t, InterfaceState> m_interfaces;  // by interface index
+  std::string m_interfaceSelectionName;
+  bool m_spreadInterfaces;       // InterfaceSelection spread, else best
+  // The lowest interface with a Hello socket carries the on-link route and
+  // sources unaddressed packets; 0 while there is none
+  uint32_t m_outputInterface;
+  Ptr<NetDevice> m_outputDevice;
+  Ipv4Address m_sourceAddress;
+  // Addresses of up interfaces, for one-lookup local delivery in RouteInput
+  std::unordered_set<Ipv4Address, Ipv4AddressHash> m_localAddresses;
+  std::unordered_set<Ipv4Address, Ipv4AddressHash> m_broadcastAddresses;
+  // Trickle-style Hello scheduling: the interval doubles from
+  // HelloMinInterval up to HelloMaxInterval while nothing changes
+  bool m_adaptiveHello;
+  Time m_helloMinInterval;
+  Time m_helloMaxInterval;
+  double m_featureChangeThreshold;
+  uint8_t m_helloExponent;     // next interval is the base interval << this
+  uint8_t m_helloExponentMax;
+  double m_advertisedETX;      // features in the last Hello sent
+  double m_advertisedEnergy;
+  double m_advertisedQueue;
+  uint32_t m_helloWindow;      // Hellos per link behind its ETX
+  Time m_queueSampleInterval;
+  double m_queueSmoothing;     // weight of each new sample
+  EventId m_queueSampleEvent;
+  Time m_lastHelloSent;
+  Time m_helloIntervalSum;
+  uint32_t m_helloIntervalCount;
+  uint32_t m_helloResets;
+  // Desynchronizes Hellos: random first Hello, then up to MaxHelloJitter
+  // early each period, so neighbors' advertised deadlines still hold
+  Ptr<UniformRandomVariable> m_helloJitter;
+  Time m_maxHelloJitter;
+  uint8_t m_helloSequence;
+  uint32_t m_hellosReceived;
+  uint32_t m_hellosLost;
+  uint32_t m_hellosSent;
+  uint32_t m_hellosDropped;
+  
+  // Packets received from each previous hop and not acknowledged yet,
+  // aggregated per destination until AckBatchSize or AckTimeout
+  struct PendingAck
+  {
+    uint32_t packets;
+    double delaySum;
+    double energySum;
+    double qNextMax;
+  };
+  struct PendingAcks
+  {
+    uint32_t packets;
+    std::map<uint32_t, PendingAck> destinations;
+  };
+  std::map<uint32_t, PendingAcks> m_pendingAcks;
+  uint32_t m_ackBatchSize;
+  Time m_ackTimeout;
+  double m_energyPerBit;
+  EventId m_ackEvent;
+  uint32_t m_acksSent;
+  
+  // Rows that moved by DisseminationThreshold since last advertised go to
+  // the neighbors in the next Hello or in their own rate-limited message
+  enum DisseminationMode
+  {
+    DISSEMINATE_NONE,
+    DISSEMINATE_HELLO,
+    DISSEMINATE_MESSAGE
+  };
+  std::string m_disseminationModeName;
+  DisseminationMode m_disseminationMode;
+  double m_disseminationThreshold;
+  uint32_t m_disseminationMaxRows;
+  Time m_disseminationInterval;
+  double m_disseminationWeight;
+  EventId m_deltaEvent;
+  uint32_t m_deltaRowsSent;
+  uint32_t m_deltaRowsReceived;
   
-  std::map<uint32_t, NeighborInfo> m_neighbors;
   EventId m_helloEvent;
   EventId m_cleanupEvent;
   uint32_t m_controlPacketsSent;    
   uint64_t m_controlBytesSent;    
+  uint64_t m_routeOutputCalls;
+  uint64_t m_routeInputCalls;
+  
+  // Trace sources; each costs an empty-list check while nothing is connected
+  TracedCallback<uint32_t, uint32_t, uint32_t> m_routeLookupTrace;
+  TracedCallback<Ptr<const Packet>, uint32_t> m_helloTxTrace;
+  TracedCallback<Ptr<const Packet>, uint32_t> m_helloRxTrace;
+  TracedCallback<Ptr<const Packet>, uint32_t> m_helloDropTrace;
+  TracedValue<uint32_t> m_neighborCount;
  
-  Ptr<Socket> m_socket;          
-  uint16_t m_helloPort;          
+  uint16_t m_helloPort;
 };
 
 } // namespace ns3
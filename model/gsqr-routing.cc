@@ -3,17 +3,142 @@
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
 #include "ns3/string.h"
-#include <fstream>
-#include <sstream>
+#include "ns3/boolean.h"
+#include "ns3/simulator.h"
+#include "ns3/trace-source-accessor.h"
+#include "ns3/system-path.h"
 #include <algorithm>
 #include <numeric>
+#include <iterator>
 #include <cmath>
+#include <cstdio>
+#include <fstream>
 
 NS_LOG_COMPONENT_DEFINE ("GsqrRouting");
 
 namespace ns3 {
 
 NS_OBJECT_ENSURE_REGISTERED (GsqrRouting);
+NS_OBJECT_ENSURE_REGISTERED (GsqrCheckpointWriter);
+
+const uint32_t GsqrRouting::UNKNOWN_NODE;
+
+namespace {
+
+// A reader never sees a half-written checkpoint: the image goes to a
+// temporary file first, which then replaces the old one
+bool WriteFileAtomically(const std::string &path, const std::string &image)
+{
+    std::string temporary = path + ".tmp";
+    {
+        std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+        file.write(image.data(), image.size());
+        if (!file.good()) {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+} // anonymous namespace
+
+TypeId
+GsqrCheckpointWriter::GetTypeId (void)
+{
+    static TypeId tid = TypeId ("ns3::GsqrCheckpointWriter")
+        .SetParent<Object> ()
+        .SetGroupName ("Gsqr")
+        .AddConstructor<GsqrCheckpointWriter> ();
+    return tid;
+}
+
+GsqrCheckpointWriter::GsqrCheckpointWriter ()
+    : m_stop (false),
+      m_written (0)
+{
+    NS_LOG_FUNCTION (this);
+}
+
+GsqrCheckpointWriter::~GsqrCheckpointWriter ()
+{
+    NS_LOG_FUNCTION (this);
+    Drain();
+}
+
+void GsqrCheckpointWriter::DoDispose()
+{
+    NS_LOG_FUNCTION (this);
+    Drain();
+    Object::DoDispose();
+}
+
+void GsqrCheckpointWriter::Write(const std::string &path, std::string image)
+{
+    NS_LOG_FUNCTION (this << path << image.size());
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto inserted = m_images.emplace(path, std::string());
+        if (inserted.second) {
+            m_queue.push_back(path);
+        }
+        inserted.first->second = std::move(image);
+        if (!m_thread.joinable()) {
+            m_stop = false;
+            m_thread = std::thread(&GsqrCheckpointWriter::Run, this);
+        }
+    }
+    m_wake.notify_one();
+}
+
+void GsqrCheckpointWriter::Drain()
+{
+    if (!m_thread.joinable()) {
+        return;
+    }
+    NS_LOG_FUNCTION (this);
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_one();
+    m_thread.join();
+    // Logged here, on the simulation thread, not by the writer
+    for (const std::string &path : m_failed) {
+        NS_LOG_ERROR ("Cannot write checkpoint " << path);
+    }
+    m_failed.clear();
+}
+
+uint32_t GsqrCheckpointWriter::GetNumWritten() const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_written;
+}
+
+void GsqrCheckpointWriter::Run()
+{
+    std::unique_lock<std::mutex> lock(m_mutex);
+    while (true) {
+        m_wake.wait(lock, [this]() { return m_stop || !m_queue.empty(); });
+        if (m_queue.empty()) {
+            return;
+        }
+        std::string path = std::move(m_queue.front());
+        m_queue.pop_front();
+        auto it = m_images.find(path);
+        std::string image = std::move(it->second);
+        m_images.erase(it);
+        // A slow disk holds up the queue, never the simulation
+        lock.unlock();
+        bool written = WriteFileAtomically(path, image);
+        lock.lock();
+        if (written) {
+            m_written++;
+        } else {
+            m_failed.push_back(path);
+        }
+    }
+}
 
 TypeId 
 GsqrRouting::GetTypeId (void)
@@ -42,18 +167,142 @@ GsqrRouting::GetTypeId (void)
                        DoubleValue (2.0),
                        MakeDoubleAccessor (&GsqrRouting::m_updateInterval),
                        MakeDoubleChecker<double> (0.1, 10.0))
+        .AddAttribute ("BatchUpdates",
+                       "Accumulate TD steps per (neighbor, destination) and apply "
+                       "them once per UpdateInterval instead of on every ACK",
+                       BooleanValue (false),
+                       MakeBooleanAccessor (&GsqrRouting::m_batchUpdates),
+                       MakeBooleanChecker ())
+        .AddAttribute ("AverageBatch",
+                       "Apply the mean rather than the sum of a pair's batched steps",
+                       BooleanValue (false),
+                       MakeBooleanAccessor (&GsqrRouting::m_averageBatch),
+                       MakeBooleanChecker ())
+        .AddAttribute ("MultipathK",
+                       "Neighbors by Q a flow's next hop is drawn from in "
+                       "SelectMultipathHop; 1 forwards every packet to the best",
+                       UintegerValue (1),
+                       MakeUintegerAccessor (&GsqrRouting::m_multipathK),
+                       MakeUintegerChecker<uint32_t> (1, 16))
+        .AddAttribute ("MultipathWeighting",
+                       "How the k best share the flows: softmax (of Q over "
+                       "MultipathTemperature) or queue (inverse advertised queue occupancy)",
+                       StringValue ("softmax"),
+                       MakeStringAccessor (&GsqrRouting::SetMultipathWeightingName,
+                                           &GsqrRouting::GetMultipathWeightingName),
+                       MakeStringChecker ())
+        .AddAttribute ("MultipathTemperature",
+                       "Q difference over which a neighbor's softmax weight falls by e",
+                       DoubleValue (0.01),
+                       MakeDoubleAccessor (&GsqrRouting::m_multipathTemperature),
+                       MakeDoubleChecker<double> (1e-9))
+        .AddAttribute ("MultipathQueueFloor",
+                       "Added to the queue occupancy before inverting it, so that "
+                       "empty queues do not take every flow",
+                       DoubleValue (0.05),
+                       MakeDoubleAccessor (&GsqrRouting::m_multipathQueueFloor),
+                       MakeDoubleChecker<double> (1e-9))
+        .AddAttribute ("FlowTimeout",
+                       "Seconds without a packet after which a flow is drawn a next hop anew",
+                       DoubleValue (1.0),
+                       MakeDoubleAccessor (&GsqrRouting::m_flowTimeout),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("CheckpointDirectory",
+                       "Directory the learned table of each node is checkpointed to, "
+                       "as node-<id>.bin in the binary format; none if empty",
+                       StringValue (""),
+                       MakeStringAccessor (&GsqrRouting::m_checkpointDirectory),
+                       MakeStringChecker ())
+        .AddAttribute ("CheckpointInterval",
+                       "Seconds between checkpoints; 0 checkpoints only when the "
+                       "node is disposed of, at the end of the simulation",
+                       DoubleValue (0.0),
+                       MakeDoubleAccessor (&GsqrRouting::m_checkpointInterval),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("WarmStartDirectory",
+                       "Directory of checkpoints from an earlier run, loaded over the "
+                       "pretrained table on Initialize; none if empty",
+                       StringValue (""),
+                       MakeStringAccessor (&GsqrRouting::m_warmStartDirectory),
+                       MakeStringChecker ())
+        .AddAttribute ("ConvergenceWindow",
+                       "Seconds of TD errors and next-hop choices each convergence "
+                       "judgement is made over; 0 disables the detector",
+                       DoubleValue (2.0),
+                       MakeDoubleAccessor (&GsqrRouting::m_convergenceWindow),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("ConvergenceThreshold",
+                       "Mean |TD error| below which a window counts as stable",
+                       DoubleValue (0.01),
+                       MakeDoubleAccessor (&GsqrRouting::m_convergenceThreshold),
+                       MakeDoubleChecker<double> (0.0))
+        .AddAttribute ("StableWindows",
+                       "Consecutive stable windows after which the node has converged",
+                       UintegerValue (3),
+                       MakeUintegerAccessor (&GsqrRouting::m_stableWindows),
+                       MakeUintegerChecker<uint32_t> (1))
+        .AddTraceSource ("NextHop",
+                         "A next hop was chosen for a destination, from the memo or "
+                         "by scoring every neighbor",
+                         MakeTraceSourceAccessor (&GsqrRouting::m_nextHopTrace),
+                         "ns3::GsqrRouting::NextHopTracedCallback")
+        .AddTraceSource ("TdError",
+                         "TD error of an ACK, before the learning rate is applied",
+                         MakeTraceSourceAccessor (&GsqrRouting::m_tdErrorTrace),
+                         "ns3::GsqrRouting::TdErrorTracedCallback")
+        .AddTraceSource ("RowTouched",
+                         "An embedding row was written by a TD step, a neighbor delta "
+                         "or the GraphSAGE engine",
+                         MakeTraceSourceAccessor (&GsqrRouting::m_rowTouchedTrace),
+                         "ns3::GsqrRouting::RowTracedCallback")
+        .AddTraceSource ("Convergence",
+                         "A convergence window ended: whether the node has converged, "
+                         "the window's mean |TD error| and its next-hop changes",
+                         MakeTraceSourceAccessor (&GsqrRouting::m_convergenceTrace),
+                         "ns3::GsqrRouting::ConvergenceTracedCallback")
         ;
     return tid;
 }
 
 GsqrRouting::GsqrRouting ()
     : m_nodeId (0),
+      m_rowClock (0),
+      m_evictionsSeen (0),
       m_alpha (0.1),
       m_gamma (0.9),
       m_lambda (0.01),
-      m_updateInterval (2.0)
+      m_updateInterval (2.0),
+      m_batchUpdates (false),
+      m_averageBatch (false),
+      m_checkpointInterval (0.0),
+      m_checkpoints (0),
+      m_convergenceWindow (2.0),
+      m_convergenceThreshold (0.01),
+      m_stableWindows (3),
+      m_windowTdSum (0.0),
+      m_windowTdErrors (0),
+      m_windowHopChanges (0),
+      m_windowActive (false),
+      m_active (false),
+      m_stableRun (0),
+      m_convergenceTime (-1.0),
+      m_nextHopChanges (0),
+      m_multipathK (1),
+      m_queueWeighting (false),
+      m_multipathTemperature (0.01),
+      m_multipathQueueFloor (0.05),
+      m_flowTimeout (1.0),
+      m_flowSweepSize (64),
+      m_qEvaluations (0),
+      m_cacheHits (0),
+      m_cacheMisses (0),
+      m_tdErrors (0),
+      m_tdErrorSum (0.0),
+      m_rowsTouched (0),
+      m_flowReroutes (0)
 {
     NS_LOG_FUNCTION (this);
+    m_multipathRng = CreateObject<UniformRandomVariable> ();
 }
 
 GsqrRouting::~GsqrRouting ()
@@ -61,82 +310,342 @@ GsqrRouting::~GsqrRouting ()
     NS_LOG_FUNCTION (this);
 }
 
+void GsqrRouting::DoDispose()
+{
+    NS_LOG_FUNCTION (this);
+    m_checkpointEvent.Cancel();
+    Checkpoint();
+    // The last protocol to let go of the writer drains it
+    m_checkpointWriter = nullptr;
+    m_updateEvent.Cancel();
+    m_convergenceEvent.Cancel();
+    m_pendingTd.clear();
+    m_pendingIndex.clear();
+    m_flows.clear();
+    m_multipathRng = nullptr;
+    m_store = nullptr;
+    if (m_sage) {
+        m_sage->Dispose();
+        m_sage = nullptr;
+    }
+    Object::DoDispose();
+}
+
 void GsqrRouting::Initialize(uint32_t nodeId, const std::string &embeddingFile)
 {
     NS_LOG_FUNCTION (this << nodeId << embeddingFile);
     m_nodeId = nodeId;
+    InvalidateNextHopCache();
+    m_flows.clear();
+    m_pendingTd.clear();
+    m_pendingIndex.clear();
+    m_updateEvent.Cancel();
+    bool sage = m_sage && m_sage->IsLoaded();
+    if (m_batchUpdates || sage) {
+        m_updateEvent = Simulator::Schedule(Seconds(m_updateInterval), &GsqrRouting::UpdateTick, this);
+    }
+    m_convergenceEvent.Cancel();
+    m_bestHops.clear();
+    if (m_convergenceWindow > 0.0) {
+        m_convergenceEvent = Simulator::Schedule(Seconds(m_convergenceWindow),
+                                                 &GsqrRouting::ConvergenceTick, this);
+    }
     
+    if (!m_store) {
+        m_store = CreateObject<GsqrEmbedding>();
+    }
+    
+    // Rows missing from the file or the shared base read as zero and are
+    // created on the first TD step, delta or GraphSAGE output for them
     if (!embeddingFile.empty()) {
         LoadEmbeddingsFromFile(embeddingFile);
-    } else {
-        // Initialize default embedding
-        for (uint32_t i = 0; i <= 50; ++i) { // Assume up to 50 nodes
-            Embedding emb;
-            emb.h = std::vector<double>(16, 0.0);
-            emb.b = 0.0;
-            m_embeddings[i] = emb;
+    }
+    if (!m_warmStartDirectory.empty()) {
+        WarmStart(GetCheckpointPath(m_warmStartDirectory, m_nodeId));
+    }
+    m_evictionsSeen = m_store->GetNumEvictions();
+    
+    m_checkpointEvent.Cancel();
+    if (!m_checkpointDirectory.empty()) {
+        SystemPath::MakeDirectories(m_checkpointDirectory);
+        if (m_checkpointInterval > 0.0) {
+            m_checkpointEvent = Simulator::Schedule(Seconds(m_checkpointInterval),
+                                                    &GsqrRouting::CheckpointTick, this);
         }
     }
+    
+    if (sage && m_sage->GetOutputDimension() != m_store->GetEmbeddingDimension()) {
+        NS_FATAL_ERROR ("GraphSAGE output dimension " << m_sage->GetOutputDimension()
+                        << " does not match embedding dimension " << m_store->GetEmbeddingDimension());
+    }
 }
 
 double GsqrRouting::ComputeQValue(uint32_t destId, uint32_t neighborId) const
 {
     NS_LOG_FUNCTION (this << destId << neighborId);
     
-    auto destIt = m_embeddings.find(destId);
-    auto neighborIt = m_embeddings.find(neighborId);
-    
-    if (destIt == m_embeddings.end() || neighborIt == m_embeddings.end()) {
-        NS_LOG_WARN ("Embedding not found for dest " << destId << " or neighbor " << neighborId);
+    // h_d^T · h_nh + b_nh, in the store's precision
+    m_qEvaluations++;
+    double q;
+    if (!m_store->ComputeQ(destId, neighborId, &q)) {
+        // Not referenced yet: the zero row scores 0
+        NS_LOG_LOGIC ("Embedding not found for dest " << destId << " or neighbor " << neighborId);
         return 0.0;
     }
-    
-    const auto& h_d = destIt->second.h;
-    const auto& h_nh = neighborIt->second.h;
-    double b_nh = neighborIt->second.b;
-    
-    //: h_d^T · h_nh
-    double dot = DotProduct(h_d, h_nh);
-    
-    // bias: + b_nh
-    return dot + b_nh;
+    return q;
 }
 
-uint32_t GsqrRouting::SelectNextHop(uint32_t destNodeId, uint32_t currentNodeId)
+uint32_t GsqrRouting::SelectNextHop(uint32_t destNodeId, uint32_t currentNodeId, double *bestQ)
 {
     NS_LOG_FUNCTION (this << destNodeId << currentNodeId);
     
+    // A row evicted for the memory budget reads from the base again
+    NoteEvictions();
+    
+    // Steady state: the memoized choice is still the argmax
+    bool cacheable = (currentNodeId == m_nodeId && destNodeId != UNKNOWN_NODE);
+    if (cacheable && destNodeId < m_nextHopCache.size() && m_nextHopCache[destNodeId].valid) {
+        if (m_nextHopCache[destNodeId].checked != m_rowClock) {
+            RecheckMemo(destNodeId);
+        }
+        const MemoEntry& entry = m_nextHopCache[destNodeId];
+        NS_LOG_DEBUG ("Cached next hop: " << entry.nextHop << " with Q=" << entry.q);
+        m_cacheHits++;
+        m_nextHopTrace(destNodeId, entry.nextHop, entry.q, true);
+        NoteBestHop(destNodeId, entry.nextHop);
+        if (bestQ) {
+            *bestQ = entry.q;
+        }
+        return entry.nextHop;
+    }
+    
     auto neighborIt = m_neighbors.find(currentNodeId);
     if (neighborIt == m_neighbors.end() || neighborIt->second.empty()) {
         NS_LOG_WARN ("No neighbors for node " << currentNodeId);
+        if (bestQ) {
+            *bestQ = 0.0;
+        }
         return currentNodeId; 
     }
     
-    // Calculate the Q value for each neighbor
-    std::vector<std::pair<double, uint32_t>> qValues;
-    for (uint32_t neighborId : neighborIt->second) {
-        double q = ComputeQValue(destNodeId, neighborId);
-        qValues.emplace_back(q, neighborId);
-        NS_LOG_DEBUG ("Q(" << currentNodeId << "->" << neighborId << ", dest=" << 
-                     destNodeId << ") = " << q);
+    // Score all neighbors in one batched pass and take the maximum Q value
+    const std::vector<uint32_t>& candidates = neighborIt->second;
+    double q;
+    size_t best = m_store->ArgmaxQ(destNodeId, candidates.data(), candidates.size(), &q);
+    m_qEvaluations += candidates.size();
+    m_cacheMisses++;
+    m_nextHopTrace(destNodeId, candidates[best], q, false);
+    
+    if (cacheable) {
+        SetMemo(destNodeId, candidates[best], q);
+        NoteBestHop(destNodeId, candidates[best]);
+    }
+    if (bestQ) {
+        *bestQ = q;
     }
     
-    // Select the neighbor with the maximum Q value
-    auto bestIt = std::max_element(qValues.begin(), qValues.end(),
-        [](const auto& a, const auto& b) { return a.first < b.first; });
+    NS_LOG_DEBUG ("Selected next hop: " << candidates[best] << " with Q=" << q);
+    return candidates[best];
+}
+
+uint32_t GsqrRouting::SelectNextHopExcluding(uint32_t destNodeId, uint32_t excluded, double *bestQ)
+{
+    NS_LOG_FUNCTION (this << destNodeId << excluded);
     
-    if (bestIt != qValues.end()) {
-        NS_LOG_DEBUG ("Selected next hop: " << bestIt->second << " with Q=" << bestIt->first);
-        return bestIt->second;
+    auto neighborIt = m_neighbors.find(m_nodeId);
+    if (neighborIt == m_neighbors.end() || neighborIt->second.empty()) {
+        NS_LOG_WARN ("No neighbors for node " << m_nodeId);
+        if (bestQ) {
+            *bestQ = 0.0;
+        }
+        return m_nodeId;
+    }
+    m_candidates.clear();
+    for (uint32_t neighbor : neighborIt->second) {
+        if (neighbor != excluded) {
+            m_candidates.push_back(neighbor);
+        }
+    }
+    if (m_candidates.empty()) {
+        m_candidates.push_back(excluded);
     }
     
-    return currentNodeId;
+    double q;
+    size_t best = m_store->ArgmaxQ(destNodeId, m_candidates.data(), m_candidates.size(), &q);
+    m_qEvaluations += m_candidates.size();
+    m_cacheMisses++;
+    m_nextHopTrace(destNodeId, m_candidates[best], q, false);
+    if (bestQ) {
+        *bestQ = q;
+    }
+    NS_LOG_DEBUG ("Selected next hop: " << m_candidates[best] << " with Q=" << q
+                  << " instead of " << excluded);
+    return m_candidates[best];
+}
+
+uint32_t GsqrRouting::SelectMultipathHop(uint32_t destNodeId, uint32_t flowId, double *bestQ)
+{
+    if (m_multipathK <= 1 || destNodeId == UNKNOWN_NODE) {
+        return SelectNextHop(destNodeId, m_nodeId, bestQ);
+    }
+    NS_LOG_FUNCTION (this << destNodeId << flowId);
+    
+    NoteEvictions();
+    const std::vector<NextHopEntry>& hops = GetTopK(destNodeId);
+    if (hops.empty()) {
+        NS_LOG_WARN ("No neighbors for node " << m_nodeId);
+        if (bestQ) {
+            *bestQ = 0.0;
+        }
+        return m_nodeId;
+    }
+    NoteBestHop(destNodeId, hops[0].nextHop);
+    if (bestQ) {
+        *bestQ = hops[0].q;
+    }
+    
+    // Pinned: the flow stays put while its next hop is still among the k best
+    double now = Simulator::Now().GetSeconds();
+    auto inserted = m_flows.emplace(flowId, FlowEntry {destNodeId, 0, now});
+    FlowEntry& flow = inserted.first->second;
+    if (!inserted.second) {
+        bool idle = now - flow.lastUse > m_flowTimeout;
+        flow.lastUse = now;
+        if (!idle && flow.destId == destNodeId) {
+            for (const NextHopEntry& hop : hops) {
+                if (hop.nextHop == flow.nextHop) {
+                    m_nextHopTrace(destNodeId, hop.nextHop, hop.q, true);
+                    return hop.nextHop;
+                }
+            }
+        }
+        m_flowReroutes++;
+    }
+    
+    // Weights relative to the best, so that exp cannot overflow
+    m_weights.resize(hops.size());
+    double total = 0.0;
+    for (size_t i = 0; i < hops.size(); ++i) {
+        if (m_queueWeighting) {
+            auto it = m_nodeFeatures.find(hops[i].nextHop);
+            double queue = it != m_nodeFeatures.end() ? it->second.queueLength : 0.0;
+            m_weights[i] = 1.0 / (std::max(queue, 0.0) + m_multipathQueueFloor);
+        } else {
+            m_weights[i] = std::exp((hops[i].q - hops[0].q) / m_multipathTemperature);
+        }
+        total += m_weights[i];
+    }
+    double draw = m_multipathRng->GetValue(0.0, total);
+    size_t chosen = hops.size() - 1;
+    for (size_t i = 0; i < hops.size(); ++i) {
+        if (draw < m_weights[i]) {
+            chosen = i;
+            break;
+        }
+        draw -= m_weights[i];
+    }
+    
+    uint32_t nextHop = hops[chosen].nextHop;
+    m_nextHopTrace(destNodeId, nextHop, hops[chosen].q, false);
+    flow.destId = destNodeId;
+    flow.nextHop = nextHop;
+    if (m_flows.size() >= m_flowSweepSize) {
+        SweepFlows(now);
+    }
+    NS_LOG_DEBUG ("Flow " << flowId << " pinned to " << nextHop << " with Q=" << hops[chosen].q);
+    return nextHop;
+}
+
+int64_t GsqrRouting::AssignStreams(int64_t stream)
+{
+    NS_LOG_FUNCTION (this << stream);
+    m_multipathRng->SetStream(stream);
+    return 1;
+}
+
+void GsqrRouting::SetMultipathWeightingName(std::string name)
+{
+    if (name == "softmax") {
+        m_queueWeighting = false;
+    } else if (name == "queue") {
+        m_queueWeighting = true;
+    } else {
+        NS_FATAL_ERROR ("Unknown MultipathWeighting \"" << name << "\"; expected softmax or queue");
+    }
+}
+
+const std::vector<GsqrRouting::NextHopEntry>& GsqrRouting::GetTopK(uint32_t destId)
+{
+    static const std::vector<NextHopEntry> none;
+    if (destId < m_topKCache.size() && m_topKCache[destId].valid
+        && (m_topKCache[destId].checked == m_rowClock || RecheckTopK(destId))) {
+        m_cacheHits++;
+        return m_topKCache[destId].hops;
+    }
+    auto neighborIt = m_neighbors.find(m_nodeId);
+    if (neighborIt == m_neighbors.end() || neighborIt->second.empty()) {
+        return none;
+    }
+    
+    // One batched scoring pass, then the k best in candidate order on ties
+    const std::vector<uint32_t>& candidates = neighborIt->second;
+    size_t n = candidates.size();
+    m_scores.resize(n);
+    m_store->ScoreQ(destId, candidates.data(), n, m_scores.data());
+    m_qEvaluations += n;
+    m_cacheMisses++;
+    m_order.resize(n);
+    std::iota(m_order.begin(), m_order.end(), 0);
+    size_t k = std::min<size_t>(m_multipathK, n);
+    std::partial_sort(m_order.begin(), m_order.begin() + k, m_order.end(),
+                      [this](uint32_t a, uint32_t b) {
+                          return m_scores[a] != m_scores[b] ? m_scores[a] > m_scores[b] : a < b;
+                      });
+    
+    if (destId >= m_topKCache.size()) {
+        m_topKCache.resize(destId + 1, TopKEntry {{}, false, 0});
+    }
+    TopKEntry& entry = m_topKCache[destId];
+    entry.hops.clear();
+    for (size_t i = 0; i < k; ++i) {
+        entry.hops.push_back(NextHopEntry {candidates[m_order[i]], m_scores[m_order[i]], true});
+    }
+    entry.valid = true;
+    entry.checked = m_rowClock;
+    return entry.hops;
+}
+
+void GsqrRouting::InvalidateTopK(uint32_t nodeId)
+{
+    for (TopKEntry& entry : m_topKCache) {
+        if (!entry.valid) {
+            continue;
+        }
+        for (const NextHopEntry& hop : entry.hops) {
+            if (hop.nextHop == nodeId) {
+                entry.valid = false;
+                break;
+            }
+        }
+    }
+}
+
+void GsqrRouting::SweepFlows(double now)
+{
+    for (auto it = m_flows.begin(); it != m_flows.end();) {
+        if (now - it->second.lastUse > m_flowTimeout) {
+            it = m_flows.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_flowSweepSize = std::max<size_t>(64, 2 * m_flows.size());
 }
 
 void GsqrRouting::ReceiveAck(uint32_t neighborId, uint32_t destId, 
-                            double reward, double delay, double energy)
+                            double reward, double delay, double energy, double qNextMax)
 {
-    NS_LOG_FUNCTION (this << neighborId << destId << reward << delay << energy);
+    NS_LOG_FUNCTION (this << neighborId << destId << reward << delay << energy << qNextMax);
     
     // Calculate rewards: r = -T_delay - λ·E_per_bit
     double r = -delay - m_lambda * energy;
@@ -144,42 +653,245 @@ void GsqrRouting::ReceiveAck(uint32_t neighborId, uint32_t destId,
     // Calculate the current Q value
     double qCurrent = ComputeQValue(destId, neighborId);
     
-    // Calculate the maximum Q value for the next hop (simplified: assume 0)
-    double qNextMax = 0.0; // need to know the next hop information in practice
-    
     // TDerror: δ = r + γ * max_{n′} Q̂(v′,d,n′) - Q̂(v,d,nh)
     double tdError = r + m_gamma * qNextMax - qCurrent;
+    m_tdErrors++;
+    m_tdErrorSum += std::abs(tdError);
+    m_windowTdSum += std::abs(tdError);
+    m_windowTdErrors++;
+    m_windowActive = true;
+    m_tdErrorTrace(neighborId, destId, tdError);
     
-    // Find embedding vector
-    auto destIt = m_embeddings.find(destId);
-    auto neighborIt = m_embeddings.find(neighborId);
-    
-    if (destIt == m_embeddings.end() || neighborIt == m_embeddings.end()) {
-        NS_LOG_WARN ("Cannot update: embedding not found");
+    if (m_batchUpdates) {
+        // Steps for one pair add up, since h_d holds still until the tick
+        uint64_t key = (static_cast<uint64_t>(neighborId) << 32) | destId;
+        auto inserted = m_pendingIndex.emplace(key, m_pendingTd.size());
+        if (inserted.second) {
+            m_pendingTd.push_back(PendingTd {neighborId, destId, 0.0, 0});
+        }
+        PendingTd& pending = m_pendingTd[inserted.first->second];
+        pending.step += m_alpha * tdError;
+        pending.count++;
         return;
     }
     
     // Update embed: h_nh = h_nh + α * δ * h_d
-    const auto& h_d = destIt->second.h;
-    auto& h_nh = neighborIt->second.h;
-    
-    for (size_t i = 0; i < 16; ++i) {
-        h_nh[i] += m_alpha * tdError * h_d[i];
-    }
-    
     // Update bias: b_nh = b_nh + α * δ
-    neighborIt->second.b += m_alpha * tdError;
+    if (!m_store->ApplyTd(neighborId, destId, m_alpha * tdError)) {
+        NS_LOG_LOGIC ("No embedding for dest " << destId << ": only the bias moved");
+    }
+    NoteRowTouched(neighborId);
+    RefreshNextHopCache(neighborId, true);
     
     NS_LOG_DEBUG ("Updated embedding for neighbor " << neighborId << 
                  ", tdError=" << tdError);
 }
 
+void GsqrRouting::ApplyPendingUpdates()
+{
+    NS_LOG_FUNCTION (this << m_pendingTd.size());
+    
+    if (m_pendingTd.empty()) {
+        return;
+    }
+    // Group by neighbor: its row is written back to back, then the
+    // memoized next hops are refreshed once for it
+    std::sort(m_pendingTd.begin(), m_pendingTd.end(),
+              [](const PendingTd& a, const PendingTd& b) {
+                  return a.neighborId != b.neighborId ? a.neighborId < b.neighborId
+                                                      : a.destId < b.destId;
+              });
+    for (size_t i = 0; i < m_pendingTd.size(); ++i) {
+        const PendingTd& pending = m_pendingTd[i];
+        double step = m_averageBatch ? pending.step / pending.count : pending.step;
+        if (!m_store->ApplyTd(pending.neighborId, pending.destId, step)) {
+            NS_LOG_LOGIC ("No embedding for dest " << pending.destId << ": only the bias moved");
+        }
+        NoteRowTouched(pending.neighborId);
+        if (i + 1 == m_pendingTd.size() || m_pendingTd[i + 1].neighborId != pending.neighborId) {
+            RefreshNextHopCache(pending.neighborId, true);
+        }
+    }
+    m_pendingTd.clear();
+    m_pendingIndex.clear();
+}
+
+void GsqrRouting::ApplyNeighborDelta(uint32_t nodeId, const double *delta)
+{
+    NS_LOG_FUNCTION (this << nodeId);
+    
+    m_store->ApplyRowDelta(nodeId, delta);
+    NoteRowTouched(nodeId);
+    RefreshNextHopCache(nodeId, true);
+}
+
+void GsqrRouting::UpdateTick()
+{
+    ApplyPendingUpdates();
+    RefreshEmbeddings();
+    m_updateEvent = Simulator::Schedule(Seconds(m_updateInterval), &GsqrRouting::UpdateTick, this);
+}
+
+void GsqrRouting::NoteBestHop(uint32_t destId, uint32_t nextHop)
+{
+    m_windowActive = true;
+    if (destId >= m_bestHops.size()) {
+        m_bestHops.resize(destId + 1, UNKNOWN_NODE);
+    }
+    // The first choice for a destination is not a change of mind
+    if (m_bestHops[destId] != nextHop && m_bestHops[destId] != UNKNOWN_NODE) {
+        m_windowHopChanges++;
+        m_nextHopChanges++;
+    }
+    m_bestHops[destId] = nextHop;
+}
+
+void GsqrRouting::ConvergenceTick()
+{
+    double meanTd = m_windowTdErrors ? m_windowTdSum / m_windowTdErrors : 0.0;
+    bool stable = meanTd < m_convergenceThreshold && m_windowHopChanges == 0;
+    m_active = m_active || m_windowActive;
+    
+    // Idle windows before the first packet are not a converged state
+    double now = Simulator::Now().GetSeconds();
+    if (!stable || !m_active) {
+        m_stableRun = 0;
+        m_convergenceTime = -1.0;
+    } else if (++m_stableRun == m_stableWindows) {
+        m_convergenceTime = now - m_stableWindows * m_convergenceWindow;
+        NS_LOG_INFO ("Node " << m_nodeId << " converged at " << m_convergenceTime << "s");
+    }
+    m_convergenceTrace(IsConverged(), meanTd, m_windowHopChanges);
+    
+    m_windowTdSum = 0.0;
+    m_windowTdErrors = 0;
+    m_windowHopChanges = 0;
+    m_windowActive = false;
+    m_convergenceEvent = Simulator::Schedule(Seconds(m_convergenceWindow), &GsqrRouting::ConvergenceTick, this);
+}
+
+void GsqrRouting::Checkpoint()
+{
+    if (m_checkpointDirectory.empty() || !m_store) {
+        return;
+    }
+    NS_LOG_FUNCTION (this << m_store->GetNumLocalRows());
+    
+    if (!m_checkpointWriter) {
+        m_checkpointWriter = CreateObject<GsqrCheckpointWriter>();
+    }
+    m_checkpointWriter->Write(GetCheckpointPath(m_checkpointDirectory, m_nodeId),
+                              m_store->EncodeLocalRows());
+    m_checkpoints++;
+}
+
+void GsqrRouting::CheckpointTick()
+{
+    Checkpoint();
+    m_checkpointEvent = Simulator::Schedule(Seconds(m_checkpointInterval), &GsqrRouting::CheckpointTick, this);
+}
+
+std::string GsqrRouting::GetCheckpointPath(const std::string &directory, uint32_t nodeId)
+{
+    return directory + "/node-" + std::to_string(nodeId) + ".bin";
+}
+
+bool GsqrRouting::WarmStart(const std::string &filename)
+{
+    NS_LOG_FUNCTION (this << filename);
+    
+    // The first run of a series has nothing to start from
+    if (!std::ifstream(filename).good()) {
+        NS_LOG_INFO ("No checkpoint " << filename << ": cold start");
+        return false;
+    }
+    Ptr<GsqrEmbedding> snapshot = CreateObject<GsqrEmbedding>();
+    if (!snapshot->LoadFromBinary(filename)) {
+        return false;
+    }
+    size_t rows = m_store->MergeRows(*snapshot);
+    bool complete = (rows == snapshot->GetNumNodes());
+    snapshot->Dispose();
+    InvalidateNextHopCache();
+    NS_LOG_INFO ("Node " << m_nodeId << " warm-started " << rows << " rows from " << filename);
+    return complete;
+}
+
 void GsqrRouting::UpdateNeighborList(uint32_t nodeId, const std::vector<uint32_t> &neighbors)
 {
     NS_LOG_FUNCTION (this << nodeId << "neighbors count: " << neighbors.size());
+    
+    // Applied as the departures and arrivals it amounts to, so that the
+    // memos and GraphSAGE see each one
+    std::vector<uint32_t> before(m_neighbors[nodeId]);
+    std::vector<uint32_t> after(neighbors);
+    std::sort(before.begin(), before.end());
+    std::sort(after.begin(), after.end());
+    std::vector<uint32_t> removed;
+    std::vector<uint32_t> added;
+    std::set_difference(before.begin(), before.end(), after.begin(), after.end(),
+                        std::back_inserter(removed));
+    std::set_difference(after.begin(), after.end(), before.begin(), before.end(),
+                        std::back_inserter(added));
+    for (uint32_t lostNeighbor : removed) {
+        RemoveNeighbor(nodeId, lostNeighbor);
+    }
+    for (uint32_t newNeighbor : added) {
+        AddNeighbor(nodeId, newNeighbor);
+    }
+    // In the order given, which breaks ties in Q
     m_neighbors[nodeId] = neighbors;
 }
 
+void GsqrRouting::AddNeighbor(uint32_t nodeId, uint32_t neighborId)
+{
+    NS_LOG_FUNCTION (this << nodeId << neighborId);
+    
+    std::vector<uint32_t>& current = m_neighbors[nodeId];
+    if (std::find(current.begin(), current.end(), neighborId) != current.end()) {
+        return;
+    }
+    current.push_back(neighborId);
+    if (m_sage) {
+        m_sage->AddNeighbor(nodeId, neighborId);
+    }
+    if (nodeId == m_nodeId) {
+        RefreshNextHopCache(neighborId, false);
+    }
+}
+
+void GsqrRouting::RemoveNeighbor(uint32_t nodeId, uint32_t neighborId)
+{
+    NS_LOG_FUNCTION (this << nodeId << neighborId);
+    
+    auto neighborIt = m_neighbors.find(nodeId);
+    if (neighborIt == m_neighbors.end()) {
+        return;
+    }
+    std::vector<uint32_t>& current = neighborIt->second;
+    auto it = std::find(current.begin(), current.end(), neighborId);
+    if (it == current.end()) {
+        return;
+    }
+    *it = current.back();
+    current.pop_back();
+    if (m_sage) {
+        m_sage->RemoveNeighbor(nodeId, neighborId);
+    }
+    if (nodeId == m_nodeId) {
+        // Only destinations that routed through the lost neighbor are recomputed
+        DropMemosThrough(neighborId);
+        InvalidateTopK(neighborId);
+    }
+}
+
+const std::vector<uint32_t>& GsqrRouting::GetNeighbors(uint32_t nodeId) const
+{
+    static const std::vector<uint32_t> none;
+    auto neighborIt = m_neighbors.find(nodeId);
+    return neighborIt != m_neighbors.end() ? neighborIt->second : none;
+}
+
 std::vector<double> GsqrRouting::GetNodeFeatures(uint32_t nodeId) const
 {
     NS_LOG_FUNCTION (this << nodeId);
@@ -193,112 +905,233 @@ std::vector<double> GsqrRouting::GetNodeFeatures(uint32_t nodeId) const
     return {1.0, 1.0, 0.0}; // mean_ETX=1.0, E_r=1.0, q=0.0
 }
 
+void GsqrRouting::UpdateNodeFeatures(uint32_t nodeId, double meanETX,
+                                     double energyPercent, double queueLength)
+{
+    NS_LOG_FUNCTION (this << nodeId << meanETX << energyPercent << queueLength);
+    
+    double residualEnergy = energyPercent / 100.0;
+    m_nodeFeatures[nodeId] = NodeFeatures {meanETX, residualEnergy, queueLength};
+    if (m_sage && m_sage->IsLoaded()) {
+        m_sage->SetFeatures(nodeId, {meanETX, residualEnergy, queueLength});
+    }
+}
+
 std::vector<double> GsqrRouting::GenerateEmbedding(uint32_t nodeId)
 {
     NS_LOG_FUNCTION (this << nodeId);
     
-    // Simplified version: Return the current embedding or generate a new one
-    auto it = m_embeddings.find(nodeId);
-    if (it != m_embeddings.end()) {
-        return it->second.h;
+    RefreshEmbeddings();
+    size_t dim = m_store->GetEmbeddingDimension();
+    std::vector<double> row(dim + 1, 0.0);
+    m_store->ReadRow(nodeId, row.data());
+    row.pop_back();
+    return row;
+}
+
+size_t GsqrRouting::RefreshEmbeddings()
+{
+    if (!m_sage || !m_sage->IsLoaded()) {
+        return 0;
     }
+    NS_LOG_FUNCTION (this << m_sage->GetNumPending());
     
-    // generate random embedding
-    std::vector<double> embedding(16, 0.0);
-    for (double& val : embedding) {
-        val = (std::rand() / (double)RAND_MAX) * 2.0 - 1.0; // [-1, 1]
+    std::vector<uint32_t> changed;
+    m_sage->Update(changed);
+    size_t dim = m_store->GetEmbeddingDimension();
+    std::vector<double> row(dim + 1);
+    for (uint32_t nodeId : changed) {
+        // b_v is learned by TD alone
+        if (!m_store->ReadRow(nodeId, row.data())) {
+            row[dim] = 0.0;
+        }
+        m_sage->GetEmbedding(nodeId, row.data());
+        m_store->WriteRow(nodeId, row.data());
+        NoteRowTouched(nodeId);
+        RefreshNextHopCache(nodeId, true);
     }
     
-    Embedding emb;
-    emb.h = embedding;
-    emb.b = 0.0;
-    m_embeddings[nodeId] = emb;
-    
-    return embedding;
+    NS_LOG_DEBUG ("GraphSAGE recomputed " << changed.size() << " embeddings");
+    return changed.size();
 }
 
-double GsqrRouting::GetMemoryUsageKB() const
+double GsqrRouting::ScoreCandidate(uint32_t destId, uint32_t nodeId) const
 {
-    size_t numNodes = m_embeddings.size();
-    size_t totalBytes = numNodes * (16 * sizeof(double) + sizeof(double)); // h + b
-    return totalBytes / 1024.0;
+    double q;
+    m_store->ArgmaxQ(destId, &nodeId, 1, &q);
+    m_qEvaluations++;
+    return q;
 }
 
-void GsqrRouting::LoadEmbeddingsFromFile(const std::string &filename)
+void GsqrRouting::NoteEvictions()
 {
-    NS_LOG_FUNCTION (this << filename);
-    
-    std::ifstream file(filename);
-    if (!file.is_open()) {
-        NS_LOG_ERROR ("Cannot open embedding file: " << filename);
+    uint64_t evictions = m_store->GetNumEvictions();
+    // To the memos an evicted row is one that changed; past the store's
+    // log the evicted ids are lost, and with them every memo
+    for (uint64_t eviction = m_evictionsSeen; eviction < evictions; ++eviction) {
+        uint32_t nodeId;
+        if (!m_store->GetEvictedNode(eviction, &nodeId)) {
+            InvalidateNextHopCache();
+            break;
+        }
+        RefreshNextHopCache(nodeId, true);
+    }
+    m_evictionsSeen = evictions;
+}
+
+void GsqrRouting::RefreshNextHopCache(uint32_t nodeId, bool rowChanged)
+{
+    if (m_nextHopCache.empty() && m_topKCache.empty()) {
         return;
     }
+    if (nodeId >= m_rowVersions.size()) {
+        m_rowVersions.resize(nodeId + 1, 0);
+    }
+    m_rowVersions[nodeId] = ++m_rowClock;
     
-    std::string line;
-    while (std::getline(file, line)) {
-        std::stringstream ss(line);
-        std::string item;
-        
-        // Node ID
-        if (!std::getline(ss, item, ',')) continue;
-        uint32_t nodeId = std::stoul(item);
-        
-        // 16 Dim
-        std::vector<double> embedding;
-        for (int i = 0; i < 16; ++i) {
-            if (!std::getline(ss, item, ',')) break;
-            embedding.push_back(std::stod(item));
-        }
-        
-        // bias
-        if (!std::getline(ss, item, ',')) continue;
-        double bias = std::stod(item);
-        
-        Embedding emb;
-        emb.h = embedding;
-        emb.b = bias;
-        m_embeddings[nodeId] = emb;
-        
-        NS_LOG_DEBUG ("Loaded embedding for node " << nodeId);
+    // Q(d, n) for other n depends on h_nodeId only when d == nodeId
+    if (rowChanged && nodeId < m_nextHopCache.size()) {
+        DropMemo(nodeId);
+    }
+    if (rowChanged && nodeId < m_topKCache.size()) {
+        m_topKCache[nodeId].valid = false;
     }
     
-    file.close();
-    NS_LOG_INFO ("Loaded " << m_embeddings.size() << " embeddings from " << filename);
+    // A memo through nodeId still holds if it did not lose value; the
+    // others, and the k best, see whether it passed them when next hit
+    auto viaIt = m_routedVia.find(nodeId);
+    if (viaIt == m_routedVia.end()) {
+        return;
+    }
+    std::vector<uint32_t>& dests = viaIt->second;
+    for (size_t i = dests.size(); i-- > 0;) {
+        uint32_t destId = dests[i];
+        double q = ScoreCandidate(destId, nodeId);
+        if (q >= m_nextHopCache[destId].q) {
+            m_nextHopCache[destId].q = q;
+        } else {
+            // Moves the last of dests, already seen, into i
+            DropMemo(destId);
+        }
+    }
 }
 
-void GsqrRouting::SaveEmbeddingsToFile(const std::string &filename) const
+void GsqrRouting::RecheckMemo(uint32_t destId)
 {
-    NS_LOG_FUNCTION (this << filename);
-    
-    std::ofstream file(filename);
-    if (!file.is_open()) {
-        NS_LOG_ERROR ("Cannot create file: " << filename);
-        return;
+    auto neighborIt = m_neighbors.find(m_nodeId);
+    uint64_t checked = m_nextHopCache[destId].checked;
+    if (neighborIt != m_neighbors.end()) {
+        for (uint32_t neighbor : neighborIt->second) {
+            const MemoEntry& entry = m_nextHopCache[destId];
+            if (neighbor == entry.nextHop || !ChangedSince(neighbor, checked)) {
+                continue;
+            }
+            double q = ScoreCandidate(destId, neighbor);
+            if (q > entry.q) {
+                SetMemo(destId, neighbor, q);
+            }
+        }
     }
-    
-    for (const auto& entry : m_embeddings) {
-        file << entry.first;
-        for (double val : entry.second.h) {
-            file << "," << val;
+    m_nextHopCache[destId].checked = m_rowClock;
+}
+
+bool GsqrRouting::RecheckTopK(uint32_t destId)
+{
+    // A member that lost value and is now last may have been passed by a
+    // neighbor outside the set
+    auto byQ = [](const NextHopEntry& a, const NextHopEntry& b) { return a.q > b.q; };
+    TopKEntry& entry = m_topKCache[destId];
+    auto neighborIt = m_neighbors.find(m_nodeId);
+    if (neighborIt != m_neighbors.end()) {
+        for (uint32_t neighbor : neighborIt->second) {
+            if (!ChangedSince(neighbor, entry.checked)) {
+                continue;
+            }
+            auto member = std::find_if(entry.hops.begin(), entry.hops.end(),
+                                       [neighbor](const NextHopEntry& hop) { return hop.nextHop == neighbor; });
+            double q = ScoreCandidate(destId, neighbor);
+            if (member != entry.hops.end()) {
+                bool lost = q < member->q;
+                member->q = q;
+                std::stable_sort(entry.hops.begin(), entry.hops.end(), byQ);
+                if (lost && entry.hops.size() == m_multipathK && entry.hops.back().nextHop == neighbor) {
+                    entry.valid = false;
+                    return false;
+                }
+            } else if (entry.hops.size() < m_multipathK) {
+                entry.hops.push_back(NextHopEntry {neighbor, q, true});
+                std::stable_sort(entry.hops.begin(), entry.hops.end(), byQ);
+            } else if (q > entry.hops.back().q) {
+                entry.hops.back() = NextHopEntry {neighbor, q, true};
+                std::stable_sort(entry.hops.begin(), entry.hops.end(), byQ);
+            }
         }
-        file << "," << entry.second.b << "\n";
     }
-    
-    file.close();
-    NS_LOG_INFO ("Saved " << m_embeddings.size() << " embeddings to " << filename);
+    entry.checked = m_rowClock;
+    return true;
+}
+
+void GsqrRouting::SetMemo(uint32_t destId, uint32_t nextHop, double q)
+{
+    if (destId >= m_nextHopCache.size()) {
+        m_nextHopCache.resize(destId + 1, MemoEntry {0, 0.0, false, 0, 0});
+    }
+    if (!m_nextHopCache[destId].valid || m_nextHopCache[destId].nextHop != nextHop) {
+        DropMemo(destId);
+        std::vector<uint32_t>& via = m_routedVia[nextHop];
+        m_nextHopCache[destId].via = static_cast<uint32_t>(via.size());
+        via.push_back(destId);
+    }
+    MemoEntry& entry = m_nextHopCache[destId];
+    entry.nextHop = nextHop;
+    entry.q = q;
+    entry.valid = true;
+    entry.checked = m_rowClock;
+}
+
+void GsqrRouting::DropMemo(uint32_t destId)
+{
+    MemoEntry& entry = m_nextHopCache[destId];
+    if (!entry.valid) {
+        return;
+    }
+    std::vector<uint32_t>& via = m_routedVia[entry.nextHop];
+    uint32_t moved = via.back();
+    via[entry.via] = moved;
+    m_nextHopCache[moved].via = entry.via;
+    via.pop_back();
+    entry.valid = false;
 }
 
-double GsqrRouting::DotProduct(const std::vector<double> &a, const std::vector<double> &b) const
+void GsqrRouting::DropMemosThrough(uint32_t nextHop)
+{
+    auto viaIt = m_routedVia.find(nextHop);
+    if (viaIt == m_routedVia.end()) {
+        return;
+    }
+    while (!viaIt->second.empty()) {
+        DropMemo(viaIt->second.back());
+    }
+}
+
+double GsqrRouting::GetMemoryUsageKB() const
 {
-    if (a.size() != b.size()) {
+    if (!m_store) {
         return 0.0;
     }
+    // Padded rows in the storage precision, any shadow rows and the
+    // id-to-slot index, as allocated
+    return m_store->GetMemoryUsageBytes() / 1024.0;
+}
+
+void GsqrRouting::LoadEmbeddingsFromFile(const std::string &filename)
+{
+    NS_LOG_FUNCTION (this << filename);
     
-    double result = 0.0;
-    for (size_t i = 0; i < a.size(); ++i) {
-        result += a[i] * b[i];
+    // CSV or the binary format, told apart by the file magic
+    if (!m_store->LoadFromFile(filename)) {
+        NS_LOG_ERROR ("Cannot open embedding file: " << filename);
     }
-    return result;
 }
 
 std::vector<double> GsqrRouting::VectorAdd(const std::vector<double> &a,
@@ -3,14 +3,60 @@
 
 #include "ns3/object.h" 
 #include "ns3/ptr.h"
+#include "ns3/event-id.h"
+#include "ns3/random-variable-stream.h"
+#include "ns3/traced-callback.h"
+#include "gsqr-embedding.h"
+#include "gsqr-sage.h"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <cstdint>
 #include <string>
+#include <thread>
 
 namespace ns3
 {
 
+// One background thread writing the checkpoints of every node in the
+// process; GsqrHelper shares one among all the protocols it creates.
+// Images are written in the order they were queued, a newer image of a
+// path replacing one still waiting, each to a temporary file renamed over
+// the previous checkpoint. The queue is drained, and failed writes
+// logged, by Drain, which disposal and destruction call
+class GsqrCheckpointWriter : public Object
+{
+public:
+    static TypeId GetTypeId (void);
+
+    GsqrCheckpointWriter();
+    virtual ~GsqrCheckpointWriter();
+
+    // Queues image to be written to path; starts the thread if needed
+    void Write(const std::string &path, std::string image);
+    // Waits until every queued image is written and stops the thread
+    void Drain();
+    uint32_t GetNumWritten() const;
+
+protected:
+    void DoDispose() override;
+
+private:
+    void Run();
+
+    mutable std::mutex m_mutex;
+    std::condition_variable m_wake;
+    std::deque<std::string> m_queue;                          // paths, oldest first
+    std::unordered_map<std::string, std::string> m_images;    // latest image of each queued path
+    std::vector<std::string> m_failed;                        // since the last Drain
+    bool m_stop;
+    uint32_t m_written;
+    std::thread m_thread;
+};
+
 class GsqrRouting : public Object
 {
 public:
@@ -24,66 +70,321 @@ public:
 
     // online Q approximation algorithm
     // Q̂(v,d,nh) = h_d^T h_nh + b_nh, nh ∈ N(v)
-    uint32_t SelectNextHop(uint32_t destNodeId, uint32_t currentNodeId);
+    // The choice for this node is memoized per destination until a TD step
+    // or a neighbor change can alter it. bestQ, if given, receives
+    // max_nh Q̂(v,d,nh), or 0 without neighbors
+    uint32_t SelectNextHop(uint32_t destNodeId, uint32_t currentNodeId, double *bestQ = nullptr);
+
+    // Multipath forwarding for one flow of this node. With MultipathK > 1
+    // the next hop is drawn from the k best neighbors by Q, weighted by
+    // softmax(Q / MultipathTemperature) or by 1 / (queue occupancy +
+    // MultipathQueueFloor) as last advertised, and the flow keeps it while
+    // it stays among the k and the flow is never idle for FlowTimeout.
+    // The k best are memoized per destination like the argmax. With
+    // MultipathK = 1, or an unknown destination, this is SelectNextHop.
+    // bestQ, if given, receives the best of the k, whichever is drawn
+    uint32_t SelectMultipathHop(uint32_t destNodeId, uint32_t flowId, double *bestQ = nullptr);
+    // Whether Q towards destNodeId reads an embedding row of its own. Without
+    // one every neighbor scores its bias alone, which says nothing about
+    // where the destination lies
+    bool HasDestinationRow(uint32_t destNodeId) const
+    {
+        return destNodeId != UNKNOWN_NODE && m_store && m_store->HasRow(destNodeId);
+    }
+    // Best-Q neighbor of this node other than excluded, the hop a packet
+    // came from, so that packets with no usable Q do not bounce straight
+    // back. Not memoized; excluded is returned only if it is the sole
+    // neighbor. bestQ as for SelectNextHop
+    uint32_t SelectNextHopExcluding(uint32_t destNodeId, uint32_t excluded, double *bestQ = nullptr);
+    uint32_t GetMultipathK() const { return m_multipathK; }
+    // Assigns the stream of the multipath draw; returns the number used
+    int64_t AssignStreams(int64_t stream);
 
     // reinforcement learning update
+    // δ = r + γ max_n′ Q̂(v′,d,n′) - Q̂(v,d,nh), with the max reported by nh
     // h_nh ← h_nh + α δ h_d, b_nh ← b_nh + α δ
+    // With BatchUpdates the step is only accumulated until the next
+    // UpdateInterval tick
     void ReceiveAck(uint32_t neighborId, uint32_t destId, double reward,
-                    double delay, double energy);
+                    double delay, double energy, double qNextMax);
+
+    // Applies the accumulated steps now; called on every UpdateInterval tick
+    void ApplyPendingUpdates();
+    size_t GetNumPendingUpdates() const { return m_pendingTd.size(); }
+
+    // Row change advertised by a neighbor: h_n += Δh, b_n += Δb
+    void ApplyNeighborDelta(uint32_t nodeId, const double *delta);
 
     // Neighborhood Management
     void UpdateNeighborList(uint32_t nodeId, const std::vector<uint32_t> &neighbors);
+    // Single neighbor arrivals and departures, from Hello reception and expiry
+    void AddNeighbor(uint32_t nodeId, uint32_t neighborId);
+    void RemoveNeighbor(uint32_t nodeId, uint32_t neighborId);
+    const std::vector<uint32_t>& GetNeighbors(uint32_t nodeId) const;
 
-    // Node Features: x_v = [mean_ETX, E_r, q] ∈ ℝ³
+    // Node Features: x_v = [mean_ETX, E_r, q] ∈ ℝ³, E_r the residual
+    // energy fraction (0..1) the SAGE scaler was trained on
     std::vector<double> GetNodeFeatures(uint32_t nodeId) const;
+    // From Hellos heard, and this node's own for nodeId == m_nodeId;
+    // energyPercent as the Hello carries it, converted to E_r here
+    void UpdateNodeFeatures(uint32_t nodeId, double meanETX, double energyPercent, double queueLength);
 
-    // GraphSAGE Embedding（simple）
+    // GraphSAGE Embedding h_v, without the bias; current as of this call
+    // with an engine, else the stored row (zero if there is none)
     std::vector<double> GenerateEmbedding(uint32_t nodeId);
 
+    // In-simulator GraphSAGE over the known graph and features, set before
+    // Initialize. Its output replaces h_v (b_v is kept) for the nodes whose
+    // neighborhood or features changed, on every UpdateInterval tick
+    void SetSage(Ptr<GsqrSage> sage) { m_sage = sage; }
+    Ptr<GsqrSage> GetSage() const { return m_sage; }
+    // Writes the embeddings the engine recomputes into the store; returns how many
+    size_t RefreshEmbeddings();
+
+    // Destination id for addresses with no known node: scores by bias alone
+    static const uint32_t UNKNOWN_NODE = 0xffffffff;
+
     void SetLearningRate(double alpha) { m_alpha = alpha; }
     void SetDiscountFactor(double gamma) { m_gamma = gamma; }
     void SetEnergyWeight(double lambda) { m_lambda = lambda; }
     void SetUpdateInterval(double seconds) { m_updateInterval = seconds; }
 
-    size_t GetEmbeddingDimension() const { return m_embeddingDim; }
-    size_t GetNumNodes() const { return m_embeddings.size(); }
+    // Checkpoints of the learned table: the rows this node holds itself,
+    // in the binary format, go to CheckpointDirectory every
+    // CheckpointInterval and at DoDispose. The image is taken on the
+    // simulation thread and queued on the checkpoint writer, the helper's
+    // shared one if set, else one of this node's own
+    void Checkpoint();
+    void SetCheckpointWriter(Ptr<GsqrCheckpointWriter> writer) { m_checkpointWriter = writer; }
+    uint32_t GetNumCheckpoints() const { return m_checkpoints; }
+    // Where the checkpoint of nodeId lives in directory
+    static std::string GetCheckpointPath(const std::string &directory, uint32_t nodeId);
+    // Writes a checkpoint over the table loaded so far; Initialize does so
+    // from WarmStartDirectory. False if there is no usable checkpoint
+    bool WarmStart(const std::string &filename);
+
+    // Convergence of this node, judged every ConvergenceWindow seconds. A
+    // window is stable if the mean |δ| of its ACKs stays below
+    // ConvergenceThreshold and no destination's best next hop changed in
+    // it; one without ACKs or choices is stable as well. The node has
+    // converged once it has learned or routed at all and its last
+    // StableWindows windows were stable
+    bool IsConverged() const { return m_convergenceTime >= 0.0; }
+    // Whether the node has received an ACK or chosen a next hop at all
+    bool IsActive() const { return m_active; }
+    // Start of the run of stable windows the node converged with; -1 while it has not
+    double GetConvergenceTime() const { return m_convergenceTime; }
+    // Times the best next hop of a destination changed, over the whole run
+    uint64_t GetNumNextHopChanges() const { return m_nextHopChanges; }
+
+    // Embedding store shared with the owning protocol; set before Initialize
+    void SetEmbeddingStore(Ptr<GsqrEmbedding> store) { m_store = store; InvalidateNextHopCache(); }
+    Ptr<GsqrEmbedding> GetEmbeddingStore() const { return m_store; }
+
+    size_t GetEmbeddingDimension() const { return m_store ? m_store->GetEmbeddingDimension() : 0; }
+    size_t GetNumNodes() const { return m_store ? m_store->GetNumNodes() : 0; }
     double GetMemoryUsageKB() const;
 
     double ComputeQValue(uint32_t destId, uint32_t neighborId) const;
+
+    // Forgets every memoized next hop; for writers of the store other than ReceiveAck
+    void InvalidateNextHopCache() { m_nextHopCache.clear(); m_topKCache.clear(); m_routedVia.clear(); }
+
+    // Performance counters since creation. A Q evaluation is one candidate
+    // scored; a row touch is one write of a row by a TD step, a neighbor
+    // delta or the GraphSAGE engine
+    uint64_t GetNumQEvaluations() const { return m_qEvaluations; }
+    uint64_t GetNextHopCacheHits() const { return m_cacheHits; }
+    uint64_t GetNextHopCacheMisses() const { return m_cacheMisses; }
+    uint64_t GetNumTdErrors() const { return m_tdErrors; }
+    // Mean |δ| over every ACK received; 0 before the first
+    double GetMeanTdErrorMagnitude() const { return m_tdErrors ? m_tdErrorSum / m_tdErrors : 0.0; }
+    uint64_t GetNumRowsTouched() const { return m_rowsTouched; }
+    // Flows pinned to a next hop, and how often one was drawn a new one
+    // because its next hop fell out of the k best or it went idle
+    size_t GetNumFlows() const { return m_flows.size(); }
+    uint64_t GetNumFlowReroutes() const { return m_flowReroutes; }
+
+    typedef void (* NextHopTracedCallback)(uint32_t destId, uint32_t nextHop, double q, bool cached);
+    typedef void (* TdErrorTracedCallback)(uint32_t neighborId, uint32_t destId, double tdError);
+    typedef void (* RowTracedCallback)(uint32_t nodeId);
+    typedef void (* ConvergenceTracedCallback)(bool converged, double meanTdError,
+                                               uint32_t nextHopChanges);
     
+protected:
+    virtual void DoDispose();
+
 private:
-    struct Embedding
+    // Memoized argmax for one destination, over m_neighbors[m_nodeId]
+    struct NextHopEntry
+    {
+        uint32_t nextHop;
+        double q;
+        bool valid;
+    };
+
+    // Memoized argmax for one destination. It has taken the candidates into
+    // account up to m_rowClock = checked, and sits at m_routedVia[nextHop][via]
+    struct MemoEntry
+    {
+        uint32_t nextHop;
+        double q;
+        bool valid;
+        uint64_t checked;
+        uint32_t via;
+    };
+
+    // The k best candidates for one destination by Q, best first; checked
+    // as for MemoEntry
+    struct TopKEntry
+    {
+        std::vector<NextHopEntry> hops;
+        bool valid;
+        uint64_t checked;
+    };
+
+    // Next hop a flow is pinned to, and when the flow last sent
+    struct FlowEntry
     {
-        std::vector<double> h; 
-        double b;              
+        uint32_t destId;
+        uint32_t nextHop;
+        double lastUse;
     };
 
     struct NodeFeatures
     {
         double meanETX;        
-        double residualEnergy;
+        double residualEnergy; // fraction
         double queueLength;    
     };
 
     
     uint32_t m_nodeId;
-    std::map<uint32_t, Embedding> m_embeddings;
+    Ptr<GsqrEmbedding> m_store; // flat h/b table, shared with GsqrEmbedding users
+    Ptr<GsqrSage> m_sage;       // may be null
     std::map<uint32_t, NodeFeatures> m_nodeFeatures;
     std::map<uint32_t, std::vector<uint32_t>> m_neighbors;
+    std::vector<MemoEntry> m_nextHopCache;    // indexed by destination id
+    std::vector<TopKEntry> m_topKCache;       // indexed by destination id
+    // Destinations memoized through each next hop, which a change of its
+    // row rescores at once; the memos through others look at it when
+    // next hit, if its m_rowVersions stamp is newer than theirs
+    std::unordered_map<uint32_t, std::vector<uint32_t>> m_routedVia;
+    std::vector<uint64_t> m_rowVersions;      // node id -> m_rowClock at its last change
+    uint64_t m_rowClock;                      // row changes and new candidates so far
+    uint64_t m_evictionsSeen;                  // store evictions the cache has seen
 
     
     double m_alpha;          
     double m_gamma;          
     double m_lambda;         
     double m_updateInterval; // Δt = 2s
+    bool m_batchUpdates;
+    bool m_averageBatch;     // mean instead of sum of the steps per pair
+    EventId m_updateEvent;
+
+    std::string m_checkpointDirectory;  // no checkpoints if empty
+    double m_checkpointInterval;        // seconds; 0 only checkpoints at DoDispose
+    std::string m_warmStartDirectory;   // no warm start if empty
+    EventId m_checkpointEvent;
+    Ptr<GsqrCheckpointWriter> m_checkpointWriter;
+    uint32_t m_checkpoints;
+
+    double m_convergenceWindow;          // seconds; 0 disables the detector
+    double m_convergenceThreshold;       // of the window's mean |δ|
+    uint32_t m_stableWindows;
+    EventId m_convergenceEvent;
+    std::vector<uint32_t> m_bestHops;    // last argmax per destination id, UNKNOWN_NODE before one
+    double m_windowTdSum;                // of |δ| in the current window
+    uint64_t m_windowTdErrors;
+    uint32_t m_windowHopChanges;
+    bool m_windowActive;                 // an ACK or a choice in the current window
+    bool m_active;                       // one in any window so far
+    uint32_t m_stableRun;                // consecutive stable windows up to the last
+    double m_convergenceTime;
+    uint64_t m_nextHopChanges;
+
+    uint32_t m_multipathK;
+    bool m_queueWeighting;   // MultipathWeighting queue, else softmax
+    double m_multipathTemperature;
+    double m_multipathQueueFloor;
+    double m_flowTimeout;    // seconds
+    std::unordered_map<uint32_t, FlowEntry> m_flows;
+    size_t m_flowSweepSize;  // flow count that triggers the next idle sweep
+    Ptr<UniformRandomVariable> m_multipathRng;
+    std::vector<double> m_scores;     // ScoreQ output, one per neighbor
+    std::vector<uint32_t> m_order;    // neighbor indices by score
+    std::vector<double> m_weights;    // draw weights of the k best
+    std::vector<uint32_t> m_candidates; // neighbors left by SelectNextHopExcluding
+
+    // Summed α δ per (neighbor, destination) since the last tick, in
+    // arrival order; m_pendingIndex finds a pair's slot
+    struct PendingTd
+    {
+        uint32_t neighborId;
+        uint32_t destId;
+        double step;
+        uint32_t count;
+    };
+    std::vector<PendingTd> m_pendingTd;
+    std::unordered_map<uint64_t, size_t> m_pendingIndex;
+
+    mutable uint64_t m_qEvaluations;
+    uint64_t m_cacheHits;
+    uint64_t m_cacheMisses;
+    uint64_t m_tdErrors;
+    double m_tdErrorSum;     // of |δ|
+    uint64_t m_rowsTouched;
+    uint64_t m_flowReroutes;
+    TracedCallback<uint32_t, uint32_t, double, bool> m_nextHopTrace;
+    TracedCallback<uint32_t, uint32_t, double> m_tdErrorTrace;
+    TracedCallback<uint32_t> m_rowTouchedTrace;
+    TracedCallback<bool, double, uint32_t> m_convergenceTrace;
 
-    static const size_t m_embeddingDim = 16; // 16Dim GraphSAGE
     static const size_t m_featureDim = 3;    // 3Dim Node featrue
 
+    // Score of one candidate, with ArgmaxQ's treatment of missing rows
+    double ScoreCandidate(uint32_t destId, uint32_t nodeId) const;
+    // Counts and traces one write of the row of nodeId
+    void NoteRowTouched(uint32_t nodeId)
+    {
+        m_rowsTouched++;
+        m_rowTouchedTrace(nodeId);
+    }
+    // The argmax for destId is nextHop, for the convergence detector
+    void NoteBestHop(uint32_t destId, uint32_t nextHop);
+    // The row of nodeId moved (rowChanged) or nodeId just became a candidate
+    void RefreshNextHopCache(uint32_t nodeId, bool rowChanged);
+    // Memo bookkeeping that keeps m_routedVia in step
+    void SetMemo(uint32_t destId, uint32_t nextHop, double q);
+    void DropMemo(uint32_t destId);
+    void DropMemosThrough(uint32_t nextHop);
+    // Brings a memo or top-k set hit after m_rowClock moved up to date
+    void RecheckMemo(uint32_t destId);
+    // False if the set must be recomputed
+    bool RecheckTopK(uint32_t destId);
+    // Whether nodeId changed since checked
+    bool ChangedSince(uint32_t nodeId, uint64_t checked) const
+    {
+        return nodeId < m_rowVersions.size() && m_rowVersions[nodeId] > checked;
+    }
+    // Memoized k best for destId; empty without neighbors
+    const std::vector<NextHopEntry>& GetTopK(uint32_t destId);
+    // Drops the top-k sets that contain nodeId
+    void InvalidateTopK(uint32_t nodeId);
+    // Refreshes the memos for the rows the store evicted since the last call
+    void NoteEvictions();
+    // Forgets flows idle for FlowTimeout
+    void SweepFlows(double now);
+    void SetMultipathWeightingName(std::string name);
+    std::string GetMultipathWeightingName() const { return m_queueWeighting ? "queue" : "softmax"; }
+    void UpdateTick();
+    void CheckpointTick();
+    // Judges the window just ended and starts the next
+    void ConvergenceTick();
+
     void LoadEmbeddingsFromFile(const std::string &filename);
-    void SaveEmbeddingsToFile(const std::string &filename) const;
 
-    double DotProduct(const std::vector<double> &a, const std::vector<double> &b) const;
     std::vector<double> VectorAdd(const std::vector<double> &a,
                                   const std::vector<double> &b) const;
     std::vector<double> VectorScale(const std::vector<double> &v, double scalar) const;
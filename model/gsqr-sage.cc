@@ -0,0 +1,361 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#include "gsqr-sage.h"
+#include "ns3/log.h"
+#include <fstream>
+#include <algorithm>
+#include <cstring>
+
+NS_LOG_COMPONENT_DEFINE ("GsqrSage");
+
+namespace ns3 {
+
+NS_OBJECT_ENSURE_REGISTERED (GsqrSage);
+
+namespace {
+
+const char SAGE_MAGIC[8] = {'G', 'S', 'Q', 'R', 'S', 'A', 'G', 'E'};
+const uint32_t SAGE_VERSION = 1;
+const uint32_t SAGE_MAX_DIMENSION = 1024;
+
+struct SageHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t inDim;
+    uint32_t hiddenDim;
+    uint32_t outDim;
+};
+
+bool ReadFloats(std::ifstream& file, size_t count, std::vector<double>& out)
+{
+    std::vector<float> values(count);
+    if (!file.read(reinterpret_cast<char*>(values.data()), count * sizeof(float))) {
+        return false;
+    }
+    out.assign(values.begin(), values.end());
+    return true;
+}
+
+} // anonymous namespace
+
+TypeId
+GsqrSage::GetTypeId (void)
+{
+    static TypeId tid = TypeId ("ns3::GsqrSage")
+        .SetParent<Object> ()
+        .SetGroupName ("Gsqr")
+        .AddConstructor<GsqrSage> ()
+        ;
+    return tid;
+}
+
+GsqrSage::GsqrSage ()
+{
+    NS_LOG_FUNCTION (this);
+}
+
+GsqrSage::~GsqrSage ()
+{
+    NS_LOG_FUNCTION (this);
+}
+
+void GsqrSage::DoDispose()
+{
+    NS_LOG_FUNCTION (this);
+    m_nodes.clear();
+    m_x.clear();
+    m_h1.clear();
+    m_h2.clear();
+    m_dirty1.clear();
+    m_dirty2.clear();
+    Object::DoDispose();
+}
+
+bool GsqrSage::LoadWeights(const std::string& filename)
+{
+    NS_LOG_FUNCTION (this << filename);
+
+    std::ifstream file(filename, std::ios::binary);
+    if (!file.is_open()) {
+        NS_LOG_ERROR ("Cannot open GraphSAGE weight file: " << filename);
+        return false;
+    }
+    SageHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))
+        || std::memcmp(header.magic, SAGE_MAGIC, sizeof(SAGE_MAGIC)) != 0
+        || header.version != SAGE_VERSION) {
+        NS_LOG_ERROR ("Not a version " << SAGE_VERSION << " GraphSAGE weight file: " << filename);
+        return false;
+    }
+    if (header.inDim < 1 || header.inDim > SAGE_MAX_DIMENSION
+        || header.hiddenDim < 1 || header.hiddenDim > SAGE_MAX_DIMENSION
+        || header.outDim < 1 || header.outDim > SAGE_MAX_DIMENSION) {
+        NS_LOG_ERROR ("Unsupported dimensions " << header.inDim << "/" << header.hiddenDim
+                      << "/" << header.outDim << " in " << filename);
+        return false;
+    }
+
+    const size_t in = header.inDim;
+    const size_t hidden = header.hiddenDim;
+    const size_t out = header.outDim;
+    std::vector<double> mean, scale, w1l, b1, w1r, w2l, b2, w2r;
+    if (!ReadFloats(file, in, mean) || !ReadFloats(file, in, scale)
+        || !ReadFloats(file, hidden * in, w1l) || !ReadFloats(file, hidden, b1)
+        || !ReadFloats(file, hidden * in, w1r)
+        || !ReadFloats(file, out * hidden, w2l) || !ReadFloats(file, out, b2)
+        || !ReadFloats(file, out * hidden, w2r)
+        || file.peek() != std::ifstream::traits_type::eof()) {
+        NS_LOG_ERROR ("Corrupt GraphSAGE weight file: " << filename);
+        return false;
+    }
+    for (double& s : scale) {
+        // Like StandardScaler, a constant feature is only centered
+        if (s == 0.0) {
+            s = 1.0;
+        }
+    }
+
+    // Features were standardized with the old scaler, so the graph goes too
+    m_inDim = header.inDim;
+    m_hiddenDim = header.hiddenDim;
+    m_outDim = header.outDim;
+    m_mean.swap(mean);
+    m_scale.swap(scale);
+    m_w1l.swap(w1l);
+    m_b1.swap(b1);
+    m_w1r.swap(w1r);
+    m_w2l.swap(w2l);
+    m_b2.swap(b2);
+    m_w2r.swap(w2r);
+    m_nodes.clear();
+    m_x.clear();
+    m_h1.clear();
+    m_h2.clear();
+    m_dirty1.clear();
+    m_dirty2.clear();
+
+    NS_LOG_INFO ("Loaded GraphSAGE weights " << m_inDim << "-" << m_hiddenDim << "-"
+                 << m_outDim << " from " << filename);
+    return true;
+}
+
+GsqrSage::Node& GsqrSage::Touch(uint32_t nodeId)
+{
+    if (nodeId >= m_nodes.size()) {
+        m_nodes.resize(nodeId + 1);
+        m_x.resize(m_nodes.size() * m_inDim, 0.0);
+        m_h1.resize(m_nodes.size() * m_hiddenDim, 0.0);
+        m_h2.resize(m_nodes.size() * m_outDim, 0.0);
+    }
+    if (!m_nodes[nodeId].known) {
+        m_nodes[nodeId].known = true;
+        MarkLayer1(nodeId);
+    }
+    return m_nodes[nodeId];
+}
+
+void GsqrSage::MarkLayer1(uint32_t nodeId)
+{
+    Node& node = m_nodes[nodeId];
+    if (!(node.dirty & DIRTY_LAYER1)) {
+        node.dirty |= DIRTY_LAYER1;
+        m_dirty1.push_back(nodeId);
+    }
+}
+
+void GsqrSage::MarkLayer2(uint32_t nodeId)
+{
+    Node& node = m_nodes[nodeId];
+    if (!(node.dirty & DIRTY_LAYER2)) {
+        node.dirty |= DIRTY_LAYER2;
+        m_dirty2.push_back(nodeId);
+    }
+}
+
+void GsqrSage::SetFeatures(uint32_t nodeId, const std::vector<double>& features)
+{
+    NS_LOG_FUNCTION (this << nodeId);
+
+    if (features.size() != m_inDim) {
+        NS_LOG_WARN ("Ignoring " << features.size() << " features for node " << nodeId
+                     << ", the model takes " << m_inDim);
+        return;
+    }
+    Touch(nodeId);
+    bool moved = false;
+    double* x = &m_x[nodeId * m_inDim];
+    for (uint32_t i = 0; i < m_inDim; ++i) {
+        double standardized = (features[i] - m_mean[i]) / m_scale[i];
+        moved = moved || standardized != x[i];
+        x[i] = standardized;
+    }
+    if (!moved) {
+        return;
+    }
+
+    // x_v enters h1 of v and of every node aggregating over v
+    MarkLayer1(nodeId);
+    for (uint32_t user : m_nodes[nodeId].out) {
+        MarkLayer1(user);
+    }
+}
+
+void GsqrSage::Link(uint32_t nodeId, uint32_t neighborId)
+{
+    std::vector<uint32_t>& in = m_nodes[nodeId].in;
+    if (nodeId == neighborId || std::find(in.begin(), in.end(), neighborId) != in.end()) {
+        return;
+    }
+    in.push_back(neighborId);
+    m_nodes[neighborId].out.push_back(nodeId);
+    // h1_v aggregates over the new set, and h_v over the new set of h1
+    MarkLayer1(nodeId);
+    MarkLayer2(nodeId);
+}
+
+void GsqrSage::Unlink(uint32_t nodeId, uint32_t neighborId)
+{
+    std::vector<uint32_t>& in = m_nodes[nodeId].in;
+    auto it = std::find(in.begin(), in.end(), neighborId);
+    if (it == in.end()) {
+        return;
+    }
+    *it = in.back();
+    in.pop_back();
+    std::vector<uint32_t>& out = m_nodes[neighborId].out;
+    auto outIt = std::find(out.begin(), out.end(), nodeId);
+    *outIt = out.back();
+    out.pop_back();
+    MarkLayer1(nodeId);
+    MarkLayer2(nodeId);
+}
+
+void GsqrSage::SetNeighbors(uint32_t nodeId, const std::vector<uint32_t>& neighbors)
+{
+    NS_LOG_FUNCTION (this << nodeId << neighbors.size());
+
+    // Touch first: growing m_nodes moves every Node
+    Touch(nodeId);
+    for (uint32_t neighborId : neighbors) {
+        Touch(neighborId);
+    }
+    std::vector<uint32_t> current(m_nodes[nodeId].in);
+    for (uint32_t neighborId : current) {
+        if (std::find(neighbors.begin(), neighbors.end(), neighborId) == neighbors.end()) {
+            Unlink(nodeId, neighborId);
+        }
+    }
+    for (uint32_t neighborId : neighbors) {
+        Link(nodeId, neighborId);
+    }
+}
+
+void GsqrSage::AddNeighbor(uint32_t nodeId, uint32_t neighborId)
+{
+    NS_LOG_FUNCTION (this << nodeId << neighborId);
+    Touch(nodeId);
+    Touch(neighborId);
+    Link(nodeId, neighborId);
+}
+
+void GsqrSage::RemoveNeighbor(uint32_t nodeId, uint32_t neighborId)
+{
+    NS_LOG_FUNCTION (this << nodeId << neighborId);
+    if (nodeId < m_nodes.size() && neighborId < m_nodes.size()) {
+        Unlink(nodeId, neighborId);
+    }
+}
+
+void GsqrSage::Layer(uint32_t nodeId, const std::vector<double>& input, uint32_t inDim,
+                     const std::vector<double>& wl, const std::vector<double>& bias,
+                     const std::vector<double>& wr, uint32_t outDim, double* out) const
+{
+    const std::vector<uint32_t>& in = m_nodes[nodeId].in;
+    std::vector<double> mean(inDim, 0.0);
+    for (uint32_t neighborId : in) {
+        const double* row = &input[neighborId * inDim];
+        for (uint32_t i = 0; i < inDim; ++i) {
+            mean[i] += row[i];
+        }
+    }
+    if (!in.empty()) {
+        for (double& value : mean) {
+            value /= in.size();
+        }
+    }
+
+    const double* self = &input[nodeId * inDim];
+    for (uint32_t o = 0; o < outDim; ++o) {
+        const double* l = &wl[o * inDim];
+        const double* r = &wr[o * inDim];
+        double sum = bias[o];
+        for (uint32_t i = 0; i < inDim; ++i) {
+            sum += l[i] * mean[i] + r[i] * self[i];
+        }
+        out[o] = sum;
+    }
+}
+
+size_t GsqrSage::Update(std::vector<uint32_t>& changed)
+{
+    NS_LOG_FUNCTION (this << m_dirty1.size() << m_dirty2.size());
+
+    if (!IsLoaded()) {
+        return 0;
+    }
+
+    std::vector<double> h1(m_hiddenDim);
+    for (uint32_t nodeId : m_dirty1) {
+        Node& node = m_nodes[nodeId];
+        node.dirty &= ~DIRTY_LAYER1;
+        Layer(nodeId, m_x, m_inDim, m_w1l, m_b1, m_w1r, m_hiddenDim, h1.data());
+        m_evaluations++;
+        for (double& value : h1) {
+            value = std::max(value, 0.0);
+        }
+        // An unchanged h1 leaves every embedding that reads it alone
+        double* stored = &m_h1[nodeId * m_hiddenDim];
+        if (node.computed && std::equal(h1.begin(), h1.end(), stored)) {
+            continue;
+        }
+        std::copy(h1.begin(), h1.end(), stored);
+        MarkLayer2(nodeId);
+        for (uint32_t user : node.out) {
+            MarkLayer2(user);
+        }
+    }
+    m_dirty1.clear();
+
+    // Every first layer is current, so the second reads consistent inputs
+    size_t count = 0;
+    std::vector<double> h2(m_outDim);
+    for (uint32_t nodeId : m_dirty2) {
+        Node& node = m_nodes[nodeId];
+        node.dirty &= ~DIRTY_LAYER2;
+        Layer(nodeId, m_h1, m_hiddenDim, m_w2l, m_b2, m_w2r, m_outDim, h2.data());
+        m_evaluations++;
+        double* stored = &m_h2[nodeId * m_outDim];
+        if (node.computed && std::equal(h2.begin(), h2.end(), stored)) {
+            continue;
+        }
+        std::copy(h2.begin(), h2.end(), stored);
+        node.computed = true;
+        changed.push_back(nodeId);
+        count++;
+    }
+    m_dirty2.clear();
+    return count;
+}
+
+bool GsqrSage::GetEmbedding(uint32_t nodeId, double* out) const
+{
+    if (nodeId >= m_nodes.size() || !m_nodes[nodeId].computed) {
+        return false;
+    }
+    const double* stored = &m_h2[nodeId * m_outDim];
+    std::copy(stored, stored + m_outDim, out);
+    return true;
+}
+
+} // namespace ns3
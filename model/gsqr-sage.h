@@ -0,0 +1,127 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+#ifndef GSQR_SAGE_H
+#define GSQR_SAGE_H
+
+#include "ns3/object.h"
+#include <vector>
+#include <string>
+#include <cstdint>
+
+namespace ns3 {
+
+/**
+ * \ingroup gsqr
+ * \brief Incremental two-layer GraphSAGE forward pass
+ *
+ * Runs the GraphSAGE model of pytorch/train_embedding.py in the simulator,
+ * with the weights that script exports (--weights). Each layer is a
+ * PyTorch Geometric SAGEConv with mean aggregation,
+ *
+ *     h1_v = ReLU(W1l mean_{u in N(v)} x_u + b1 + W1r x_v)
+ *     h_v  =      W2l mean_{u in N(v)} h1_u + b2 + W2r h1_v
+ *
+ * where an empty N(v) aggregates to zero and x_v = [mean ETX, residual
+ * energy, queue occupancy] is standardized with the training scaler.
+ * Nodes whose features were never set sit at the training mean.
+ *
+ * The graph and the features are fed one change at a time. Only nodes
+ * whose own features or 1- or 2-hop neighborhood changed are recomputed
+ * by Update, and a first-layer output that comes out unchanged stops the
+ * propagation there.
+ *
+ * The weight file is little-endian:
+ *
+ *     offset  bytes
+ *          0      8  magic "GSQRSAGE"
+ *          8      4  version (1)
+ *         12      4  input dimension I
+ *         16      4  hidden dimension H
+ *         20      4  output dimension D
+ *         24         float32 arrays, row-major: scaler mean [I],
+ *                    scaler scale [I], W1l [H][I], b1 [H], W1r [H][I],
+ *                    W2l [D][H], b2 [D], W2r [D][H]
+ */
+class GsqrSage : public Object
+{
+public:
+    static TypeId GetTypeId (void);
+
+    GsqrSage ();
+    virtual ~GsqrSage ();
+
+    /// Replaces the weights and forgets the graph, whose features it standardized.
+    bool LoadWeights (const std::string& filename);
+    bool IsLoaded () const { return m_outDim != 0; }
+
+    uint32_t GetInputDimension () const { return m_inDim; }
+    uint32_t GetHiddenDimension () const { return m_hiddenDim; }
+    uint32_t GetOutputDimension () const { return m_outDim; }
+
+    /// Raw x_v, InputDimension values in the units of the training data.
+    void SetFeatures (uint32_t nodeId, const std::vector<double>& features);
+    /// N(v), the nodes v aggregates over.
+    void SetNeighbors (uint32_t nodeId, const std::vector<uint32_t>& neighbors);
+    void AddNeighbor (uint32_t nodeId, uint32_t neighborId);
+    void RemoveNeighbor (uint32_t nodeId, uint32_t neighborId);
+
+    /**
+     * Recomputes the embeddings the changes since the last call can have
+     * moved; appends the nodes whose embedding did change to changed and
+     * returns how many.
+     */
+    size_t Update (std::vector<uint32_t>& changed);
+    /// OutputDimension values, as of the last Update; false for unknown nodes.
+    bool GetEmbedding (uint32_t nodeId, double* out) const;
+
+    /// Nodes waiting for their first layer to be recomputed.
+    size_t GetNumPending () const { return m_dirty1.size (); }
+    /// Layer evaluations done so far, both layers counted.
+    uint64_t GetNumEvaluations () const { return m_evaluations; }
+
+protected:
+    virtual void DoDispose ();
+
+private:
+    /// Per-node graph state; outputs are valid once computed is set.
+    struct Node
+    {
+        bool known {false};
+        bool computed {false};
+        uint8_t dirty {0};               //!< DIRTY_* flags
+        std::vector<uint32_t> in;        //!< N(v)
+        std::vector<uint32_t> out;       //!< nodes with v in their N
+    };
+    static const uint8_t DIRTY_LAYER1 = 1;
+    static const uint8_t DIRTY_LAYER2 = 2;
+
+    Node& Touch (uint32_t nodeId);
+    void MarkLayer1 (uint32_t nodeId);
+    void MarkLayer2 (uint32_t nodeId);
+    void Link (uint32_t nodeId, uint32_t neighborId);
+    void Unlink (uint32_t nodeId, uint32_t neighborId);
+    /// out = W_l mean_{u in N(v)} in_u + b + W_r in_v over a flat per-node input table.
+    void Layer (uint32_t nodeId, const std::vector<double>& input, uint32_t inDim,
+                const std::vector<double>& wl, const std::vector<double>& bias,
+                const std::vector<double>& wr, uint32_t outDim, double* out) const;
+
+    uint32_t m_inDim {0};
+    uint32_t m_hiddenDim {0};
+    uint32_t m_outDim {0};
+    std::vector<double> m_mean;          //!< scaler mean [I]
+    std::vector<double> m_scale;         //!< scaler scale [I]
+    std::vector<double> m_w1l, m_b1, m_w1r;
+    std::vector<double> m_w2l, m_b2, m_w2r;
+
+    std::vector<Node> m_nodes;           //!< indexed by node id
+    std::vector<double> m_x;             //!< standardized features, I per node
+    std::vector<double> m_h1;            //!< first-layer outputs, H per node
+    std::vector<double> m_h2;            //!< embeddings, D per node
+    std::vector<uint32_t> m_dirty1;      //!< nodes with DIRTY_LAYER1
+    std::vector<uint32_t> m_dirty2;      //!< nodes with DIRTY_LAYER2
+    uint64_t m_evaluations {0};
+};
+
+} // namespace ns3
+
+#endif // GSQR_SAGE_H
@@ -1,7 +1,8 @@
 #!/usr/bin/env python3
 """
 GraphSAGE Embed training script
-Generate 16-dimensional node embedding for GSQR
+Generate node embeddings for GSQR (16-dimensional by default;
+ns-3 has specialized kernels for 8, 16 and 32)
 """
 
 import torch
@@ -13,10 +14,11 @@ import networkx as nx
 from sklearn.preprocessing import StandardScaler
 import pandas as pd
 import matplotlib.pyplot as plt
+import argparse
 import os
 
 class GraphSAGE(nn.Module):
-    """The GraphSAGE model generates a 16-dimensional embedding."""
+    """The GraphSAGE model generates an out_channels-dimensional embedding."""
     def __init__(self, in_channels, hidden_channels, out_channels):
         super(GraphSAGE, self).__init__()
         self.conv1 = SAGEConv(in_channels, hidden_channels)
@@ -69,14 +71,13 @@ def generate_uav_network(num_nodes=30, area_size=1000):
     
     return positions, adjacency, features, G
 
-def train_embeddings(num_nodes=30, num_epochs=50):
+def train_embeddings(num_nodes=30, num_epochs=50, output_dim=16):
     """Training GraphSAGE embeddings"""
     print("\n=== Start GraphSAGE training ===")
     
     # parameter
     input_dim = 3      # ETX, E_r, q
     hidden_dim = 32
-    output_dim = 16    # 16 Dim
     learning_rate = 0.01
     
     # Generate training data
@@ -91,7 +92,7 @@ def train_embeddings(num_nodes=30, num_epochs=50):
     
     if len(edge_index) == 0:
         print("Error: The image has no edges!")
-        return None
+        return None, None, None, None, None
     
     edge_index = torch.tensor(edge_index, dtype=torch.long).t()
     features = torch.tensor(features, dtype=torch.float)
@@ -186,12 +187,15 @@ def train_embeddings(num_nodes=30, num_epochs=50):
     plt.savefig('training_loss.png', dpi=150, bbox_inches='tight')
     plt.close()
     
-    return final_embeddings, biases, G
+    return final_embeddings, biases, G, model, scaler
 
-def save_embeddings(embeddings, biases, filename='emb_16.csv'):
+def save_embeddings(embeddings, biases, filename=None):
     """Save embedded in CSV file"""
+    dim = embeddings.shape[1]
+    if filename is None:
+        filename = f'emb_{dim}.csv'
     df = pd.DataFrame(embeddings)
-    df.columns = [f'h{i}' for i in range(16)]
+    df.columns = [f'h{i}' for i in range(dim)]
     df['bias'] = biases
     df.index.name = 'node_id'
     
@@ -202,7 +206,7 @@ def save_embeddings(embeddings, biases, filename='emb_16.csv'):
     df.to_csv(filepath)
     print(f"\nEmbedded saved to: {filepath}")
     print(f"  Number of nodes: {len(df)}")
-    print(f"  Embedding dimension: 16")
+    print(f"  Embedding dimension: {dim}")
     print(f"  file size: {os.path.getsize(filepath) / 1024:.1f} KB")
     
     # Show the first few rows
@@ -211,6 +215,108 @@ def save_embeddings(embeddings, biases, filename='emb_16.csv'):
     
     return filepath
 
+# Binary table layout; must match GsqrEmbedding (model/gsqr-embedding.h)
+# and gsqr::MakeRowFormat (model/gsqr-q-kernel.cc)
+BINARY_MAGIC = b'GSQREMB\0'
+BINARY_VERSION = 1
+PRECISIONS = {'float64': 0, 'float32': 1, 'fp16': 2, 'int8': 3}
+ELEMENT_TYPES = {'float64': '<f8', 'float32': '<f4', 'fp16': '<f2', 'int8': 'i1'}
+
+def row_format(precision, dim):
+    """Return (meta_offset, stride) of one row, as gsqr::MakeRowFormat"""
+    element_bytes = np.dtype(ELEMENT_TYPES[precision]).itemsize
+    meta_offset = (dim * element_bytes + 7) // 8 * 8
+    row_bytes = meta_offset + 8      # double bias, or float bias + float scale
+    if row_bytes <= 64:
+        stride = 8
+        while stride < row_bytes:
+            stride *= 2
+    else:
+        stride = (row_bytes + 63) // 64 * 64
+    return meta_offset, stride
+
+def save_embeddings_binary(embeddings, biases, filename=None, precision='float64'):
+    """Save embeddings in the binary, memory-mapped format read by GsqrEmbedding"""
+    num_nodes, dim = embeddings.shape
+    if filename is None:
+        filename = f'emb_{dim}_{precision}.bin'
+    meta_offset, stride = row_format(precision, dim)
+    
+    rows = np.zeros((num_nodes, stride), dtype=np.uint8)
+    if precision == 'int8':
+        # Symmetric per-row scale; round half away from zero like std::lround
+        scales = (np.abs(embeddings).max(axis=1) / 127.0).astype('<f4')
+        safe = np.where(scales > 0, scales, 1.0).astype(np.float64)[:, None]
+        scaled = embeddings.astype(np.float64) / safe
+        quantized = np.clip(np.sign(scaled) * np.floor(np.abs(scaled) + 0.5), -127, 127)
+        quantized[scales == 0] = 0
+        rows[:, :dim] = quantized.astype('i1').view(np.uint8)
+        rows[:, meta_offset + 4:meta_offset + 8] = scales.reshape(-1, 1).view(np.uint8)
+    else:
+        values = embeddings.astype(ELEMENT_TYPES[precision])
+        rows[:, :values.itemsize * dim] = values.view(np.uint8).reshape(num_nodes, -1)
+    bias_type = '<f8' if precision == 'float64' else '<f4'
+    bias_bytes = np.dtype(bias_type).itemsize
+    rows[:, meta_offset:meta_offset + bias_bytes] = \
+        np.asarray(biases, dtype=bias_type).reshape(-1, 1).view(np.uint8)
+    
+    # Node ids are 0..N-1, so both id tables are the identity
+    ids = np.arange(num_nodes, dtype='<u4')
+    index_offset = 64
+    nodes_offset = index_offset + ids.nbytes
+    rows_offset = (nodes_offset + ids.nbytes + 63) // 64 * 64
+    header = BINARY_MAGIC + np.array(
+        [BINARY_VERSION, dim, PRECISIONS[precision], stride, num_nodes, num_nodes],
+        dtype='<u4').tobytes() + np.array(
+        [index_offset, nodes_offset, rows_offset, 0], dtype='<u8').tobytes()
+    
+    os.makedirs('outputs', exist_ok=True)
+    filepath = f'outputs/{filename}'
+    with open(filepath, 'wb') as f:
+        f.write(header)
+        f.write(ids.tobytes())
+        f.write(ids.tobytes())
+        f.write(b'\0' * (rows_offset - nodes_offset - ids.nbytes))
+        f.write(rows.tobytes())
+    print(f"\nBinary embedding saved to: {filepath}")
+    print(f"  Precision: {precision}, {stride} bytes per row")
+    print(f"  file size: {os.path.getsize(filepath) / 1024:.1f} KB")
+    
+    return filepath
+
+# GraphSAGE weight layout; must match GsqrSage (model/gsqr-sage.h)
+SAGE_MAGIC = b'GSQRSAGE'
+SAGE_VERSION = 1
+
+def save_sage_weights(model, scaler, filename=None):
+    """Save the model and feature scaler for the in-simulator GsqrSage engine"""
+    model = model.cpu()
+    layers = []
+    for conv in (model.conv1, model.conv2):
+        # SAGEConv: lin_l on the neighbor mean (with bias), lin_r on the root
+        layers.append((conv.lin_l.weight.detach().numpy(),
+                       conv.lin_l.bias.detach().numpy(),
+                       conv.lin_r.weight.detach().numpy()))
+    hidden_dim, input_dim = layers[0][0].shape
+    output_dim = layers[1][0].shape[0]
+    if filename is None:
+        filename = f'sage_{output_dim}.bin'
+    
+    os.makedirs('outputs', exist_ok=True)
+    filepath = f'outputs/{filename}'
+    with open(filepath, 'wb') as f:
+        f.write(SAGE_MAGIC)
+        f.write(np.array([SAGE_VERSION, input_dim, hidden_dim, output_dim], dtype='<u4').tobytes())
+        for array in (scaler.mean_, scaler.scale_):
+            f.write(np.asarray(array, dtype='<f4').tobytes())
+        for weight_l, bias, weight_r in layers:
+            for array in (weight_l, bias, weight_r):
+                f.write(np.ascontiguousarray(array, dtype='<f4').tobytes())
+    print(f"\nGraphSAGE weights saved to: {filepath}")
+    print(f"  Layers: {input_dim}-{hidden_dim}-{output_dim}")
+    
+    return filepath
+
 def visualize_embeddings(embeddings, G, filename='embedding_visualization.png'):
     """Visualization Embedding (2D PCA)"""
     from sklearn.decomposition import PCA
@@ -253,6 +359,17 @@ if __name__ == "__main__":
     print("GSQR - GraphSAGE training embedding")
     print("=" * 60)
     
+    parser = argparse.ArgumentParser(description='Train GraphSAGE embeddings for GSQR')
+    parser.add_argument('--dim', type=int, default=16,
+                        help='embedding dimension (8, 16 and 32 run specialized kernels in ns-3)')
+    parser.add_argument('--binary', action='store_true',
+                        help='also write the binary table GsqrEmbedding maps directly')
+    parser.add_argument('--precision', choices=sorted(PRECISIONS), default='float64',
+                        help='storage precision of the binary table')
+    parser.add_argument('--weights', action='store_true',
+                        help='also write the GraphSAGE weights GsqrSage runs in ns-3')
+    args = parser.parse_args()
+    
     np.random.seed(42)
     torch.manual_seed(42)
     
@@ -262,18 +379,22 @@ if __name__ == "__main__":
     
     try:
         # training embedding
-        embeddings, biases, G = train_embeddings(num_nodes, num_epochs)
+        embeddings, biases, G, model, scaler = train_embeddings(num_nodes, num_epochs, args.dim)
         
         if embeddings is not None:
             # Save embedded
             csv_file = save_embeddings(embeddings, biases)
+            if args.binary:
+                save_embeddings_binary(embeddings, biases, precision=args.precision)
+            if args.weights:
+                save_sage_weights(model, scaler)
             
             # Visualization embedding
             visualize_embeddings(embeddings, G)
             
             print("\n✅ Training completed")
             print("next step:")
-            print("1. Used in ns-3 simulation outputs/emb_16.csv")
+            print(f"1. Used in ns-3 simulation {csv_file}")
         else:
             print("❌ Training failed")
             
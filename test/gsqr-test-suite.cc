@@ -0,0 +1,1204 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+
+/*
+ * Unit tests of the GSQR module.
+ *
+ *     ./test.py --suite=gsqr
+ */
+
+#include "ns3/boolean.h"
+#include "ns3/double.h"
+#include "ns3/gsqr-embedding.h"
+#include "ns3/gsqr-helper.h"
+#include "ns3/gsqr-q-kernel.h"
+#include "ns3/gsqr-routing-protocol.h"
+#include "ns3/gsqr-routing.h"
+#include "ns3/gsqr-sage.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/internet-stack-helper.h"
+#include "ns3/ipv4-address-helper.h"
+#include "ns3/simple-channel.h"
+#include "ns3/simple-net-device-helper.h"
+#include "ns3/simple-net-device.h"
+#include "ns3/simulator.h"
+#include "ns3/socket.h"
+#include "ns3/string.h"
+#include "ns3/test.h"
+#include "ns3/udp-socket-factory.h"
+#include "ns3/uinteger.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace ns3;
+
+namespace {
+
+// Serializes header and reads it back into copy; returns the bytes read
+template <typename H>
+uint32_t RoundTrip(const H& header, H& copy)
+{
+    Buffer buffer;
+    buffer.AddAtStart(header.GetSerializedSize());
+    header.Serialize(buffer.Begin());
+    return copy.Deserialize(buffer.Begin());
+}
+
+} // anonymous namespace
+
+class GsqrHelloHeaderTestCase : public TestCase
+{
+public:
+    GsqrHelloHeaderTestCase() : TestCase("Hello header round trip") {}
+
+private:
+    void DoRun() override
+    {
+        GsqrHelloHeader hello;
+        NS_TEST_EXPECT_MSG_EQ(hello.GetSerializedSize(), GsqrHelloHeader::BASE_SIZE, "size without extensions");
+        hello.SetNodeId(513);
+        hello.SetSequence(250);
+        hello.SetIntervalExponent(3);
+        hello.SetTimestamp(MilliSeconds(70123));
+        hello.SetMeanETX(1.5);
+        hello.SetResidualEnergy(95.0);
+        hello.SetQueueLength(0.2);
+        hello.AddExtension(GsqrHelloHeader::EXT_ACK, std::vector<uint8_t>{1, 2, 3});
+        hello.AddExtension(GsqrHelloHeader::EXT_DELTA, std::vector<uint8_t>(40, 7));
+
+        GsqrHelloHeader copy;
+        NS_TEST_ASSERT_MSG_EQ(RoundTrip(hello, copy), hello.GetSerializedSize(),
+                              "Deserialize reads what Serialize wrote");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetVersion(), GsqrHelloHeader::VERSION, "version");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetNodeId(), 513u, "node id");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetSequence(), 250, "sequence");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetIntervalExponent(), 3, "interval exponent");
+        // 16 ms bits on the wire: resolved against a receive time after the send
+        NS_TEST_EXPECT_MSG_EQ(copy.GetTimestamp(MilliSeconds(70200)), MilliSeconds(70123), "timestamp");
+        NS_TEST_EXPECT_MSG_EQ_TOL(copy.GetMeanETX(), 1.5, 1.0 / 512, "mean ETX");
+        NS_TEST_EXPECT_MSG_EQ_TOL(copy.GetResidualEnergy(), 95.0, 0.25, "residual energy");
+        NS_TEST_EXPECT_MSG_EQ_TOL(copy.GetQueueLength(), 0.2, 1.0 / 510, "queue length");
+        std::vector<uint8_t> value;
+        NS_TEST_ASSERT_MSG_EQ(copy.GetExtension(GsqrHelloHeader::EXT_ACK, value), true, "first extension");
+        NS_TEST_EXPECT_MSG_EQ((value == std::vector<uint8_t>{1, 2, 3}), true, "first extension value");
+        NS_TEST_ASSERT_MSG_EQ(copy.GetExtension(GsqrHelloHeader::EXT_DELTA, value), true, "second extension");
+        NS_TEST_EXPECT_MSG_EQ(value.size(), 40u, "second extension value");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetExtension(3, value), false, "absent extension");
+    }
+};
+
+class GsqrAckHeaderTestCase : public TestCase
+{
+public:
+    GsqrAckHeaderTestCase() : TestCase("ACK header round trip") {}
+
+private:
+    void DoRun() override
+    {
+        GsqrAckHeader ack;
+        ack.SetSender(12);
+        ack.SetReceiver(34);
+        ack.AddEntry(GsqrAckHeader::Entry{100, 3, 0.0123, 2.5e-7, -0.75});
+        ack.AddEntry(GsqrAckHeader::Entry{7, 1, 9.0, 0.0, 1.0});
+
+        GsqrAckHeader copy;
+        NS_TEST_ASSERT_MSG_EQ(RoundTrip(ack, copy), ack.GetSerializedSize(),
+                              "Deserialize reads what Serialize wrote");
+        NS_TEST_ASSERT_MSG_EQ(copy.IsValid(), true, "type byte");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetSender(), 12u, "sender");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetReceiver(), 34u, "receiver");
+        NS_TEST_ASSERT_MSG_EQ(copy.GetEntries().size(), 2u, "entries");
+        const GsqrAckHeader::Entry& first = copy.GetEntries()[0];
+        NS_TEST_EXPECT_MSG_EQ(first.destination, 100u, "destination");
+        NS_TEST_EXPECT_MSG_EQ(first.packets, 3, "packets");
+        NS_TEST_EXPECT_MSG_EQ_TOL(first.delay, 0.0123, 0.5e-4, "delay, in 0.1 ms");
+        NS_TEST_EXPECT_MSG_EQ_TOL(first.energy, 2.5e-7, 1e-13, "energy, a float");
+        NS_TEST_EXPECT_MSG_EQ_TOL(first.qNextMax, -0.75, 1e-7, "downstream Q, a float");
+        // Delays past the 16-bit field saturate
+        NS_TEST_EXPECT_MSG_EQ_TOL(copy.GetEntries()[1].delay, 6.5535, 1e-9, "saturated delay");
+    }
+};
+
+class GsqrDeltaHeaderTestCase : public TestCase
+{
+public:
+    GsqrDeltaHeaderTestCase() : TestCase("Delta header round trip") {}
+
+private:
+    void DoRun() override
+    {
+        const uint32_t dim = 5;
+        const double changes[2][dim + 1] = {{0.5, -0.25, 0.0, 0.125, -0.5, 0.01},
+                                            {0.0, 0.0, 0.0, 0.0, 0.0, 0.0}};
+        GsqrDeltaHeader delta;
+        delta.SetSender(9);
+        delta.SetDimension(dim);
+        delta.AddRow(40, changes[0]);
+        delta.AddRow(41, changes[1]);
+
+        GsqrDeltaHeader copy;
+        NS_TEST_ASSERT_MSG_EQ(RoundTrip(delta, copy), delta.GetSerializedSize(),
+                              "Deserialize reads what Serialize wrote");
+        NS_TEST_ASSERT_MSG_EQ(copy.IsValid(), true, "type byte");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetSender(), 9u, "sender");
+        NS_TEST_EXPECT_MSG_EQ(copy.GetDimension(), dim, "dimension");
+        NS_TEST_ASSERT_MSG_EQ(copy.GetNRows(), 2u, "rows");
+        for (uint32_t r = 0; r < 2; ++r) {
+            NS_TEST_EXPECT_MSG_EQ(copy.GetRowNode(r), 40 + r, "row node");
+            double decoded[dim + 1];
+            copy.GetRowDelta(r, decoded);
+            for (uint32_t i = 0; i <= dim; ++i) {
+                // int8 against the row's largest change: within half a step
+                NS_TEST_EXPECT_MSG_EQ_TOL(decoded[i], changes[r][i], 0.5 / 127 / 2 + 1e-9,
+                                          "row change");
+            }
+        }
+    }
+};
+
+class GsqrKernelTestCase : public TestCase
+{
+public:
+    GsqrKernelTestCase() : TestCase("Row kernels: encode/decode round trip and argmax") {}
+
+private:
+    void DoRun() override
+    {
+        const gsqr::Precision precisions[] = {gsqr::Precision::FLOAT64, gsqr::Precision::FLOAT32,
+                                              gsqr::Precision::FLOAT16, gsqr::Precision::INT8};
+        const size_t dims[] = {8, 16, 17, 32};
+        std::mt19937 rng(7);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+
+        for (gsqr::Precision precision : precisions) {
+            for (size_t dim : dims) {
+                const gsqr::RowFormat format = gsqr::MakeRowFormat(precision, dim);
+                const gsqr::QKernel& kernel = gsqr::GetQKernel(precision, dim);
+                std::string name = std::string(gsqr::PrecisionName(precision)) + "/"
+                                   + std::to_string(dim) + "/" + kernel.isa;
+                // Largest round-trip error of values in [-1, 1]
+                double tolerance = precision == gsqr::Precision::FLOAT64 ? 0.0
+                                   : precision == gsqr::Precision::FLOAT32 ? 1e-7
+                                   : precision == gsqr::Precision::FLOAT16 ? 1.0 / 2048
+                                   : 1.0 / 254 + 1e-7;
+
+                const size_t n = 37;
+                std::vector<uint8_t> storage((n + 1) * format.stride);
+                std::vector<std::vector<double>> decoded(n + 1, std::vector<double>(dim + 1));
+                std::vector<const uint8_t*> rows(n);
+                for (size_t r = 0; r <= n; ++r) {
+                    std::vector<double> in(dim + 1);
+                    for (double& x : in) {
+                        x = value(rng);
+                    }
+                    uint8_t* row = storage.data() + r * format.stride;
+                    kernel.encode(in.data(), row, dim);
+                    kernel.decode(row, decoded[r].data(), dim);
+                    for (size_t i = 0; i <= dim; ++i) {
+                        NS_TEST_ASSERT_MSG_EQ_TOL(decoded[r][i], in[i], tolerance, name + " round trip");
+                    }
+                    if (r < n) {
+                        rows[r] = row;
+                    }
+                }
+
+                // Plain loop over the decoded rows, the last row being the destination
+                const uint8_t* hd = storage.data() + n * format.stride;
+                const std::vector<double>& dest = decoded[n];
+                std::vector<double> reference(n);
+                size_t best = 0;
+                for (size_t r = 0; r < n; ++r) {
+                    reference[r] = decoded[r][dim];
+                    for (size_t i = 0; i < dim; ++i) {
+                        reference[r] += dest[i] * decoded[r][i];
+                    }
+                    NS_TEST_ASSERT_MSG_EQ_TOL(kernel.q(hd, rows[r], dim), reference[r], 1e-5,
+                                              name + " Q");
+                    if (reference[r] > reference[best]) {
+                        best = r;
+                    }
+                }
+                double bestQ = 0.0;
+                size_t chosen = kernel.argmax(hd, rows.data(), n, dim, &bestQ);
+                NS_TEST_ASSERT_MSG_EQ(chosen < n, true, name + " argmax in range");
+                // Rounding may reorder a near tie, but never past it
+                NS_TEST_EXPECT_MSG_EQ_TOL(reference[chosen], reference[best], 1e-5, name + " argmax");
+                NS_TEST_EXPECT_MSG_EQ_TOL(bestQ, reference[chosen], 1e-5, name + " argmax Q");
+            }
+        }
+    }
+};
+
+class GsqrHalfTestCase : public TestCase
+{
+public:
+    GsqrHalfTestCase() : TestCase("FLOAT16 rows round to the nearest half") {}
+
+private:
+    void DoRun() override
+    {
+        // Subnormal halves are multiples of 2^-24, ties to even
+        const double unit = std::ldexp(1.0, -24);
+        const double values[] = {std::ldexp(1.0, -15), 3e-5, unit, 0.75 * unit, 0.5 * unit,
+                                 1.5 * unit, 2.5 * unit, 1023.5 * unit, -7e-6,
+                                 1.0, -0.1, 65504.0, 6.1e-5};
+        const double expected[] = {std::ldexp(1.0, -15), 503 * unit, unit, unit, 0.0,
+                                   2 * unit, 2 * unit, 1024 * unit, -117 * unit,
+                                   1.0, -0.0999755859375, 65504.0, 1023 * unit};
+        const size_t dim = 8;
+        const size_t n = sizeof(values) / sizeof(values[0]);
+        const gsqr::QKernel& kernel = gsqr::GetQKernel(gsqr::Precision::FLOAT16, dim);
+        std::vector<uint8_t> row(gsqr::MakeRowFormat(gsqr::Precision::FLOAT16, dim).stride);
+        for (size_t v = 0; v < n; ++v) {
+            double in[dim + 1] = {values[v]};
+            double out[dim + 1];
+            kernel.encode(in, row.data(), dim);
+            kernel.decode(row.data(), out, dim);
+            NS_TEST_EXPECT_MSG_EQ(out[0], expected[v], "half of " + std::to_string(values[v]));
+        }
+    }
+};
+
+class GsqrEmbeddingFileTestCase : public TestCase
+{
+public:
+    GsqrEmbeddingFileTestCase() : TestCase("Embedding table CSV and binary round trip") {}
+
+private:
+    void DoRun() override
+    {
+        const uint32_t dim = 6;
+        Ptr<GsqrEmbedding> table = CreateObject<GsqrEmbedding>();
+        table->SetAttribute("Dimension", UintegerValue(dim));
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<double> value(-2.0, 2.0);
+        std::vector<std::vector<double>> rows;
+        for (uint32_t node = 0; node < 20; ++node) {
+            std::vector<double> row(dim + 1);
+            for (double& x : row) {
+                x = value(rng);
+            }
+            table->WriteRow(node * 3, row.data());
+            rows.push_back(row);
+        }
+
+        std::string csv = CreateTempDirFilename("gsqr-table.csv");
+        std::string bin = CreateTempDirFilename("gsqr-table.bin");
+        NS_TEST_ASSERT_MSG_EQ(table->SaveToCSV(csv), true, "CSV written");
+        NS_TEST_ASSERT_MSG_EQ(table->SaveToBinary(bin), true, "binary written");
+        for (const std::string& file : {csv, bin}) {
+            Ptr<GsqrEmbedding> loaded = CreateObject<GsqrEmbedding>();
+            NS_TEST_ASSERT_MSG_EQ(loaded->LoadFromFile(file), true, file + " loaded");
+            NS_TEST_ASSERT_MSG_EQ(loaded->GetEmbeddingDimension(), dim, file + " dimension");
+            // The CSV holds six significant digits
+            double tolerance = file == csv ? 1e-5 : 1e-12;
+            std::vector<double> out(dim + 1);
+            for (uint32_t node = 0; node < 20; ++node) {
+                NS_TEST_ASSERT_MSG_EQ(loaded->ReadRow(node * 3, out.data()), true, file + " row");
+                for (uint32_t i = 0; i <= dim; ++i) {
+                    NS_TEST_EXPECT_MSG_EQ_TOL(out[i], rows[node][i], tolerance, file + " value");
+                }
+            }
+            NS_TEST_EXPECT_MSG_EQ(loaded->HasRow(1), false, file + " holds no other rows");
+        }
+        std::remove(csv.c_str());
+        std::remove(bin.c_str());
+    }
+};
+
+class GsqrCorruptEmbeddingFileTestCase : public TestCase
+{
+public:
+    GsqrCorruptEmbeddingFileTestCase() : TestCase("Binary embedding files with bad tables or offsets are refused") {}
+
+private:
+    void DoRun() override
+    {
+        Ptr<GsqrEmbedding> table = CreateObject<GsqrEmbedding>();
+        table->SetAttribute("Dimension", UintegerValue(4));
+        std::vector<double> row(5, 0.5);
+        for (uint32_t node = 0; node < 8; node += 2) {
+            table->WriteRow(node, row.data());
+        }
+        std::string bin = CreateTempDirFilename("gsqr-corrupt.bin");
+        NS_TEST_ASSERT_MSG_EQ(table->SaveToBinary(bin), true, "binary written");
+        std::ifstream in(bin, std::ios::binary);
+        std::string image((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        in.close();
+        NS_TEST_ASSERT_MSG_EQ(Load(bin, image), true, "intact file loaded");
+
+        // Node 1 has no row: its index entry is 0xffffffff
+        uint64_t indexOffset;
+        std::memcpy(&indexOffset, &image[32], sizeof(indexOffset));
+        std::string stray = image;
+        uint32_t slot = 0;
+        std::memcpy(&stray[indexOffset + 4], &slot, sizeof(slot));
+        NS_TEST_EXPECT_MSG_EQ(Load(bin, stray), false, "index entry aliasing another node's slot");
+        slot = 1000;
+        std::memcpy(&stray[indexOffset + 4], &slot, sizeof(slot));
+        NS_TEST_EXPECT_MSG_EQ(Load(bin, stray), false, "index entry past the rows");
+
+        // Offsets near 2^64 wrap around when the table size is added
+        for (size_t field : {32, 40, 48}) {
+            std::string wrapped = image;
+            uint64_t offset = UINT64_MAX - 63;
+            std::memcpy(&wrapped[field], &offset, sizeof(offset));
+            NS_TEST_EXPECT_MSG_EQ(Load(bin, wrapped), false, "offset at byte " << field);
+        }
+        std::remove(bin.c_str());
+    }
+
+    bool Load(const std::string& filename, const std::string& image)
+    {
+        std::ofstream(filename, std::ios::binary) << image;
+        return CreateObject<GsqrEmbedding>()->LoadFromBinary(filename);
+    }
+};
+
+class GsqrEmbeddingBudgetTestCase : public TestCase
+{
+public:
+    GsqrEmbeddingBudgetTestCase() : TestCase("Rows beyond the MemoryBudget evict cold ones and fall back to the base") {}
+
+private:
+    void DoRun() override
+    {
+        Ptr<GsqrEmbedding> base = CreateObject<GsqrEmbedding>();
+        base->SetAttribute("Dimension", UintegerValue(16));
+        std::vector<double> row(17);
+        for (uint32_t node = 0; node < 200; ++node) {
+            for (size_t i = 0; i < row.size(); ++i) {
+                row[i] = 0.001 * node + i;
+            }
+            base->WriteRow(node, row.data());
+        }
+
+        for (const char* policy : {"lru", "lfu"}) {
+            Ptr<GsqrEmbedding> table = CreateObject<GsqrEmbedding>();
+            table->SetAttribute("MemoryBudget", UintegerValue(4096));
+            table->SetAttribute("EvictionPolicy", StringValue(policy));
+            table->SetBase(base);
+            const size_t maxRows = table->GetMaxRows();
+            NS_TEST_ASSERT_MSG_EQ((maxRows > 4 && maxRows < 190), true, policy << ": budget holds a few rows");
+
+            // Four hot rows learned on all along, every other row once
+            for (uint32_t node = 10; node < 200; ++node) {
+                table->ApplyTd(node, 5, 0.01);
+                for (uint32_t hot = 0; hot < 4; ++hot) {
+                    table->ApplyTd(hot, 5, 0.01);
+                }
+            }
+            NS_TEST_EXPECT_MSG_EQ(table->GetNumLocalRows(), maxRows, policy << ": table is full");
+            NS_TEST_EXPECT_MSG_EQ(table->GetNumEvictions(), 194 - maxRows, policy << ": one eviction per row over");
+            NS_TEST_EXPECT_MSG_EQ(table->GetNumNodes(), 200u, policy << ": evicted nodes stay known");
+            for (uint32_t hot = 0; hot < 4; ++hot) {
+                NS_TEST_EXPECT_MSG_EQ(table->HasLocalRow(hot), true, policy << ": hot row " << hot << " kept");
+            }
+            std::vector<double> local(17);
+            std::vector<double> pretrained(17);
+            for (uint32_t node = 10; node < 200; ++node) {
+                if (!table->HasLocalRow(node)) {
+                    table->ReadRow(node, local.data());
+                    base->ReadRow(node, pretrained.data());
+                    NS_TEST_EXPECT_MSG_EQ((local == pretrained), true, policy << ": row " << node << " reads the base");
+                }
+            }
+        }
+    }
+};
+
+class GsqrNextHopCacheTestCase : public TestCase
+{
+public:
+    GsqrNextHopCacheTestCase() : TestCase("Memoized next hops follow TD steps and neighbor changes") {}
+
+private:
+    // Every destination's next hop has the best Q among the neighbors
+    void CheckChoices(Ptr<GsqrRouting> routing, const std::vector<uint32_t>& neighbors,
+                      const std::string& when)
+    {
+        for (uint32_t dest = 1; dest <= 20; ++dest) {
+            double best = routing->ComputeQValue(dest, neighbors[0]);
+            for (uint32_t n : neighbors) {
+                best = std::max(best, routing->ComputeQValue(dest, n));
+            }
+            uint32_t hop = routing->SelectNextHop(dest, 0);
+            NS_TEST_EXPECT_MSG_EQ(std::count(neighbors.begin(), neighbors.end(), hop), 1,
+                                  when + ": next hop is a neighbor");
+            NS_TEST_EXPECT_MSG_EQ_TOL(routing->ComputeQValue(dest, hop), best, 1e-12,
+                                      when + ": next hop of " + std::to_string(dest));
+        }
+    }
+
+    void DoRun() override
+    {
+        Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+        routing->Initialize(0);
+        Ptr<GsqrEmbedding> store = routing->GetEmbeddingStore();
+        const size_t dim = store->GetEmbeddingDimension();
+        std::mt19937 rng(11);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        for (uint32_t node = 0; node <= 20; ++node) {
+            std::vector<double> row(dim + 1);
+            for (double& x : row) {
+                x = value(rng);
+            }
+            store->WriteRow(node, row.data());
+        }
+
+        std::vector<uint32_t> neighbors = {1, 2, 3, 4, 5, 6};
+        routing->UpdateNeighborList(0, neighbors);
+        CheckChoices(routing, neighbors, "initial");
+
+        // A TD step rescores only the destinations routed through its
+        // neighbor, beside the Q it corrects
+        uint64_t routedVia = 0;
+        for (uint32_t d = 1; d <= 20; ++d) {
+            routedVia += routing->SelectNextHop(d, 0) == neighbors[0];
+        }
+        uint64_t evaluations = routing->GetNumQEvaluations();
+        routing->ReceiveAck(neighbors[0], 20, 0.0, 0.5, 0.0, 0.0);
+        NS_TEST_EXPECT_MSG_EQ((routing->GetNumQEvaluations() - evaluations <= 1 + routedVia), true,
+                              "Q evaluations of one TD step");
+        CheckChoices(routing, neighbors, "after one ACK");
+
+        // TD steps on one neighbor's row, some towards a neighbor itself
+        std::uniform_int_distribution<uint32_t> neighbor(0, neighbors.size() - 1);
+        std::uniform_int_distribution<uint32_t> dest(1, 20);
+        for (uint32_t i = 0; i < 200; ++i) {
+            routing->ReceiveAck(neighbors[neighbor(rng)], dest(rng), 0.0, value(rng) + 1.0, 0.0, value(rng));
+            CheckChoices(routing, neighbors, "after ACK " + std::to_string(i));
+        }
+
+        // The neighbor most destinations route through leaves, others arrive
+        std::vector<uint32_t> chosen;
+        for (uint32_t d = 1; d <= 20; ++d) {
+            chosen.push_back(routing->SelectNextHop(d, 0));
+        }
+        uint32_t busiest = neighbors[0];
+        for (uint32_t n : neighbors) {
+            if (std::count(chosen.begin(), chosen.end(), n)
+                > std::count(chosen.begin(), chosen.end(), busiest)) {
+                busiest = n;
+            }
+        }
+        neighbors.erase(std::find(neighbors.begin(), neighbors.end(), busiest));
+        routing->UpdateNeighborList(0, neighbors);
+        CheckChoices(routing, neighbors, "after a departure");
+        neighbors.push_back(busiest);
+        neighbors.push_back(7);
+        neighbors.push_back(8);
+        routing->UpdateNeighborList(0, neighbors);
+        CheckChoices(routing, neighbors, "after arrivals");
+    }
+};
+
+class GsqrEvictionMemoTestCase : public TestCase
+{
+public:
+    GsqrEvictionMemoTestCase() : TestCase("Evicting a row refreshes only the memoized next hops that read it") {}
+
+private:
+    void CheckChoices(Ptr<GsqrRouting> routing, const std::vector<uint32_t>& neighbors,
+                      const std::string& when)
+    {
+        for (uint32_t dest = 10; dest < 40; ++dest) {
+            double best = routing->ComputeQValue(dest, neighbors[0]);
+            for (uint32_t n : neighbors) {
+                best = std::max(best, routing->ComputeQValue(dest, n));
+            }
+            uint32_t hop = routing->SelectNextHop(dest, 0);
+            NS_TEST_EXPECT_MSG_EQ_TOL(routing->ComputeQValue(dest, hop), best, 1e-12,
+                                      when << ": next hop of " << dest);
+        }
+    }
+
+    void DoRun() override
+    {
+        Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+        routing->Initialize(0);
+        Ptr<GsqrEmbedding> store = routing->GetEmbeddingStore();
+        const size_t dim = store->GetEmbeddingDimension();
+        Ptr<GsqrEmbedding> base = CreateObject<GsqrEmbedding>();
+        base->SetAttribute("Dimension", UintegerValue(dim));
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        std::vector<double> row(dim + 1);
+        auto randomize = [&]() {
+            for (double& x : row) {
+                x = value(rng);
+            }
+        };
+        for (uint32_t node = 0; node < 40; ++node) {
+            randomize();
+            base->WriteRow(node, row.data());
+        }
+        store->SetBase(base);
+        store->SetAttribute("MemoryBudget", UintegerValue(20 * store->GetRowBytes()));
+        const size_t maxRows = store->GetMaxRows();
+
+        // Learned neighbor rows that differ from the base, then unrelated
+        // rows up to the budget
+        std::vector<uint32_t> neighbors = {1, 2, 3, 4, 5, 6};
+        routing->UpdateNeighborList(0, neighbors);
+        for (uint32_t n : neighbors) {
+            randomize();
+            store->WriteRow(n, row.data());
+        }
+        uint32_t unrelated = 100;
+        while (store->GetNumLocalRows() < maxRows) {
+            store->WriteRow(unrelated++, row.data());
+        }
+        CheckChoices(routing, neighbors, "full table");
+
+        // The unrelated rows are the coldest: evicting them leaves every memo
+        uint64_t misses = routing->GetNextHopCacheMisses();
+        for (int i = 0; i < 5; ++i) {
+            store->WriteRow(unrelated++, row.data());
+        }
+        NS_TEST_ASSERT_MSG_EQ(store->GetNumEvictions(), 5u, "unrelated rows evicted");
+        CheckChoices(routing, neighbors, "after evicting unrelated rows");
+        NS_TEST_EXPECT_MSG_EQ(routing->GetNextHopCacheMisses(), misses, "memos kept");
+
+        // Evicted neighbor rows fall back to the base; reads would keep them
+        for (size_t i = 0; i < maxRows; ++i) {
+            store->WriteRow(unrelated++, row.data());
+        }
+        NS_TEST_EXPECT_MSG_EQ(store->HasLocalRow(neighbors[0]), false, "neighbor rows evicted");
+        CheckChoices(routing, neighbors, "after evicting the neighbor rows");
+
+        // More evictions at once than the store logs
+        for (uint32_t n : neighbors) {
+            routing->ReceiveAck(n, 10 + n, 0.0, value(rng) + 1.0, 0.0, value(rng));
+        }
+        NS_TEST_EXPECT_MSG_EQ(store->HasLocalRow(neighbors[0]), true, "neighbor rows relearned");
+        CheckChoices(routing, neighbors, "relearned");
+        for (uint32_t i = 0; i < 2 * GsqrEmbedding::EVICTION_LOG; ++i) {
+            store->WriteRow(unrelated++, row.data());
+        }
+        CheckChoices(routing, neighbors, "after a burst of evictions");
+    }
+};
+
+class GsqrTopKCacheTestCase : public TestCase
+{
+public:
+    GsqrTopKCacheTestCase() : TestCase("Multipath hops stay among the k best as TD steps and neighbors change") {}
+
+private:
+    // Each new flow to every destination goes to one of the k best by Q
+    void CheckHops(Ptr<GsqrRouting> routing, const std::vector<uint32_t>& neighbors, const std::string& when)
+    {
+        for (uint32_t dest = 10; dest <= 20; ++dest) {
+            std::vector<double> q;
+            for (uint32_t n : neighbors) {
+                q.push_back(routing->ComputeQValue(dest, n));
+            }
+            std::sort(q.rbegin(), q.rend());
+            const double kth = q[std::min<size_t>(routing->GetMultipathK(), q.size()) - 1];
+            for (uint32_t draw = 0; draw < 5; ++draw) {
+                uint32_t hop = routing->SelectMultipathHop(dest, m_nextFlow++);
+                NS_TEST_EXPECT_MSG_EQ(std::count(neighbors.begin(), neighbors.end(), hop), 1,
+                                      when << ": hop to " << dest << " is a neighbor");
+                NS_TEST_EXPECT_MSG_EQ((routing->ComputeQValue(dest, hop) >= kth - 1e-12), true,
+                                      when << ": hop to " << dest << " is among the k best");
+            }
+        }
+    }
+
+    void DoRun() override
+    {
+        Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+        routing->SetAttribute("MultipathK", UintegerValue(3));
+        routing->SetAttribute("MultipathTemperature", DoubleValue(1.0));
+        routing->Initialize(0);
+        routing->AssignStreams(1);
+        Ptr<GsqrEmbedding> store = routing->GetEmbeddingStore();
+        const size_t dim = store->GetEmbeddingDimension();
+        std::mt19937 rng(23);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        for (uint32_t node = 0; node <= 20; ++node) {
+            std::vector<double> row(dim + 1);
+            for (double& x : row) {
+                x = value(rng);
+            }
+            store->WriteRow(node, row.data());
+        }
+        std::vector<uint32_t> neighbors = {1, 2, 3, 4, 5, 6};
+        routing->UpdateNeighborList(0, neighbors);
+        CheckHops(routing, neighbors, "initial");
+
+        // A flow keeps its hop while nothing changes
+        uint32_t pinned = routing->SelectMultipathHop(15, 0);
+        for (uint32_t i = 0; i < 10; ++i) {
+            NS_TEST_EXPECT_MSG_EQ(routing->SelectMultipathHop(15, 0), pinned, "pinned flow");
+        }
+
+        std::uniform_int_distribution<uint32_t> neighbor(0, neighbors.size() - 1);
+        std::uniform_int_distribution<uint32_t> dest(10, 20);
+        for (uint32_t i = 0; i < 100; ++i) {
+            routing->ReceiveAck(neighbors[neighbor(rng)], dest(rng), 0.0, value(rng) + 1.0, 0.0, value(rng));
+            CheckHops(routing, neighbors, "after ACK " + std::to_string(i));
+        }
+
+        // The pinned flow's hop leaves, then two neighbors arrive
+        pinned = routing->SelectMultipathHop(15, 0);
+        routing->RemoveNeighbor(0, pinned);
+        neighbors.erase(std::find(neighbors.begin(), neighbors.end(), pinned));
+        NS_TEST_EXPECT_MSG_EQ((routing->SelectMultipathHop(15, 0) != pinned), true, "flow leaves a departed hop");
+        CheckHops(routing, neighbors, "after removal");
+        for (uint32_t n : {7u, 8u}) {
+            routing->AddNeighbor(0, n);
+            neighbors.push_back(n);
+            CheckHops(routing, neighbors, "after adding " + std::to_string(n));
+        }
+    }
+
+    uint32_t m_nextFlow {1};
+};
+
+class GsqrConvergenceTestCase : public TestCase
+{
+public:
+    GsqrConvergenceTestCase() : TestCase("Convergence is declared after StableWindows quiet windows, and withdrawn") {}
+
+private:
+    void DoRun() override
+    {
+        Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+        routing->SetAttribute("ConvergenceWindow", DoubleValue(1.0));
+        routing->SetAttribute("ConvergenceThreshold", DoubleValue(0.01));
+        routing->SetAttribute("StableWindows", UintegerValue(3));
+        routing->Initialize(0);
+        Ptr<GsqrEmbedding> store = routing->GetEmbeddingStore();
+        const size_t dim = store->GetEmbeddingDimension();
+        std::mt19937 rng(3);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        for (uint32_t node = 0; node <= 7; ++node) {
+            std::vector<double> row(dim + 1);
+            for (double& x : row) {
+                x = value(rng);
+            }
+            store->WriteRow(node, row.data());
+        }
+        routing->UpdateNeighborList(0, {1, 2, 3});
+
+        // Idle windows before any traffic do not count
+        Simulator::Schedule(Seconds(3.5), &GsqrConvergenceTestCase::Check, this, routing, false);
+        // Learning: TD errors far above the threshold
+        Simulator::Schedule(Seconds(4.5), &GsqrConvergenceTestCase::Learn, this, routing, 0.5);
+        Simulator::Schedule(Seconds(5.5), &GsqrConvergenceTestCase::Check, this, routing, false);
+        // Then only memoized choices, in three windows from 5 s
+        for (double at = 5.25; at < 9.5; at += 0.25) {
+            Simulator::Schedule(Seconds(at), &GsqrConvergenceTestCase::Route, this, routing);
+        }
+        Simulator::Schedule(Seconds(7.5), &GsqrConvergenceTestCase::Check, this, routing, false);
+        Simulator::Schedule(Seconds(8.5), &GsqrConvergenceTestCase::Check, this, routing, true);
+        // Delays jump and the learned values are off again
+        Simulator::Schedule(Seconds(9.6), &GsqrConvergenceTestCase::Learn, this, routing, 5.0);
+        Simulator::Schedule(Seconds(10.5), &GsqrConvergenceTestCase::Check, this, routing, false);
+        Simulator::Stop(Seconds(11));
+        Simulator::Run();
+        Simulator::Destroy();
+    }
+
+    void Learn(Ptr<GsqrRouting> routing, double delay)
+    {
+        for (uint32_t i = 0; i < 20; ++i) {
+            routing->SelectNextHop(7, 0);
+            routing->ReceiveAck(1 + i % 3, 7, 0.0, delay, 0.0, 0.0);
+        }
+    }
+
+    void Route(Ptr<GsqrRouting> routing)
+    {
+        routing->SelectNextHop(7, 0);
+    }
+
+    void Check(Ptr<GsqrRouting> routing, bool converged)
+    {
+        NS_TEST_EXPECT_MSG_EQ(routing->IsConverged(), converged,
+                              "converged at " << Simulator::Now().GetSeconds() << " s");
+        if (converged) {
+            NS_TEST_EXPECT_MSG_EQ_TOL(routing->GetConvergenceTime(), 5.0, 1e-9, "start of the stable run");
+        }
+    }
+};
+
+class GsqrBatchedTdTestCase : public TestCase
+{
+public:
+    GsqrBatchedTdTestCase() : TestCase("Batched TD steps sum per pair and land on the UpdateInterval tick") {}
+
+private:
+    void DoRun() override
+    {
+        Ptr<GsqrRouting> routing = CreateObject<GsqrRouting>();
+        routing->SetAttribute("BatchUpdates", BooleanValue(true));
+        routing->SetAttribute("UpdateInterval", DoubleValue(1.0));
+        routing->SetAttribute("LearningRate", DoubleValue(0.1));
+        routing->SetAttribute("DiscountFactor", DoubleValue(0.9));
+        routing->SetAttribute("EnergyWeight", DoubleValue(0.01));
+        routing->Initialize(0);
+        Ptr<GsqrEmbedding> store = routing->GetEmbeddingStore();
+        const size_t dim = store->GetEmbeddingDimension();
+        // The same rows in a store the steps are applied to by hand
+        Ptr<GsqrEmbedding> expected = CreateObject<GsqrEmbedding>();
+        std::mt19937 rng(5);
+        std::uniform_real_distribution<double> value(-1.0, 1.0);
+        for (uint32_t node = 0; node <= 20; ++node) {
+            std::vector<double> row(dim + 1);
+            for (double& x : row) {
+                x = value(rng);
+            }
+            store->WriteRow(node, row.data());
+            expected->WriteRow(node, row.data());
+        }
+        std::vector<uint32_t> neighbors = {1, 2, 3, 4};
+        routing->UpdateNeighborList(0, neighbors);
+
+        // Destinations are not neighbors, so h_d holds still while steps apply
+        std::map<std::pair<uint32_t, uint32_t>, double> steps;
+        std::uniform_int_distribution<uint32_t> neighbor(0, neighbors.size() - 1);
+        std::uniform_int_distribution<uint32_t> dest(10, 13);
+        for (uint32_t i = 0; i < 100; ++i) {
+            uint32_t n = neighbors[neighbor(rng)];
+            uint32_t d = dest(rng);
+            double delay = value(rng) + 1.0;
+            double energy = value(rng) + 1.0;
+            double qNextMax = value(rng);
+            double target = -delay - 0.01 * energy + 0.9 * qNextMax;
+            steps[{n, d}] += 0.1 * (target - routing->ComputeQValue(d, n));
+            routing->ReceiveAck(n, d, 0.0, delay, energy, qNextMax);
+        }
+        NS_TEST_ASSERT_MSG_EQ(routing->GetNumPendingUpdates(), steps.size(), "one pending step per pair");
+        for (uint32_t n : neighbors) {
+            NS_TEST_EXPECT_MSG_EQ((store->GetEmbedding(n) == expected->GetEmbedding(n)), true,
+                                  "row " << n << " untouched before the tick");
+        }
+
+        for (const auto& step : steps) {
+            expected->ApplyTd(step.first.first, step.first.second, step.second);
+        }
+        Simulator::Stop(Seconds(1.5));
+        Simulator::Run();
+        NS_TEST_EXPECT_MSG_EQ(routing->GetNumPendingUpdates(), 0u, "tick drains the buffer");
+        for (uint32_t n : neighbors) {
+            std::vector<double> row = store->GetEmbedding(n);
+            std::vector<double> want = expected->GetEmbedding(n);
+            for (size_t k = 0; k < row.size(); ++k) {
+                NS_TEST_EXPECT_MSG_EQ_TOL(row[k], want[k], 1e-12, "row " << n << " element " << k);
+            }
+        }
+        // The memo follows the rows the tick moved
+        for (uint32_t d = 10; d <= 13; ++d) {
+            double best = routing->ComputeQValue(d, neighbors[0]);
+            for (uint32_t n : neighbors) {
+                best = std::max(best, routing->ComputeQValue(d, n));
+            }
+            NS_TEST_EXPECT_MSG_EQ_TOL(routing->ComputeQValue(d, routing->SelectNextHop(d, 0)), best, 1e-12,
+                                      "next hop of " << d);
+        }
+        Simulator::Destroy();
+    }
+};
+
+class GsqrSageTestCase : public TestCase
+{
+public:
+    GsqrSageTestCase() : TestCase("GraphSAGE forward pass against reference values, and its incremental updates") {}
+
+private:
+    // Three features, two hidden and two output units; every value is dyadic
+    // so the reference outputs below are exact
+    std::string WriteWeights()
+    {
+        const uint32_t header[4] = {1, 3, 2, 2};
+        const float weights[] = {
+            1, 0.5, 0,                    // scaler mean
+            0.5, 1, 2,                    // scaler scale
+            1, -1, 0.5, 0.5, 0.25, -1,    // W1l
+            0.25, -0.5,                   // b1
+            -0.5, 1, 0, 1, 0, 0.5,        // W1r
+            1, 0.5, -1, 0.25,             // W2l
+            0.5, 0,                       // b2
+            0.25, -0.5, 1, 1,             // W2r
+        };
+        std::string filename = CreateTempDirFilename("gsqr-sage-test.bin");
+        std::ofstream file(filename, std::ios::binary);
+        file.write("GSQRSAGE", 8);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(weights), sizeof(weights));
+        return filename;
+    }
+
+    // A path 1 - 0 - 2 - 3
+    void Feed(Ptr<GsqrSage> sage, const std::vector<std::vector<double>>& features)
+    {
+        const std::vector<std::vector<uint32_t>> neighbors = {{1, 2}, {0}, {0, 3}, {2}};
+        for (uint32_t v = 0; v < features.size(); ++v) {
+            sage->SetFeatures(v, features[v]);
+            sage->SetNeighbors(v, neighbors[v]);
+        }
+    }
+
+    void DoRun() override
+    {
+        std::string filename = WriteWeights();
+        Ptr<GsqrSage> sage = CreateObject<GsqrSage>();
+        NS_TEST_ASSERT_MSG_EQ(sage->LoadWeights(filename), true, "weights load");
+        NS_TEST_EXPECT_MSG_EQ(sage->GetInputDimension(), 3u, "input dimension");
+        NS_TEST_ASSERT_MSG_EQ(sage->GetOutputDimension(), 2u, "output dimension");
+
+        std::vector<std::vector<double>> features = {{1.5, 0.5, 1}, {1, 1, 0}, {2, 0, -2}, {0.5, 1.5, 4}};
+        Feed(sage, features);
+        std::vector<uint32_t> changed;
+        NS_TEST_ASSERT_MSG_EQ(sage->Update(changed), 4u, "first pass computes every node");
+        // Node 2's hidden units and one of node 1's are cut by the ReLU
+        const double reference[4][2] = {{0.75, 1.25}, {2.375, 1.9375}, {3.40625, -1.734375}, {0.75, 5.125}};
+        for (uint32_t v = 0; v < 4; ++v) {
+            double out[2];
+            NS_TEST_ASSERT_MSG_EQ(sage->GetEmbedding(v, out), true, "embedding of " << v);
+            NS_TEST_EXPECT_MSG_EQ_TOL(out[0], reference[v][0], 1e-12, "h_" << v << "[0]");
+            NS_TEST_EXPECT_MSG_EQ_TOL(out[1], reference[v][1], 1e-12, "h_" << v << "[1]");
+        }
+
+        uint64_t evaluations = sage->GetNumEvaluations();
+        changed.clear();
+        NS_TEST_EXPECT_MSG_EQ(sage->Update(changed), 0u, "nothing changed");
+        NS_TEST_EXPECT_MSG_EQ(sage->GetNumEvaluations(), evaluations, "nothing recomputed");
+
+        // Node 3 reaches node 0 in two hops but node 1 only in three
+        features[3] = {2, 0.25, -1};
+        sage->SetFeatures(3, features[3]);
+        changed.clear();
+        sage->Update(changed);
+        NS_TEST_EXPECT_MSG_EQ(std::count(changed.begin(), changed.end(), 1u), 0, "node 1 is out of reach");
+        // First layer of 3 and 2, second layer of 3, 2 and 0
+        NS_TEST_EXPECT_MSG_EQ(sage->GetNumEvaluations() - evaluations, 5u, "only the affected layers run");
+        Ptr<GsqrSage> full = CreateObject<GsqrSage>();
+        full->LoadWeights(filename);
+        Feed(full, features);
+        full->Update(changed);
+        for (uint32_t v = 0; v < 4; ++v) {
+            double incremental[2];
+            double recomputed[2];
+            sage->GetEmbedding(v, incremental);
+            full->GetEmbedding(v, recomputed);
+            NS_TEST_EXPECT_MSG_EQ_TOL(incremental[0], recomputed[0], 1e-12, "incremental h_" << v << "[0]");
+            NS_TEST_EXPECT_MSG_EQ_TOL(incremental[1], recomputed[1], 1e-12, "incremental h_" << v << "[1]");
+        }
+        std::remove(filename.c_str());
+    }
+};
+
+class GsqrNeighborExpiryTestCase : public TestCase
+{
+public:
+    GsqrNeighborExpiryTestCase() : TestCase("Neighbors expire NeighborHoldHellos intervals after going silent") {}
+
+private:
+    void DoRun() override
+    {
+        NodeContainer nodes;
+        nodes.Create(2);
+        SimpleNetDeviceHelper simple;
+        NetDeviceContainer devices = simple.Install(nodes);
+        GsqrHelper gsqr;
+        gsqr.SetHelloInterval(Seconds(1));
+        InternetStackHelper internet;
+        internet.SetRoutingHelper(gsqr);
+        internet.Install(nodes);
+        Ipv4AddressHelper address;
+        address.SetBase("10.1.1.0", "255.255.255.0");
+        address.Assign(devices);
+
+        Simulator::Schedule(Seconds(5), &GsqrNeighborExpiryTestCase::CheckNeighbors, this, nodes, 1);
+        Simulator::Schedule(Seconds(5), &GsqrNeighborExpiryTestCase::CutLink, this, devices);
+        // Still inside the hold time of the last Hello heard
+        Simulator::Schedule(Seconds(6.5), &GsqrNeighborExpiryTestCase::CheckNeighbors, this, nodes, 1);
+        Simulator::Schedule(Seconds(10), &GsqrNeighborExpiryTestCase::CheckNeighbors, this, nodes, 0);
+        Simulator::Stop(Seconds(10.5));
+        Simulator::Run();
+        Simulator::Destroy();
+    }
+
+    void CutLink(NetDeviceContainer devices)
+    {
+        Ptr<SimpleNetDevice> a = DynamicCast<SimpleNetDevice>(devices.Get(0));
+        Ptr<SimpleNetDevice> b = DynamicCast<SimpleNetDevice>(devices.Get(1));
+        Ptr<SimpleChannel> channel = DynamicCast<SimpleChannel>(a->GetChannel());
+        channel->BlackList(a, b);
+        channel->BlackList(b, a);
+    }
+
+    void CheckNeighbors(NodeContainer nodes, uint32_t expected)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            Ptr<GsqrRoutingProtocol> protocol = nodes.Get(i)->GetObject<GsqrRoutingProtocol>();
+            NS_TEST_ASSERT_MSG_EQ(protocol->GetRouting()->GetNeighbors(nodes.Get(i)->GetId()).size(), expected,
+                                  "neighbors of node " << i << " at " << Simulator::Now().GetSeconds() << " s");
+        }
+    }
+};
+
+class GsqrAdaptiveHelloTestCase : public TestCase
+{
+public:
+    GsqrAdaptiveHelloTestCase() : TestCase("Adaptive Hello interval backs off while stable and resets on a join") {}
+
+private:
+    void DoRun() override
+    {
+        NodeContainer nodes;
+        nodes.Create(3);
+        SimpleNetDeviceHelper simple;
+        NetDeviceContainer devices = simple.Install(nodes);
+        GsqrHelper gsqr;
+        gsqr.SetAdaptiveHello(Seconds(0.5), Seconds(4));
+        InternetStackHelper internet;
+        internet.SetRoutingHelper(gsqr);
+        internet.Install(nodes);
+        Ipv4AddressHelper address;
+        address.SetBase("10.1.1.0", "255.255.255.0");
+        address.Assign(devices);
+
+        // Node 2 is out of range of the others until 30 s
+        SetLink(devices, false);
+        Simulator::Schedule(Seconds(30), &GsqrAdaptiveHelloTestCase::SetLink, this, devices, true);
+        Simulator::Schedule(Seconds(29.9), &GsqrAdaptiveHelloTestCase::Record, this, nodes);
+        Simulator::Schedule(Seconds(29.9), &GsqrAdaptiveHelloTestCase::CheckInterval, this, nodes,
+                            Seconds(4), true);
+        for (double at = 30; at < 40; at += 0.1) {
+            Simulator::Schedule(Seconds(at), &GsqrAdaptiveHelloTestCase::Sample, this, nodes, Seconds(4));
+        }
+        // Every node hears a new neighbor within one maximum interval of the join
+        Simulator::Schedule(Seconds(40), &GsqrAdaptiveHelloTestCase::CheckReset, this, nodes);
+        Simulator::Schedule(Seconds(60), &GsqrAdaptiveHelloTestCase::CheckInterval, this, nodes,
+                            Seconds(4), true);
+        Simulator::Stop(Seconds(60.5));
+        Simulator::Run();
+        Simulator::Destroy();
+    }
+
+    void SetLink(NetDeviceContainer devices, bool up)
+    {
+        Ptr<SimpleNetDevice> isolated = DynamicCast<SimpleNetDevice>(devices.Get(2));
+        Ptr<SimpleChannel> channel = DynamicCast<SimpleChannel>(isolated->GetChannel());
+        for (uint32_t i = 0; i < 2; ++i) {
+            Ptr<SimpleNetDevice> other = DynamicCast<SimpleNetDevice>(devices.Get(i));
+            if (up) {
+                channel->UnBlackList(isolated, other);
+                channel->UnBlackList(other, isolated);
+            } else {
+                channel->BlackList(isolated, other);
+                channel->BlackList(other, isolated);
+            }
+        }
+    }
+
+    void Record(NodeContainer nodes)
+    {
+        m_resets.clear();
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            m_resets.push_back(nodes.Get(i)->GetObject<GsqrRoutingProtocol>()->GetHelloIntervalResets());
+        }
+        m_backedOff.assign(nodes.GetN(), false);
+    }
+
+    void Sample(NodeContainer nodes, Time maximum)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            if (nodes.Get(i)->GetObject<GsqrRoutingProtocol>()->GetCurrentHelloInterval() < maximum) {
+                m_backedOff[i] = true;
+            }
+        }
+    }
+
+    void CheckReset(NodeContainer nodes)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            Ptr<GsqrRoutingProtocol> protocol = nodes.Get(i)->GetObject<GsqrRoutingProtocol>();
+            NS_TEST_EXPECT_MSG_EQ((protocol->GetHelloIntervalResets() > m_resets[i]), true,
+                                  "node " << i << " reset its interval on the join");
+            NS_TEST_EXPECT_MSG_EQ(m_backedOff[i], true, "node " << i << " sent faster after the join");
+        }
+    }
+
+    // Whether each node's interval is at the given maximum
+    void CheckInterval(NodeContainer nodes, Time maximum, bool atMaximum)
+    {
+        for (uint32_t i = 0; i < nodes.GetN(); ++i) {
+            Ptr<GsqrRoutingProtocol> protocol = nodes.Get(i)->GetObject<GsqrRoutingProtocol>();
+            NS_TEST_EXPECT_MSG_EQ((protocol->GetCurrentHelloInterval() == maximum), atMaximum,
+                                  "interval of node " << i << " at " << Simulator::Now().GetSeconds() << " s");
+        }
+    }
+
+    std::vector<uint32_t> m_resets;
+    std::vector<bool> m_backedOff;
+};
+
+class GsqrMultiHopTestCase : public TestCase
+{
+public:
+    GsqrMultiHopTestCase() : TestCase("Packets cross a line of nodes and every hop learns from the ACKs") {}
+
+private:
+    void DoRun() override
+    {
+        // 0 - 1 - 2 - 3: each node hears only its neighbors in the line
+        NodeContainer nodes;
+        nodes.Create(4);
+        SimpleNetDeviceHelper simple;
+        NetDeviceContainer devices = simple.Install(nodes);
+        Ptr<SimpleChannel> channel = DynamicCast<SimpleChannel>(devices.Get(0)->GetChannel());
+        for (uint32_t i = 0; i < devices.GetN(); ++i) {
+            for (uint32_t j = i + 2; j < devices.GetN(); ++j) {
+                Ptr<SimpleNetDevice> a = DynamicCast<SimpleNetDevice>(devices.Get(i));
+                Ptr<SimpleNetDevice> b = DynamicCast<SimpleNetDevice>(devices.Get(j));
+                channel->BlackList(a, b);
+                channel->BlackList(b, a);
+            }
+        }
+        GsqrHelper gsqr;
+        gsqr.SetHelloInterval(Seconds(1));
+        InternetStackHelper internet;
+        internet.SetRoutingHelper(gsqr);
+        internet.Install(nodes);
+        Ipv4AddressHelper address;
+        address.SetBase("10.1.1.0", "255.255.255.0");
+        Ipv4InterfaceContainer interfaces = address.Assign(devices);
+
+        Ptr<Socket> sink = Socket::CreateSocket(nodes.Get(3), UdpSocketFactory::GetTypeId());
+        sink->Bind(InetSocketAddress(Ipv4Address::GetAny(), 9));
+        sink->SetIpRecvTtl(true);
+        sink->SetRecvCallback(MakeCallback(&GsqrMultiHopTestCase::Receive, this));
+        Ptr<Socket> source = Socket::CreateSocket(nodes.Get(0), UdpSocketFactory::GetTypeId());
+        InetSocketAddress sinkAddress(interfaces.GetAddress(3), 9);
+        m_sent = 0;
+        m_received = 0;
+        m_detours = 0;
+        for (double at = 5; at < 15; at += 0.25) {
+            Simulator::Schedule(Seconds(at), &GsqrMultiHopTestCase::Send, this, source, sinkAddress);
+        }
+        Simulator::Schedule(Seconds(16), &GsqrMultiHopTestCase::Check, this, nodes);
+        Simulator::Stop(Seconds(16.5));
+        Simulator::Run();
+        Simulator::Destroy();
+    }
+
+    void Send(Ptr<Socket> source, InetSocketAddress to)
+    {
+        source->SendTo(Create<Packet>(64), 0, to);
+        m_sent++;
+    }
+
+    void Receive(Ptr<Socket> socket)
+    {
+        Address from;
+        while (Ptr<Packet> packet = socket->RecvFrom(from)) {
+            m_received++;
+            // Sent with the default TTL of 64 and forwarded by nodes 1 and 2
+            SocketIpTtlTag ttl;
+            if (!packet->PeekPacketTag(ttl) || ttl.GetTtl() != 62) {
+                m_detours++;
+            }
+        }
+    }
+
+    void Check(NodeContainer nodes)
+    {
+        NS_TEST_EXPECT_MSG_EQ(m_received, m_sent, "packets delivered over three hops");
+        NS_TEST_EXPECT_MSG_EQ(m_detours, 0, "packets sent back the way they came");
+        for (uint32_t i = 0; i < 3; ++i) {
+            Ptr<GsqrRouting> routing = nodes.Get(i)->GetObject<GsqrRoutingProtocol>()->GetRouting();
+            NS_TEST_EXPECT_MSG_GT(routing->GetNumTdErrors(), 0, "ACKs applied at node " << i);
+            // One next-hop choice per packet, none where node 3 is a neighbor:
+            // the ACK reuses the Q of the choice
+            uint64_t choices = routing->GetNextHopCacheHits() + routing->GetNextHopCacheMisses();
+            NS_TEST_EXPECT_MSG_EQ(choices, (i < 2 ? m_sent : 0), "next hops chosen at node " << i);
+        }
+    }
+
+    uint32_t m_sent;
+    uint32_t m_received;
+    uint32_t m_detours;
+};
+
+class GsqrCheckpointWriterTestCase : public TestCase
+{
+public:
+    GsqrCheckpointWriterTestCase() : TestCase("Checkpoint writer drains its queue") {}
+
+private:
+    void DoRun() override
+    {
+        Ptr<GsqrCheckpointWriter> writer = CreateObject<GsqrCheckpointWriter>();
+        std::vector<std::string> paths;
+        for (uint32_t node = 0; node < 8; ++node) {
+            paths.push_back(CreateTempDirFilename("gsqr-checkpoint-" + std::to_string(node)));
+            for (uint32_t version = 0; version < 3; ++version) {
+                writer->Write(paths.back(), std::to_string(node) + "/" + std::to_string(version));
+            }
+        }
+        writer->Drain();
+        // A path is written at least once, and last with its newest image
+        NS_TEST_EXPECT_MSG_EQ((writer->GetNumWritten() >= 8 && writer->GetNumWritten() <= 24), true,
+                              "writes");
+        for (uint32_t node = 0; node < 8; ++node) {
+            std::ifstream file(paths[node]);
+            std::string image;
+            std::getline(file, image);
+            NS_TEST_EXPECT_MSG_EQ(image, std::to_string(node) + "/2", "newest image");
+            std::remove(paths[node].c_str());
+        }
+        // Writing again after a drain starts the thread again
+        writer->Write(paths[0], "again");
+        writer->Dispose();
+        std::ifstream file(paths[0]);
+        std::string image;
+        std::getline(file, image);
+        NS_TEST_EXPECT_MSG_EQ(image, "again", "written by the second thread");
+        std::remove(paths[0].c_str());
+    }
+};
+
+class GsqrTestSuite : public TestSuite
+{
+public:
+    GsqrTestSuite();
+};
+
+GsqrTestSuite::GsqrTestSuite()
+    : TestSuite("gsqr", Type::UNIT)
+{
+    AddTestCase(new GsqrHelloHeaderTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrAckHeaderTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrDeltaHeaderTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrKernelTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrHalfTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrEmbeddingFileTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrCorruptEmbeddingFileTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrEmbeddingBudgetTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrNextHopCacheTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrEvictionMemoTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrTopKCacheTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrConvergenceTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrBatchedTdTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrSageTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrNeighborExpiryTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrAdaptiveHelloTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrMultiHopTestCase, TestCase::Duration::QUICK);
+    AddTestCase(new GsqrCheckpointWriterTestCase, TestCase::Duration::QUICK);
+}
+
+static GsqrTestSuite g_gsqrTestSuite;